@@ -53,10 +53,76 @@
 static const char *Arf_Hdu_Names[] = {"SPECRESP", NULL};
 static const char *Arf_Hdu_Names_Hook = "_nonstandard_arf_hdu_names";
 
+/* ARF files already in memory, keyed by path, size and modification
+ * time.  Loading the same file again copies the header information
+ * of the first load and shares its grid and effective area arrays
+ * until one of the ARFs using them is modified.
+ */
+typedef struct Arf_Shared_t Arf_Shared_t;
+struct Arf_Shared_t
+{
+   Arf_Shared_t *next;
+   char *key;
+   Isis_Arf_t info;             /* as read; the arrays are shared */
+   unsigned int num_users;
+};
+static Arf_Shared_t *Shared_Arf_List;
+
+static Arf_Shared_t *find_shared_arrays (Isis_Arf_t *a) /*{{{*/
+{
+   Arf_Shared_t *s;
+
+   if (a->arf == NULL)
+     return NULL;
+
+   for (s = Shared_Arf_List; s != NULL; s = s->next)
+     {
+        if (s->info.arf == a->arf)
+          return s;
+     }
+
+   return NULL;
+}
+
+/*}}}*/
+
+static void release_shared_arrays (Arf_Shared_t *s) /*{{{*/
+{
+   Arf_Shared_t *t, *prev = NULL;
+
+   if (--s->num_users > 0)
+     return;
+
+   for (t = Shared_Arf_List; t != NULL; t = t->next)
+     {
+        if (t == s)
+          {
+             if (prev == NULL)
+               Shared_Arf_List = t->next;
+             else prev->next = t->next;
+             break;
+          }
+        prev = t;
+     }
+
+   ISIS_FREE (s->info.bin_lo);
+   ISIS_FREE (s->info.bin_hi);
+   ISIS_FREE (s->info.arf);
+   ISIS_FREE (s->info.arf_err);
+   if (s->info.fracexpo_is_vector)
+     ISIS_FREE (s->info.fracexpo.v);
+   ISIS_FREE (s->key);
+   ISIS_FREE (s);
+}
+
+/*}}}*/
+
 /*{{{ new/free */
 
 void Arf_free_arf (Isis_Arf_t *a) /*{{{*/
 {
+   Arf_Shared_t *s;
+
    if (NULL == a)
      return;
 
@@ -65,10 +131,15 @@ void Arf_free_arf (Isis_Arf_t *a) /*{{{*/
    if (a->ref_count > 0)
      return;
 
-   ISIS_FREE (a->bin_lo);
-   ISIS_FREE (a->bin_hi);
-   ISIS_FREE (a->arf);
-   ISIS_FREE (a->arf_err);
+   if (NULL != (s = find_shared_arrays (a)))
+     release_shared_arrays (s);
+   else
+     {
+        ISIS_FREE (a->bin_lo);
+        ISIS_FREE (a->bin_hi);
+        ISIS_FREE (a->arf);
+        ISIS_FREE (a->arf_err);
+     }
 
    if (a->fracexpo_is_vector)
      ISIS_FREE (a->fracexpo.v);
@@ -388,12 +459,129 @@ static int validate_and_append (Isis_Arf_t *head, Isis_Arf_t *a, int input_units
 
 /*}}}*/
 
+/* key is freed if it can't be kept */
+static void share_arf_arrays (Isis_Arf_t *a, char *key) /*{{{*/
+{
+   Arf_Shared_t *s;
+
+   if ((a->nbins <= 0)
+       || (NULL == (s = (Arf_Shared_t *) ISIS_MALLOC (sizeof(Arf_Shared_t)))))
+     {
+        ISIS_FREE (key);
+        return;
+     }
+
+   /* struct copy */
+   s->info = *a;
+   s->info.next = NULL;
+   s->info.file = NULL;
+
+   if (a->fracexpo_is_vector)
+     {
+        int size = a->nbins * sizeof(double);
+        if (NULL == (s->info.fracexpo.v = (double *) ISIS_MALLOC (size)))
+          {
+             ISIS_FREE (s);
+             ISIS_FREE (key);
+             return;
+          }
+        memcpy ((char *)s->info.fracexpo.v, (char *)a->fracexpo.v, size);
+     }
+
+   s->key = key;
+   s->num_users = 1;
+   s->next = Shared_Arf_List;
+   Shared_Arf_List = s;
+}
+
+/*}}}*/
+
+static Isis_Arf_t *new_arf_from_shared (char *key, char *filename) /*{{{*/
+{
+   Arf_Shared_t *s;
+   Isis_Arf_t *a;
+
+   for (s = Shared_Arf_List; s != NULL; s = s->next)
+     {
+        if (0 == strcmp (s->key, key))
+          break;
+     }
+
+   if (s == NULL)
+     return NULL;
+
+   if (NULL == (a = new_arf (0)))
+     return NULL;
+
+   /* struct copy */
+   *a = s->info;
+   a->file = NULL;
+   a->fracexpo_is_vector = 0;
+
+   if (s->info.fracexpo_is_vector)
+     {
+        int size = a->nbins * sizeof(double);
+        if (NULL == (a->fracexpo.v = (double *) ISIS_MALLOC (size)))
+          {
+             ISIS_FREE (a);
+             return NULL;
+          }
+        memcpy ((char *)a->fracexpo.v, (char *)s->info.fracexpo.v, size);
+        a->fracexpo_is_vector = 1;
+     }
+
+   s->num_users++;
+
+   if (NULL == (a->file = isis_make_string (filename)))
+     {
+        Arf_free_arf (a);
+        return NULL;
+     }
+
+   return a;
+}
+
+/*}}}*/
+
+/* Gives a private copy of shared arrays, which may then be modified */
+static int unshare_arf_arrays (Isis_Arf_t *a) /*{{{*/
+{
+   Arf_Shared_t *s;
+   Isis_Arf_t *u;
+   int size;
+
+   if (NULL == (s = find_shared_arrays (a)))
+     return 0;
+
+   if (NULL == (u = new_arf (a->nbins)))
+     return -1;
+
+   size = a->nbins * sizeof(double);
+   memcpy ((char *)u->bin_lo, (char *)a->bin_lo, size);
+   memcpy ((char *)u->bin_hi, (char *)a->bin_hi, size);
+   memcpy ((char *)u->arf, (char *)a->arf, size);
+   memcpy ((char *)u->arf_err, (char *)a->arf_err, size);
+
+   a->bin_lo = u->bin_lo;
+   a->bin_hi = u->bin_hi;
+   a->arf = u->arf;
+   a->arf_err = u->arf_err;
+   ISIS_FREE (u);
+
+   release_shared_arrays (s);
+
+   return 0;
+}
+
+/*}}}*/
+
 int Arf_read_arf (Isis_Arf_t *head, char *filename) /*{{{*/
 {
    Keyword_t *keytable = Arf_Keyword_Table;
    Isis_Arf_t *a = NULL;
    cfitsfile *fp = NULL;
    char bin_units[ISIS_ARF_VALUE_SIZE];
+   char *key;
    int nbins, input_units;
    int ret = -1;
    int id = -1;
@@ -401,9 +589,17 @@ int Arf_read_arf (Isis_Arf_t *head, char *filename) /*{{{*/
    if (head == NULL || filename == NULL)
      return -1;
 
+   if ((NULL != (key = isis_file_identity (filename)))
+       && (NULL != (a = new_arf_from_shared (key, filename))))
+     {
+        ISIS_FREE (key);
+        return arf_list_append (head, a);
+     }
+
    if (NULL == (fp = cfits_open_file_readonly (filename)))
      {
         isis_vmesg (FAIL, I_READ_OPEN_FAILED, __FILE__, __LINE__, "%s", filename);
+        ISIS_FREE (key);
         return -1;
      }
 
@@ -461,10 +657,14 @@ int Arf_read_arf (Isis_Arf_t *head, char *filename) /*{{{*/
 
    if (ret)
      {
+        ISIS_FREE (key);
         Arf_free_arf (a);
         return ret;
      }
 
+   if (key != NULL)
+     share_arf_arrays (a, key);
+
    return id;
 }
 
@@ -571,6 +771,9 @@ int Arf_put_arf (Isis_Arf_t *a, double *arf, double *arf_err, double *binlo, dou
    if (i != a->nbins)
      isis_vmesg (WARN, I_WARNING, __FILE__, __LINE__, "ARF grid change may cause ARF/RMF mismatch");
 
+   if (-1 == unshare_arf_arrays (a))
+     return -1;
+
    size = a->nbins * sizeof(double);
    memcpy ((char *) a->bin_lo, (char *)binlo, size);
    memcpy ((char *) a->bin_hi, (char *)binhi, size);
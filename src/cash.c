@@ -41,54 +41,20 @@
 #include "isis.h"
 #include "util.h"
 #include "errors.h"
+#include "statsum.h"
 
 /* Cash ML statistic */
 
-#define SIGN(x)  ((x) < 0.0 ? -1 : 1)
-
 static int cash_function (Isis_Fit_Statistic_Type *st, /*{{{*/
                           double *y, double *fx, double *w, unsigned int npts,
                           double *vec, double *stat)
 {
-   double sum, s, *val;
-   unsigned int i;
+   double sum;
 
    (void) w;
    (void) st;
 
-   sum = 0.0;
-
-   if (NULL == (val = (double *) ISIS_MALLOC (npts * sizeof(double))))
-     return -1;
-
-   /* The form of the statistic is modified according to the
-    * suggestion of Castor described in the XSPEC manual.
-    */
-
-   for (i = 0; i < npts; i++)
-     {
-        double fxi = fx[i];
-        double yi = y[i];
-        double log_fxi;
-
-        /* Want sum += (yi - fxi) +  yi * log (fxi/yi);
-         * but must avoid log(0) and f/0
-         */
-
-        if (yi <= 0) yi = 1.e-5;
-        log_fxi = (fxi > 0) ? log(fxi) : (double) DBL_MIN_10_EXP;
-
-        s = (yi - fxi);
-        s += yi * (log_fxi - log (yi));
-        s *= -2;
-
-        /* sum += s; */
-        val[i] = s;
-        vec[i] = isfinite(s) ? (s * SIGN(yi-fxi)) : DBL_MAX;
-     }
-
-   sum = isis_kahan_sum (val, npts);
-   ISIS_FREE(val);
+   sum = isis_cash_sum (y, fx, npts, vec);
 
    if (0 == isfinite (sum))
      sum = DBL_MAX;
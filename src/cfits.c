@@ -653,6 +653,173 @@ int cfits_read_column_floats (cfitsfile *ft, int col, long row, long ofs,
    return 0;
 }
 
+/* Variable-length arrays are stored in the heap, and cfitsio
+ * reads them one row at a time.  For large tables, it is faster
+ * to read the descriptors for a block of rows, fetch the heap
+ * bytes they span in a single read, and convert the values here.
+ */
+int cfits_read_descripts (cfitsfile *ft, int col, long first_row, long num_rows,
+                          long *repeat, long *offset)
+{
+   int status = 0;
+
+   if (ft == NULL)
+     return -1;
+
+   if (num_rows == 0) return 0;
+
+   (void) fits_read_descripts ((fitsfile *)ft, col, first_row, num_rows,
+                               repeat, offset, &status);
+   cfits_report_error (status);
+
+   if (status != 0) return -1;
+   return 0;
+}
+
+static int read_optional_double_keyn (cfitsfile *ft, const char *keyroot, int n,
+                                      double *value, double default_value)
+{
+   char keyname[FLEN_KEYWORD];
+   int status = 0;
+
+   (void) fits_make_keyn (keyroot, n, keyname, &status);
+   (void) fits_read_key ((fitsfile *)ft, TDOUBLE, keyname, value, NULL, &status);
+   if (status == KEY_NO_EXIST)
+     {
+        fits_clear_errmsg ();
+        *value = default_value;
+        return 0;
+     }
+   cfits_report_error (status);
+
+   if (status != 0) return -1;
+   return 0;
+}
+
+/* Returns the size in bytes of the elements of a variable-length
+ * float or double column, or 0 if its values can't be converted
+ * by cfits_decode_floats, e.g. because they're scaled.
+ */
+int cfits_get_vla_float_size (cfitsfile *ft, int col)
+{
+   int typecode, status = 0;
+   long repeat, width;
+   double scale, zero;
+
+   if (ft == NULL)
+     return 0;
+
+   (void) fits_get_coltype ((fitsfile *)ft, col, &typecode, &repeat, &width, &status);
+   cfits_report_error (status);
+   if ((status != 0) || (typecode >= 0))
+     return 0;
+
+   if ((-1 == read_optional_double_keyn (ft, "TSCAL", col, &scale, 1.0))
+       || (-1 == read_optional_double_keyn (ft, "TZERO", col, &zero, 0.0))
+       || (scale != 1.0) || (zero != 0.0))
+     return 0;
+
+   switch (-typecode)
+     {
+      case TFLOAT:
+        return 4;
+      case TDOUBLE:
+        return 8;
+      default:
+        break;
+     }
+
+   return 0;
+}
+
+int cfits_read_heap (cfitsfile *ft, long offset, long nbytes, unsigned char *buf)
+{
+   LONGLONG naxis1, naxis2, theap;
+   int status = 0;
+
+   if (ft == NULL)
+     return -1;
+
+   if (nbytes == 0) return 0;
+
+   (void) fits_read_key ((fitsfile *)ft, TLONGLONG, "NAXIS1", &naxis1, NULL, &status);
+   (void) fits_read_key ((fitsfile *)ft, TLONGLONG, "NAXIS2", &naxis2, NULL, &status);
+   cfits_report_error (status);
+   if (status != 0) return -1;
+
+   /* the heap follows the table unless THEAP says otherwise */
+   (void) fits_read_key ((fitsfile *)ft, TLONGLONG, "THEAP", &theap, NULL, &status);
+   if (status == KEY_NO_EXIST)
+     {
+        fits_clear_errmsg ();
+        status = 0;
+        theap = naxis1 * naxis2;
+     }
+
+   if (status == 0)
+     (void) ffgextn ((fitsfile *)ft, theap + offset, nbytes, buf, &status);
+   cfits_report_error (status);
+
+   if (status != 0) return -1;
+   return 0;
+}
+
+/* Converts num big-endian IEEE floats or doubles (size = 4 or 8)
+ * to float.  As in cfits_read_column_floats, NaNs become FLT_MIN.
+ */
+void cfits_decode_floats (unsigned char *buf, int size, long num, float *data)
+{
+   unsigned int one = 1;
+   int swap = (*(unsigned char *)&one == 1);
+   unsigned char b[8];
+   long i;
+   int k;
+
+   for (i = 0; i < num; i++)
+     {
+        unsigned char *p = buf + i * size;
+        double d;
+        float f;
+
+        if (swap)
+          {
+             for (k = 0; k < size; k++)
+               b[k] = p[size - 1 - k];
+          }
+        else memcpy ((char *)b, (char *)p, size);
+
+        if (size == 4)
+          {
+             memcpy ((char *)&f, (char *)b, sizeof f);
+          }
+        else
+          {
+             memcpy ((char *)&d, (char *)b, sizeof d);
+             f = (float) d;
+          }
+
+        data[i] = isnan (f) ? FLT_MIN : f;
+     }
+}
+
+int cfits_get_column_repeat (cfitsfile *ft, int col, long *repeat, int *is_variable)
+{
+   int typecode, status = 0;
+   long width;
+
+   if (ft == NULL)
+     return -1;
+
+   (void) fits_get_coltype ((fitsfile *)ft, col, &typecode, repeat, &width, &status);
+   cfits_report_error (status);
+
+   if (status != 0) return -1;
+
+   /* variable length arrays have negative type codes */
+   *is_variable = (typecode < 0);
+   return 0;
+}
+
 int cfits_get_column_numbers (cfitsfile *ft, unsigned int num, const char **names, int *cols)
 {
    unsigned int i;
@@ -98,6 +98,12 @@ extern long cfits_optimal_numrows (cfitsfile *fptr);
 extern int cfits_locate_vextension (cfitsfile *ft, int argc, const char **ext_names,
                                     int (*fun) (cfitsfile *));
 extern int cfits_get_column_numbers (cfitsfile *ft, unsigned int num, const char **names, int *cols);
+extern int cfits_get_column_repeat (cfitsfile *ft, int col, long *repeat, int *is_variable);
+extern int cfits_read_descripts (cfitsfile *ft, int col, long first_row, long num_rows,
+                                 long *repeat, long *offset);
+extern int cfits_get_vla_float_size (cfitsfile *ft, int col);
+extern int cfits_read_heap (cfitsfile *ft, long offset, long nbytes, unsigned char *buf);
+extern void cfits_decode_floats (unsigned char *buf, int size, long num, float *data);
 
 extern int cfits_read_column_uints (cfitsfile *ft, int col, int row, long ofs,
                                      unsigned int *data, int nrows);
@@ -42,13 +42,14 @@
 
 #include "isis.h"
 #include "util.h"
+#include "statsum.h"
 
 enum
 {
-     DATA_VARIANCE,
-     GEHRELS_VARIANCE,
-     MODEL_VARIANCE,
-     LEAST_SQUARES
+     DATA_VARIANCE = STATSUM_DATA_VARIANCE,
+     GEHRELS_VARIANCE = STATSUM_GEHRELS_VARIANCE,
+     MODEL_VARIANCE = STATSUM_MODEL_VARIANCE,
+     LEAST_SQUARES = STATSUM_LEAST_SQUARES
 };
 
 typedef struct Chisqr_Type
@@ -73,65 +74,19 @@ static int chisqr_function (Isis_Fit_Statistic_Type *st,  /*{{{*/
                             double *y, double *fx, double *w,
                             unsigned int npts, double *vec, double *stat)
 {
-   double sum, dy, wt;
-   unsigned int i, bad;
+   double sum;
+   unsigned int bad;
 
    bad = 0;
-   sum = 0.0;
 
    *stat = -1.0;
 
    switch (st->sigma)
      {
       case DATA_VARIANCE:
-        for (i = 0; i < npts; i++)
-          {
-             dy = y[i] - fx[i];
-             /* sum += dy*dy * w[i]; */
-             vec[i] = dy * sqrt(w[i]);
-          }
-        break;
-
       case GEHRELS_VARIANCE:
-        for (i = 0; i < npts; i++)
-          {
-             dy = y[i] - fx[i];
-             if (y[i] >= 0.0) dy /= 1.0 + sqrt(y[i] + 0.75);
-             else bad++;
-             /* sum += dy*dy; */
-             vec[i] = dy;
-          }
-        if (bad && (st->message_string == NULL))
-          {
-             st->message_string =
-               "*** Warning: chisqr used sigma=1.0 for some points with negative data values";
-          }
-        break;
-
       case MODEL_VARIANCE:
-        for (i = 0; i < npts; i++)
-          {
-             dy = y[i] - fx[i];
-             wt = 1.0;
-             if (fx[i] != 0.0) wt = 1.0 / fabs(fx[i]);
-             else bad++;
-             /* sum += dy*dy * wt; */
-             vec[i] = dy * sqrt(wt);
-          }
-        if (bad && (st->message_string == NULL))
-          {
-             st->message_string =
-               "*** Warning: chisqr used sigma=1.0 for some points with model=0";
-          }
-        break;
-
       case LEAST_SQUARES:
-        for (i = 0; i < npts; i++)
-          {
-             dy = y[i] - fx[i];
-             /* sum += dy*dy; */
-             vec[i] = dy;
-          }
         break;
 
       default:
@@ -139,7 +94,18 @@ static int chisqr_function (Isis_Fit_Statistic_Type *st,  /*{{{*/
         return -1;
      }
 
-   sum = isis_kahan_sum_squares (vec, npts);
+   /* vec[i] = residual / sigma */
+   sum = isis_chisqr_sum (st->sigma, y, fx, w, npts, vec, &bad);
+
+   if (bad && (st->message_string == NULL))
+     {
+        if (st->sigma == GEHRELS_VARIANCE)
+          st->message_string =
+            "*** Warning: chisqr used sigma=1.0 for some points with negative data values";
+        else if (st->sigma == MODEL_VARIANCE)
+          st->message_string =
+            "*** Warning: chisqr used sigma=1.0 for some points with model=0";
+     }
 
    if (0 == isfinite(sum))
      sum = DBL_MAX;
@@ -84,6 +84,14 @@ static unsigned int EM_Load_Line_Emis;
  *                       (the emissivity database is "disk resident")
  */
 
+unsigned int EM_Line_Cache_Size = EM_LINE_CACHE_SIZE_DEFAULT;
+unsigned int EM_Line_Cache_Hits;
+unsigned int EM_Line_Cache_Misses;
+/* EM_Line_Cache_Size is the memory budget (bytes) for caching
+ * interpolated line spectra, keyed by plasma state.  Zero disables
+ * the cache.
+ */
+
 int EM_Maybe_Missing_Lines = 1;
 /*EM_Maybe_Missing_Lines != 0 means that the atomic database might not contain
  *                          every line listed in the emissivity tables.
@@ -97,6 +105,7 @@ typedef struct _EM_cont_data_t EM_cont_data_t;
 typedef struct _EM_cont_emis_t EM_cont_emis_t;
 typedef struct _EM_ionfrac_t EM_ionfrac_t;
 typedef struct _EM_abund_t EM_abund_t;
+typedef struct _EM_line_cache_t EM_line_cache_t;
 
 struct _EM_t
 {
@@ -107,6 +116,8 @@ struct _EM_t
    EM_abund_t *abund;
    int chosen_abund_table;       /* user-specified abund table */
    int standard_abund_table;     /* the standard abund table */
+   unsigned int ioniz_serial;    /* counts changes to the alt ioniz table */
+   EM_line_cache_t *line_cache;  /* recently computed line spectra */
 };
 
 struct EM_filemap_t
@@ -129,10 +140,10 @@ struct _EM_line_emis_t
 {
    DB_line_t **line;          /* vector of ptrs to atomic data for each line */
    float *emissivity;         /* vector of line emissivities */
-   int *lookup;
    float temperature;
    float density;
    int nlines;
+   int refcount;              /* the line cache may hold a reference */
 };
 /* contains all the line emissivities for e.g. a given (T, density) pair */
 
@@ -167,7 +178,10 @@ struct _EM_ioniz_table_t
 {
    EM_ionfrac_t **ionfrac;
    int *offset;          /* offset[i] is offset to ith element in each ionfrac vector */
+   float *temps;         /* temps[i] = ionfrac[i]->temperature */
    int num_td_pairs;     /* number of temp/density grid points in ionfrac */
+   int num_sorted;       /* temps[0..num_sorted-1] is non-decreasing */
+   int num_ions;         /* length of each ionfrac vector */
 };
 
 struct _EM_abund_t
@@ -731,6 +745,7 @@ static void free_ioniz_table (EM_ioniz_table_t *p) /*{{{*/
      }
 
    ISIS_FREE (p->offset);
+   ISIS_FREE (p->temps);
    ISIS_FREE (p);
 }
 /*}}}*/
@@ -749,8 +764,10 @@ static EM_ioniz_table_t *new_ioniz_table (int num_ions, int num_td_pairs) /*{{{*
    memset ((char *)t, 0, sizeof (*t));
 
    t->num_td_pairs = num_td_pairs;
+   t->num_ions = num_ions;
 
    if (NULL == (t->offset = (int *) ISIS_MALLOC ((ISIS_MAX_PROTON_NUMBER + 1) * sizeof(int)))
+       || NULL == (t->temps = (float *) ISIS_MALLOC (num_td_pairs * sizeof(float)))
        || NULL == (t->ionfrac = (EM_ionfrac_t **) ISIS_MALLOC (num_td_pairs * sizeof(EM_ionfrac_t *))))
      goto free_and_return;
    memset ((char *)t->ionfrac, 0, num_td_pairs * sizeof (EM_ionfrac_t *));
@@ -878,8 +895,15 @@ static EM_ioniz_table_t *load_ionization_table (char * filename) /*{{{*/
              isis_vmesg (FAIL, I_READ_COL_FAILED, __FILE__, __LINE__, "%s", filename);
              goto close_and_return;
           }
+
+        t->temps[i] = p->temperature;
      }
 
+   t->num_sorted = 1;
+   while ((t->num_sorted < num_td_pairs)
+          && (t->temps[t->num_sorted-1] <= t->temps[t->num_sorted]))
+     t->num_sorted++;
+
    ret = 0;
    isis_vmesg (INFO, I_READ_OK, __FILE__, __LINE__, "%s", filename);
 
@@ -898,9 +922,86 @@ static EM_ioniz_table_t *load_ionization_table (char * filename) /*{{{*/
 }
 /*}}}*/
 
+/* Given t[0] <= x < t[n-1] with t[] non-decreasing, return the
+ * index k such that t[k] <= x < t[k+1].  The APED grids are uniform
+ * in log(t), so first try computing the index directly.
+ */
+static int search_grid (float x, float *t, int n) /*{{{*/
+{
+   int lo, hi;
+
+   if ((n > 2) && (t[0] > 0.0) && (t[n-1] > t[0]))
+     {
+        double s = (n - 1) * log (x / t[0]) / log (t[n-1] / t[0]);
+        int k = (int) s;
+
+        if (k > n-2)
+          k = n-2;
+        if (k < 0)
+          k = 0;
+
+        if (t[k] <= x && x < t[k+1])
+          return k;
+        if (k > 0 && t[k-1] <= x && x < t[k])
+          return k-1;
+        if (k < n-2 && t[k+1] <= x && x < t[k+2])
+          return k+1;
+     }
+
+   lo = 0;
+   hi = n-1;
+   while (hi - lo > 1)
+     {
+        int mid = lo + (hi - lo) / 2;
+        if (t[mid] <= x)
+          lo = mid;
+        else
+          hi = mid;
+     }
+
+   return lo;
+}
+
+/*}}}*/
+
+static int find_ionfrac_interval (float *x, float temp, EM_ioniz_table_t *t) /*{{{*/
+{
+   int i, n, m;
+
+   n = t->num_td_pairs;
+   m = t->num_sorted;
+
+   if ((m > 1) && (t->temps[0] <= temp) && (temp < t->temps[m-1]))
+     i = search_grid (temp, t->temps, m);
+   else
+     {
+        /* temperatures beyond the sorted part of the table */
+        for (i = (m > 0) ? m-1 : 0; i < n-1; i++)
+          {
+             if (t->temps[i] <= temp && temp < t->temps[i+1])
+               break;
+          }
+     }
+
+   if (i >= n-1)
+     {
+        isis_vmesg (FAIL, I_RANGE_ERROR, __FILE__, __LINE__,
+                    "%11.4e K out of range [%11.4e, %11.4e]",
+                    temp, t->temps[0], t->temps[n-1]);
+        return -1;
+     }
+
+   *x = (temp - t->temps[i]) / (t->temps[i+1] - t->temps[i]);
+
+   return i;
+}
+
+/*}}}*/
+
 static int get_ion_fraction (float *frac, float temp, float dens, int Z, int q, EM_ioniz_table_t *t) /*{{{*/
 {
-   int i, n, off;
+   float x;
+   int i, off;
 
    if (NULL == t)
      {
@@ -926,35 +1027,37 @@ static int get_ion_fraction (float *frac, float temp, float dens, int Z, int q,
    /* FIXME: ignoring density dependence of ionization */
    (void) dens;
 
-   n = t->num_td_pairs;
-
-   for (i=0; i < n-1; i++)
+   if (-1 == (i = find_ionfrac_interval (&x, temp, t)))
      {
-        EM_ionfrac_t *p  = t->ionfrac[i  ];
-        EM_ionfrac_t *pn = t->ionfrac[i+1];
-        float t1 = p->temperature;
-        float t2 = pn->temperature;
-        float x, f1, f2;
+        *frac = 0.0;
+        return -1;
+     }
 
-        if (temp < t1 || t2 <= temp)
-          continue;
+   *frac = (1.0 - x) * t->ionfrac[i]->fraction[ off ] + x * t->ionfrac[i+1]->fraction[ off ];
+   return 0;
+}
+/*}}}*/
+
+/* Interpolate the complete ion fraction vector at once, so that
+ * rescaling many ions costs only one temperature search.
+ */
+static int get_ion_fraction_vector (float *frac, float temp, EM_ioniz_table_t *t) /*{{{*/
+{
+   float x, *f1, *f2;
+   int i, k;
 
-        x = (temp - t1) / (t2 - t1);
+   if (-1 == (i = find_ionfrac_interval (&x, temp, t)))
+     return -1;
 
-        f1 = p->fraction[ off ];
-        f2 = pn->fraction[ off ];
+   f1 = t->ionfrac[i  ]->fraction;
+   f2 = t->ionfrac[i+1]->fraction;
 
-        *frac = (1.0 - x) * f1 + x * f2;
-        return 0;
+   for (k = 0; k < t->num_ions; k++)
+     {
+        frac[k] = (1.0 - x) * f1[k] + x * f2[k];
      }
-                            /* temperature not found */
-   *frac = 0.0;
-   isis_vmesg (FAIL, I_RANGE_ERROR, __FILE__, __LINE__,
-               "%11.4e K out of range [%11.4e, %11.4e]",
-               temp,
-               t->ionfrac[0  ]->temperature,
-               t->ionfrac[n-1]->temperature);
-   return -1;
+
+   return 0;
 }
 /*}}}*/
 
@@ -992,11 +1095,25 @@ static int get_ioniz_factor (float f_ioniz[ISIS_MAX_PROTON_NUMBER+1][ISIS_MAX_PR
    int size = dim*dim;
    int Z, num_rescale_failures = 0;
    int num_failures[ISIS_MAX_PROTON_NUMBER+1];
+   float *frac_old = NULL, *frac_new = NULL;
+   int have_old, have_new;
 
    if ((NULL == t_old)
        || (NULL == t_new && ionpop_new == NULL))
      return -1;
 
+   if (NULL == (frac_old = (float *) ISIS_MALLOC (t_old->num_ions * sizeof(float))))
+     return -1;
+   if ((t_new != NULL)
+       && (NULL == (frac_new = (float *) ISIS_MALLOC (t_new->num_ions * sizeof(float)))))
+     {
+        ISIS_FREE (frac_old);
+        return -1;
+     }
+
+   have_old = (0 == get_ion_fraction_vector (frac_old, temp, t_old));
+   have_new = (t_new != NULL) && (0 == get_ion_fraction_vector (frac_new, temp, t_new));
+
    memset ((char *) f_ioniz, 0, size * sizeof(float));
 
    for (Z = 1; Z <= ISIS_MAX_PROTON_NUMBER; Z++)
@@ -1015,14 +1132,10 @@ static int get_ioniz_factor (float f_ioniz[ISIS_MAX_PROTON_NUMBER+1][ISIS_MAX_PR
                {
                   float f_old, f_new, ff;
 
-                  if (get_ion_fraction (&f_old, temp, dens, Z, q, t_old) != 0)
-                    f_old = 1.0;
+                  f_old = have_old ? frac_old[t_old->offset[Z] + q] : 1.0;
 
                   if (t_new != NULL)
-                    {
-                       if (get_ion_fraction (&f_new, temp, dens, Z, q, t_new) != 0)
-                         f_new = 1.0;
-                    }
+                    f_new = have_new ? frac_new[t_new->offset[Z] + q] : 1.0;
                   else f_new = ionpop_new[Z*dim + q];
 
                   if ((f_old == 0.0) && (f_new > 0.0))
@@ -1066,6 +1179,9 @@ static int get_ioniz_factor (float f_ioniz[ISIS_MAX_PROTON_NUMBER+1][ISIS_MAX_PR
           }
      }
 
+   ISIS_FREE (frac_old);
+   ISIS_FREE (frac_new);
+
    return 0;
 }
 
@@ -1111,6 +1227,7 @@ void EM_free_alt_ionization_table (EM_t *em) /*{{{*/
 
    free_ioniz_table (em->ioniz_table[1]);
    em->ioniz_table[1] = NULL;
+   em->ioniz_serial++;
 }
 
 /*}}}*/
@@ -1127,6 +1244,7 @@ int EM_load_alt_ionization_table (char *file, EM_t *em) /*{{{*/
 
    free_ioniz_table (em->ioniz_table[1]);
    em->ioniz_table[1] = t;
+   em->ioniz_serial++;
 
    return 0;
 }
@@ -1606,8 +1724,10 @@ void EM_free_line_emis_list (EM_line_emis_t *p) /*{{{*/
    if (p == NULL)
      return;
 
+   if (--p->refcount > 0)
+     return;
+
    ISIS_FREE (p->line);
-   ISIS_FREE (p->lookup);
    ISIS_FREE (p->emissivity);
    ISIS_FREE (p);
 }
@@ -1631,7 +1751,7 @@ static EM_line_emis_t *new_line_emis_list (int nlines) /*{{{*/
 
    emis->temperature = emis->density = 0.0;
    emis->nlines = nlines;
-   emis->lookup = NULL;
+   emis->refcount = 1;
 
    return emis;
 }
@@ -1748,8 +1868,85 @@ static int init_load_linefile_hdu (void ***vp, int nlines) /*{{{*/
 
 /*}}}*/
 
+typedef struct
+{
+   DB_line_t *line;
+   float emis;
+   int row;
+}
+Line_Sort_Type;
+
+static int line_sort_key (DB_line_t *line) /*{{{*/
+{
+   /* unidentified lines go last */
+   return (line != NULL) ? line->indx : INT_MAX;
+}
+
+/*}}}*/
+
+static int compare_line_index (const void *va, const void *vb) /*{{{*/
+{
+   const Line_Sort_Type *a = (const Line_Sort_Type *)va;
+   const Line_Sort_Type *b = (const Line_Sort_Type *)vb;
+   int ka = line_sort_key (a->line);
+   int kb = line_sort_key (b->line);
+
+   if (ka != kb)
+     return (ka < kb) ? -1 : 1;
+
+   /* keep the file order of repeated lines */
+   return (a->row < b->row) ? -1 : (a->row > b->row);
+}
+
+/*}}}*/
+
+static int sort_line_emis_list (EM_line_emis_t *p) /*{{{*/
+{
+   Line_Sort_Type *s;
+   int i;
+
+   /* Sort by line index, so that tables can be
+    * interpolated by merging them.
+    */
+
+   for (i = 1; i < p->nlines; i++)
+     {
+        if (line_sort_key (p->line[i-1]) > line_sort_key (p->line[i]))
+          break;
+     }
+   if (i >= p->nlines)
+     return 0;
+
+   if (NULL == (s = (Line_Sort_Type *) ISIS_MALLOC (p->nlines * sizeof(Line_Sort_Type))))
+     return -1;
+
+   for (i = 0; i < p->nlines; i++)
+     {
+        s[i].line = p->line[i];
+        s[i].emis = p->emissivity[i];
+        s[i].row = i;
+     }
+
+   qsort (s, p->nlines, sizeof(Line_Sort_Type), compare_line_index);
+
+   for (i = 0; i < p->nlines; i++)
+     {
+        p->line[i] = s[i].line;
+        p->emissivity[i] = s[i].emis;
+     }
+
+   ISIS_FREE (s);
+   return 0;
+}
+
+/*}}}*/
+
 static int clean_load_linefile_hdu (void **vp, int ret) /*{{{*/
 {
+   if ((ret == 0)
+       && (-1 == sort_line_emis_list (*(EM_line_emis_t **)vp)))
+     ret = -1;
+
    if (ret)
      EM_free_line_emis_list (*(EM_line_emis_t **)vp);
 
@@ -2488,8 +2685,6 @@ static EM_cont_data_t *load_cont_data (char *filename, void *cl, EM_t *em) /*{{{
 
 static int find_in_table (float x, float *t, int n) /*{{{*/
 {
-   int i;
-
    if (NULL == t || n <= 0)
      return -1;
 
@@ -2501,13 +2696,10 @@ static int find_in_table (float x, float *t, int n) /*{{{*/
         return -1;
      }
 
-   for (i=0; i < n-1; i++)                /* brute force for now */
-     {
-        if (t[i] <= x && x < t[i+1])
-          return i;
-     }
+   if (x == t[n-1])
+     return n-1;
 
-   return -1;                             /* should never happen */
+   return search_grid (x, t, n);
 }
 
 /*}}}*/
@@ -2639,33 +2831,26 @@ static int interp_coeffs (float *coef, int *idx, int *npoints, /*{{{*/
 
 /*{{{ interpolate line spectrum using filemap */
 
-static int build_lookup_table (EM_line_emis_t *p, DB_t *db) /*{{{*/
+static int find_line_emis (EM_line_emis_t *p, int indx) /*{{{*/
 {
-   DB_line_t **line;
-   int i, nlines;
-   int *lookup = NULL;
-
-   if (NULL == p || NULL == db)
-     return -1;
-
-   if (-1 == (nlines = DB_get_nlines (db))
-       || NULL == (lookup = (int *) ISIS_MALLOC (nlines * sizeof(int))))
-     return -1;
-
-   for (i=0; i < nlines; i++)        /* init to invalid values */
-     lookup[i] = INT_MIN;
-
-   line = p->line;
+   int lo, hi;
 
-   for (i=0; i < p->nlines; i++)
+   /* the interpolated lists are sorted by line index */
+   lo = 0;
+   hi = p->nlines;
+   while (lo < hi)
      {
-        if (line[i])
-          lookup[line[i]->indx] = i;
+        int mid = lo + (hi - lo) / 2;
+        if (p->line[mid]->indx < indx)
+          lo = mid + 1;
+        else
+          hi = mid;
      }
 
-   p->lookup = lookup;
+   if ((lo < p->nlines) && (p->line[lo]->indx == indx))
+     return lo;
 
-   return 0;
+   return -1;
 }
 
 /*}}}*/
@@ -2716,95 +2901,102 @@ static int get_line_interp_points (EM_t *em, int npoints, int *idx, EM_line_emis
 /*}}}*/
 
 static EM_line_emis_t *interpolate_line_emis (char *flag, EM_line_emis_t **table, /*{{{*/
-                                             float *coef, int n, DB_t *db)
+                                             float *coef, int n)
 {
    EM_line_emis_t *result = NULL;
-   int j, k, nl, ntot;
+   int pos[4];
+   int j, nl, max_nl;
    int  ret = -1;
 
-   struct line_interp_t
-     {
-        float emis;
-        DB_line_t *line;
-     }
-   *t = NULL;
-
    if (NULL == table || NULL == coef
        || (n != 2 && n != 4))
      return NULL;
 
-   /* Use a temporary array of structures to
-    *  1) determine the union of the N line lists and
-    *  2) to assign an interpolated emissivity to each line.
-    *
-    * The temp array is used as a lookup table in which the array
-    * index is equal to the index of the line in the internal list.
-    * (e.g. it is big enough to hold the entire available line list).
-    *
-    * We waste a bit of memory, but this is a simple algorithm and
-    * is guaranteed to work (right?) even if the input line lists
-    * are unsorted.  and memory is cheap.... isnt it?
-    *
+   /* Each table is sorted by line index (see sort_line_emis_list),
+    * so the union of the N line lists and the interpolated
+    * emissivity of each line come from merging the tables.
+    * The result is also sorted by line index.
     */
 
-   if (-1 == (ntot = DB_get_nlines (db)))
-     return NULL;
-   if (NULL == (t = (struct line_interp_t *) ISIS_MALLOC (ntot * sizeof(struct line_interp_t))))
-     return NULL;
-   memset ((char *)t, 0, ntot * sizeof(struct line_interp_t));
+   max_nl = 0;
+   for (j=0; j < n; j++)
+     {
+        pos[j] = 0;
+        max_nl += table[j]->nlines;
+     }
+
+   if (max_nl == 0
+       || NULL == (result = new_line_emis_list (max_nl)))
+     goto fail;
 
    nl = 0;
-   for (j=0; j < n; j++)
+   for (;;)
      {
-        EM_line_emis_t *tbl = table[j];
-        int nlines = tbl->nlines;
+        DB_line_t *line = NULL;
+        float emis = 0.0;
+        int idx = INT_MAX;
 
-        for (k=0; k < nlines; k++)
+        /* find the smallest line index not yet merged */
+        for (j=0; j < n; j++)
           {
-             DB_line_t *p = tbl->line[k];
-             int idx;
+             EM_line_emis_t *tbl = table[j];
+             DB_line_t *p;
+
+             if (pos[j] == tbl->nlines)
+               continue;
 
-             if (p == NULL)
+             if (NULL == (p = tbl->line[pos[j]]))
                goto fail;
 
-             idx = p->indx;
+             if (p->indx < idx)
+               {
+                  idx = p->indx;
+                  line = p;
+               }
+          }
+
+        if (line == NULL)
+          break;
+
+        for (j=0; j < n; j++)
+          {
+             EM_line_emis_t *tbl = table[j];
+             int k = pos[j];
 
-             if (t[idx].line == NULL)
+             while ((k < tbl->nlines)
+                    && (tbl->line[k] != NULL)
+                    && (tbl->line[k]->indx == idx))
                {
-                  t[idx].line = p;
-                  nl++;
+                  if (tbl->line[k] != line)       /* safety check */
+                    goto fail;
+                  if (NULL == flag || flag[idx] != 0)
+                    emis += coef[j] * tbl->emissivity[k];
+                  k++;
                }
-             else if (t[idx].line != p)       /* safety check */
-               goto fail;
 
-             if (NULL == flag || flag[idx] != 0)
-               t[idx].emis += coef[j] * tbl->emissivity[k];
+             pos[j] = k;
           }
+
+        result->line[ nl ] = line;
+        result->emissivity[ nl ] = MAX(emis, 0.0);
+        nl++;
      }
 
-   if (nl == 0
-       || NULL == (result = new_line_emis_list (nl)))
+   if (nl == 0)
      goto fail;
 
-   k = 0;
-   for (j=0; j < ntot; j++)
-     {
-        if (t[j].line == NULL)
-          continue;
-
-        result->line[ k ] = t[j].line;
-        result->emissivity[ k ] = MAX(t[j].emis, 0.0);
-        k++;
-     }
-
-   if (k != nl)
+   if (nl < max_nl)
      {
-        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "Internal error in interpolate_line_emis");
-        goto fail;
+        DB_line_t **l;
+        float *e;
+        /* release the unused space, if possible */
+        if (NULL != (l = (DB_line_t **) ISIS_REALLOC (result->line, nl * sizeof(DB_line_t *))))
+          result->line = l;
+        if (NULL != (e = (float *) ISIS_REALLOC (result->emissivity, nl * sizeof(float))))
+          result->emissivity = e;
      }
 
-   if (-1 == build_lookup_table (result, db))
-     goto fail;
+   result->nlines = nl;
 
    ret = 0;
 
@@ -2816,12 +3008,318 @@ static EM_line_emis_t *interpolate_line_emis (char *flag, EM_line_emis_t **table
         result = NULL;
      }
 
-   ISIS_FREE (t);
    return result;
 }
 /*}}}*/
 
-EM_line_emis_t *EM_get_line_spectrum (char *flag, float temp, float dens, float *ionpop_new, EM_t *em) /*{{{*/
+/*{{{ line spectrum cache */
+
+/* Interpolated line spectra are cached, most recently used first,
+ * and evicted from the tail of the list when the cache exceeds
+ * EM_Line_Cache_Size bytes.  A cached spectrum is returned to the
+ * caller with its reference count incremented, so callers must
+ * treat it as read-only.
+ */
+
+typedef struct _EM_line_cache_entry_t EM_line_cache_entry_t;
+struct _EM_line_cache_entry_t
+{
+   EM_line_cache_entry_t *next;
+   EM_line_emis_t *list;
+   char *flag;                   /* copy of the line flags, or NULL */
+   float *ionpop;                /* copy of the modified ion populations, or NULL */
+   unsigned long flag_hash;
+   size_t size;                  /* bytes accounted to this entry */
+   float temperature;
+   float density;
+   int chosen_abund_table;
+   int standard_abund_table;
+   unsigned int ioniz_serial;
+};
+
+struct _EM_line_cache_t
+{
+   EM_line_cache_entry_t *head;
+   size_t size;
+};
+
+#define IONPOP_SIZE \
+   ((ISIS_MAX_PROTON_NUMBER+1)*(ISIS_MAX_PROTON_NUMBER+1)*sizeof(float))
+
+static void free_line_cache_entry (EM_line_cache_entry_t *e) /*{{{*/
+{
+   if (e == NULL)
+     return;
+
+   EM_free_line_emis_list (e->list);
+   ISIS_FREE (e->flag);
+   ISIS_FREE (e->ionpop);
+   ISIS_FREE (e);
+}
+
+/*}}}*/
+
+static void free_line_cache (EM_t *em) /*{{{*/
+{
+   EM_line_cache_t *c;
+   EM_line_cache_entry_t *e;
+
+   if (em == NULL || em->line_cache == NULL)
+     return;
+
+   c = em->line_cache;
+   while (c->head != NULL)
+     {
+        e = c->head;
+        c->head = e->next;
+        free_line_cache_entry (e);
+     }
+
+   ISIS_FREE (em->line_cache);
+}
+
+/*}}}*/
+
+static void trim_line_cache (EM_line_cache_t *c, size_t max_size) /*{{{*/
+{
+   EM_line_cache_entry_t *e, *prev;
+
+   /* evict least recently used entries until the cache fits */
+   while (c->size > max_size && c->head != NULL)
+     {
+        prev = NULL;
+        for (e = c->head; e->next != NULL; e = e->next)
+          prev = e;
+
+        if (prev == NULL)
+          c->head = NULL;
+        else prev->next = NULL;
+
+        c->size -= e->size;
+        free_line_cache_entry (e);
+     }
+}
+
+/*}}}*/
+
+static unsigned long hash_line_flags (char *flag, int n) /*{{{*/
+{
+   unsigned long h = 2166136261UL;
+   int i;
+
+   if (flag == NULL)
+     return 0;
+
+   for (i = 0; i < n; i++)
+     {
+        h ^= (unsigned char) flag[i];
+        h *= 16777619UL;
+     }
+
+   return h;
+}
+
+/*}}}*/
+
+static int line_cache_entry_matches (EM_line_cache_entry_t *e, EM_t *em, /*{{{*/
+                                     char *flag, int nflags, unsigned long flag_hash,
+                                     float temp, float dens, float *ionpop_new)
+{
+   if ((e->temperature != temp)
+       || (e->density != dens)
+       || (e->chosen_abund_table != em->chosen_abund_table)
+       || (e->standard_abund_table != em->standard_abund_table)
+       || (e->ioniz_serial != em->ioniz_serial)
+       || (e->flag_hash != flag_hash)
+       || ((e->flag == NULL) != (flag == NULL))
+       || ((e->ionpop == NULL) != (ionpop_new == NULL)))
+     return 0;
+
+   if ((flag != NULL)
+       && (0 != memcmp (e->flag, flag, nflags)))
+     return 0;
+
+   if ((ionpop_new != NULL)
+       && (0 != memcmp ((char *)e->ionpop, (char *)ionpop_new, IONPOP_SIZE)))
+     return 0;
+
+   return 1;
+}
+
+/*}}}*/
+
+static EM_line_emis_t *line_cache_lookup (EM_t *em, char *flag, float temp, /*{{{*/
+                                          float dens, float *ionpop_new)
+{
+   EM_line_cache_t *c;
+   EM_line_cache_entry_t *e, *prev;
+   unsigned long flag_hash;
+   int nflags;
+
+   if (EM_Line_Cache_Size == 0)
+     {
+        free_line_cache (em);
+        return NULL;
+     }
+
+   if (NULL == (c = em->line_cache))
+     {
+        EM_Line_Cache_Misses++;
+        return NULL;
+     }
+
+   trim_line_cache (c, EM_Line_Cache_Size);
+
+   nflags = (flag != NULL) ? DB_get_nlines (em->db) : 0;
+   flag_hash = hash_line_flags (flag, nflags);
+
+   prev = NULL;
+   for (e = c->head; e != NULL; e = e->next)
+     {
+        if (line_cache_entry_matches (e, em, flag, nflags, flag_hash,
+                                      temp, dens, ionpop_new))
+          break;
+        prev = e;
+     }
+
+   if (e == NULL)
+     {
+        EM_Line_Cache_Misses++;
+        return NULL;
+     }
+
+   EM_Line_Cache_Hits++;
+
+   if (prev != NULL)
+     {
+        prev->next = e->next;
+        e->next = c->head;
+        c->head = e;
+     }
+
+   e->list->refcount++;
+   return e->list;
+}
+
+/*}}}*/
+
+static void line_cache_insert (EM_t *em, EM_line_emis_t *list, char *flag, /*{{{*/
+                               float temp, float dens, float *ionpop_new)
+{
+   EM_line_cache_t *c;
+   EM_line_cache_entry_t *e;
+   unsigned long flag_hash;
+   size_t size;
+   int nflags;
+
+   if (EM_Line_Cache_Size == 0)
+     return;
+
+   nflags = (flag != NULL) ? DB_get_nlines (em->db) : 0;
+
+   size = sizeof(*e) + list->nlines * (sizeof(DB_line_t *) + sizeof(float));
+   if (flag != NULL)
+     size += nflags;
+   if (ionpop_new != NULL)
+     size += IONPOP_SIZE;
+
+   if (size > EM_Line_Cache_Size)
+     return;
+
+   flag_hash = hash_line_flags (flag, nflags);
+
+   /* the same spectrum may have been computed twice, e.g. by
+    * different threads */
+   if (NULL != (c = em->line_cache))
+     {
+        for (e = c->head; e != NULL; e = e->next)
+          {
+             if (line_cache_entry_matches (e, em, flag, nflags, flag_hash,
+                                           temp, dens, ionpop_new))
+               return;
+          }
+     }
+
+   if (NULL == (c = em->line_cache))
+     {
+        if (NULL == (c = (EM_line_cache_t *) ISIS_MALLOC (sizeof(EM_line_cache_t))))
+          return;
+        memset ((char *)c, 0, sizeof(*c));
+        em->line_cache = c;
+     }
+
+   if (NULL == (e = (EM_line_cache_entry_t *) ISIS_MALLOC (sizeof(EM_line_cache_entry_t))))
+     return;
+   memset ((char *)e, 0, sizeof(*e));
+
+   if (flag != NULL)
+     {
+        if (NULL == (e->flag = (char *) ISIS_MALLOC (nflags * sizeof(char))))
+          {
+             free_line_cache_entry (e);
+             return;
+          }
+        memcpy (e->flag, flag, nflags);
+     }
+
+   if (ionpop_new != NULL)
+     {
+        if (NULL == (e->ionpop = (float *) ISIS_MALLOC (IONPOP_SIZE)))
+          {
+             free_line_cache_entry (e);
+             return;
+          }
+        memcpy ((char *)e->ionpop, (char *)ionpop_new, IONPOP_SIZE);
+     }
+
+   e->flag_hash = flag_hash;
+   e->temperature = temp;
+   e->density = dens;
+   e->chosen_abund_table = em->chosen_abund_table;
+   e->standard_abund_table = em->standard_abund_table;
+   e->ioniz_serial = em->ioniz_serial;
+   e->size = size;
+
+   e->list = list;
+   list->refcount++;
+
+   trim_line_cache (c, EM_Line_Cache_Size - size);
+
+   e->next = c->head;
+   c->head = e;
+   c->size += size;
+}
+
+/*}}}*/
+
+/*}}}*/
+
+/* The line cache is not thread-safe, but EM_compute_line_spectrum
+ * may be called from several threads at once when the emissivity
+ * tables are memory resident (see EM_is_memory_resident).
+ */
+
+EM_line_emis_t *EM_lookup_line_spectrum (char *flag, float temp, float dens, float *ionpop_new, EM_t *em) /*{{{*/
+{
+   if (NULL == em || NULL == em->line_data)
+     return NULL;
+
+   return line_cache_lookup (em, flag, temp, dens, ionpop_new);
+}
+
+/*}}}*/
+
+void EM_cache_line_spectrum (EM_line_emis_t *line, char *flag, float temp, float dens, float *ionpop_new, EM_t *em) /*{{{*/
+{
+   if (NULL == em || NULL == line)
+     return;
+
+   line_cache_insert (em, line, flag, temp, dens, ionpop_new);
+}
+
+/*}}}*/
+
+EM_line_emis_t *EM_compute_line_spectrum (char *flag, float temp, float dens, float *ionpop_new, EM_t *em) /*{{{*/
 {
    EM_line_data_t *ld;
    EM_line_emis_t *line = NULL;
@@ -2840,13 +3338,17 @@ EM_line_emis_t *EM_get_line_spectrum (char *flag, float temp, float dens, float
    if (-1 == get_line_interp_points (em, npoints, idx, tbl))
      goto close_and_return;
 
-   line = interpolate_line_emis (flag, tbl, coef, npoints, em->db);
+   line = interpolate_line_emis (flag, tbl, coef, npoints);
    if (NULL == line)
      goto close_and_return;
 
    if (-1 == scale_line_abundance (line, em)
        || -1 == scale_line_ionization (line, temp, dens, ionpop_new, em))
-     goto close_and_return;
+     {
+        EM_free_line_emis_list (line);
+        line = NULL;
+        goto close_and_return;
+     }
 
    line->temperature = temp;
    line->density = dens;
@@ -2866,6 +3368,27 @@ EM_line_emis_t *EM_get_line_spectrum (char *flag, float temp, float dens, float
 }
 /*}}}*/
 
+EM_line_emis_t *EM_get_line_spectrum (char *flag, float temp, float dens, float *ionpop_new, EM_t *em) /*{{{*/
+{
+   EM_line_emis_t *line;
+
+   if (NULL != (line = EM_lookup_line_spectrum (flag, temp, dens, ionpop_new, em)))
+     return line;
+
+   if (NULL != (line = EM_compute_line_spectrum (flag, temp, dens, ionpop_new, em)))
+     EM_cache_line_spectrum (line, flag, temp, dens, ionpop_new, em);
+
+   return line;
+}
+/*}}}*/
+
+int EM_is_memory_resident (void) /*{{{*/
+{
+   return (EM_Load_Line_Emis != 0) && (EM_Load_Cont_Emis != 0);
+}
+
+/*}}}*/
+
 int EM_get_nlines (EM_line_emis_t *t) /*{{{*/
 {
    if (NULL == t)
@@ -2923,7 +3446,7 @@ int EM_sum_line_emissivity (float * emis, float temp, float dens, /*{{{*/
              *emis = -1.0;
              goto finish;
           }
-        k = t->lookup[ list[i] ];
+        k = find_line_emis (t, list[i]);
         if (k < 0)
           continue;
         *emis += t->emissivity[k];
@@ -3582,6 +4105,7 @@ void EM_end (EM_t *em) /*{{{*/
    if (em == NULL)
      return;
 
+   free_line_cache (em);
    free_ioniz_table (em->ioniz_table[0]);
    free_ioniz_table (em->ioniz_table[1]);
    free_abund_list (em->abund);
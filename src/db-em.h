@@ -45,6 +45,7 @@ extern "C" {
 
 enum
 {
+  EM_LINE_CACHE_SIZE_DEFAULT=0x2000000,
   EM_USE_MEMORY_DEFAULT=3
    /* FIXME:  setting this to 1 (meaning load lines into RAM
     * but load cont emissivity from disk on-demand) reveals
@@ -60,6 +61,9 @@ enum
 extern unsigned int EM_Use_Memory;
 extern int EM_Maybe_Missing_Lines;
 extern unsigned int EM_Hash_Table_Size_Hint;
+extern unsigned int EM_Line_Cache_Size;
+extern unsigned int EM_Line_Cache_Hits;
+extern unsigned int EM_Line_Cache_Misses;
 
 typedef struct _EM_t EM_t;
 typedef struct _EM_ioniz_table_t EM_ioniz_table_t;
@@ -115,6 +119,10 @@ extern void EM_free_alt_ionization_table (EM_t *em);
 extern int EM_get_nlines (EM_line_emis_t *t);
 extern void EM_free_line_emis_list (EM_line_emis_t *p);
 extern EM_line_emis_t *EM_get_line_spectrum (char *flag, float temp, float dens, float *ionpop_new, EM_t *em);
+extern EM_line_emis_t *EM_lookup_line_spectrum (char *flag, float temp, float dens, float *ionpop_new, EM_t *em);
+extern EM_line_emis_t *EM_compute_line_spectrum (char *flag, float temp, float dens, float *ionpop_new, EM_t *em);
+extern void EM_cache_line_spectrum (EM_line_emis_t *line, char *flag, float temp, float dens, float *ionpop_new, EM_t *em);
+extern int EM_is_memory_resident (void);
 
 extern EM_cont_type_t *EM_new_continuum (int nbins);
 extern void EM_free_continuum (EM_cont_type_t *t);
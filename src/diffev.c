@@ -0,0 +1,922 @@
+/* -*- mode: C; mode: fold -*- */
+
+/*  This file is part of ISIS, the Interactive Spectral Interpretation System
+    Copyright (C) 1998-2020 Massachusetts Institute of Technology
+
+    This software was developed by the MIT Center for Space Research under
+    contract SV1-61010 from the Smithsonian Institution.
+
+    Author:  John C. Houck  <houck@space.mit.edu>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* $Id$ */
+
+/*  Differential evolution, following the algorithm of the
+ *  S-Lang implementation in share/diffevol.sl.  Each generation,
+ *  a trial vector is built for every member of the population
+ *  and the whole set of trial vectors is evaluated in batches,
+ *  so that the models for a batch are folded through the
+ *  instrument responses together.  Optionally, the population
+ *  is shared among worker processes, forked when the fit starts.
+ */
+
+/*{{{ Includes  */
+
+#include "config.h"
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#if defined(HAVE_UNISTD_H) && defined(HAVE_SYS_WAIT_H)
+# include <unistd.h>
+# include <sys/types.h>
+# include <sys/wait.h>
+# define HAVE_DIFFEV_WORKERS 1
+#else
+# define HAVE_DIFFEV_WORKERS 0
+#endif
+
+/*}}}*/
+
+#define ISIS_FIT_ENGINE_PRIVATE_DATA \
+   double diffscale, crossprob, reldiff, absdiff; \
+   int npop, maxnfe, max_gens, batch, seed; \
+   int strategy, workers;
+
+#include "isis.h"
+#include "isismath.h"
+
+enum
+{
+   DE_BEST1BIN = 0,
+   DE_BEST1EXP,
+   DE_RAND1BIN,
+   DE_RAND1EXP,
+   DE_RANDTOBEST1BIN,
+   DE_RANDTOBEST1EXP
+};
+
+static const char *Strategy_Names[] =
+{
+   "best1bin", "best1exp", "rand1bin", "rand1exp",
+   "randtobest1bin", "randtobest1exp", NULL
+};
+
+typedef struct
+{
+   double *x;
+   double *y;
+   double *weights;
+   unsigned int npts;
+   unsigned int npars;
+
+   double *fx;         /* [batch * npts] */
+   double **fx_list;   /* [batch] */
+   double *fvec;       /* [npts] */
+   double **par_list;  /* [batch] */
+   unsigned int batch;
+
+   int nfe;
+}
+Fun_Info_Type;
+
+#define MAX_DIFFEV_WORKERS 64
+
+/* A worker process evaluates the trial vectors it is sent
+ * and sends back their statistics. */
+typedef struct
+{
+   int pid;
+   int to_worker;      /* write end */
+   int from_worker;    /* read end */
+   unsigned int num;   /* members sent in this generation */
+}
+Worker_Type;
+
+static int rand_index (int n) /*{{{*/
+{
+   int k = (int) (n * urand ());
+   return (k < n) ? k : n - 1;
+}
+
+/*}}}*/
+
+static void pick_samples (int npop, int current, int n, int *samples) /*{{{*/
+{
+   int i, j;
+
+   /* n distinct members, none equal to the current one */
+   for (i = 0; i < n; i++)
+     {
+        int s;
+        do
+          {
+             s = rand_index (npop);
+             if (s == current)
+               continue;
+             for (j = 0; j < i; j++)
+               {
+                  if (samples[j] == s)
+                    break;
+               }
+          }
+        while ((s == current) || (j < i));
+        samples[i] = s;
+     }
+}
+
+/*}}}*/
+
+static void make_trial (Isis_Fit_Engine_Type *e, double *pop, double *best, /*{{{*/
+                        int npop, unsigned int npars, int current, double *trial)
+{
+   double *cur, *p0, *p1, *p2;
+   double f = e->diffscale;
+   int samples[3];
+   unsigned int j, k;
+   int is_exp;
+
+   cur = pop + current * npars;
+
+   switch (e->strategy)
+     {
+      case DE_RAND1BIN:
+      case DE_RAND1EXP:
+        pick_samples (npop, current, 3, samples);
+        p0 = pop + samples[0] * npars;
+        p1 = pop + samples[1] * npars;
+        p2 = pop + samples[2] * npars;
+        break;
+
+      case DE_RANDTOBEST1BIN:
+      case DE_RANDTOBEST1EXP:
+        pick_samples (npop, current, 2, samples);
+        p1 = pop + samples[0] * npars;
+        p2 = pop + samples[1] * npars;
+        /* cur + f*((best-cur) + (p1-p2)) */
+        for (j = 0; j < npars; j++)
+          trial[j] = cur[j] + f * ((best[j] - cur[j]) + (p1[j] - p2[j]));
+        p0 = NULL;
+        break;
+
+      default:
+        pick_samples (npop, current, 2, samples);
+        p0 = best;
+        p1 = pop + samples[0] * npars;
+        p2 = pop + samples[1] * npars;
+        break;
+     }
+
+   if (p0 != NULL)
+     {
+        for (j = 0; j < npars; j++)
+          trial[j] = p0[j] + f * (p1[j] - p2[j]);
+     }
+
+   /* crossover with the current member */
+   is_exp = ((e->strategy == DE_BEST1EXP)
+             || (e->strategy == DE_RAND1EXP)
+             || (e->strategy == DE_RANDTOBEST1EXP));
+
+   if (is_exp)
+     {
+        /* copy a run of mutant values starting at a random index */
+        unsigned int start = rand_index (npars);
+        for (k = 1; k < npars; k++)
+          {
+             if (urand () > e->crossprob)
+               break;
+          }
+        for (j = k; j < npars; j++)
+          {
+             unsigned int i = (start + j) % npars;
+             trial[i] = cur[i];
+          }
+     }
+   else
+     {
+        /* at least one mutant value survives */
+        unsigned int keep = rand_index (npars);
+        for (j = 0; j < npars; j++)
+          {
+             if ((j != keep) && (urand () >= e->crossprob))
+               trial[j] = cur[j];
+          }
+     }
+}
+
+/*}}}*/
+
+static void truncate_to_range (Isis_Fit_Engine_Type *e, double *par, unsigned int npars) /*{{{*/
+{
+   unsigned int j;
+
+   for (j = 0; j < npars; j++)
+     {
+        if (par[j] < e->par_min[j])
+          par[j] = e->par_min[j];
+        else if (par[j] > e->par_max[j])
+          par[j] = e->par_max[j];
+     }
+}
+
+/*}}}*/
+
+static double member_statistic (Isis_Fit_Statistic_Type *fs, Fun_Info_Type *fi, double *fx) /*{{{*/
+{
+   double stat;
+
+   if ((-1 == fs->compute_statistic (fs, fi->y, fx, fi->weights,
+                                     fi->npts, fi->fvec, &stat))
+       || (0 == isfinite (stat)))
+     return DBL_MAX;
+
+   return stat;
+}
+
+/*}}}*/
+
+static int eval_batch (Isis_Fit_Type *ift, Fun_Info_Type *fi, /*{{{*/
+                       double *pars, unsigned int num, double *energy)
+{
+   Isis_Fit_Statistic_Type *fs = ift->stat;
+   unsigned int i, j, n;
+
+   /* The batched evaluation doesn't provide optional data
+    * to the statistic, so statistics which need it get
+    * one model at a time.
+    */
+   if ((ift->compute_models == NULL) || (fs->uses_opt_data != 0))
+     {
+        for (i = 0; i < num; i++)
+          {
+             double *p = pars + i * fi->npars;
+             if (-1 == ift->compute_model (fs->opt_data, fi->x, fi->npts,
+                                           p, fi->npars, fi->fx))
+               return -1;
+             energy[i] = member_statistic (fs, fi, fi->fx);
+          }
+        fi->nfe += num;
+        return 0;
+     }
+
+   /* evaluate num parameter vectors, stored one after another
+    * in pars[], in groups of at most fi->batch */
+   for (i = 0; i < num; i += n)
+     {
+        n = num - i;
+        if (n > fi->batch)
+          n = fi->batch;
+
+        for (j = 0; j < n; j++)
+          fi->par_list[j] = pars + (i + j) * fi->npars;
+
+        if (-1 == ift->compute_models (fi->x, fi->npts, fi->par_list, fi->npars,
+                                       n, fi->fx_list))
+          return -1;
+
+        for (j = 0; j < n; j++)
+          energy[i+j] = member_statistic (fs, fi, fi->fx_list[j]);
+
+        fi->nfe += n;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+#if HAVE_DIFFEV_WORKERS
+
+static int write_bytes (int fd, void *buf, size_t size) /*{{{*/
+{
+   char *b = (char *) buf;
+
+   while (size > 0)
+     {
+        ssize_t n = write (fd, b, size);
+        if (n < 0)
+          {
+             if (errno == EINTR)
+               continue;
+             return -1;
+          }
+        b += n;
+        size -= n;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int read_bytes (int fd, void *buf, size_t size) /*{{{*/
+{
+   char *b = (char *) buf;
+
+   while (size > 0)
+     {
+        ssize_t n = read (fd, b, size);
+        if (n < 0)
+          {
+             if (errno == EINTR)
+               continue;
+             return -1;
+          }
+        if (n == 0)
+          return -1;
+        b += n;
+        size -= n;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static void run_worker (Isis_Fit_Type *ift, Fun_Info_Type *fi, /*{{{*/
+                        double *pars, double *energy, int in, int out)
+{
+   unsigned int num;
+   int status;
+
+   /* Evaluate trial vectors until the parent closes the pipe.
+    * The worker has its own copy of the fit, the data and the
+    * interpreter, as they were when it was forked.
+    */
+   while (0 == read_bytes (in, &num, sizeof num))
+     {
+        if (-1 == read_bytes (in, pars, num * fi->npars * sizeof(double)))
+          break;
+
+        status = eval_batch (ift, fi, pars, num, energy);
+
+        if ((-1 == write_bytes (out, &status, sizeof status))
+            || ((status == 0)
+                && (-1 == write_bytes (out, energy, num * sizeof(double)))))
+          break;
+     }
+
+   _exit (0);
+}
+
+/*}}}*/
+
+static void stop_workers (Worker_Type *w, int num_workers) /*{{{*/
+{
+   int i;
+
+   for (i = 0; i < num_workers; i++)
+     {
+        (void) close (w[i].to_worker);
+        (void) close (w[i].from_worker);
+     }
+
+   for (i = 0; i < num_workers; i++)
+     {
+        while ((-1 == waitpid (w[i].pid, NULL, 0)) && (errno == EINTR))
+          ;
+     }
+}
+
+/*}}}*/
+
+static int start_workers (Isis_Fit_Type *ift, Fun_Info_Type *fi, /*{{{*/
+                          double *pars, double *energy,
+                          Worker_Type *w, int num_workers)
+{
+   int i, n;
+
+   /* anything buffered would be written by every worker */
+   fflush (stdout);
+   fflush (stderr);
+
+   for (n = 0; n < num_workers; n++)
+     {
+        int to_worker[2], from_worker[2];
+        pid_t pid;
+
+        if (-1 == pipe (to_worker))
+          break;
+        if (-1 == pipe (from_worker))
+          {
+             (void) close (to_worker[0]);
+             (void) close (to_worker[1]);
+             break;
+          }
+
+        if (-1 == (pid = fork ()))
+          {
+             (void) close (to_worker[0]);
+             (void) close (to_worker[1]);
+             (void) close (from_worker[0]);
+             (void) close (from_worker[1]);
+             break;
+          }
+
+        if (pid == 0)
+          {
+             /* don't hold other workers' pipes open */
+             for (i = 0; i < n; i++)
+               {
+                  (void) close (w[i].to_worker);
+                  (void) close (w[i].from_worker);
+               }
+             (void) close (to_worker[1]);
+             (void) close (from_worker[0]);
+             run_worker (ift, fi, pars, energy, to_worker[0], from_worker[1]);
+          }
+
+        (void) close (to_worker[0]);
+        (void) close (from_worker[1]);
+
+        w[n].pid = pid;
+        w[n].to_worker = to_worker[1];
+        w[n].from_worker = from_worker[0];
+        w[n].num = 0;
+     }
+
+   return n;
+}
+
+/*}}}*/
+
+static int eval_population (Isis_Fit_Type *ift, Fun_Info_Type *fi, /*{{{*/
+                            Worker_Type *w, int num_workers,
+                            double *pars, unsigned int num, double *energy)
+{
+   unsigned int n, share, first;
+   int status = 0;
+   int k;
+
+   if (num_workers == 0)
+     return eval_batch (ift, fi, pars, num, energy);
+
+   /* The workers take the first members, an equal share each,
+    * and this process evaluates the rest while they run. */
+   share = num / (num_workers + 1);
+   first = 0;
+
+   for (k = 0; k < num_workers; k++)
+     {
+        w[k].num = share;
+        if ((-1 == write_bytes (w[k].to_worker, &w[k].num, sizeof w[k].num))
+            || (-1 == write_bytes (w[k].to_worker, pars + first * fi->npars,
+                                   w[k].num * fi->npars * sizeof(double))))
+          {
+             /* a worker which didn't get its members won't reply */
+             for (; k < num_workers; k++)
+               w[k].num = 0;
+             status = -1;
+             break;
+          }
+        first += share;
+     }
+
+   if ((status == 0)
+       && (-1 == eval_batch (ift, fi, pars + first * fi->npars,
+                            num - first, energy + first)))
+     status = -1;
+
+   /* collect every reply, so the pipes stay in step */
+   first = 0;
+   for (k = 0; k < num_workers; k++)
+     {
+        int worker_status;
+
+        n = w[k].num;
+        if (n == 0)
+          continue;
+
+        if ((-1 == read_bytes (w[k].from_worker, &worker_status, sizeof worker_status))
+            || (worker_status != 0)
+            || (-1 == read_bytes (w[k].from_worker, energy + first, n * sizeof(double))))
+          status = -1;
+        else
+          fi->nfe += n;
+
+        first += n;
+     }
+
+   return status;
+}
+
+/*}}}*/
+
+#else
+
+static int start_workers (Isis_Fit_Type *ift, Fun_Info_Type *fi, /*{{{*/
+                          double *pars, double *energy,
+                          Worker_Type *w, int num_workers)
+{
+   (void) ift; (void) fi; (void) pars; (void) energy; (void) w; (void) num_workers;
+   return 0;
+}
+
+/*}}}*/
+
+static void stop_workers (Worker_Type *w, int num_workers) /*{{{*/
+{
+   (void) w; (void) num_workers;
+}
+
+/*}}}*/
+
+static int eval_population (Isis_Fit_Type *ift, Fun_Info_Type *fi, /*{{{*/
+                            Worker_Type *w, int num_workers,
+                            double *pars, unsigned int num, double *energy)
+{
+   (void) w; (void) num_workers;
+   return eval_batch (ift, fi, pars, num, energy);
+}
+
+/*}}}*/
+
+#endif
+
+static int converged (Isis_Fit_Engine_Type *e, double emin, double emax) /*{{{*/
+{
+   double diff = fabs (emax - emin);
+   double scale = (fabs(emax) > fabs(emin)) ? fabs(emax) : fabs(emin);
+
+   if (emax == DBL_MAX)
+     return 0;
+
+   return ((diff <= e->absdiff) || (diff <= e->reldiff * scale));
+}
+
+/*}}}*/
+
+static int diffev (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
+                   double *x, double *y, double *weights, unsigned int npts,
+                   double *pars, unsigned int npars)
+{
+   Isis_Fit_Engine_Type *e;
+   Fun_Info_Type fi;
+   Worker_Type workers[MAX_DIFFEV_WORKERS];
+   int num_workers = 0;
+   double *pop = NULL, *energy = NULL, *trial = NULL, *trial_energy = NULL;
+   double *best, best_energy;
+   int npop, i, k, ibest, gen, num_changed;
+   unsigned int j;
+   int ret = -1;
+
+   if ((ift == NULL) || (npars == 0))
+     return -1;
+
+   e = ift->engine;
+
+   npop = (e->npop > 0) ? e->npop : 10 * (int) npars;
+   if (npop < 5)
+     npop = 5;
+
+   memset ((char *)&fi, 0, sizeof fi);
+   fi.x = x;
+   fi.y = y;
+   fi.weights = weights;
+   fi.npts = npts;
+   fi.npars = npars;
+   fi.batch = ((e->batch > 0) && (e->batch < npop)) ? (unsigned int) e->batch : (unsigned int) npop;
+
+   if ((NULL == (pop = (double *) ISIS_MALLOC (npop * npars * sizeof(double))))
+       || (NULL == (trial = (double *) ISIS_MALLOC (npop * npars * sizeof(double))))
+       || (NULL == (energy = (double *) ISIS_MALLOC (npop * sizeof(double))))
+       || (NULL == (trial_energy = (double *) ISIS_MALLOC (npop * sizeof(double))))
+       || (NULL == (fi.fvec = (double *) ISIS_MALLOC (npts * sizeof(double))))
+       || (NULL == (fi.fx = (double *) ISIS_MALLOC (fi.batch * npts * sizeof(double))))
+       || (NULL == (fi.fx_list = (double **) ISIS_MALLOC (fi.batch * sizeof(double *))))
+       || (NULL == (fi.par_list = (double **) ISIS_MALLOC (fi.batch * sizeof(double *)))))
+     goto finish;
+
+   for (j = 0; j < fi.batch; j++)
+     fi.fx_list[j] = fi.fx + j * npts;
+
+   if (e->workers > 0)
+     {
+        int n = e->workers;
+        if (n > MAX_DIFFEV_WORKERS)
+          n = MAX_DIFFEV_WORKERS;
+        if (n > npop - 1)
+          n = npop - 1;
+        num_workers = start_workers (ift, &fi, trial, trial_energy, workers, n);
+        if ((num_workers < n) && (e->verbose > 0))
+          e->warn_hook (clientdata, "diffev: started %d of %d worker processes\n", num_workers, n);
+     }
+
+   if (e->seed > 0)
+     random_seed ((unsigned long) e->seed);
+
+   /* The initial parameters are the first member, the rest are
+    * drawn uniformly from the allowed ranges. */
+   for (j = 0; j < npars; j++)
+     pop[j] = pars[j];
+   truncate_to_range (e, pop, npars);
+   for (i = 1; i < npop; i++)
+     {
+        double *p = pop + i * npars;
+        for (j = 0; j < npars; j++)
+          p[j] = e->par_min[j] + urand () * (e->par_max[j] - e->par_min[j]);
+     }
+
+   if (-1 == eval_population (ift, &fi, workers, num_workers, pop, npop, energy))
+     goto finish;
+
+   ibest = 0;
+   for (i = 1; i < npop; i++)
+     {
+        if (energy[i] < energy[ibest])
+          ibest = i;
+     }
+   best_energy = energy[ibest];
+
+   if (e->verbose > 0)
+     e->verbose_hook (clientdata, best_energy, pop + ibest * npars, npars);
+
+   for (gen = 0; (e->max_gens < 0) || (gen < e->max_gens); gen++)
+     {
+        double emax = energy[0];
+
+        for (i = 1; i < npop; i++)
+          {
+             if (energy[i] > emax)
+               emax = energy[i];
+          }
+
+        if (converged (e, best_energy, emax))
+          break;
+
+        if (fi.nfe + npop > e->maxnfe)
+          {
+             if (e->verbose > 0)
+               e->warn_hook (clientdata, "diffev: reached maximum number of function evaluations\n");
+             break;
+          }
+
+        best = pop + ibest * npars;
+        for (i = 0; i < npop; i++)
+          {
+             double *t = trial + i * npars;
+             make_trial (e, pop, best, npop, npars, i, t);
+             truncate_to_range (e, t, npars);
+          }
+
+        if (-1 == eval_population (ift, &fi, workers, num_workers, trial, npop, trial_energy))
+          goto finish;
+
+        /* Accept a trial only if it lowers the energy.  A tie
+         * could mean that the parameter's value has no effect. */
+        num_changed = 0;
+        k = ibest;
+        for (i = 0; i < npop; i++)
+          {
+             if (trial_energy[i] < energy[i])
+               {
+                  memcpy ((char *)(pop + i * npars), (char *)(trial + i * npars),
+                          npars * sizeof(double));
+                  energy[i] = trial_energy[i];
+                  if (energy[i] < energy[k])
+                    k = i;
+                  num_changed++;
+               }
+          }
+
+        if (energy[k] < best_energy)
+          {
+             ibest = k;
+             best_energy = energy[k];
+             if (e->verbose > 0)
+               e->verbose_hook (clientdata, best_energy, pop + ibest * npars, npars);
+          }
+
+        if (e->verbose > 1)
+          e->warn_hook (clientdata, "diffev: generation %d: nfe=%d  changed=%d  best=%g  worst=%g\n",
+                        gen, fi.nfe, num_changed, best_energy, emax);
+     }
+
+   for (j = 0; j < npars; j++)
+     pars[j] = pop[ibest * npars + j];
+   ift->statistic = best_energy;
+
+   ret = (best_energy < DBL_MAX) ? 0 : -1;
+
+   finish:
+
+   stop_workers (workers, num_workers);
+
+   ISIS_FREE (pop);
+   ISIS_FREE (trial);
+   ISIS_FREE (energy);
+   ISIS_FREE (trial_energy);
+   ISIS_FREE (fi.fvec);
+   ISIS_FREE (fi.fx);
+   ISIS_FREE (fi.fx_list);
+   ISIS_FREE (fi.par_list);
+
+   return ret;
+}
+
+/*}}}*/
+
+static void warn_hook (void *clientdata, const char * fmt, ...) /*{{{*/
+{
+   char buf[1024];
+   va_list ap;
+
+   (void) clientdata;
+
+   if (fmt == NULL)
+     return;
+
+   va_start (ap, fmt);
+   if (-1 == isis_vsnprintf (buf, sizeof(buf), fmt, ap))
+     fputs ("**** String buffer overflow in warn_hook\n", stderr);
+   va_end (ap);
+
+   fputs (buf, stdout);
+}
+
+/*}}}*/
+
+static void verbose_hook (void *clientdata, double statistic, /*{{{*/
+                          double *par, unsigned int n)
+{
+   unsigned int i;
+   (void) clientdata;
+   fprintf (stdout, "statistic: %e", statistic);
+   for (i = 0; i < n; i++)
+     fprintf (stdout, "\tp[%u]=%e", i, par[i]);
+   (void) fputs ("\n", stdout);
+}
+
+/*}}}*/
+
+static int handle_double_option (char *subsystem, char *optname, char *value, double *d) /*{{{*/
+{
+   if (1 != sscanf (value, "%lf", d))
+     {
+        fprintf (stderr, "%s;%s option requires a double\n", subsystem, optname);
+        return -1;
+     }
+   return 0;
+}
+
+/*}}}*/
+
+static int handle_int_option (char *subsystem, char *optname, char *value, int *d) /*{{{*/
+{
+   if (1 != sscanf (value, "%d", d))
+     {
+        fprintf (stderr, "%s;%s option requires a int\n", subsystem, optname);
+        return -1;
+     }
+   return 0;
+}
+
+/*}}}*/
+
+#define HANDLE_OPTION(type, name) \
+static int handle_##name##_option (char *subsystem, char *optname, char *value, void *clientdata) \
+{\
+   Isis_Fit_Engine_Type *e; \
+   e = (Isis_Fit_Engine_Type *) clientdata; \
+   if (-1 == handle_##type##_option (subsystem, optname, value, &e->name)) \
+     return -1; \
+   return isis_update_option_string (&e->option_string, optname, value); \
+}
+
+HANDLE_OPTION(double, diffscale)
+HANDLE_OPTION(double, crossprob)
+HANDLE_OPTION(double, reldiff)
+HANDLE_OPTION(double, absdiff)
+HANDLE_OPTION(int, npop)
+HANDLE_OPTION(int, maxnfe)
+HANDLE_OPTION(int, max_gens)
+HANDLE_OPTION(int, batch)
+HANDLE_OPTION(int, seed)
+HANDLE_OPTION(int, workers)
+
+static int handle_strategy_option (char *subsystem, char *optname, char *value, void *clientdata) /*{{{*/
+{
+   Isis_Fit_Engine_Type *e = (Isis_Fit_Engine_Type *) clientdata;
+   int i;
+
+   for (i = 0; Strategy_Names[i] != NULL; i++)
+     {
+        if (0 == strcmp (value, Strategy_Names[i]))
+          {
+             e->strategy = i;
+             return isis_update_option_string (&e->option_string, optname, value);
+          }
+     }
+
+   fprintf (stderr, "%s;%s: unknown strategy '%s'\n", subsystem, optname, value);
+   return -1;
+}
+
+/*}}}*/
+
+static Isis_Option_Table_Type Option_Table [] =
+{
+     {"npop", handle_npop_option, ISIS_OPT_REQUIRES_VALUE, "-1", "Population size (<= 0 means 10 times the number of parameters)"},
+     {"maxnfe", handle_maxnfe_option, ISIS_OPT_REQUIRES_VALUE, "50000", "Maximum number of function evaluations"},
+     {"max_gens", handle_max_gens_option, ISIS_OPT_REQUIRES_VALUE, "-1", "Maximum number of generations (< 0 means no limit)"},
+     {"diffscale", handle_diffscale_option, ISIS_OPT_REQUIRES_VALUE, "0.7", "Scale factor applied to difference vectors"},
+     {"crossprob", handle_crossprob_option, ISIS_OPT_REQUIRES_VALUE, "0.5", "Crossover probability"},
+     {"strategy", handle_strategy_option, ISIS_OPT_REQUIRES_VALUE, "best1bin", "best1bin|best1exp|rand1bin|rand1exp|randtobest1bin|randtobest1exp"},
+     {"reldiff", handle_reldiff_option, ISIS_OPT_REQUIRES_VALUE, "1.e-4", "Relative spread of population statistics for termination"},
+     {"absdiff", handle_absdiff_option, ISIS_OPT_REQUIRES_VALUE, "1.e-9", "Absolute spread of population statistics for termination"},
+     {"batch", handle_batch_option, ISIS_OPT_REQUIRES_VALUE, "0", "Maximum number of models evaluated together (<= 0 means whole population)"},
+     {"seed", handle_seed_option, ISIS_OPT_REQUIRES_VALUE, "0", "Random number seed (<= 0 means don't reseed)"},
+     {"workers", handle_workers_option, ISIS_OPT_REQUIRES_VALUE, "0", "Number of worker processes sharing the population"},
+     {NULL, NULL, 0, NULL, NULL}
+};
+
+static int set_options (Isis_Fit_Engine_Type *e, Isis_Option_Type *opts) /*{{{*/
+{
+   return isis_process_options (opts, Option_Table, (void *)e, 1);
+}
+
+/*}}}*/
+
+static int set_range_hook (Isis_Fit_Engine_Type *e, Isis_Fit_Range_Hook_Type r) /*{{{*/
+{
+   (void) e; (void) r;
+   return 0;
+}
+
+/*}}}*/
+
+static void deallocate (Isis_Fit_Engine_Type *e)
+{
+   ISIS_FREE (e->engine_name);
+   ISIS_FREE (e->default_statistic_name);
+   ISIS_FREE (e->option_string);
+}
+
+ISIS_FIT_ENGINE_METHOD(diffev,name,sname)
+{
+   Isis_Fit_Engine_Type *e;
+
+   if (NULL == (e = (Isis_Fit_Engine_Type *) ISIS_MALLOC (sizeof(Isis_Fit_Engine_Type))))
+     return NULL;
+   memset ((char *)e, 0, sizeof (*e));
+
+   if ((NULL == (e->engine_name = isis_make_string (name)))
+       || (NULL == (e->default_statistic_name = isis_make_string (sname))))
+     {
+        deallocate (e);
+        ISIS_FREE (e);
+        return NULL;
+     }
+
+   e->method = diffev;
+   e->set_options = set_options;
+   e->deallocate = deallocate;
+   e->set_range_hook = set_range_hook;
+   e->range_hook = NULL;
+   e->verbose_hook = verbose_hook;
+   e->warn_hook = warn_hook;
+
+   e->npop = -1;
+   e->maxnfe = 50000;
+   e->max_gens = -1;
+   e->diffscale = 0.7;
+   e->crossprob = 0.5;
+   e->strategy = DE_BEST1BIN;
+   e->reldiff = 1.e-4;
+   e->absdiff = 1.e-9;
+   e->batch = 0;
+   e->seed = 0;
+   e->workers = 0;
+
+   e->option_string = isis_make_default_option_string ("diffev", Option_Table);
+   if (e->option_string == NULL)
+     {
+        deallocate (e);
+        return NULL;
+     }
+
+   return e;
+}
@@ -714,6 +714,9 @@ static SLang_Intrin_Var_Type Emis_Intrin_Vars [] = /*{{{*/
    MAKE_VARIABLE("Use_Memory", &EM_Use_Memory, SLANG_UINT_TYPE, 0),
    MAKE_VARIABLE("Incomplete_Line_List", &EM_Maybe_Missing_Lines, SLANG_INT_TYPE, 0),
    MAKE_VARIABLE("EM_Hash_Table_Size_Hint", &EM_Hash_Table_Size_Hint, SLANG_UINT_TYPE, 0),
+   MAKE_VARIABLE("EM_Line_Cache_Size", &EM_Line_Cache_Size, SLANG_UINT_TYPE, 0),
+   MAKE_VARIABLE("EM_Line_Cache_Hits", &EM_Line_Cache_Hits, SLANG_UINT_TYPE, 0),
+   MAKE_VARIABLE("EM_Line_Cache_Misses", &EM_Line_Cache_Misses, SLANG_UINT_TYPE, 0),
    SLANG_END_INTRIN_VAR_TABLE
 };
 
@@ -132,51 +132,112 @@ static int examine_fit_statistic (Param_t *pt, unsigned int idx, double p, doubl
 
 enum
 {
-   USE_QUADRATIC = 0,
-   USE_LINEAR    = 1,
-   USE_BISECT    = 2,
+   USE_SECANT    = 0,
+   USE_BISECT    = 1,
    MAX_BRACKET_TRIES = 30,
-   MAX_CONVERGE_TRIES = 30
+   MAX_CONVERGE_TRIES = 30,
+   MAX_PROBE_TRIES = 8
 };
 
-static int interp_par (int mode, Sample_Type *a, Sample_Type *b, /*{{{*/
+/* smallest statistic change, relative to the target, that
+ * predict_limit trusts for a curvature estimate */
+#define PROBE_MIN_DSTAT  1.e-2
+
+static double stat_distance (double chisqr, double min_chisqr) /*{{{*/
+{
+   double d = chisqr - min_chisqr;
+
+   /* Near the minimum, the fit-statistic grows quadratically
+    * with the distance from the best-fit parameter value,
+    * so sqrt(chisqr - min_chisqr) is nearly linear in the parameter.
+    */
+   return (d > 0.0) ? sqrt (d) : 0.0;
+}
+
+/*}}}*/
+
+static int interp_par (int mode, Sample_Type *a, Sample_Type *b, Sample_Type *c, /*{{{*/
                        double min_chisqr, double target_chisqr,
                        double *ptest, Fit_Param_t *par)
 {
-   double r, factor;
+   double r, sa, sb, sc, st;
    int i;
 
+   sa = stat_distance (a->chisqr, min_chisqr);
+   sb = stat_distance (b->chisqr, min_chisqr);
+   st = stat_distance (target_chisqr, min_chisqr);
+
    switch (mode)
      {
       case USE_BISECT:
-        *ptest = 0.5 * (a->v + b->v);
-        for (i = 0; i < par->npars; i++)
-          par->par[i] = 0.5 * (a->par[i] + b->par[i]);
-        mode = USE_LINEAR;
-        break;
-
-      case USE_LINEAR:
-        r = (target_chisqr - b->chisqr) / (a->chisqr - b->chisqr);
-        *ptest = r * a->v + (1.0 - r) * b->v;
-        factor = 1-r;
-        for (i = 0; i < par->npars; i++)
-          par->par[i] = r * a->par[i] + (1.0 - r) * b->par[i];
+        r = 0.5;
+        mode = USE_SECANT;
         break;
 
-      case USE_QUADRATIC:
-        factor = sqrt ((target_chisqr - min_chisqr)/(a->chisqr - min_chisqr));
-        *ptest = b->v + (a->v - b->v)*factor;
-        for (i = 0; i < par->npars; i++)
-          par->par[i] = b->par[i] + (a->par[i] - b->par[i]) * factor;
-        mode = USE_LINEAR;
+      default:
+        /* secant step on the square-root of the statistic */
+        r = (st - sb) / (sa - sb);
+        /* with a third sample, try inverse quadratic interpolation
+         * but keep the secant step if it leaves the bracket */
+        if (c != NULL)
+          {
+             sc = stat_distance (c->chisqr, min_chisqr);
+             if ((sc != sa) && (sc != sb))
+               {
+                  double p, rq;
+                  p = (a->v * (st - sb) * (st - sc) / ((sa - sb) * (sa - sc))
+                       + b->v * (st - sa) * (st - sc) / ((sb - sa) * (sb - sc))
+                       + c->v * (st - sa) * (st - sb) / ((sc - sa) * (sc - sb)));
+                  rq = (p - b->v) / (a->v - b->v);
+                  if ((0.0 < rq) && (rq < 1.0))
+                    r = rq;
+               }
+          }
         break;
      }
 
+   if (!((0.0 < r) && (r < 1.0)))
+     r = 0.5;
+
+   *ptest = b->v + r * (a->v - b->v);
+   for (i = 0; i < par->npars; i++)
+     par->par[i] = r * a->par[i] + (1.0 - r) * b->par[i];
+
    return mode;
 }
 
 /*}}}*/
 
+static double extrapolate_par (double pbest, double ptest, double prange, /*{{{*/
+                               double chisqr, Search_Info_Type *sinfo)
+{
+   double dchisqr, factor, pnext;
+
+   /* Try to avoid the endpoint if possible */
+   pnext = 0.5 * (prange + ptest);
+
+   /* If the statistic has grown measurably, assume it grows
+    * quadratically and aim a little past the target, so the
+    * next step is likely to bracket it.
+    */
+   dchisqr = chisqr - sinfo->min_chisqr;
+   if (dchisqr <= sinfo->tolerance * sinfo->delt)
+     return pnext;
+
+   factor = 1.1 * sqrt (sinfo->delt / dchisqr);
+   if (factor > 4.0)
+     factor = 4.0;
+
+   ptest = pbest + (ptest - pbest) * factor;
+
+   if (fabs(ptest - pbest) < fabs(pnext - pbest))
+     return ptest;
+
+   return pnext;
+}
+
+/*}}}*/
+
 static int bracket_target (Param_t *pt, int idx, double *conf_limit, /*{{{*/
                            double pbest, double ptest, double prange,
                            Sample_Type *a, Sample_Type *b,
@@ -224,8 +285,7 @@ static int bracket_target (Param_t *pt, int idx, double *conf_limit, /*{{{*/
         for (i = 0; i < par->npars; i++)
           b->par[i] = par->par[i];
 
-        /* Try to avoid the endpoint if possible */
-        ptest = 0.5 * (prange + ptest);
+        ptest = extrapolate_par (pbest, ptest, prange, chisqr, sinfo);
         status = examine_fit_statistic (pt, idx, ptest, &chisqr, sinfo, fo);
         if (status != EVAL_OK)
           {
@@ -258,9 +318,10 @@ static int find_limit (double *conf_limit, unsigned int idx, /*{{{*/
    Fit_Info_Type *info = fo->info;
    double test, chisqr, target_chisqr, accept_tol;
    int i, k, count, status, verbose;
-   Sample_Type a, b;
+   Sample_Type a, b, c;
    Fit_Param_t *par;
-   int mode = USE_QUADRATIC;
+   int have_c = 0;
+   int mode = USE_SECANT;
 
    /* on input:
     *  pbest = best fit parameter value (corresponding to min_chisqr),
@@ -333,7 +394,8 @@ static int find_limit (double *conf_limit, unsigned int idx, /*{{{*/
              goto finish;
           }
 
-        mode = interp_par (mode, &a, &b, sinfo->min_chisqr, target_chisqr, &ptest, par);
+        mode = interp_par (mode, &a, &b, have_c ? &c : NULL,
+                           sinfo->min_chisqr, target_chisqr, &ptest, par);
         status = examine_fit_statistic (pt, idx, ptest, &chisqr, sinfo, fo);
         if (status != EVAL_OK)
           {
@@ -354,6 +416,11 @@ static int find_limit (double *conf_limit, unsigned int idx, /*{{{*/
              update = &b;
           }
 
+        /* keep the displaced sample for inverse quadratic interpolation */
+        c.v = update->v;
+        c.chisqr = update->chisqr;
+        have_c = 1;
+
         update->v = ptest;
         update->chisqr = chisqr;
         for (i = 0; i < par->npars; i++)
@@ -429,6 +496,91 @@ static int find_limit (double *conf_limit, unsigned int idx, /*{{{*/
 
 /*}}}*/
 
+static double param_probe_step (Param_t *pt, int idx, double pbest) /*{{{*/
+{
+   Param_Info_t *p = Fit_param_info (pt, idx);
+   double scale = (pbest == 0.0) ? 1.0 : fabs(pbest);
+
+   /* the same step the fit uses for numerical derivatives */
+   if (p != NULL)
+     {
+        if (p->step > 0.0)
+          return p->step;
+        if (p->relstep > 0.0)
+          return p->relstep * scale;
+     }
+
+   return Isis_Default_Relstep * scale;
+}
+
+/*}}}*/
+
+static double predict_limit (Fit_Object_Type *fo, Param_t *pt, int idx, /*{{{*/
+                             double pbest, double prange, double pdefault,
+                             Search_Info_Type *sinfo)
+{
+   double h, hmax, chisqr, dchisqr, ptest;
+   int k;
+
+   /* Estimate the curvature of the fit-statistic from one
+    * evaluation near the minimum, with the other parameters held
+    * at their best-fit values, and use a quadratic approximation
+    * to predict where the statistic reaches the target.
+    * Because the other parameters aren't re-optimized, the
+    * curvature is overestimated and the prediction tends to
+    * fall short of the limit, so bracket_target can then
+    * extrapolate outward from it.
+    *
+    * The probe starts at the fit's parameter step and grows
+    * until the statistic changes by a measurable fraction of
+    * the target, so that it stays within the quadratic region
+    * however wide the parameter limits are.
+    */
+
+   hmax = 0.5 * (prange - pbest);
+   if (hmax == 0.0)
+     return pdefault;
+
+   h = param_probe_step (pt, idx, pbest);
+   if (hmax < 0.0)
+     h = -h;
+
+   dchisqr = 0.0;
+
+   for (k = 0; k < MAX_PROBE_TRIES; k++)
+     {
+        if (fabs(h) > fabs(hmax))
+          h = hmax;
+
+        Fit_set_param_value (pt, idx, pbest + h);
+        if (-1 == fit_statistic (fo, 0, &chisqr, NULL))
+          chisqr = sinfo->min_chisqr;
+        Fit_set_param_value (pt, idx, pbest);
+
+        dchisqr = chisqr - sinfo->min_chisqr;
+        if ((dchisqr <= 0.0) || (0 == isfinite (dchisqr)))
+          return pdefault;
+
+        if ((dchisqr >= PROBE_MIN_DSTAT * sinfo->delt) || (h == hmax))
+          break;
+
+        h *= 10.0;
+     }
+
+   if (dchisqr < PROBE_MIN_DSTAT * sinfo->delt)
+     return pdefault;
+
+   ptest = pbest + h * sqrt (sinfo->delt / dchisqr);
+
+   /* keep the default if the prediction is no closer */
+   if (fabs(ptest - pbest) >= fabs(pdefault - pbest))
+     return pdefault;
+
+   return ptest;
+}
+
+/*}}}*/
+
 static Param_Info_t *get_valid_param_info (Param_t *pt, int idx) /*{{{*/
 {
    Param_Info_t *p;
@@ -488,8 +640,8 @@ static int init_conf_limit_search (Param_t *pt, int idx, /*{{{*/
 
 /*}}}*/
 
-int get_confidence_limits (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *ctrl,  /*{{{*/
-                           int idx, double *pconf_min, double *pconf_max)
+static int search_confidence_limits (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *ctrl,  /*{{{*/
+                                     int idx, double *pconf_min, double *pconf_max, int *status)
 {
    Search_Info_Type sinfo;
    Param_Info_t *par_info = NULL;
@@ -555,6 +707,7 @@ int get_confidence_limits (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *
 
    /* Search for the lower limit */
    pstart = 0.5 * (pbest + par_info->min);
+   pstart = predict_limit (fo, pt, idx, pbest, par_info->min, pstart, &sinfo);
 
    ret = find_limit (&conf_min, idx, pstart, par_info->min, pbest, &sinfo, fo, pt, "Lower");
    if (ret == EVAL_ERROR || ret == EVAL_FAILED)
@@ -575,6 +728,15 @@ int get_confidence_limits (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *
    pstart = pbest + 2.0*(pbest - conf_min);
    if (pstart >= par_info->max)
      pstart = 0.5 * (pbest + par_info->max);
+   else
+     {
+        /* start from the mirror image of the lower limit,
+         * unless the curvature estimate says to go farther */
+        double pmirror = pbest + (pbest - conf_min);
+        pstart = predict_limit (fo, pt, idx, pbest, par_info->max, pstart, &sinfo);
+        if (pstart < pmirror)
+          pstart = pmirror;
+     }
 
    ret = find_limit (&conf_max, idx, pstart, par_info->max, pbest, &sinfo, fo, pt, "Upper");
    if (ret == EVAL_ERROR || ret == EVAL_FAILED)
@@ -607,11 +769,153 @@ int get_confidence_limits (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *
 
    *pconf_min = conf_min;
    *pconf_max = conf_max;
+   *status = ret;
+
+   return 0;
+}
+
+/*}}}*/
+
+int get_confidence_limits (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *ctrl,  /*{{{*/
+                           int idx, double *pconf_min, double *pconf_max)
+{
+   int status;
+   return search_confidence_limits (fo, pt, ctrl, idx, pconf_min, pconf_max, &status);
+}
+
+/*}}}*/
+
+static int refit_params (Fit_Object_Type *fo, Param_t *pt, double *stat) /*{{{*/
+{
+   if (-1 == fit_object_config (fo, pt, 1))
+     return -1;
+
+   if (-1 == fit_statistic (fo, 1, stat, NULL))
+     return -1;
+
+   /* the optimizer leaves the best-fit values packed in info->par */
+   if (-1 == Fit_unpack_variable_params (pt, fo->info->par->par))
+     return -1;
 
    return 0;
 }
 
 /*}}}*/
 
+int get_confidence_limit_list (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *ctrl,  /*{{{*/
+                               int *idx, unsigned int num, unsigned int max_restarts,
+                               unsigned int max_param_retries,
+                               double *pconf_min, double *pconf_max)
+{
+   unsigned int *order = NULL;
+   char *done = NULL;
+   unsigned int i, k, num_restarts = 0;
+   int ret = -1;
+
+   /* Search for the confidence limits of each parameter in turn,
+    * sharing one fit object and the responses already loaded.
+    * As in conf_loop, when a search fails or turns up a better
+    * fit (pmin == pmax), refit and retry that parameter up to
+    * max_param_retries times.  A parameter that needed a refit
+    * is moved to the front of the list, so that repeated failures
+    * show up as early as possible, and every search is repeated
+    * from the new minimum.  At most max_restarts refits are done
+    * in all.
+    */
+
+   if ((fo == NULL) || (ctrl == NULL) || (idx == NULL)
+       || (pconf_min == NULL) || (pconf_max == NULL))
+     return -1;
+
+   if (num == 0)
+     return 0;
+
+   if ((NULL == (order = (unsigned int *) ISIS_MALLOC (num * sizeof(unsigned int))))
+       || (NULL == (done = (char *) ISIS_MALLOC (num * sizeof(char)))))
+     goto free_and_return;
+
+   for (i = 0; i < num; i++)
+     {
+        order[i] = i;
+        done[i] = 0;
+        if (0 != Fit_get_param_value (pt, idx[i], &pconf_min[i]))
+          goto free_and_return;
+        pconf_max[i] = pconf_min[i];
+     }
+
+   k = 0;
+   while (k < num)
+     {
+        unsigned int j = order[k];
+        unsigned int num_param_retries = 0;
+
+        if (done[j])
+          {
+             k++;
+             continue;
+          }
+
+        for (;;)
+          {
+             int status = EVAL_OK;
+             double stat;
+
+             if (-1 == search_confidence_limits (fo, pt, ctrl, idx[j],
+                                                 &pconf_min[j], &pconf_max[j], &status))
+               goto free_and_return;
+
+             if (SLang_get_error())
+               goto free_and_return;
+
+             if (pconf_min[j] != pconf_max[j])
+               break;
+
+             /* the search failed or found a better fit -- refit */
+             if (num_restarts == max_restarts)
+               {
+                  isis_vmesg (FAIL, I_WARNING, __FILE__, __LINE__,
+                              "confidence limit search: giving up after %u restarts", num_restarts);
+                  goto free_and_return;
+               }
+             num_restarts++;
+
+             if (-1 == refit_params (fo, pt, &stat))
+               goto free_and_return;
+
+             if (ctrl->verbose >= 0)
+               verbose_warn_hook (NULL, "Restarting confidence limit search from stat= %0.6g\n", stat);
+
+             if (++num_param_retries > max_param_retries)
+               break;
+          }
+
+        done[j] = 1;
+
+        if (num_param_retries == 0)
+          {
+             k++;
+             continue;
+          }
+
+        /* param[j] needed a refit -- move it to the front */
+        for (i = k; i > 0; i--)
+          order[i] = order[i-1];
+        order[0] = j;
+
+        memset ((char *)done, 0, num * sizeof(char));
+        k = 0;
+     }
+
+   ret = 0;
+
+   free_and_return:
+   ISIS_FREE (order);
+   ISIS_FREE (done);
+
+   return ret;
+}
+
+/*}}}*/
+
 /*}}}*/
 
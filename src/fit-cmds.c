@@ -35,6 +35,7 @@
 #include <float.h>
 #include <limits.h>
 #include <errno.h>
+#include <ctype.h>
 
 #ifdef HAVE_STDLIB_H
 #  include <stdlib.h>
@@ -48,6 +49,8 @@
 #include "fit.h"
 #include "_isis.h"
 #include "errors.h"
+#include "threads.h"
+#include "statsum.h"
 
 /*}}}*/
 
@@ -91,10 +94,13 @@ static enum Mode_type
 }
 Mode = BIN_EVAL_MODE;
 
+typedef struct Native_Model_Type Native_Model_Type;
+
 typedef struct
 {
    SLang_Name_Type *fun_ptr;    /* function pointer */
    char *fun_string;            /* definition string */
+   Native_Model_Type *native;   /* compiled evaluator, or NULL */
 }
 User_Function_Type;
 
@@ -117,11 +123,40 @@ struct Fit_Data_t
    double *data;
    double *weight;
    double *tmp;
+   double *src_at;                      /* [nbins] scaling vectors */
+   double *bkg_at;                      /* [nbins] */
+   int *have_scaling;                   /* [num_datasets] */
    int nbins;
    int num_datasets;
    int nbins_after_datasets_combined;
+   Isis_Arena_Type *arena[ISIS_MAX_THREADS];    /* scratch space per thread */
+   double *values[ISIS_MAX_THREADS];            /* parameter values per context */
+   unsigned int num_values[ISIS_MAX_THREADS];
 };
 
+typedef struct Multi_Model_Info_Type Multi_Model_Info_Type;
+
+/* Everything needed to evaluate and fold the model for one
+ * parameter vector.  Each evaluation carries its own context,
+ * including its own parameter values, so that evaluations which
+ * do not call into the S-Lang interpreter may run concurrently.
+ * The parameter table is shared, and only read.
+ */
+typedef struct
+{
+   Fit_Data_t *d;                       /* datasets being fit */
+   Hist_t *h;                           /* dataset being evaluated */
+   Isis_Hist_t grid;                    /* model evaluation grid */
+   Param_t *param;                      /* parameter table */
+   int (*unpack)(Param_t *, double *);
+   double *values;                      /* parameter values, by index */
+   int store_model;                     /* boolean */
+   Multi_Model_Info_Type *multi;        /* see compute_models() */
+   Isis_Arena_Type *arena;              /* scratch space */
+   int in_thread;                       /* boolean: no S-Lang calls */
+}
+Eval_Context_Type;
+
 static int Response_Type = USE_ASSIGNED_ARF_RMF;
 
 static char *Fit_Method;
@@ -130,6 +165,7 @@ static SLang_Name_Type *Fit_Constraint;
 static SLang_Name_Type *Fit_Range_Hook;
 static SLang_Name_Type *Define_Model_Hook;
 static Fit_Data_t *Current_Fit_Data_Info;
+static Isis_Arena_Type *Scratch_Arena;
 
 static Kernel_Table_t _Kernel_Table;
 static Kernel_Table_t *Kernel_Table = &_Kernel_Table;
@@ -138,6 +174,7 @@ static Isis_Hist_t Eval_Grid;
 static Isis_User_Grid_t Differential_Grid;
 
 static int Fit_Verbose;
+static int Fit_Num_Threads = 1;
 static int Fit_Store_Model;
 static int Use_Interactive_Param_Init;
 static int Looking_For_Confidence_Limits;
@@ -156,6 +193,12 @@ static int push_kernel (Kernel_Table_t *t, unsigned int hist_index,
 static int pop_kernel (Kernel_Table_t *t, unsigned int hist_index, Kernel_Info_t *ki);
 static Cached_Grid_Type *find_cached_grid (Cached_Grid_Type *t, unsigned int type, unsigned int id);
 static void cached_models_need_updating (Fit_Data_t *d);
+static Native_Model_Type *compile_native_model (char *def);
+static void free_native_model (Native_Model_Type *nm);
+static int eval_native_user_model (Isis_Hist_t *g, double *param_values);
+static int eval_native_model (Native_Model_Type *nm, Isis_Hist_t *g, double *param_values,
+                              Isis_Arena_Type *arena);
+static int native_user_model_is_thread_safe (void);
 
 /*}}}*/
 
@@ -166,6 +209,85 @@ static Isis_Hist_t *get_evaluation_grid (void) /*{{{*/
 
 /*}}}*/
 
+/* Temporaries needed while evaluating the model come from an
+ * arena belonging to the fit, one per evaluation thread, so that
+ * repeated evaluations don't allocate memory.  Outside a fit,
+ * a single arena is shared.
+ */
+static Isis_Arena_Type *get_scratch_arena (Fit_Data_t *d, unsigned int thread) /*{{{*/
+{
+   Isis_Arena_Type **pa = (d != NULL) ? &d->arena[thread] : &Scratch_Arena;
+
+   if (*pa == NULL)
+     *pa = isis_new_arena ();
+
+   return *pa;
+}
+
+/*}}}*/
+
+/* Like the arenas, the parameter values of each context belong
+ * to the fit, and grow with the parameter table.
+ */
+static double *get_param_values (Fit_Data_t *d, unsigned int slot) /*{{{*/
+{
+   unsigned int n;
+
+   if (d == NULL)
+     return NULL;
+
+   if (0 == (n = Fit_num_param_values (Param)))
+     n = 1;
+
+   if (n > d->num_values[slot])
+     {
+        double *v;
+        if (NULL == (v = (double *) ISIS_REALLOC (d->values[slot], n * sizeof(double))))
+          return NULL;
+        d->values[slot] = v;
+        d->num_values[slot] = n;
+     }
+
+   return d->values[slot];
+}
+
+/*}}}*/
+
+static void init_eval_context (Eval_Context_Type *ctx) /*{{{*/
+{
+   memset ((char *)ctx, 0, sizeof (*ctx));
+   ctx->d = Current_Fit_Data_Info;
+   ctx->param = Param;
+   ctx->unpack = Unpack;
+   ctx->values = get_param_values (ctx->d, 0);
+   ctx->store_model = Fit_Store_Model;
+   ctx->arena = get_scratch_arena (ctx->d, 0);
+}
+
+/*}}}*/
+
+/* The trial parameters are unpacked into the values of the
+ * context.  On the main thread, they're also unpacked into the
+ * table, so that S-Lang code run during the evaluation, e.g. the
+ * fit-function or a derived parameter, sees them.
+ */
+static int unpack_context_params (Eval_Context_Type *ctx, double *par) /*{{{*/
+{
+   if (ctx->values == NULL)
+     return -1;
+
+   if (ctx->in_thread)
+     return Fit_unpack_param_values (ctx->param, (ctx->unpack == &Fit_unpack_all_params),
+                                     par, ctx->values);
+
+   if (-1 == (*ctx->unpack)(ctx->param, par))
+     return -1;
+
+   return Fit_save_param_values (ctx->param, ctx->values);
+}
+
+/*}}}*/
+
 static int map_datasets (int (*fun)(Hist_t *, void *), void *cl) /*{{{*/
 {
    enum {check_exclude = 1};
@@ -415,6 +537,8 @@ static void reset_user_function (void) /*{{{*/
 static void free_user_function (void) /*{{{*/
 {
    ISIS_FREE (User_Function.fun_string);
+   free_native_model (User_Function.native);
+   User_Function.native = NULL;
 }
 
 /*}}}*/
@@ -423,6 +547,8 @@ static void delete_user_model (void) /*{{{*/
 {
    ISIS_FREE(User_Function.fun_string);
    User_Function.fun_ptr = NULL;
+   free_native_model (User_Function.native);
+   User_Function.native = NULL;
 }
 
 /*}}}*/
@@ -1377,10 +1503,262 @@ static int call_fitfun_trace_hook (Fit_Fun_t *ff, int fun_id, double *par) /*{{{
 
 /*}}}*/
 
+/* During a fit, the binned values of compiled components are cached,
+ * keyed by the parameter values and the noticed bins of the
+ * evaluation grid, so that a component whose parameters did not
+ * change (e.g. in a finite-difference derivative step for another
+ * component) is not re-evaluated.  A few sets of parameter values
+ * are kept for each component and grid, so that the base point of
+ * the derivative steps stays cached.
+ */
+typedef struct Component_Cache_Type Component_Cache_Type;
+struct Component_Cache_Type
+{
+   Component_Cache_Type *next;
+   unsigned int fun_type;
+   unsigned int fun_id;
+   unsigned int nparams;
+   int n_notice;
+   double *par;                 /* [nparams] */
+   double *bin_lo;              /* [n_notice] noticed grid bins */
+   double *bin_hi;              /* [n_notice] */
+   double *val;                 /* [n_notice] */
+   unsigned long last_use;
+};
+
+#define COMPONENT_CACHE_SLOTS    2
+#define COMPONENT_CACHE_MAX_SIZE (1 << 23)   /* doubles */
+
+static Component_Cache_Type *Component_Cache;
+static unsigned long Component_Cache_Clock;
+static unsigned long Component_Cache_Size;
+static int Fit_Cache_Components = 1;
+
+static void free_component_cache (void) /*{{{*/
+{
+   while (Component_Cache != NULL)
+     {
+        Component_Cache_Type *next = Component_Cache->next;
+        ISIS_FREE (Component_Cache->par);
+        ISIS_FREE (Component_Cache);
+        Component_Cache = next;
+     }
+
+   Component_Cache_Size = 0;
+}
+
+/*}}}*/
+
+static int can_cache_component (Fit_Fun_t *ff, SLang_Struct_Type *qualifiers) /*{{{*/
+{
+   /* Operators depend on their input, and the result of
+    * an S-Lang function may depend on anything at all.
+    * Compiled functions may depend on external state too,
+    * unless they say otherwise. */
+   return (Fit_Cache_Components != 0)
+     && (Current_Fit_Data_Info != NULL)
+     && (qualifiers == NULL)
+     && (ff->trace_hook == NULL)
+     && (ff->s.category == ISIS_FUN_ADDMUL)
+     && Fit_fun_is_compiled (ff)
+     && (ff->s.cacheable != 0);
+}
+
+/*}}}*/
+
+static int cached_component_grid_matches (Component_Cache_Type *c, Isis_Hist_t *g) /*{{{*/
+{
+   int i;
+
+   if (c->n_notice != g->n_notice)
+     return 0;
+
+   for (i = 0; i < c->n_notice; i++)
+     {
+        int n = g->notice_list[i];
+        if ((c->bin_lo[i] != g->bin_lo[n]) || (c->bin_hi[i] != g->bin_hi[n]))
+          return 0;
+     }
+
+   return 1;
+}
+
+/*}}}*/
+
+static unsigned int num_params_changed (Component_Cache_Type *c, double *par) /*{{{*/
+{
+   unsigned int k, num = 0;
+
+   for (k = 0; k < c->nparams; k++)
+     {
+        if (c->par[k] != par[k])
+          num++;
+     }
+
+   return num;
+}
+
+/*}}}*/
+
+static Component_Cache_Type *find_cached_component (Fit_Fun_t *ff, unsigned int fun_id, /*{{{*/
+                                                    double *par, Isis_Hist_t *g)
+{
+   Component_Cache_Type *c;
+
+   for (c = Component_Cache; c != NULL; c = c->next)
+     {
+        if ((c->fun_type == ff->fun_type)
+            && (c->fun_id == fun_id)
+            && (0 == num_params_changed (c, par))
+            && cached_component_grid_matches (c, g))
+          {
+             c->last_use = ++Component_Cache_Clock;
+             return c;
+          }
+     }
+
+   return NULL;
+}
+
+/*}}}*/
+
+static int push_cached_component (Component_Cache_Type *c) /*{{{*/
+{
+   SLang_Array_Type *at;
+   SLindex_Type n = c->n_notice;
+
+   if (NULL == (at = SLang_create_array (SLANG_DOUBLE_TYPE, 0, NULL, &n, 1)))
+     return -1;
+
+   memcpy ((char *)at->data, (char *)c->val, n * sizeof(double));
+
+   return SLang_push_array (at, 1);
+}
+
+/*}}}*/
+
+static Component_Cache_Type *new_cached_component (Fit_Fun_t *ff, unsigned int fun_id, int n_notice) /*{{{*/
+{
+   Component_Cache_Type *c;
+   unsigned long size = ff->nparams + 3 * n_notice + 1;
+
+   if (Component_Cache_Size + size > COMPONENT_CACHE_MAX_SIZE)
+     free_component_cache ();
+
+   if (NULL == (c = (Component_Cache_Type *) ISIS_MALLOC (sizeof *c)))
+     return NULL;
+   memset ((char *)c, 0, sizeof *c);
+
+   /* one allocation for all the arrays */
+   if (NULL == (c->par = (double *) ISIS_MALLOC (size * sizeof(double))))
+     {
+        ISIS_FREE (c);
+        return NULL;
+     }
+
+   c->fun_type = ff->fun_type;
+   c->fun_id = fun_id;
+   c->nparams = ff->nparams;
+   c->n_notice = n_notice;
+   c->bin_lo = c->par + ff->nparams;
+   c->bin_hi = c->bin_lo + n_notice;
+   c->val = c->bin_hi + n_notice;
+
+   c->next = Component_Cache;
+   Component_Cache = c;
+   Component_Cache_Size += size;
+
+   return c;
+}
+
+/*}}}*/
+
+static Component_Cache_Type *reusable_cached_component (Fit_Fun_t *ff, unsigned int fun_id, /*{{{*/
+                                                        double *par, Isis_Hist_t *g)
+{
+   Component_Cache_Type *c, *victim = NULL;
+   unsigned int num_slots = 0, victim_changed = 0;
+
+   /* In a derivative step, the new parameters differ from the
+    * base point in one value.  So, replace the entry which differs
+    * the most, or else the least recently used one.
+    */
+   for (c = Component_Cache; c != NULL; c = c->next)
+     {
+        unsigned int changed;
+
+        if ((c->fun_type != ff->fun_type)
+            || (c->fun_id != fun_id)
+            || (0 == cached_component_grid_matches (c, g)))
+          continue;
+
+        num_slots++;
+        changed = num_params_changed (c, par);
+
+        if ((victim == NULL)
+            || (changed > victim_changed)
+            || ((changed == victim_changed) && (c->last_use < victim->last_use)))
+          {
+             victim = c;
+             victim_changed = changed;
+          }
+     }
+
+   if (num_slots < COMPONENT_CACHE_SLOTS)
+     return new_cached_component (ff, fun_id, g->n_notice);
+
+   return victim;
+}
+
+/*}}}*/
+
+static void store_component_value (Fit_Fun_t *ff, unsigned int fun_id, /*{{{*/
+                                   double *par, Isis_Hist_t *g, double *val)
+{
+   Component_Cache_Type *c;
+   int i;
+
+   if (NULL == (c = reusable_cached_component (ff, fun_id, par, g)))
+     return;
+
+   if (ff->nparams > 0)
+     memcpy ((char *)c->par, (char *)par, ff->nparams * sizeof(double));
+   for (i = 0; i < g->n_notice; i++)
+     {
+        int n = g->notice_list[i];
+        c->bin_lo[i] = g->bin_lo[n];
+        c->bin_hi[i] = g->bin_hi[n];
+     }
+   memcpy ((char *)c->val, (char *)val, g->n_notice * sizeof(double));
+   c->last_use = ++Component_Cache_Clock;
+}
+
+/*}}}*/
+
+static void cache_component_value (Fit_Fun_t *ff, unsigned int fun_id, /*{{{*/
+                                   double *par, Isis_Hist_t *g)
+{
+   SLang_Array_Type *at = NULL;
+
+   /* the value is on top of the stack */
+   if (-1 == SLang_pop_array_of_type (&at, SLANG_DOUBLE_TYPE))
+     return;
+
+   if (at->num_elements == (SLuindex_Type) g->n_notice)
+     store_component_value (ff, fun_id, par, g, (double *) at->data);
+
+   (void) SLang_push_array (at, 1);
+}
+
+/*}}}*/
+
 static int bin_eval (Fit_Fun_t *ff, unsigned int fun_id, unsigned int num_extra_args, SLang_Struct_Type *qualifiers) /*{{{*/
 {
+   Isis_Arena_Type *a;
    double *par = NULL;
    Isis_Hist_t *g;
+   size_t mark;
+   int use_cache, ret = -1;
 
    (void) num_extra_args;
 
@@ -1399,31 +1777,45 @@ static int bin_eval (Fit_Fun_t *ff, unsigned int fun_id, unsigned int num_extra_
         return -1;
      }
 
+   if (NULL == (a = get_scratch_arena (Current_Fit_Data_Info, 0)))
+     return -1;
+   mark = isis_arena_mark (a);
+
    if (ff->nparams)
      {
-        par = (double *) ISIS_MALLOC (ff->nparams * sizeof(double));
-        if (NULL == par)
-          return -1;
+        par = (double *) isis_arena_alloc (a, ff->nparams * sizeof(double));
+        if ((NULL == par)
+            || (-1 == Fit_get_fun_params (Param, ff->fun_type, fun_id, par)))
+          goto finish;
+     }
+   else par = NULL;
 
-        if (-1 == Fit_get_fun_params (Param, ff->fun_type, fun_id, par))
+   use_cache = can_cache_component (ff, qualifiers);
+   if (use_cache)
+     {
+        Component_Cache_Type *c;
+        if (NULL != (c = find_cached_component (ff, fun_id, par, g)))
           {
-             ISIS_FREE (par);
-             return -1;
+             ret = push_cached_component (c);
+             goto finish;
           }
      }
-   else par = NULL;
 
    if (((ff->trace_hook != NULL)
         && (-1 == call_fitfun_trace_hook (ff, fun_id, par)))
        || (-1 == (*ff->bin_eval_method)(ff, g, par, qualifiers)))
      {
         SLang_push_double (1.0);
-        ISIS_FREE (par);
-        return -1;
+        goto finish;
      }
 
-   ISIS_FREE (par);
-   return 0;
+   if (use_cache)
+     cache_component_value (ff, fun_id, par, g);
+
+   ret = 0;
+   finish:
+   isis_arena_release (a, mark);
+   return ret;
 }
 /*}}}*/
 
@@ -1758,8 +2150,12 @@ static int do_define_user_model (char *fun_body) /*{{{*/
    if (-1 == reset_param_lookup_table (&Param))
      return -1;
 
+   free_component_cache ();
+
    if ((fun_body == NULL) || (NULL == f))
      return -1;
+   free_native_model (f->native);
+   f->native = NULL;
    ISIS_FREE (f->fun_string);
    if (NULL == (f->fun_string = isis_make_string (fun_body)))
      return -1;
@@ -1783,6 +2179,9 @@ static int do_define_user_model (char *fun_body) /*{{{*/
    if (-1 == register_constraint_pars ())
      return -1;
 
+   /* NULL if the S-Lang interpreter is needed */
+   f->native = compile_native_model (fun_body);
+
    return 0;
 }
 
@@ -1943,16 +2342,35 @@ static SLang_Name_Type *prep_model_eval_for_dataset (Hist_t *h) /*{{{*/
 
 /*}}}*/
 
-static int eval_model_using_global_grid (Hist_t *h, Isis_Hist_t *g) /*{{{*/
+static int eval_model_using_global_grid (Hist_t *h, Isis_Hist_t *g, void *cl) /*{{{*/
 {
    SLang_Name_Type *fun_ptr;
+   Isis_Hist_t save_g;
+   int ret;
+
+   if (NULL == Hist_assigned_model (h))
+     {
+        save_g = Eval_Grid;
+        Eval_Grid = *g;
+        ret = eval_native_user_model (g, ((Eval_Context_Type *)cl)->values);
+        Eval_Grid = save_g;
+        if (ret != 1)
+          return ret;
+     }
 
    if (NULL == (fun_ptr = prep_model_eval_for_dataset (h)))
      return -1;
 
+   /* S-Lang models are evaluated on the global grid */
+   save_g = Eval_Grid;
+   Eval_Grid = *g;
+
    SLexecute_function (fun_ptr);
+   ret = pop_model_result (g);
 
-   return pop_model_result (g);
+   Eval_Grid = save_g;
+
+   return ret;
 }
 
 /*}}}*/
@@ -1967,9 +2385,10 @@ static double *temp_workspace_for_eval (Isis_Hist_t *g) /*{{{*/
 
 /*}}}*/
 
-static int eval_model_using_cached_grid (Hist_t *h, Isis_Hist_t *g) /*{{{*/
+static int eval_model_using_cached_grid (Hist_t *h, Isis_Hist_t *g, void *cl) /*{{{*/
 {
-   Fit_Data_t *d = Current_Fit_Data_Info;
+   Eval_Context_Type *ctx = (Eval_Context_Type *)cl;
+   Fit_Data_t *d = ctx->d;
    Hist_Eval_Grid_Method_Type *egm;
    Cached_Grid_Type *m;
    Isis_Hist_t *x;
@@ -1982,15 +2401,8 @@ static int eval_model_using_cached_grid (Hist_t *h, Isis_Hist_t *g) /*{{{*/
 
    if (m->updated_cached_model_values == 0)
      {
-        Isis_Hist_t tmp;
-        int ret;
-
-        /* FIXME!!! This is ugly. */
-        tmp = *g;
-        *g = m->grid;
-        ret = eval_model_using_global_grid (h, g);
-        *g = tmp;
-        if (ret == -1) return -1;
+        if (-1 == eval_model_using_global_grid (h, &m->grid, cl))
+          return -1;
 
         m->updated_cached_model_values = 1;
      }
@@ -2009,30 +2421,42 @@ static int eval_model_using_cached_grid (Hist_t *h, Isis_Hist_t *g) /*{{{*/
 
 /*}}}*/
 
-static int evaluate_model (Isis_Hist_t *g) /*{{{*/
+static int evaluate_model (Isis_Hist_t *g, void *cl) /*{{{*/
 {/* Don't change the signature of this function without
   * changing the prototype of kernel->compute_kernel()
   * in isis.h
   */
-   Hist_t *h = Hist_Current;
+   Eval_Context_Type *ctx = (Eval_Context_Type *)cl;
    Hist_Eval_Grid_Method_Type *m;
+   Hist_t *h;
    int status;
 
-   /* global evaluation grid pointer should now point to
+   /* evaluation grid pointer should now point to
     * the source model grid (usually the arf grid)
     */
-   if (NULL == g)
+   if ((NULL == g) || (NULL == ctx))
      return -1;
 
+   h = ctx->h;
+
    if (NULL == (m = Hist_eval_grid_method (h)))
      return -1;
 
    if (m->eval_model == NULL)
      m->eval_model = &eval_model_using_global_grid;
 
-   status = (*m->eval_model)(h, g);
+   if (ctx->in_thread)
+     {
+        /* see can_eval_hist_model_in_thread() */
+        User_Function_Type *f = get_user_function ();
+        status = eval_native_model (f->native, g, ctx->values, ctx->arena);
+        if (status == 1)
+          status = -1;
+     }
+   else
+     status = (*m->eval_model)(h, g, ctx);
 
-   if (Fit_Store_Model)
+   if (ctx->store_model)
      {
         if (-1 == Hist_set_model (h, H_FLUX, g->val))
           return -1;
@@ -2243,14 +2667,15 @@ static int add_instrumental_background (double *cts, Hist_t *h, double *opt_bkg)
 
 /*}}}*/
 
-static int apply_response (double *result, Isis_Hist_t *g, Hist_t *h) /*{{{*/
+static int apply_response (Eval_Context_Type *ctx, double *result, Hist_t *h) /*{{{*/
 {
    Isis_Kernel_Def_t *def;
    Isis_Kernel_t *k;
    double *kp = NULL;
+   size_t mark;
    int hist_index, ret;
 
-   if (NULL == h || NULL == g || NULL == result)
+   if (NULL == ctx || NULL == h || NULL == result)
      return -1;
 
    k = Hist_get_kernel (h);
@@ -2260,26 +2685,54 @@ static int apply_response (double *result, Isis_Hist_t *g, Hist_t *h) /*{{{*/
    def = k->kernel_def;
    hist_index = Hist_get_index (h);
 
-   kp = Fit_get_kernel_params (Param, hist_index, def);
-   if ((NULL == kp) && (def->num_kernel_parms > 0))
-     return -1;
+   mark = isis_arena_mark (ctx->arena);
+
+   if (def->num_kernel_parms > 0)
+     {
+        if ((NULL == (kp = (double *) isis_arena_alloc (ctx->arena, def->num_kernel_parms * sizeof(double))))
+            || (-1 == Fit_copy_kernel_param_values (ctx->param, ctx->values, hist_index, def, kp)))
+          {
+             isis_arena_release (ctx->arena, mark);
+             return -1;
+          }
+     }
 
-   ret = k->compute_kernel (k, result, g, kp, def->num_kernel_parms,
-                            evaluate_model);
-   ISIS_FREE (kp);
+   ctx->h = h;
+   ret = k->compute_kernel (k, result, &ctx->grid, kp, def->num_kernel_parms,
+                            evaluate_model, ctx);
+   isis_arena_release (ctx->arena, mark);
 
    return ret;
 }
 
 /*}}}*/
 
-static int provide_opt_data (Hist_t *h, double *opt_bkg, /*{{{*/
+static int find_fit_dataset (Fit_Data_t *d, Hist_t *h, int offset) /*{{{*/
+{
+   int i;
+
+   if (d == NULL)
+     return -1;
+
+   for (i = 0; i < d->num_datasets; i++)
+     {
+        if ((d->datasets[i] == h) && (d->offsets[i] == offset))
+          return i;
+     }
+
+   return -1;
+}
+
+/*}}}*/
+
+static int provide_opt_data (Eval_Context_Type *ctx, Hist_t *h, double *opt_bkg, /*{{{*/
                              Isis_Fit_Statistic_Optional_Data_Type *opt_data,
                              int opt_data_offset)
 {
+   Fit_Data_t *d = ctx->d;
    double *src_at=NULL, *bkg_at=NULL, *binned_bkg;
    double *opt_src_at, *opt_bkg_at;
-   int nb;
+   int i, nb;
 
    if (opt_data == NULL)
      return 0;
@@ -2288,15 +2741,35 @@ static int provide_opt_data (Hist_t *h, double *opt_bkg, /*{{{*/
    if (-1 == Hist_apply_rebin_and_notice_list (binned_bkg, opt_bkg, h))
      return -1;
 
+   opt_src_at = opt_data->src_at + opt_data_offset;
+   opt_bkg_at = opt_data->bkg_at + opt_data_offset;
+
+   /* The scaling vectors don't change during a fit,
+    * so they're computed once per dataset.
+    */
+   i = find_fit_dataset (d, h, opt_data_offset);
+   if ((i >= 0) && d->have_scaling[i])
+     {
+        nb = Hist_num_data_noticed (h);
+        memcpy ((char *)opt_src_at, (char *)(d->src_at + opt_data_offset), nb * sizeof(double));
+        memcpy ((char *)opt_bkg_at, (char *)(d->bkg_at + opt_data_offset), nb * sizeof(double));
+        opt_data->num += nb;
+        return 0;
+     }
+
    if (-1 == Hist_scaling_vectors (h, 1, 1, &src_at, &bkg_at, &nb))
      return -1;
 
-   opt_src_at = opt_data->src_at + opt_data_offset;
    memcpy ((char *)opt_src_at, (char *)src_at, nb * sizeof(double));
-
-   opt_bkg_at = opt_data->bkg_at + opt_data_offset;
    memcpy ((char *)opt_bkg_at, (char *)bkg_at, nb * sizeof(double));
 
+   if ((i >= 0) && (opt_data_offset + nb <= d->nbins))
+     {
+        memcpy ((char *)(d->src_at + opt_data_offset), (char *)src_at, nb * sizeof(double));
+        memcpy ((char *)(d->bkg_at + opt_data_offset), (char *)bkg_at, nb * sizeof(double));
+        d->have_scaling[i] = 1;
+     }
+
    ISIS_FREE(src_at);
    ISIS_FREE(bkg_at);
 
@@ -2307,14 +2780,15 @@ static int provide_opt_data (Hist_t *h, double *opt_bkg, /*{{{*/
 
 /*}}}*/
 
-static int compute_hist_model (Hist_t *h, double *bincts, /*{{{*/
+static int compute_hist_model (Eval_Context_Type *ctx, Hist_t *h, double *bincts, /*{{{*/
                                Isis_Fit_Statistic_Optional_Data_Type *opt_data,
                                int opt_data_offset)
 {
-   Isis_Hist_t *g = NULL;
+   Isis_Hist_t *g = &ctx->grid;
    double *temp_cts = NULL;
    double *opt_bkg = NULL;
    int orig_nbins, temp_cts_size;
+   size_t mark;
    int ret = -1;
 
    if (-1 == (orig_nbins = Hist_orig_hist_size (h)))
@@ -2322,16 +2796,17 @@ static int compute_hist_model (Hist_t *h, double *bincts, /*{{{*/
 
    temp_cts_size = orig_nbins * (opt_data ? 2 : 1);
 
+   if (ctx->arena == NULL)
+     return -1;
+   mark = isis_arena_mark (ctx->arena);
+
    /* allocate space for the full-resolution result */
-   if (NULL == (temp_cts = (double *) ISIS_MALLOC (temp_cts_size * sizeof(double))))
+   if (NULL == (temp_cts = (double *) isis_arena_alloc (ctx->arena, temp_cts_size * sizeof(double))))
      return -1;
    memset ((char *)temp_cts, 0, temp_cts_size * sizeof(double));
 
    opt_bkg = opt_data ? (temp_cts + orig_nbins) : NULL;
 
-   /* g is a pointer to a global structure */
-   if (NULL == (g = get_evaluation_grid ()))
-     return -1;
    g->val = NULL;
 
    /* point evaluation grid 'g' at the appropriate model grid */
@@ -2343,13 +2818,12 @@ static int compute_hist_model (Hist_t *h, double *bincts, /*{{{*/
     * (use temp_workspace_for_eval() to get a pointer to this space)
     */
 
-   if (NULL == (g->val = (double *) ISIS_MALLOC ((g->n_notice + g->nbins) * sizeof(double))))
+   if (NULL == (g->val = (double *) isis_arena_alloc (ctx->arena, (g->n_notice + g->nbins) * sizeof(double))))
      goto finish;
 
-   if (-1 == apply_response (temp_cts, g, h))
+   if (-1 == apply_response (ctx, temp_cts, h))
      goto finish;
 
-   ISIS_FREE (g->val);
    memset ((char *)g, 0, sizeof (*g));
 
    if (-1 == add_instrumental_background (temp_cts, h, opt_bkg))
@@ -2358,7 +2832,7 @@ static int compute_hist_model (Hist_t *h, double *bincts, /*{{{*/
    if (-1 == Hist_apply_rebin_and_notice_list (bincts, temp_cts, h))
      goto finish;
 
-   if (-1 == provide_opt_data (h, opt_bkg, opt_data, opt_data_offset))
+   if (-1 == provide_opt_data (ctx, h, opt_bkg, opt_data, opt_data_offset))
      goto finish;
 
    if (is_flux(Fit_Data_Type))
@@ -2367,7 +2841,7 @@ static int compute_hist_model (Hist_t *h, double *bincts, /*{{{*/
           goto finish;
      }
 
-   if (Fit_Store_Model)
+   if (ctx->store_model)
      {
         unsigned int model_type = 0;
         if (is_flux(Fit_Data_Type))
@@ -2379,40 +2853,264 @@ static int compute_hist_model (Hist_t *h, double *bincts, /*{{{*/
    ret = 0;
    finish:
 
-   ISIS_FREE (g->val);
-   ISIS_FREE (temp_cts);
+   g->val = NULL;
+   isis_arena_release (ctx->arena, mark);
 
    return ret;
 }
 
 /*}}}*/
 
+/* When Fit_Num_Threads > 1, datasets whose models are computed
+ * without calling the S-Lang interpreter are evaluated in parallel.
+ * Each dataset writes to its own slice of the packed model.
+ * Datasets which share an RMF are evaluated by the same thread,
+ * because the RMF keeps per-channel-selection caches.
+ */
+typedef struct
+{
+   Hist_t *h;
+   Isis_Rmf_t *rmf;
+   int offset;
+   double cost;
+   unsigned int thread;
+}
+Dataset_Job_Type;
+
 typedef struct
 {
+   Eval_Context_Type *ctx;
    double *model;
    Isis_Fit_Statistic_Optional_Data_Type *opt_data;
    int offset;
+   Dataset_Job_Type *jobs;              /* NULL for serial evaluation */
+   unsigned int num_jobs;
 }
 Model_Map_Info_Type;
 
-static int compute_hist_model_hook (Hist_t *h, void *cl) /*{{{*/
+static char *Reentrant_Kernels[] = {"std", "yshift", "gainshift", NULL};
+
+static int can_eval_hist_model_in_thread (Hist_t *h) /*{{{*/
 {
-   Model_Map_Info_Type *map_info = (Model_Map_Info_Type *)cl;
-   int ret;
+   Hist_Eval_Grid_Method_Type *m;
+   Isis_Kernel_t *k;
+   char **name;
+
+   /* Models on a cached grid are shared with other datasets */
+   if ((NULL == (m = Hist_eval_grid_method (h)))
+       || ((m->eval_model != NULL)
+           && (m->eval_model != &eval_model_using_global_grid))
+       || (NULL != Hist_assigned_model (h))
+       || (0 == native_user_model_is_thread_safe ()))
+     return 0;
 
-   if (Hist_num_data_noticed (h) < 1)
+   if ((NULL != Hist_get_instrumental_background_hook (h))
+       || (NULL != Hist_post_model_hook (h)))
      return 0;
 
-   ret = compute_hist_model (h, map_info->model + map_info->offset,
-                             map_info->opt_data,
-                             map_info->offset);
-   map_info->offset += Hist_num_data_noticed (h);
+   k = Hist_get_kernel (h);
+   if ((k == NULL) || (k->rsp.next != NULL))
+     return 0;
+
+   for (name = Reentrant_Kernels; *name != NULL; name++)
+     {
+        if (0 == strcmp (*name, k->kernel_def->kernel_name))
+          return 1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int compute_hist_model_hook (Hist_t *h, void *cl) /*{{{*/
+{
+   Model_Map_Info_Type *map_info = (Model_Map_Info_Type *)cl;
+   int ret = 0;
+
+   if (Hist_num_data_noticed (h) < 1)
+     return 0;
+
+   if ((map_info->jobs != NULL) && can_eval_hist_model_in_thread (h))
+     {
+        Dataset_Job_Type *job = &map_info->jobs[map_info->num_jobs++];
+        Isis_Hist_t g;
+
+        g.val = NULL;
+        if (-1 == Hist_get_model_grid (&g, h))
+          return -1;
+
+        job->h = h;
+        job->rmf = Hist_get_kernel (h)->rsp.rmf;
+        job->offset = map_info->offset;
+        job->cost = (double) g.n_notice + Hist_orig_hist_size (h);
+        job->thread = 0;
+     }
+   else
+     {
+        ret = compute_hist_model (map_info->ctx, h, map_info->model + map_info->offset,
+                                  map_info->opt_data,
+                                  map_info->offset);
+     }
+   map_info->offset += Hist_num_data_noticed (h);
 
    return ret;
 }
 
 /*}}}*/
 
+static int compare_job_cost (const void *va, const void *vb) /*{{{*/
+{
+   const Dataset_Job_Type *a = (const Dataset_Job_Type *)va;
+   const Dataset_Job_Type *b = (const Dataset_Job_Type *)vb;
+
+   if (a->cost > b->cost)
+     return -1;
+   if (a->cost < b->cost)
+     return 1;
+   return a->offset - b->offset;
+}
+
+/*}}}*/
+
+static void assign_dataset_jobs (Dataset_Job_Type *jobs, unsigned int num_jobs, /*{{{*/
+                                 unsigned int num_threads)
+{
+   double load[ISIS_MAX_THREADS];
+   unsigned int i, j, t;
+
+   /* Most expensive first, each to the least loaded thread */
+   qsort (jobs, num_jobs, sizeof(Dataset_Job_Type), &compare_job_cost);
+
+   for (t = 0; t < num_threads; t++)
+     load[t] = 0.0;
+
+   for (i = 0; i < num_jobs; i++)
+     {
+        for (j = 0; j < i; j++)
+          {
+             if (jobs[j].rmf == jobs[i].rmf)
+               break;
+          }
+
+        if (j < i)
+          t = jobs[j].thread;
+        else
+          {
+             unsigned int tmin = 0;
+             for (t = 1; t < num_threads; t++)
+               {
+                  if (load[t] < load[tmin])
+                    tmin = t;
+               }
+             t = tmin;
+          }
+
+        jobs[i].thread = t;
+        load[t] += jobs[i].cost;
+     }
+}
+
+/*}}}*/
+
+typedef struct
+{
+   Model_Map_Info_Type *map_info;
+   Eval_Context_Type *ctx;                      /* [num_threads] */
+   Isis_Fit_Statistic_Optional_Data_Type *opt_data;     /* [num_threads] */
+}
+Dataset_Task_Type;
+
+static int compute_hist_model_task (void *cl, unsigned int thread, unsigned int num_threads) /*{{{*/
+{
+   Dataset_Task_Type *dt = (Dataset_Task_Type *)cl;
+   Model_Map_Info_Type *map_info = dt->map_info;
+   Isis_Fit_Statistic_Optional_Data_Type *opt_data;
+   unsigned int i;
+
+   (void) num_threads;
+
+   opt_data = (map_info->opt_data != NULL) ? &dt->opt_data[thread] : NULL;
+
+   for (i = 0; i < map_info->num_jobs; i++)
+     {
+        Dataset_Job_Type *job = &map_info->jobs[i];
+
+        if (job->thread != thread)
+          continue;
+
+        if (-1 == compute_hist_model (&dt->ctx[thread], job->h,
+                                      map_info->model + job->offset,
+                                      opt_data, job->offset))
+          return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int compute_queued_hist_models (Model_Map_Info_Type *map_info) /*{{{*/
+{
+   Dataset_Task_Type dt;
+   Isis_Fit_Statistic_Optional_Data_Type *opt_data = map_info->opt_data;
+   Isis_Arena_Type *a = map_info->ctx->arena;
+   unsigned int t, num_threads;
+   size_t mark;
+   int status = -1;
+
+   num_threads = (unsigned int) Fit_Num_Threads;
+   if (num_threads > map_info->num_jobs)
+     num_threads = map_info->num_jobs;
+   if (num_threads > ISIS_MAX_THREADS)
+     num_threads = ISIS_MAX_THREADS;
+
+   assign_dataset_jobs (map_info->jobs, map_info->num_jobs, num_threads);
+
+   mark = isis_arena_mark (a);
+
+   dt.map_info = map_info;
+   dt.opt_data = NULL;
+   if (NULL == (dt.ctx = (Eval_Context_Type *) isis_arena_alloc (a, num_threads * sizeof(Eval_Context_Type))))
+     return -1;
+
+   if ((opt_data != NULL)
+       && (NULL == (dt.opt_data = (Isis_Fit_Statistic_Optional_Data_Type *)
+                    isis_arena_alloc (a, num_threads * sizeof(Isis_Fit_Statistic_Optional_Data_Type)))))
+     goto finish;
+
+   for (t = 0; t < num_threads; t++)
+     {
+        dt.ctx[t] = *map_info->ctx;
+        dt.ctx[t].in_thread = 1;
+        memset ((char *)&dt.ctx[t].grid, 0, sizeof (Isis_Hist_t));
+        /* thread 0 shares the caller's arena */
+        if (t > 0)
+          dt.ctx[t].arena = get_scratch_arena (map_info->ctx->d, t);
+        if (dt.ctx[t].arena == NULL)
+          goto finish;
+        if (opt_data != NULL)
+          {
+             dt.opt_data[t] = *opt_data;
+             dt.opt_data[t].num = 0;
+          }
+     }
+
+   status = isis_run_threads (num_threads, &compute_hist_model_task, (void *)&dt);
+
+   if (opt_data != NULL)
+     {
+        for (t = 0; t < num_threads; t++)
+          opt_data->num += dt.opt_data[t].num;
+     }
+
+finish:
+   isis_arena_release (a, mark);
+   return status;
+}
+
+/*}}}*/
+
 static int copy_hist_model_hook (Hist_t *h, void *cl) /*{{{*/
 {
    Model_Map_Info_Type *map_info = (Model_Map_Info_Type *)cl;
@@ -2438,25 +3136,26 @@ static int copy_hist_model_hook (Hist_t *h, void *cl) /*{{{*/
 
 /*}}}*/
 
-static int compute_model (double *model, double *par_list, int npars_vary, /*{{{*/
-                          Isis_Fit_Statistic_Optional_Data_Type *opt_data)
+static int compute_model (Eval_Context_Type *ctx, double *model, double *par_list, /*{{{*/
+                          int npars_vary, Isis_Fit_Statistic_Optional_Data_Type *opt_data)
 {
    static char hook_name[] = "isis_start_eval_hook";
-   Fit_Data_t *d = Current_Fit_Data_Info;
+   Fit_Data_t *d = ctx->d;
    Model_Map_Info_Type map_info;
+   size_t mark;
    int severity;
 
-   if ((NULL == model) || (d == NULL)
+   if ((NULL == model) || (d == NULL) || (ctx->arena == NULL)
        || (NULL == par_list) || (npars_vary < 0))
      return -1;
 
-   if (Unpack == NULL)
+   if (ctx->unpack == NULL)
      {
         isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__, "compute_model: param_unpack_method = NULL");
         return -1;
      }
 
-   if (-1 == (*Unpack)(Param, par_list))
+   if (-1 == unpack_context_params (ctx, par_list))
      return -1;
 
    /* Check for user-defined hook function
@@ -2468,15 +3167,32 @@ static int compute_model (double *model, double *par_list, int npars_vary, /*{{{
 
    cached_models_need_updating(d);
 
+   map_info.ctx = ctx;
    map_info.model = model;
    map_info.opt_data = opt_data;
    map_info.offset = 0;
+   map_info.jobs = NULL;
+   map_info.num_jobs = 0;
 
    if (opt_data) opt_data->num = 0;
 
    if (Computing_Statistic_Only == 0)
      {
-        (void) map_datasets (&compute_hist_model_hook, &map_info);
+        mark = isis_arena_mark (ctx->arena);
+
+        if ((Fit_Num_Threads > 1) && isis_have_threads ())
+          {
+             map_info.jobs = (Dataset_Job_Type *) isis_arena_alloc (ctx->arena, d->num_datasets * sizeof(Dataset_Job_Type));
+             if (map_info.jobs == NULL)
+               return -1;
+          }
+
+        if ((0 == map_datasets (&compute_hist_model_hook, &map_info))
+            && (map_info.num_jobs > 0)
+            && (-1 == compute_queued_hist_models (&map_info)))
+          map_info.offset = -1;
+
+        isis_arena_release (ctx->arena, mark);
      }
    else
      {
@@ -2497,252 +3213,2016 @@ static int compute_model (double *model, double *par_list, int npars_vary, /*{{{
 
 /*}}}*/
 
-static int combine_marked_datasets (Fit_Data_t *d, int apply_weights, double *y, double *yc) /*{{{*/
+/* Several parameter vectors may be evaluated together, so that
+ * each kernel can fold all the models through the response in
+ * a single pass.  Datasets are still processed one at a time;
+ * the parameters are unpacked before each model evaluation.
+ */
+struct Multi_Model_Info_Type
+{
+   double **model;
+   double **par_list;
+   unsigned int num;
+   int offset;
+};
+
+static int unpack_multi_params (Eval_Context_Type *ctx, unsigned int j) /*{{{*/
+{
+   Multi_Model_Info_Type *mi = ctx->multi;
+
+   if ((mi == NULL) || (j >= mi->num))
+     return -1;
+
+   if (-1 == unpack_context_params (ctx, mi->par_list[j]))
+     return -1;
+
+   cached_models_need_updating (ctx->d);
+   return 0;
+}
+
+/*}}}*/
+
+static int evaluate_model_multi (Isis_Hist_t *g, unsigned int j, void *cl) /*{{{*/
+{/* Don't change the signature of this function without
+  * changing the prototype of kernel->compute_kernel_multi()
+  * in isis.h
+  */
+   if (-1 == unpack_multi_params ((Eval_Context_Type *)cl, j))
+     return -1;
+
+   return evaluate_model (g, cl);
+}
+
+/*}}}*/
+
+static int can_fold_multi (Hist_t *h, Isis_Kernel_t *k) /*{{{*/
+{
+   /* Kernel parameters and the S-Lang background and post-model
+    * hooks may depend on the fit parameters, but are applied
+    * outside the model evaluation.
+    */
+   if ((k == NULL) || (k->compute_kernel_multi == NULL)
+       || (k->kernel_def->num_kernel_parms > 0)
+       || (NULL != Hist_get_instrumental_background_hook (h))
+       || (NULL != Hist_post_model_hook (h)))
+     return 0;
+
+   return 1;
+}
+
+/*}}}*/
+
+static int compute_hist_model_multi (Eval_Context_Type *ctx, Hist_t *h) /*{{{*/
+{
+   Multi_Model_Info_Type *mi = ctx->multi;
+   Isis_Hist_t *g = &ctx->grid;
+   Isis_Kernel_t *k;
+   double *temp_cts = NULL;
+   double **result = NULL;
+   int orig_nbins;
+   unsigned int j;
+   size_t mark;
+   int ret = -1;
+
+   k = Hist_get_kernel (h);
+
+   if (0 == can_fold_multi (h, k))
+     {
+        for (j = 0; j < mi->num; j++)
+          {
+             if ((-1 == unpack_multi_params (ctx, j))
+                 || (-1 == compute_hist_model (ctx, h, mi->model[j] + mi->offset, NULL, 0)))
+               return -1;
+          }
+        return 0;
+     }
+
+   if (-1 == (orig_nbins = Hist_orig_hist_size (h)))
+     return -1;
+
+   if (ctx->arena == NULL)
+     return -1;
+   mark = isis_arena_mark (ctx->arena);
+
+   g->val = NULL;
+
+   if ((NULL == (temp_cts = (double *) isis_arena_alloc (ctx->arena, mi->num * orig_nbins * sizeof(double))))
+       || (NULL == (result = (double **) isis_arena_alloc (ctx->arena, mi->num * sizeof(double *)))))
+     goto finish;
+   memset ((char *)temp_cts, 0, mi->num * orig_nbins * sizeof(double));
+
+   for (j = 0; j < mi->num; j++)
+     result[j] = temp_cts + j * orig_nbins;
+
+   if (-1 == Hist_get_model_grid (g, h))
+     goto finish;
+
+   if (NULL == (g->val = (double *) isis_arena_alloc (ctx->arena, (g->n_notice + g->nbins) * sizeof(double))))
+     goto finish;
+
+   ctx->h = h;
+   if (-1 == k->compute_kernel_multi (k, result, mi->num, g, NULL, 0,
+                                      evaluate_model_multi, ctx))
+     goto finish;
+
+   memset ((char *)g, 0, sizeof (*g));
+
+   for (j = 0; j < mi->num; j++)
+     {
+        double *bincts = mi->model[j] + mi->offset;
+
+        if ((-1 == add_instrumental_background (result[j], h, NULL))
+            || (-1 == Hist_apply_rebin_and_notice_list (bincts, result[j], h)))
+          goto finish;
+
+        if (is_flux(Fit_Data_Type)
+            && (-1 == Hist_flux_corr_model (h, bincts)))
+          goto finish;
+     }
+
+   ret = 0;
+   finish:
+
+   g->val = NULL;
+   isis_arena_release (ctx->arena, mark);
+
+   return ret;
+}
+
+/*}}}*/
+
+static int compute_hist_model_multi_hook (Hist_t *h, void *cl) /*{{{*/
+{
+   Eval_Context_Type *ctx = (Eval_Context_Type *)cl;
+   int ret;
+
+   if (Hist_num_data_noticed (h) < 1)
+     return 0;
+
+   ret = compute_hist_model_multi (ctx, h);
+   ctx->multi->offset += Hist_num_data_noticed (h);
+
+   return ret;
+}
+
+/*}}}*/
+
+static int compute_models (Eval_Context_Type *ctx, double **model, double **par_list, /*{{{*/
+                           int npars_vary, unsigned int num)
+{
+   static char hook_name[] = "isis_start_eval_hook";
+   Fit_Data_t *d = ctx->d;
+   Multi_Model_Info_Type mi;
+   unsigned int j;
+   int severity;
+
+   if ((NULL == model) || (d == NULL)
+       || (NULL == par_list) || (npars_vary < 0))
+     return -1;
+
+   if (ctx->unpack == NULL)
+     {
+        isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__, "compute_models: param_unpack_method = NULL");
+        return -1;
+     }
+
+   /* The start-eval hook expects to see every parameter vector
+    * before the models are computed.
+    */
+   if ((Computing_Statistic_Only != 0) || (2 == SLang_is_defined (hook_name)))
+     {
+        for (j = 0; j < num; j++)
+          {
+             if (-1 == compute_model (ctx, model[j], par_list[j], npars_vary, NULL))
+               return -1;
+          }
+        return 0;
+     }
+
+   mi.model = model;
+   mi.par_list = par_list;
+   mi.num = num;
+   mi.offset = 0;
+
+   ctx->multi = &mi;
+   (void) map_datasets (&compute_hist_model_multi_hook, ctx);
+   ctx->multi = NULL;
+
+   Num_Statistic_Evaluations += num;
+   if (mi.offset == d->nbins)
+     {
+        return (SLang_get_error() == 0) ? 0 : -1;
+     }
+
+   severity = Looking_For_Confidence_Limits ? FAIL : INTR;
+
+   isis_vmesg (severity, I_FAILED, __FILE__, __LINE__, "evaluating model");
+   return -1;
+}
+
+/*}}}*/
+
+static int combine_marked_datasets (Fit_Data_t *d, int apply_weights, double *y, double *yc) /*{{{*/
+{
+   double w = 1.0;
+   int i;
+
+   if (d == NULL || y == NULL || yc == NULL)
+     return -1;
+
+   memset ((char *)yc, 0, d->nbins_after_datasets_combined * sizeof(double));
+
+   for (i = 0; i < d->num_datasets; i++)
+     {
+        Hist_t *h = d->datasets[i];
+        double *yt, *yf, *y_massaged;
+        int k, n;
+
+        n = Hist_num_data_noticed (h);
+
+        if (apply_weights)
+          {
+             (void) Hist_combination_weight (h, &w);
+          }
+
+        yf = y + d->offsets[i];
+        yt = yc + d->offset_for_marked[i];
+
+        if (-1 == Hist_call_pre_combine_hook (h, yf, n, &y_massaged))
+          {
+             isis_throw_exception (Isis_Error);
+             return -1;
+          }
+
+        for (k = 0; k < n; k++)
+          {
+             yt[k] += w * y_massaged[k];
+          }
+
+        if (y_massaged != yf)
+          ISIS_FREE (y_massaged);
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int store_combined_data (Fit_Data_t *d, double *data, double *weight) /*{{{*/
+{
+   SLang_Array_Type *sl_data=NULL, *sl_weight=NULL, *sl_combo_ids=NULL;
+   SLang_Array_Type *sl_offsets=NULL, *sl_lengths=NULL;
+   SLindex_Type i, n = d->nbins_after_datasets_combined;
+
+   if ((NULL == (sl_data = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
+       ||(NULL == (sl_weight = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
+       ||(NULL == (sl_combo_ids = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
+       ||(NULL == (sl_offsets = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
+       ||(NULL == (sl_lengths = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
+      )
+     {
+        SLang_free_array (sl_data);
+        SLang_free_array (sl_weight);
+        SLang_free_array (sl_combo_ids);
+        SLang_free_array (sl_offsets);
+        SLang_free_array (sl_lengths);
+        return -1;
+     }
+
+   memcpy ((char *)sl_data->data, (char *)data, n * sizeof(double));
+   memcpy ((char *)sl_weight->data, (char *)weight, n * sizeof(double));
+
+   for (i = 0; i < d->num_datasets; i++)
+     {
+        Hist_t *h = d->datasets[i];
+        int combo_id = Hist_combination_id (h);
+        int offset = d->offset_for_marked[i];
+        int nbins = Hist_num_data_noticed (h);
+        SLang_set_array_element (sl_combo_ids, &i, &combo_id);
+        SLang_set_array_element (sl_offsets, &i, &offset);
+        SLang_set_array_element (sl_lengths, &i, &nbins);
+     }
+
+   SLang_start_arg_list ();
+   SLang_push_array (sl_combo_ids, 1);
+   SLang_push_array (sl_offsets, 1);
+   SLang_push_array (sl_lengths, 1);
+   SLang_push_array (sl_data, 1);
+   SLang_push_array (sl_weight, 1);
+   SLang_end_arg_list ();
+
+   SLang_execute_function ("_isis->store_combined_data");
+
+   return 0;
+}
+
+/*}}}*/
+
+static int store_combined_opt_data (Fit_Data_t *d, /*{{{*/
+                                    Isis_Fit_Statistic_Optional_Data_Type *opt_data)
+{
+   SLang_Array_Type *sl_bkg=NULL, *sl_src_at=NULL, *sl_bkg_at=NULL, *sl_combo_ids=NULL;
+   SLindex_Type i, n = d->nbins_after_datasets_combined;
+
+   if (opt_data == NULL)
+     return 0;
+
+   if (opt_data->num != d->nbins_after_datasets_combined)
+     {
+        isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__,
+                    "store_combined_opt_data:  inconsistent array size opt_data->num=%d  expected n=%d",
+                   opt_data->num, d->nbins_after_datasets_combined);
+        isis_throw_exception (Isis_Error);
+        return -1;
+     }
+
+   if ((NULL == (sl_bkg = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
+       ||(NULL == (sl_src_at = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
+       ||(NULL == (sl_bkg_at = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
+       ||(NULL == (sl_combo_ids = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
+      )
+     {
+        SLang_free_array (sl_bkg);
+        SLang_free_array (sl_src_at);
+        SLang_free_array (sl_bkg_at);
+        SLang_free_array (sl_combo_ids);
+        return -1;
+     }
+
+   memcpy ((char *)sl_bkg->data, (char *)opt_data->bkg, n * sizeof(double));
+   memcpy ((char *)sl_bkg_at->data, (char *)opt_data->bkg_at, n * sizeof(double));
+   memcpy ((char *)sl_src_at->data, (char *)opt_data->src_at, n * sizeof(double));
+
+   for (i = 0; i < d->num_datasets; i++)
+     {
+        Hist_t *h = d->datasets[i];
+        int combo_id = Hist_combination_id (h);
+        SLang_set_array_element (sl_combo_ids, &i, &combo_id);
+     }
+
+   SLang_start_arg_list ();
+   SLang_push_array (sl_combo_ids, 1);
+   SLang_push_array (sl_bkg, 1);
+   SLang_push_array (sl_bkg_at, 1);
+   SLang_push_array (sl_src_at, 1);
+   SLang_end_arg_list ();
+
+   SLang_execute_function ("_isis->store_combined_opt_data");
+   return 0;
+}
+
+/*}}}*/
+
+static int store_combined_models (Fit_Data_t *d, double *models) /*{{{*/
+{
+   SLang_Array_Type *sl_models=NULL, *sl_combo_ids=NULL;
+   SLindex_Type i, n = d->nbins_after_datasets_combined;
+
+   if ((NULL == (sl_models = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1))
+        ||(NULL == (sl_combo_ids = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1))))
+       )
+     {
+        SLang_free_array (sl_models);
+        SLang_free_array (sl_combo_ids);
+        return -1;
+     }
+
+   for (i = 0; i < d->num_datasets; i++)
+     {
+        Hist_t *h = d->datasets[i];
+        int combo_id = Hist_combination_id (h);
+        SLang_set_array_element (sl_combo_ids, &i, &combo_id);
+     }
+
+   memcpy ((char *)sl_models->data, (char *)models, n * sizeof(double));
+
+   SLang_start_arg_list ();
+   SLang_push_array (sl_combo_ids, 1);
+   SLang_push_array (sl_models, 1);
+   SLang_end_arg_list ();
+
+   SLang_execute_function ("_isis->store_combined_models");
+
+   return 0;
+}
+
+/*}}}*/
+
+static int combine_opt_data (Fit_Data_t *d, Isis_Fit_Statistic_Optional_Data_Type *opt_data) /*{{{*/
+{
+   if (d == NULL || opt_data == NULL)
+     return 0;
+
+   memcpy ((char *)d->tmp, (char *)opt_data->bkg, opt_data->num*sizeof(double));
+   if (-1 == combine_marked_datasets (d, 0, d->tmp, opt_data->bkg))
+     return -1;
+
+   memcpy ((char *)d->tmp, (char *)opt_data->bkg_at, opt_data->num*sizeof(double));
+   if (-1 == combine_marked_datasets (d, 0, d->tmp, opt_data->bkg_at))
+     return -1;
+
+   memcpy ((char *)d->tmp, (char *)opt_data->src_at, opt_data->num*sizeof(double));
+   if (-1 == combine_marked_datasets (d, 0, d->tmp, opt_data->src_at))
+     return -1;
+
+   opt_data->num = d->nbins_after_datasets_combined;
+
+   return 0;
+}
+
+/*}}}*/
+
+static int _fitfun (Isis_Fit_Statistic_Optional_Data_Type *opt_data, /*{{{*/
+                    double *x,  unsigned int nbins,
+                    double *par, unsigned int npars, double *model)
+{
+   Fit_Data_t *d = Current_Fit_Data_Info;
+   Eval_Context_Type ctx;
+   int no_combined_datasets, num_pars = npars;
+   int status = -1;
+   (void) x; (void) nbins;
+
+   if (d == NULL)
+     {
+        isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__, "failed getting fit data info");
+        return -1;
+     }
+
+   init_eval_context (&ctx);
+
+   no_combined_datasets = (d->nbins == d->nbins_after_datasets_combined);
+
+   if (no_combined_datasets)
+     {
+        return compute_model (&ctx, model, par, num_pars, opt_data);
+     }
+
+   if (-1 == compute_model (&ctx, d->tmp, par, num_pars, opt_data))
+     return -1;
+
+   if (-1 == combine_marked_datasets (d, 0, d->tmp, model))
+     goto return_status;
+
+   if (-1 == combine_opt_data (d, opt_data))
+     goto return_status;
+
+return_status:
+   (void) store_combined_models (d, model);
+   (void) store_combined_opt_data (d, opt_data);
+   status = 0;
+   return status;
+}
+
+/*}}}*/
+
+static int _fitfun_multi (double *x, unsigned int nbins, /*{{{*/
+                          double **par, unsigned int npars,
+                          unsigned int num, double **model)
+{
+   Fit_Data_t *d = Current_Fit_Data_Info;
+   Eval_Context_Type ctx;
+   double *tmp = NULL;
+   double **tmp_model = NULL;
+   unsigned int j;
+   int status = -1;
+   (void) x; (void) nbins;
+
+   if (d == NULL)
+     {
+        isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__, "failed getting fit data info");
+        return -1;
+     }
+
+   init_eval_context (&ctx);
+
+   if (d->nbins == d->nbins_after_datasets_combined)
+     return compute_models (&ctx, model, par, npars, num);
+
+   if ((NULL == (tmp = (double *) ISIS_MALLOC (num * d->nbins * sizeof(double))))
+       || (NULL == (tmp_model = (double **) ISIS_MALLOC (num * sizeof(double *)))))
+     goto finish;
+
+   for (j = 0; j < num; j++)
+     tmp_model[j] = tmp + j * d->nbins;
+
+   if (-1 == compute_models (&ctx, tmp_model, par, npars, num))
+     goto finish;
+
+   for (j = 0; j < num; j++)
+     {
+        if (-1 == combine_marked_datasets (d, 0, tmp_model[j], model[j]))
+          goto finish;
+     }
+
+   status = 0;
+finish:
+   ISIS_FREE (tmp_model);
+   ISIS_FREE (tmp);
+   return status;
+}
+
+/*}}}*/
+
+/* Exact derivatives of the model with respect to the free
+ * parameters are available when the fit-function is a sum of
+ * products of compiled components which provide binned gradients,
+ * e.g. "poly(1) + 2*gauss(1) - gauss(2)*Lorentz(1)".  Each column
+ * of derivatives is computed on the model grid, then folded
+ * through the response along with the others.  Otherwise, the
+ * optimizer falls back to finite differences.
+ */
+enum
+{
+   GRAD_CONSTANT,
+   GRAD_COMPONENT,
+   GRAD_NEGATE,
+   GRAD_ADD,
+   GRAD_SUBTRACT,
+   GRAD_MULTIPLY,
+   GRAD_DIVIDE
+};
+
+typedef struct Grad_Expr_Type Grad_Expr_Type;
+struct Grad_Expr_Type
+{
+   Grad_Expr_Type *left;
+   Grad_Expr_Type *right;
+   int op;
+   double constant;
+   int is_integer;              /* S-Lang integer-valued constant */
+   Fit_Fun_t *ff;
+   unsigned int fun_id;
+   int *column;                 /* [nparams] free parameter index, or -1 */
+   double *par;                 /* [nparams] */
+   double *val;                 /* value on the current model grid */
+   double *dval;                /* derivative wrt the current column */
+   double *grad;                /* [nparams * n_notice] */
+};
+
+typedef struct
+{
+   Eval_Context_Type *ctx;
+   Grad_Expr_Type *e;
+   double **dfdp;
+   int *columns;                /* free parameters the model depends on */
+   unsigned int num_columns;
+   int offset;
+   int status;
+}
+Jacobian_Info_Type;
+
+static void free_grad_expr (Grad_Expr_Type *e) /*{{{*/
+{
+   if (e == NULL)
+     return;
+
+   free_grad_expr (e->left);
+   free_grad_expr (e->right);
+   ISIS_FREE (e->column);
+   ISIS_FREE (e->par);
+   ISIS_FREE (e->val);
+   ISIS_FREE (e->grad);
+   ISIS_FREE (e);
+}
+
+/*}}}*/
+
+static Grad_Expr_Type *new_grad_expr (int op, Grad_Expr_Type *left, Grad_Expr_Type *right) /*{{{*/
+{
+   Grad_Expr_Type *e;
+
+   if (NULL == (e = (Grad_Expr_Type *) ISIS_MALLOC (sizeof *e)))
+     {
+        free_grad_expr (left);
+        free_grad_expr (right);
+        return NULL;
+     }
+   memset ((char *)e, 0, sizeof *e);
+
+   e->op = op;
+   e->left = left;
+   e->right = right;
+
+   return e;
+}
+
+/*}}}*/
+
+/* S-Lang evaluates operations on integer constants in integer
+ * arithmetic, which truncates division.  Expressions containing
+ * such a division are left to S-Lang.
+ */
+static Grad_Expr_Type *new_grad_binary_expr (int op, Grad_Expr_Type *left, Grad_Expr_Type *right) /*{{{*/
+{
+   int is_integer = left->is_integer && right->is_integer;
+   Grad_Expr_Type *e;
+
+   if (is_integer && (op == GRAD_DIVIDE))
+     {
+        free_grad_expr (left);
+        free_grad_expr (right);
+        return NULL;
+     }
+
+   if (NULL == (e = new_grad_expr (op, left, right)))
+     return NULL;
+   e->is_integer = is_integer;
+
+   return e;
+}
+
+/*}}}*/
+
+static char *skip_blanks (char *s) /*{{{*/
+{
+   while (isspace ((unsigned char) *s))
+     s++;
+   return s;
+}
+
+/*}}}*/
+
+static Grad_Expr_Type *parse_grad_sum (char **ps);
+
+static Grad_Expr_Type *parse_grad_component (char **ps) /*{{{*/
+{
+   char name[MAX_NAME_SIZE];
+   char *s = *ps;
+   unsigned int fun_id = 1;
+   Grad_Expr_Type *e;
+   Fit_Fun_t *ff;
+   int fun_type, n = 0;
+
+   while (isalnum ((unsigned char) *s) || (*s == '_'))
+     {
+        if (n == MAX_NAME_SIZE-1)
+          return NULL;
+        name[n++] = *s++;
+     }
+   name[n] = 0;
+
+   s = skip_blanks (s);
+   if (*s++ != '(')
+     return NULL;
+
+   s = skip_blanks (s);
+   if (*s != ')')
+     {
+        char *end;
+        if (0 == isdigit ((unsigned char) *s))
+          return NULL;
+        fun_id = (unsigned int) strtoul (s, &end, 10);
+        s = skip_blanks (end);
+        if (*s != ')')
+          return NULL;
+     }
+   s++;
+
+   if ((-1 == (fun_type = Fit_get_fun_type (name)))
+       || (NULL == (ff = Fit_get_fit_fun (fun_type))))
+     return NULL;
+
+   /* hooks and operators see the S-Lang evaluation only */
+   if ((0 == Fit_fun_is_compiled (ff))
+       || (ff->s.category != ISIS_FUN_ADDMUL)
+       || (ff->trace_hook != NULL)
+       || (ff->post_hook != NULL))
+     return NULL;
+
+   if (NULL == (e = new_grad_expr (GRAD_COMPONENT, NULL, NULL)))
+     return NULL;
+
+   e->ff = ff;
+   e->fun_id = fun_id;
+   *ps = s;
+
+   return e;
+}
+
+/*}}}*/
+
+static Grad_Expr_Type *parse_grad_factor (char **ps) /*{{{*/
+{
+   Grad_Expr_Type *e;
+   char *s = skip_blanks (*ps);
+
+   if (*s == '(')
+     {
+        s++;
+        if (NULL == (e = parse_grad_sum (&s)))
+          return NULL;
+        s = skip_blanks (s);
+        if (*s != ')')
+          {
+             free_grad_expr (e);
+             return NULL;
+          }
+        *ps = s + 1;
+        return e;
+     }
+
+   if ((*s == '-') || (*s == '+'))
+     {
+        int negate = (*s == '-');
+        s++;
+        if (NULL == (e = parse_grad_factor (&s)))
+          return NULL;
+        *ps = s;
+        if (negate)
+          {
+             int is_integer = e->is_integer;
+             if (NULL == (e = new_grad_expr (GRAD_NEGATE, e, NULL)))
+               return NULL;
+             e->is_integer = is_integer;
+          }
+        return e;
+     }
+
+   if (isdigit ((unsigned char) *s) || (*s == '.'))
+     {
+        double value;
+        char *end, *t;
+        int is_integer = 1;
+
+        value = strtod (s, &end);
+        if (end == s)
+          return NULL;
+
+        /* reject hex literals and type suffixes */
+        for (t = s; t < end; t++)
+          {
+             if ((*t == 'x') || (*t == 'X'))
+               return NULL;
+             if (0 == isdigit ((unsigned char) *t))
+               is_integer = 0;
+          }
+        if (isalnum ((unsigned char) *end) || (*end == '_'))
+          return NULL;
+
+        if (NULL == (e = new_grad_expr (GRAD_CONSTANT, NULL, NULL)))
+          return NULL;
+        e->constant = value;
+        e->is_integer = is_integer;
+        *ps = end;
+        return e;
+     }
+
+   if (isalpha ((unsigned char) *s) || (*s == '_'))
+     {
+        *ps = s;
+        return parse_grad_component (ps);
+     }
+
+   return NULL;
+}
+
+/*}}}*/
+
+static Grad_Expr_Type *parse_grad_product (char **ps) /*{{{*/
+{
+   Grad_Expr_Type *left, *right;
+   char *s = *ps;
+
+   if (NULL == (left = parse_grad_factor (&s)))
+     return NULL;
+
+   for (;;)
+     {
+        int op;
+
+        s = skip_blanks (s);
+        if (*s == '*')
+          op = GRAD_MULTIPLY;
+        else if (*s == '/')
+          op = GRAD_DIVIDE;
+        else break;
+        s++;
+
+        if (NULL == (right = parse_grad_factor (&s)))
+          {
+             free_grad_expr (left);
+             return NULL;
+          }
+
+        if (NULL == (left = new_grad_binary_expr (op, left, right)))
+          return NULL;
+     }
+
+   *ps = s;
+   return left;
+}
+
+/*}}}*/
+
+static Grad_Expr_Type *parse_grad_sum (char **ps) /*{{{*/
+{
+   Grad_Expr_Type *left, *right;
+   char *s = *ps;
+
+   if (NULL == (left = parse_grad_product (&s)))
+     return NULL;
+
+   for (;;)
+     {
+        int op;
+
+        s = skip_blanks (s);
+        if (*s == '+')
+          op = GRAD_ADD;
+        else if (*s == '-')
+          op = GRAD_SUBTRACT;
+        else break;
+        s++;
+
+        if (NULL == (right = parse_grad_product (&s)))
+          {
+             free_grad_expr (left);
+             return NULL;
+          }
+
+        if (NULL == (left = new_grad_binary_expr (op, left, right)))
+          return NULL;
+     }
+
+   *ps = s;
+   return left;
+}
+
+/*}}}*/
+
+static Grad_Expr_Type *compile_grad_expr (char *def) /*{{{*/
+{
+   Grad_Expr_Type *e;
+   char *s = def;
+
+   if (NULL == (e = parse_grad_sum (&s)))
+     return NULL;
+
+   if (*skip_blanks (s) != 0)
+     {
+        free_grad_expr (e);
+        return NULL;
+     }
+
+   return e;
+}
+
+/*}}}*/
+
+static int map_grad_columns (Grad_Expr_Type *e, Param_t *pt, unsigned int npars) /*{{{*/
+{
+   unsigned int k, nparams;
+   int status;
+
+   if (e == NULL)
+     return 0;
+
+   if ((0 != (status = map_grad_columns (e->left, pt, npars)))
+       || (0 != (status = map_grad_columns (e->right, pt, npars))))
+     return status;
+
+   if (e->op != GRAD_COMPONENT)
+     return 0;
+
+   if (e->ff->s.binned_gradient == NULL)
+     return 1;
+
+   nparams = e->ff->nparams;
+
+   if ((NULL == (e->column = (int *) ISIS_MALLOC ((nparams + 1) * sizeof(int))))
+       || (NULL == (e->par = (double *) ISIS_MALLOC ((nparams + 1) * sizeof(double)))))
+     return -1;
+
+   for (k = 0; k < nparams; k++)
+     {
+        Param_Info_t *p;
+        unsigned int depth = 0;
+
+        if (NULL == (p = Fit_param_info2 (pt, e->ff->fun_type, e->fun_id, k)))
+          return 1;
+
+        /* the derivative goes to the parameter at the end of the tie */
+        while ((p->tie_param_name != NULL) && (p->fun_str == NULL))
+          {
+             p = Fit_find_param_info_by_full_name (pt, p->tie_param_name);
+             if ((p == NULL) || (++depth > Num_Params))
+               return 1;
+          }
+
+        if ((p->fun_str != NULL) || (p->in_use == 0))
+          return 1;
+
+        if (p->freeze)
+          {
+             e->column[k] = -1;
+             continue;
+          }
+
+        if ((p->vary_idx >= npars)
+            || (p != Fit_variable_param_info (pt, p->vary_idx)))
+          return 1;
+
+        e->column[k] = p->vary_idx;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static void mark_grad_columns (Grad_Expr_Type *e, int *used) /*{{{*/
+{
+   unsigned int k;
+
+   if (e == NULL)
+     return;
+
+   mark_grad_columns (e->left, used);
+   mark_grad_columns (e->right, used);
+
+   if (e->op != GRAD_COMPONENT)
+     return;
+
+   for (k = 0; k < e->ff->nparams; k++)
+     {
+        if (e->column[k] >= 0)
+          used[e->column[k]] = 1;
+     }
+}
+
+/*}}}*/
+
+static int load_grad_params (Grad_Expr_Type *e, Eval_Context_Type *ctx) /*{{{*/
+{
+   if (e == NULL)
+     return 0;
+
+   if ((-1 == load_grad_params (e->left, ctx))
+       || (-1 == load_grad_params (e->right, ctx)))
+     return -1;
+
+   if ((e->op == GRAD_COMPONENT) && (e->ff->nparams > 0))
+     return Fit_get_fun_param_values (ctx->param, ctx->values,
+                                      e->ff->fun_type, e->fun_id, e->par);
+
+   return 0;
+}
+
+/*}}}*/
+
+static void release_grad_values (Grad_Expr_Type *e) /*{{{*/
+{
+   if (e == NULL)
+     return;
+
+   release_grad_values (e->left);
+   release_grad_values (e->right);
+   ISIS_FREE (e->val);
+   ISIS_FREE (e->grad);
+   e->dval = NULL;
+}
+
+/*}}}*/
+
+static int eval_grad_expr (Grad_Expr_Type *e, Isis_Hist_t *g) /*{{{*/
+{
+   Grad_Expr_Type *l = e->left, *r = e->right;
+   int i, n = g->n_notice;
+   int status;
+
+   if ((l != NULL) && (0 != (status = eval_grad_expr (l, g))))
+     return status;
+   if ((r != NULL) && (0 != (status = eval_grad_expr (r, g))))
+     return status;
+
+   if (NULL == (e->val = (double *) ISIS_MALLOC ((2*n + 1) * sizeof(double))))
+     return -1;
+   e->dval = e->val + n;
+
+   switch (e->op)
+     {
+      case GRAD_CONSTANT:
+        for (i = 0; i < n; i++)
+          e->val[i] = e->constant;
+        break;
+
+      case GRAD_COMPONENT:
+          {
+             unsigned int k, nparams = e->ff->nparams;
+             double **grad;
+
+             if (-1 == (*e->ff->fun.c)(e->val, g, e->par, nparams))
+               return -1;
+
+             if (NULL == (e->grad = (double *) ISIS_MALLOC ((nparams * n + 1) * sizeof(double))))
+               return -1;
+             if (NULL == (grad = (double **) ISIS_MALLOC ((nparams + 1) * sizeof(double *))))
+               return -1;
+             for (k = 0; k < nparams; k++)
+               grad[k] = e->grad + k * n;
+
+             status = (*e->ff->s.binned_gradient)(grad, g, e->par, nparams);
+             ISIS_FREE (grad);
+             if (status != 0)
+               return 1;
+          }
+        break;
+
+      case GRAD_NEGATE:
+        for (i = 0; i < n; i++)
+          e->val[i] = -l->val[i];
+        break;
+
+      case GRAD_ADD:
+        for (i = 0; i < n; i++)
+          e->val[i] = l->val[i] + r->val[i];
+        break;
+
+      case GRAD_SUBTRACT:
+        for (i = 0; i < n; i++)
+          e->val[i] = l->val[i] - r->val[i];
+        break;
+
+      case GRAD_MULTIPLY:
+        for (i = 0; i < n; i++)
+          e->val[i] = l->val[i] * r->val[i];
+        break;
+
+      case GRAD_DIVIDE:
+        for (i = 0; i < n; i++)
+          e->val[i] = l->val[i] / r->val[i];
+        break;
+
+      default:
+        return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+/* Returns zero if the derivative vanishes identically */
+static int grad_expr_deriv (Grad_Expr_Type *e, int col, int n) /*{{{*/
+{
+   Grad_Expr_Type *l = e->left, *r = e->right;
+   int has_l, has_r, i;
+   unsigned int k;
+
+   switch (e->op)
+     {
+      case GRAD_CONSTANT:
+        return 0;
+
+      case GRAD_COMPONENT:
+        has_l = 0;
+        for (k = 0; k < e->ff->nparams; k++)
+          {
+             double *gk = e->grad + k * n;
+             if (e->column[k] != col)
+               continue;
+             if (has_l == 0)
+               memcpy ((char *)e->dval, (char *)gk, n * sizeof(double));
+             else for (i = 0; i < n; i++)
+               e->dval[i] += gk[i];
+             has_l = 1;
+          }
+        return has_l;
+
+      case GRAD_NEGATE:
+        if (0 == grad_expr_deriv (l, col, n))
+          return 0;
+        for (i = 0; i < n; i++)
+          e->dval[i] = -l->dval[i];
+        return 1;
+
+      default:
+        break;
+     }
+
+   has_l = grad_expr_deriv (l, col, n);
+   has_r = grad_expr_deriv (r, col, n);
+   if ((has_l == 0) && (has_r == 0))
+     return 0;
+
+   for (i = 0; i < n; i++)
+     {
+        double dl = has_l ? l->dval[i] : 0.0;
+        double dr = has_r ? r->dval[i] : 0.0;
+
+        switch (e->op)
+          {
+           case GRAD_ADD:
+             e->dval[i] = dl + dr;
+             break;
+           case GRAD_SUBTRACT:
+             e->dval[i] = dl - dr;
+             break;
+           case GRAD_MULTIPLY:
+             e->dval[i] = dl * r->val[i] + l->val[i] * dr;
+             break;
+           default:
+             e->dval[i] = (dl - e->val[i] * dr) / r->val[i];
+             break;
+          }
+     }
+
+   return 1;
+}
+
+/*}}}*/
+
+static int eval_grad_column (Isis_Hist_t *g, unsigned int j, void *cl) /*{{{*/
+{/* Don't change the signature of this function without
+  * changing the prototype of kernel->compute_kernel_multi()
+  * in isis.h
+  */
+   Jacobian_Info_Type *ji = (Jacobian_Info_Type *)cl;
+
+   if (j >= ji->num_columns)
+     return -1;
+
+   if (grad_expr_deriv (ji->e, ji->columns[j], g->n_notice))
+     memcpy ((char *)g->val, (char *)ji->e->dval, g->n_notice * sizeof(double));
+   else
+     memset ((char *)g->val, 0, g->n_notice * sizeof(double));
+
+   return 0;
+}
+
+/*}}}*/
+
+static int check_hist_jacobian_hook (Hist_t *h, void *cl) /*{{{*/
+{
+   Jacobian_Info_Type *ji = (Jacobian_Info_Type *)cl;
+   Hist_Eval_Grid_Method_Type *m;
+
+   if (Hist_num_data_noticed (h) < 1)
+     return 0;
+
+   /* The folded derivatives are exact only if the model is
+    * evaluated directly on the model grid of each dataset and
+    * the response is linear in the model.
+    */
+   if ((NULL != Hist_assigned_model (h))
+       || (NULL == (m = Hist_eval_grid_method (h)))
+       || (m->type != ISIS_EVAL_GRID_SEPARATE)
+       || ((m->eval_model != NULL) && (m->eval_model != &eval_model_using_global_grid))
+       || (0 == can_fold_multi (h, Hist_get_kernel (h))))
+     {
+        ji->status = 1;
+        return 1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int compute_hist_jacobian (Jacobian_Info_Type *ji, Hist_t *h) /*{{{*/
+{
+   Isis_Hist_t *g = &ji->ctx->grid;
+   Isis_Arena_Type *a = ji->ctx->arena;
+   Isis_Kernel_t *k = Hist_get_kernel (h);
+   double *temp_cts = NULL;
+   double **result = NULL;
+   unsigned int j, num = ji->num_columns;
+   int orig_nbins, status;
+   size_t mark;
+   int ret = -1;
+
+   if (num == 0)
+     return 0;
+
+   if ((a == NULL)
+       || (-1 == (orig_nbins = Hist_orig_hist_size (h))))
+     return -1;
+
+   mark = isis_arena_mark (a);
+
+   if ((NULL == (temp_cts = (double *) isis_arena_alloc (a, num * orig_nbins * sizeof(double))))
+       || (NULL == (result = (double **) isis_arena_alloc (a, num * sizeof(double *)))))
+     goto finish;
+   memset ((char *)temp_cts, 0, num * orig_nbins * sizeof(double));
+
+   for (j = 0; j < num; j++)
+     result[j] = temp_cts + j * orig_nbins;
+
+   g->val = NULL;
+
+   if (-1 == Hist_get_model_grid (g, h))
+     goto finish;
+
+   if (NULL == (g->val = (double *) isis_arena_alloc (a, (g->n_notice + g->nbins) * sizeof(double))))
+     goto finish;
+
+   if (0 != (status = eval_grad_expr (ji->e, g)))
+     {
+        ret = status;
+        goto finish;
+     }
+
+   if (-1 == k->compute_kernel_multi (k, result, num, g, NULL, 0,
+                                      eval_grad_column, ji))
+     goto finish;
+
+   for (j = 0; j < num; j++)
+     {
+        double *dfdp = ji->dfdp[ji->columns[j]] + ji->offset;
+        if (-1 == Hist_apply_rebin_and_notice_list (dfdp, result[j], h))
+          goto finish;
+     }
+
+   ret = 0;
+   finish:
+
+   release_grad_values (ji->e);
+   memset ((char *)g, 0, sizeof (*g));
+   isis_arena_release (a, mark);
+
+   return ret;
+}
+
+/*}}}*/
+
+static int compute_hist_jacobian_hook (Hist_t *h, void *cl) /*{{{*/
+{
+   Jacobian_Info_Type *ji = (Jacobian_Info_Type *)cl;
+
+   if (Hist_num_data_noticed (h) < 1)
+     return 0;
+
+   ji->status = compute_hist_jacobian (ji, h);
+   ji->offset += Hist_num_data_noticed (h);
+
+   return ji->status;
+}
+
+/*}}}*/
+
+static int Fit_Exact_Derivatives = 1;
+
+static int init_jacobian_info (Jacobian_Info_Type *ji, unsigned int npars) /*{{{*/
+{
+   static char hook_name[] = "isis_start_eval_hook";
+   Eval_Context_Type *ctx = ji->ctx;
+   Fit_Data_t *d = ctx->d;
+   User_Function_Type *f = get_user_function ();
+   int *used = NULL;
+   int num_all, num_vary, status;
+   unsigned int k;
+
+   if ((Fit_Exact_Derivatives == 0)
+       || (d->nbins != d->nbins_after_datasets_combined)
+       || is_flux (Fit_Data_Type)
+       || ctx->store_model
+       || Computing_Statistic_Only
+       || (ctx->unpack != &Fit_unpack_variable_params)
+       || (2 == SLang_is_defined (hook_name))
+       || (f == NULL) || (f->fun_string == NULL))
+     return 1;
+
+   if (-1 == Fit_count_params (ctx->param, &num_all, &num_vary))
+     return -1;
+   if (num_vary != (int) npars)
+     return 1;
+
+   if (NULL == (ji->e = compile_grad_expr (f->fun_string)))
+     return 1;
+
+   if (0 != (status = map_grad_columns (ji->e, ctx->param, npars)))
+     return status;
+
+   if ((NULL == (used = (int *) ISIS_MALLOC ((npars + 1) * sizeof(int))))
+       || (NULL == (ji->columns = (int *) ISIS_MALLOC ((npars + 1) * sizeof(int)))))
+     {
+        ISIS_FREE (used);
+        return -1;
+     }
+   memset ((char *)used, 0, (npars + 1) * sizeof(int));
+
+   mark_grad_columns (ji->e, used);
+
+   ji->num_columns = 0;
+   for (k = 0; k < npars; k++)
+     {
+        if (used[k])
+          ji->columns[ji->num_columns++] = k;
+     }
+   ISIS_FREE (used);
+
+   ji->status = 0;
+   (void) map_datasets (&check_hist_jacobian_hook, ji);
+
+   return ji->status;
+}
+
+/*}}}*/
+
+static int _fitfun_jacobian (Isis_Fit_Statistic_Optional_Data_Type *opt_data, /*{{{*/
+                             double *x, unsigned int nbins,
+                             double *par, unsigned int npars,
+                             double *fx, double **dfdp)
+{
+   Fit_Data_t *d = Current_Fit_Data_Info;
+   Eval_Context_Type ctx;
+   Jacobian_Info_Type ji;
+   unsigned int k;
+   int status;
+   (void) x; (void) nbins;
+
+   if (d == NULL)
+     {
+        isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__, "failed getting fit data info");
+        return -1;
+     }
+
+   init_eval_context (&ctx);
+   memset ((char *)&ji, 0, sizeof ji);
+   ji.ctx = &ctx;
+
+   if ((0 != (status = init_jacobian_info (&ji, npars)))
+       || (dfdp == NULL))
+     goto finish;
+
+   status = -1;
+
+   /* The model itself is computed as usual, which also
+    * unpacks the parameters and fills opt_data */
+   if ((-1 == compute_model (&ctx, fx, par, npars, opt_data))
+       || (-1 == load_grad_params (ji.e, &ctx)))
+     goto finish;
+
+   for (k = 0; k < npars; k++)
+     memset ((char *)dfdp[k], 0, d->nbins * sizeof(double));
+
+   ji.dfdp = dfdp;
+   ji.offset = 0;
+   ji.status = 0;
+
+   (void) map_datasets (&compute_hist_jacobian_hook, &ji);
+
+   status = ji.status;
+   if ((status == 0) && (ji.offset != d->nbins))
+     status = -1;
+
+finish:
+   free_grad_expr (ji.e);
+   ISIS_FREE (ji.columns);
+   return status;
+}
+
+/*}}}*/
+
+/*}}}*/
+
+/*{{{ native evaluation of the fit-function */
+
+/* When every component of the fit-function is a compiled additive
+ * or multiplicative function, e.g. "phabs(1)*(Powerlaw(1)+gauss(1))",
+ * the model is evaluated without calling the S-Lang interpreter.
+ * The expression is compiled into a postfix program over the
+ * distinct components, each of which is evaluated once into a
+ * preallocated buffer.  The program then runs over blocks of bins,
+ * so that all the arithmetic for a block is done in one pass while
+ * the temporaries stay in cache.  The operations are done in the
+ * same order as in the S-Lang evaluation.
+ */
+enum
+{
+   NATIVE_COMPONENT,
+   NATIVE_NEGATE,
+   NATIVE_ADD,
+   NATIVE_SUBTRACT,
+   NATIVE_MULTIPLY,
+   NATIVE_DIVIDE,
+   NATIVE_MULTIPLY_ADD,         /* x*y + z */
+   NATIVE_ADD_CONSTANT,         /* x + k */
+   NATIVE_SUBTRACT_CONSTANT,    /* x - k */
+   NATIVE_CONSTANT_SUBTRACT,    /* k - x */
+   NATIVE_MULTIPLY_CONSTANT,    /* x * k */
+   NATIVE_DIVIDE_CONSTANT,      /* x / k */
+   NATIVE_CONSTANT_DIVIDE       /* k / x */
+};
+
+#define NATIVE_BLOCK_SIZE 256
+#define NATIVE_MAX_DEPTH   64
+
+typedef struct
+{
+   int op;
+   unsigned int slot;           /* NATIVE_COMPONENT */
+   double constant;
+}
+Native_Op_Type;
+
+typedef struct
+{
+   unsigned int fun_type;
+   unsigned int fun_id;
+   unsigned int nparams;
+   double *par;                 /* [nparams] */
+}
+Native_Component_Type;
+
+struct Native_Model_Type
+{
+   Native_Op_Type *ops;
+   unsigned int num_ops;
+   Native_Component_Type *components;
+   unsigned int num_components;
+   unsigned int stack_size;
+   unsigned int depth;          /* used while compiling */
+   double *values;              /* [num_components * max_bins] */
+   double *scratch;             /* [stack_size * NATIVE_BLOCK_SIZE] */
+   int max_bins;
+};
+
+static int Fit_Native_Models = 1;
+
+static void free_native_model (Native_Model_Type *nm) /*{{{*/
+{
+   unsigned int k;
+
+   if (nm == NULL)
+     return;
+
+   if (nm->components != NULL)
+     {
+        for (k = 0; k < nm->num_components; k++)
+          ISIS_FREE (nm->components[k].par);
+        ISIS_FREE (nm->components);
+     }
+
+   ISIS_FREE (nm->ops);
+   ISIS_FREE (nm->values);
+   ISIS_FREE (nm->scratch);
+   ISIS_FREE (nm);
+}
+
+/*}}}*/
+
+static unsigned int count_grad_expr_nodes (Grad_Expr_Type *e) /*{{{*/
+{
+   if (e == NULL)
+     return 0;
+
+   return 1 + count_grad_expr_nodes (e->left) + count_grad_expr_nodes (e->right);
+}
+
+/*}}}*/
+
+/* Returns non-zero if the expression has a constant value */
+static int fold_constant_expr (Grad_Expr_Type *e, double *value) /*{{{*/
+{
+   double l, r;
+
+   switch (e->op)
+     {
+      case GRAD_CONSTANT:
+        *value = e->constant;
+        return 1;
+
+      case GRAD_COMPONENT:
+        return 0;
+
+      case GRAD_NEGATE:
+        if (0 == fold_constant_expr (e->left, &l))
+          return 0;
+        *value = -l;
+        return 1;
+
+      default:
+        break;
+     }
+
+   if ((0 == fold_constant_expr (e->left, &l))
+       || (0 == fold_constant_expr (e->right, &r)))
+     return 0;
+
+   switch (e->op)
+     {
+      case GRAD_ADD:      *value = l + r; break;
+      case GRAD_SUBTRACT: *value = l - r; break;
+      case GRAD_MULTIPLY: *value = l * r; break;
+      default:            *value = l / r; break;
+     }
+
+   return 1;
+}
+
+/*}}}*/
+
+static void push_native_op (Native_Model_Type *nm, int op, unsigned int slot, double constant) /*{{{*/
+{
+   Native_Op_Type *o = &nm->ops[nm->num_ops++];
+
+   o->op = op;
+   o->slot = slot;
+   o->constant = constant;
+
+   switch (op)
+     {
+      case NATIVE_COMPONENT:
+        if (++nm->depth > nm->stack_size)
+          nm->stack_size = nm->depth;
+        break;
+      case NATIVE_ADD:
+      case NATIVE_SUBTRACT:
+      case NATIVE_MULTIPLY:
+      case NATIVE_DIVIDE:
+        nm->depth -= 1;
+        break;
+      case NATIVE_MULTIPLY_ADD:
+        nm->depth -= 2;
+        break;
+      default:
+        break;
+     }
+}
+
+/*}}}*/
+
+static int native_component_slot (Native_Model_Type *nm, Grad_Expr_Type *e) /*{{{*/
+{
+   Native_Component_Type *c;
+   unsigned int k;
+
+   /* repeated components are evaluated once */
+   for (k = 0; k < nm->num_components; k++)
+     {
+        c = &nm->components[k];
+        if ((c->fun_type == e->ff->fun_type) && (c->fun_id == e->fun_id))
+          return k;
+     }
+
+   c = &nm->components[nm->num_components];
+   if (NULL == (c->par = (double *) ISIS_MALLOC ((e->ff->nparams + 1) * sizeof(double))))
+     return -1;
+   c->fun_type = e->ff->fun_type;
+   c->fun_id = e->fun_id;
+   c->nparams = e->ff->nparams;
+
+   return nm->num_components++;
+}
+
+/*}}}*/
+
+static int compile_native_expr (Native_Model_Type *nm, Grad_Expr_Type *e) /*{{{*/
+{
+   Grad_Expr_Type *l = e->left, *r = e->right, *m;
+   double k;
+   int slot;
+
+   /* constant subexpressions are folded by the caller */
+   switch (e->op)
+     {
+      case GRAD_COMPONENT:
+        if (-1 == (slot = native_component_slot (nm, e)))
+          return -1;
+        push_native_op (nm, NATIVE_COMPONENT, slot, 0.0);
+        return 0;
+
+      case GRAD_NEGATE:
+        if (-1 == compile_native_expr (nm, l))
+          return -1;
+        push_native_op (nm, NATIVE_NEGATE, 0, 0.0);
+        return 0;
+
+      default:
+        break;
+     }
+
+   if (fold_constant_expr (l, &k))
+     {
+        static int const_op[] = {NATIVE_ADD_CONSTANT, NATIVE_CONSTANT_SUBTRACT,
+                                 NATIVE_MULTIPLY_CONSTANT, NATIVE_CONSTANT_DIVIDE};
+        if (-1 == compile_native_expr (nm, r))
+          return -1;
+        push_native_op (nm, const_op[e->op - GRAD_ADD], 0, k);
+        return 0;
+     }
+
+   if (fold_constant_expr (r, &k))
+     {
+        static int const_op[] = {NATIVE_ADD_CONSTANT, NATIVE_SUBTRACT_CONSTANT,
+                                 NATIVE_MULTIPLY_CONSTANT, NATIVE_DIVIDE_CONSTANT};
+        if (-1 == compile_native_expr (nm, l))
+          return -1;
+        push_native_op (nm, const_op[e->op - GRAD_ADD], 0, k);
+        return 0;
+     }
+
+   /* x*y + z and z + x*y are done in one step */
+   m = NULL;
+   if (e->op == GRAD_ADD)
+     {
+        double tmp;
+        if ((l->op == GRAD_MULTIPLY)
+            && (0 == fold_constant_expr (l->left, &tmp))
+            && (0 == fold_constant_expr (l->right, &tmp)))
+          {
+             m = l;
+             l = r;
+          }
+        else if ((r->op == GRAD_MULTIPLY)
+                 && (0 == fold_constant_expr (r->left, &tmp))
+                 && (0 == fold_constant_expr (r->right, &tmp)))
+          {
+             m = r;
+          }
+     }
+
+   if (m != NULL)
+     {
+        if ((-1 == compile_native_expr (nm, m->left))
+            || (-1 == compile_native_expr (nm, m->right))
+            || (-1 == compile_native_expr (nm, l)))
+          return -1;
+        push_native_op (nm, NATIVE_MULTIPLY_ADD, 0, 0.0);
+        return 0;
+     }
+
+   if ((-1 == compile_native_expr (nm, l))
+       || (-1 == compile_native_expr (nm, r)))
+     return -1;
+
+   switch (e->op)
+     {
+      case GRAD_ADD:      push_native_op (nm, NATIVE_ADD, 0, 0.0); break;
+      case GRAD_SUBTRACT: push_native_op (nm, NATIVE_SUBTRACT, 0, 0.0); break;
+      case GRAD_MULTIPLY: push_native_op (nm, NATIVE_MULTIPLY, 0, 0.0); break;
+      default:            push_native_op (nm, NATIVE_DIVIDE, 0, 0.0); break;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static Native_Model_Type *compile_native_model (char *def) /*{{{*/
+{
+   Native_Model_Type *nm;
+   Grad_Expr_Type *e;
+   unsigned int num_nodes;
+   double k;
+
+   if (NULL == (e = compile_grad_expr (def)))
+     return NULL;
+
+   /* S-Lang would return a scalar */
+   if (fold_constant_expr (e, &k))
+     {
+        free_grad_expr (e);
+        return NULL;
+     }
+
+   num_nodes = count_grad_expr_nodes (e);
+
+   if (NULL == (nm = (Native_Model_Type *) ISIS_MALLOC (sizeof *nm)))
+     {
+        free_grad_expr (e);
+        return NULL;
+     }
+   memset ((char *)nm, 0, sizeof *nm);
+
+   if ((NULL == (nm->ops = (Native_Op_Type *) ISIS_MALLOC (num_nodes * sizeof(Native_Op_Type))))
+       || (NULL == (nm->components = (Native_Component_Type *) ISIS_MALLOC (num_nodes * sizeof(Native_Component_Type))))
+       || (-1 == compile_native_expr (nm, e))
+       || (nm->stack_size > NATIVE_MAX_DEPTH)
+       || (NULL == (nm->scratch = (double *) ISIS_MALLOC (nm->stack_size * NATIVE_BLOCK_SIZE * sizeof(double)))))
+     {
+        free_grad_expr (e);
+        free_native_model (nm);
+        return NULL;
+     }
+
+   free_grad_expr (e);
+   return nm;
+}
+
+/*}}}*/
+
+static Fit_Fun_t *native_component_fit_fun (Native_Component_Type *c) /*{{{*/
+{
+   Fit_Fun_t *ff = Fit_get_fit_fun (c->fun_type);
+
+   /* the function may have been redefined, or hooks added, since
+    * the fit-function was compiled */
+   if ((0 == Fit_fun_is_compiled (ff))
+       || (ff->s.category != ISIS_FUN_ADDMUL)
+       || (ff->nparams != c->nparams)
+       || (ff->trace_hook != NULL)
+       || (ff->post_hook != NULL))
+     return NULL;
+
+   return ff;
+}
+
+/*}}}*/
+
+/* In a worker thread (in_thread != 0), the component cache is
+ * locked while in use, and errors are reported without calling
+ * the interpreter.
+ */
+static int eval_native_component (Native_Component_Type *c, Fit_Fun_t *ff, /*{{{*/
+                                  Isis_Hist_t *g, double *values, double *par,
+                                  double *val, int in_thread)
+{
+   Component_Cache_Type *cc;
+   int use_cache, status;
+
+   if ((c->nparams > 0)
+       && (-1 == Fit_get_fun_param_values (Param, values, c->fun_type, c->fun_id, par)))
+     return -1;
+
+   use_cache = can_cache_component (ff, NULL);
+   if (use_cache)
+     {
+        if (in_thread) isis_lock_shared_state ();
+        if (NULL != (cc = find_cached_component (ff, c->fun_id, par, g)))
+          memcpy ((char *)val, (char *)cc->val, g->n_notice * sizeof(double));
+        if (in_thread) isis_unlock_shared_state ();
+        if (cc != NULL)
+          return 0;
+     }
+
+   /* compiled functions expect a zeroed array */
+   memset ((char *)val, 0, g->n_notice * sizeof(double));
+
+   if (in_thread)
+     status = (*ff->fun.c)(val, g, par, c->nparams);
+   else
+     {
+        Isis_Active_Function_Id = c->fun_id;
+        status = (*ff->fun.c)(val, g, par, c->nparams);
+        Isis_Active_Function_Id = 0;
+     }
+
+   if (status == -1)
+     {
+        int severity = (in_thread || Looking_For_Confidence_Limits) ? FAIL : INTR;
+        isis_vmesg (severity, I_ERROR, __FILE__, __LINE__, "function evaluation failed");
+        return -1;
+     }
+
+   if (use_cache)
+     {
+        if (in_thread) isis_lock_shared_state ();
+        store_component_value (ff, c->fun_id, par, g, val);
+        if (in_thread) isis_unlock_shared_state ();
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static void run_native_block (Native_Model_Type *nm, double *values, int stride, /*{{{*/
+                              double *scratch, int offset, int num, double *result)
 {
-   double w = 1.0;
+   double *stack[NATIVE_MAX_DEPTH];
+   unsigned int j, depth = 0;
    int i;
 
-   if (d == NULL || y == NULL || yc == NULL)
-     return -1;
-
-   memset ((char *)yc, 0, d->nbins_after_datasets_combined * sizeof(double));
-
-   for (i = 0; i < d->num_datasets; i++)
+   for (j = 0; j < nm->num_ops; j++)
      {
-        Hist_t *h = d->datasets[i];
-        double *yt, *yf, *y_massaged;
-        int k, n;
-
-        n = Hist_num_data_noticed (h);
+        Native_Op_Type *o = &nm->ops[j];
+        double k = o->constant;
+        double *x, *y, *z, *out;
 
-        if (apply_weights)
+        if (o->op == NATIVE_COMPONENT)
           {
-             (void) Hist_combination_weight (h, &w);
+             stack[depth++] = values + o->slot * stride + offset;
+             continue;
           }
 
-        yf = y + d->offsets[i];
-        yt = yc + d->offset_for_marked[i];
-
-        if (-1 == Hist_call_pre_combine_hook (h, yf, n, &y_massaged))
+        y = z = NULL;
+        switch (o->op)
           {
-             isis_throw_exception (Isis_Error);
-             return -1;
+           case NATIVE_ADD:
+           case NATIVE_SUBTRACT:
+           case NATIVE_MULTIPLY:
+           case NATIVE_DIVIDE:
+             y = stack[--depth];
+             break;
+           case NATIVE_MULTIPLY_ADD:
+             z = stack[--depth];
+             y = stack[--depth];
+             break;
+           default:
+             break;
           }
+        x = stack[depth - 1];
 
-        for (k = 0; k < n; k++)
+        /* the last operation writes the result */
+        out = (j + 1 == nm->num_ops)
+          ? result : scratch + (depth - 1) * NATIVE_BLOCK_SIZE;
+
+        switch (o->op)
           {
-             yt[k] += w * y_massaged[k];
+           case NATIVE_NEGATE:
+             for (i = 0; i < num; i++) out[i] = -x[i];
+             break;
+           case NATIVE_ADD:
+             for (i = 0; i < num; i++) out[i] = x[i] + y[i];
+             break;
+           case NATIVE_SUBTRACT:
+             for (i = 0; i < num; i++) out[i] = x[i] - y[i];
+             break;
+           case NATIVE_MULTIPLY:
+             for (i = 0; i < num; i++) out[i] = x[i] * y[i];
+             break;
+           case NATIVE_DIVIDE:
+             for (i = 0; i < num; i++) out[i] = x[i] / y[i];
+             break;
+           case NATIVE_MULTIPLY_ADD:
+             for (i = 0; i < num; i++) out[i] = x[i] * y[i] + z[i];
+             break;
+           case NATIVE_ADD_CONSTANT:
+             for (i = 0; i < num; i++) out[i] = x[i] + k;
+             break;
+           case NATIVE_SUBTRACT_CONSTANT:
+             for (i = 0; i < num; i++) out[i] = x[i] - k;
+             break;
+           case NATIVE_CONSTANT_SUBTRACT:
+             for (i = 0; i < num; i++) out[i] = k - x[i];
+             break;
+           case NATIVE_MULTIPLY_CONSTANT:
+             for (i = 0; i < num; i++) out[i] = x[i] * k;
+             break;
+           case NATIVE_DIVIDE_CONSTANT:
+             for (i = 0; i < num; i++) out[i] = x[i] / k;
+             break;
+           case NATIVE_CONSTANT_DIVIDE:
+             for (i = 0; i < num; i++) out[i] = k / x[i];
+             break;
+           default:
+             break;
           }
 
-        if (y_massaged != yf)
-          ISIS_FREE (y_massaged);
+        stack[depth - 1] = out;
      }
 
-   return 0;
+   if (stack[0] != result)
+     memcpy ((char *)result, (char *)stack[0], num * sizeof(double));
 }
 
 /*}}}*/
 
-static int store_combined_data (Fit_Data_t *d, double *data, double *weight) /*{{{*/
+static int native_model_is_usable (Native_Model_Type *nm) /*{{{*/
 {
-   SLang_Array_Type *sl_data=NULL, *sl_weight=NULL, *sl_combo_ids=NULL;
-   SLang_Array_Type *sl_offsets=NULL, *sl_lengths=NULL;
-   SLindex_Type i, n = d->nbins_after_datasets_combined;
-
-   if ((NULL == (sl_data = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
-       ||(NULL == (sl_weight = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
-       ||(NULL == (sl_combo_ids = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
-       ||(NULL == (sl_offsets = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
-       ||(NULL == (sl_lengths = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
-      )
-     {
-        SLang_free_array (sl_data);
-        SLang_free_array (sl_weight);
-        SLang_free_array (sl_combo_ids);
-        SLang_free_array (sl_offsets);
-        SLang_free_array (sl_lengths);
-        return -1;
-     }
-
-   memcpy ((char *)sl_data->data, (char *)data, n * sizeof(double));
-   memcpy ((char *)sl_weight->data, (char *)weight, n * sizeof(double));
+   unsigned int k;
 
-   for (i = 0; i < d->num_datasets; i++)
+   for (k = 0; k < nm->num_components; k++)
      {
-        Hist_t *h = d->datasets[i];
-        int combo_id = Hist_combination_id (h);
-        int offset = d->offset_for_marked[i];
-        int nbins = Hist_num_data_noticed (h);
-        SLang_set_array_element (sl_combo_ids, &i, &combo_id);
-        SLang_set_array_element (sl_offsets, &i, &offset);
-        SLang_set_array_element (sl_lengths, &i, &nbins);
+        if (NULL == native_component_fit_fun (&nm->components[k]))
+          return 0;
      }
 
-   SLang_start_arg_list ();
-   SLang_push_array (sl_combo_ids, 1);
-   SLang_push_array (sl_offsets, 1);
-   SLang_push_array (sl_lengths, 1);
-   SLang_push_array (sl_data, 1);
-   SLang_push_array (sl_weight, 1);
-   SLang_end_arg_list ();
-
-   SLang_execute_function ("_isis->store_combined_data");
-
-   return 0;
+   return 1;
 }
 
 /*}}}*/
 
-static int store_combined_opt_data (Fit_Data_t *d, /*{{{*/
-                                    Isis_Fit_Statistic_Optional_Data_Type *opt_data)
+/* Returns 1 if the model must be evaluated by S-Lang instead.
+ * Parameter values come from param_values[], indexed by parameter
+ * index.
+ * If arena != NULL, work space comes from the arena rather than
+ * the buffers of the model, so that the model may be evaluated
+ * by several threads at once.
+ */
+static int eval_native_model (Native_Model_Type *nm, Isis_Hist_t *g, /*{{{*/
+                              double *param_values, Isis_Arena_Type *arena)
 {
-   SLang_Array_Type *sl_bkg=NULL, *sl_src_at=NULL, *sl_bkg_at=NULL, *sl_combo_ids=NULL;
-   SLindex_Type i, n = d->nbins_after_datasets_combined;
+   double *values, *scratch, *par = NULL;
+   Fit_Fun_t *ff;
+   unsigned int k;
+   int i, stride, n = g->n_notice;
 
-   if (opt_data == NULL)
-     return 0;
+   if (0 == native_model_is_usable (nm))
+     return 1;
 
-   if (opt_data->num != d->nbins_after_datasets_combined)
+   if ((n > 0)
+       && ((g->notice_list == NULL)
+           || (g->bin_lo == NULL)
+           || (g->bin_hi == NULL)))
      {
-        isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__,
-                    "store_combined_opt_data:  inconsistent array size opt_data->num=%d  expected n=%d",
-                   opt_data->num, d->nbins_after_datasets_combined);
-        isis_throw_exception (Isis_Error);
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "Invalid model evaluation grid");
         return -1;
      }
 
-   if ((NULL == (sl_bkg = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
-       ||(NULL == (sl_src_at = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
-       ||(NULL == (sl_bkg_at = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1)))
-       ||(NULL == (sl_combo_ids = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1)))
-      )
+   if (arena != NULL)
      {
-        SLang_free_array (sl_bkg);
-        SLang_free_array (sl_src_at);
-        SLang_free_array (sl_bkg_at);
-        SLang_free_array (sl_combo_ids);
-        return -1;
+        size_t size = nm->num_components * (size_t) n + nm->stack_size * NATIVE_BLOCK_SIZE;
+        for (k = 0; k < nm->num_components; k++)
+          size += nm->components[k].nparams;
+        if (NULL == (values = (double *) isis_arena_alloc (arena, size * sizeof(double))))
+          return -1;
+        scratch = values + nm->num_components * (size_t) n;
+        par = scratch + nm->stack_size * NATIVE_BLOCK_SIZE;
+        stride = n;
      }
-
-   memcpy ((char *)sl_bkg->data, (char *)opt_data->bkg, n * sizeof(double));
-   memcpy ((char *)sl_bkg_at->data, (char *)opt_data->bkg_at, n * sizeof(double));
-   memcpy ((char *)sl_src_at->data, (char *)opt_data->src_at, n * sizeof(double));
-
-   for (i = 0; i < d->num_datasets; i++)
+   else
      {
-        Hist_t *h = d->datasets[i];
-        int combo_id = Hist_combination_id (h);
-        SLang_set_array_element (sl_combo_ids, &i, &combo_id);
+        if (n > nm->max_bins)
+          {
+             double *v;
+             if (NULL == (v = (double *) ISIS_REALLOC (nm->values, nm->num_components * n * sizeof(double))))
+               return -1;
+             nm->values = v;
+             nm->max_bins = n;
+          }
+        values = nm->values;
+        scratch = nm->scratch;
+        stride = nm->max_bins;
      }
 
-   SLang_start_arg_list ();
-   SLang_push_array (sl_combo_ids, 1);
-   SLang_push_array (sl_bkg, 1);
-   SLang_push_array (sl_bkg_at, 1);
-   SLang_push_array (sl_src_at, 1);
-   SLang_end_arg_list ();
-
-   SLang_execute_function ("_isis->store_combined_opt_data");
-   return 0;
-}
-
-/*}}}*/
-
-static int store_combined_models (Fit_Data_t *d, double *models) /*{{{*/
-{
-   SLang_Array_Type *sl_models=NULL, *sl_combo_ids=NULL;
-   SLindex_Type i, n = d->nbins_after_datasets_combined;
-
-   if ((NULL == (sl_models = SLang_create_array (SLANG_DOUBLE_TYPE, 1, NULL, &n, 1))
-        ||(NULL == (sl_combo_ids = SLang_create_array (SLANG_INT_TYPE, 1, NULL, &d->num_datasets, 1))))
-       )
+   for (k = 0; k < nm->num_components; k++)
      {
-        SLang_free_array (sl_models);
-        SLang_free_array (sl_combo_ids);
-        return -1;
+        Native_Component_Type *c = &nm->components[k];
+        double *p = c->par;
+        if (par != NULL)
+          {
+             p = par;
+             par += c->nparams;
+          }
+        ff = native_component_fit_fun (c);
+        if (-1 == eval_native_component (c, ff, g, param_values, p,
+                                          values + k * stride, arena != NULL))
+          return -1;
      }
 
-   for (i = 0; i < d->num_datasets; i++)
+   for (i = 0; i < n; i += NATIVE_BLOCK_SIZE)
      {
-        Hist_t *h = d->datasets[i];
-        int combo_id = Hist_combination_id (h);
-        SLang_set_array_element (sl_combo_ids, &i, &combo_id);
+        int num = n - i;
+        if (num > NATIVE_BLOCK_SIZE)
+          num = NATIVE_BLOCK_SIZE;
+        run_native_block (nm, values, stride, scratch, i, num, g->val + i);
      }
 
-   memcpy ((char *)sl_models->data, (char *)models, n * sizeof(double));
-
-   SLang_start_arg_list ();
-   SLang_push_array (sl_combo_ids, 1);
-   SLang_push_array (sl_models, 1);
-   SLang_end_arg_list ();
-
-   SLang_execute_function ("_isis->store_combined_models");
-
    return 0;
 }
 
 /*}}}*/
 
-static int combine_opt_data (Fit_Data_t *d, Isis_Fit_Statistic_Optional_Data_Type *opt_data) /*{{{*/
+static int eval_native_user_model (Isis_Hist_t *g, double *param_values) /*{{{*/
 {
-   if (d == NULL || opt_data == NULL)
-     return 0;
-
-   memcpy ((char *)d->tmp, (char *)opt_data->bkg, opt_data->num*sizeof(double));
-   if (-1 == combine_marked_datasets (d, 0, d->tmp, opt_data->bkg))
-     return -1;
-
-   memcpy ((char *)d->tmp, (char *)opt_data->bkg_at, opt_data->num*sizeof(double));
-   if (-1 == combine_marked_datasets (d, 0, d->tmp, opt_data->bkg_at))
-     return -1;
+   User_Function_Type *f = get_user_function ();
+   int status;
 
-   memcpy ((char *)d->tmp, (char *)opt_data->src_at, opt_data->num*sizeof(double));
-   if (-1 == combine_marked_datasets (d, 0, d->tmp, opt_data->src_at))
-     return -1;
+   if ((Fit_Native_Models == 0)
+       || (Mode != BIN_EVAL_MODE)
+       || (f == NULL) || (f->native == NULL)
+       || (param_values == NULL))
+     return 1;
 
-   opt_data->num = d->nbins_after_datasets_combined;
+   if (-1 == (status = eval_native_model (f->native, g, param_values, NULL)))
+     {
+        memset ((char *)g->val, 0, g->n_notice * sizeof(double));
+        verbose_warn_hook (NULL, "Failed evaluating user fit function\n");
+        if (!Looking_For_Confidence_Limits)
+          isis_throw_exception (Isis_Error);
+     }
 
-   return 0;
+   return status;
 }
 
 /*}}}*/
 
-static int _fitfun (Isis_Fit_Statistic_Optional_Data_Type *opt_data, /*{{{*/
-                    double *x,  unsigned int nbins,
-                    double *par, unsigned int npars, double *model)
+/* Compiled functions are evaluated in a worker thread only if
+ * they set the thread_safe field of Isis_User_Source_t, since they
+ * might keep static state or call the interpreter.
+ */
+static int native_model_is_thread_safe (Native_Model_Type *nm) /*{{{*/
 {
-   Fit_Data_t *d = Current_Fit_Data_Info;
-   int no_combined_datasets, num_pars = npars;
-   int status = -1;
-   (void) x; (void) nbins;
-
-   if (d == NULL)
-     {
-        isis_vmesg (FAIL, I_INTERNAL, __FILE__, __LINE__, "failed getting fit data info");
-        return -1;
-     }
-
-   no_combined_datasets = (d->nbins == d->nbins_after_datasets_combined);
+   unsigned int k;
 
-   if (no_combined_datasets)
+   for (k = 0; k < nm->num_components; k++)
      {
-        return compute_model (model, par, num_pars, opt_data);
+        Fit_Fun_t *ff = native_component_fit_fun (&nm->components[k]);
+        if ((ff == NULL) || (ff->s.thread_safe == 0))
+          return 0;
      }
 
-   if (-1 == compute_model (d->tmp, par, num_pars, opt_data))
-     return -1;
+   return 1;
+}
 
-   if (-1 == combine_marked_datasets (d, 0, d->tmp, model))
-     goto return_status;
+/*}}}*/
 
-   if (-1 == combine_opt_data (d, opt_data))
-     goto return_status;
+/* The fit-function may be evaluated in a worker thread if the
+ * native evaluator handles it, every component is thread-safe
+ * and no parameter value comes from an S-Lang function.
+ */
+static int native_user_model_is_thread_safe (void) /*{{{*/
+{
+   User_Function_Type *f = get_user_function ();
 
-return_status:
-   (void) store_combined_models (d, model);
-   (void) store_combined_opt_data (d, opt_data);
-   status = 0;
-   return status;
+   return (Fit_Native_Models != 0)
+     && (Mode == BIN_EVAL_MODE)
+     && (f != NULL) && (f->native != NULL)
+     && native_model_is_thread_safe (f->native)
+     && (0 == Fit_have_derived_params (Param));
 }
 
 /*}}}*/
@@ -2962,6 +5442,7 @@ static int get_num_noticed_bins (void) /*{{{*/
 void free_fit_data (Fit_Data_t *d) /*{{{*/
 {
    Cached_Grid_Type *t;
+   unsigned int i;
 
    if (d == NULL)
      return;
@@ -2972,6 +5453,15 @@ void free_fit_data (Fit_Data_t *d) /*{{{*/
    ISIS_FREE (d->offsets);
    ISIS_FREE (d->offset_for_marked);
    ISIS_FREE (d->tmp);
+   ISIS_FREE (d->src_at);
+   ISIS_FREE (d->bkg_at);
+   ISIS_FREE (d->have_scaling);
+
+   for (i = 0; i < ISIS_MAX_THREADS; i++)
+     {
+        isis_free_arena (d->arena[i]);
+        ISIS_FREE (d->values[i]);
+     }
 
    t = d->cache;
    while (t)
@@ -3004,6 +5494,9 @@ static Fit_Data_t *new_fit_data (int nbins) /*{{{*/
        || NULL == (d->datasets = (Hist_t **) ISIS_MALLOC (d->num_datasets * sizeof(Hist_t *)))
        || NULL == (d->offsets = (int *) ISIS_MALLOC (d->num_datasets * sizeof(int)))
        || NULL == (d->offset_for_marked = (int *) ISIS_MALLOC (d->num_datasets * sizeof(int)))
+       || NULL == (d->src_at = (double *) ISIS_MALLOC (nbins * sizeof(double)))
+       || NULL == (d->bkg_at = (double *) ISIS_MALLOC (nbins * sizeof(double)))
+       || NULL == (d->have_scaling = (int *) ISIS_MALLOC (d->num_datasets * sizeof(int)))
        )
      {
         free_fit_data (d);
@@ -3011,6 +5504,7 @@ static Fit_Data_t *new_fit_data (int nbins) /*{{{*/
      }
 
    memset ((char *)d->offset_for_marked, 0, d->num_datasets * sizeof(int));
+   memset ((char *)d->have_scaling, 0, d->num_datasets * sizeof(int));
 
    return d;
 }
@@ -3737,6 +6231,7 @@ static void fit_object_close (Fit_Object_Type *fo) /*{{{*/
 
    deinit_verbose_hook ();
    Current_Fit_Data_Info = NULL;
+   free_component_cache ();
    isis_fit_close_fit (fo->ft);
 
    (void) map_datasets (post_fit, NULL);
@@ -3846,6 +6341,7 @@ static Fit_Object_Type *fit_object_open (void) /*{{{*/
    if (NULL == (fo->d = get_fit_data ()))
      goto return_error;
    Current_Fit_Data_Info = fo->d;
+   free_component_cache ();
 
    if (NULL == (fo->dt = setup_fit_object_data (fo->d)))
      goto return_error;
@@ -3855,6 +6351,8 @@ static Fit_Object_Type *fit_object_open (void) /*{{{*/
      {
         goto return_error;
      }
+   fo->ft->compute_models = _fitfun_multi;
+   fo->ft->compute_jacobian = _fitfun_jacobian;
 
    set_fit_method_hooks (fo->ft, info->par);
 
@@ -4654,6 +7152,82 @@ static void confidence_limits (int *idx, double *delta_chisqr, int *verbose, dou
 
 /*}}}*/
 
+static void confidence_limit_list (double *delta_chisqr, int *verbose, double *tolerance, /*{{{*/
+                                   int *max_restarts, int *max_param_retries)
+{
+   SLang_Array_Type *sl_idx = NULL, *sl_min = NULL, *sl_max = NULL;
+   Fit_Object_Type *fo = NULL;
+   Isis_Fit_CLC_Type c;
+   SLindex_Type num;
+   int i, *idx;
+
+   if (-1 == SLang_pop_array_of_type (&sl_idx, SLANG_INT_TYPE))
+     {
+        isis_throw_exception (Isis_Error);
+        return;
+     }
+
+   if (0 == delta_stat_is_chisqr_distributed())
+     {
+        isis_vmesg (INTR, I_INFO, __FILE__, __LINE__, "statistic = '%s': confidence limits not supported",
+                    Fit_Statistic);
+        goto free_and_return;
+     }
+
+   num = sl_idx->num_elements;
+   idx = (int *) sl_idx->data;
+
+   for (i = 0; i < num; i++)
+     {
+        Param_Info_t *p;
+        if (NULL == (p = Fit_param_info (Param, idx[i])))
+          {
+             isis_vmesg (INTR, I_INVALID, __FILE__, __LINE__, "parameter %d", idx[i]);
+             goto free_and_return;
+          }
+        if (p->freeze != 0)
+          {
+             isis_vmesg (INTR, I_WARNING, __FILE__, __LINE__, "parameter %d is frozen", idx[i]);
+             goto free_and_return;
+          }
+     }
+
+   if ((NULL == (sl_min = SLang_create_array (SLANG_DOUBLE_TYPE, 0, NULL, &num, 1)))
+       || (NULL == (sl_max = SLang_create_array (SLANG_DOUBLE_TYPE, 0, NULL, &num, 1))))
+     goto free_and_return;
+
+   c.delta_stat = *delta_chisqr;
+   c.tol = *tolerance;
+   c.verbose = *verbose;
+
+   if (NULL == (fo = fit_object_open ()))
+     {
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "initializing fit engine");
+        goto free_and_return;
+     }
+
+   Looking_For_Confidence_Limits = 1;
+   if (-1 == get_confidence_limit_list (fo, Param, &c, idx, num, (unsigned int) *max_restarts,
+                                        (unsigned int) ((*max_param_retries > 0) ? *max_param_retries : 0),
+                                        (double *) sl_min->data, (double *) sl_max->data))
+     {
+        isis_vmesg (INTR, I_WARNING, __FILE__, __LINE__, "confidence limit search failed");
+     }
+   Looking_For_Confidence_Limits = 0;
+
+   fit_object_close (fo);
+
+   SLang_push_array (sl_min, 0);
+   SLang_push_array (sl_max, 0);
+
+   free_and_return:
+   SLang_free_array (sl_idx);
+   SLang_free_array (sl_min);
+   SLang_free_array (sl_max);
+}
+
+/*}}}*/
+
 /*}}}*/
 
 /* etc */
@@ -5344,6 +7918,11 @@ static void set_eval_grid_method (int *method, int *cache_model_values) /*{{{*/
 static SLang_Intrin_Var_Type Fit_Intrin_Vars [] =
 {
    MAKE_VARIABLE("Fit_Verbose", &Fit_Verbose, I, 0),
+   MAKE_VARIABLE("Fit_Num_Threads", &Fit_Num_Threads, I, 0),
+   MAKE_VARIABLE("Fit_Cache_Components", &Fit_Cache_Components, I, 0),
+   MAKE_VARIABLE("Fit_Native_Models", &Fit_Native_Models, I, 0),
+   MAKE_VARIABLE("Fit_Exact_Derivatives", &Fit_Exact_Derivatives, I, 0),
+   MAKE_VARIABLE("Fit_Vector_Statistics", &Isis_Vector_Statistics, I, 0),
    MAKE_VARIABLE("Fit_Statistic", &Fit_Statistic, S, 0),
    MAKE_VARIABLE("Fit_Method", &Fit_Method, S, 0),
    MAKE_VARIABLE("Isis_Fit_In_Progress", &Isis_Fit_In_Progress, I, 1),
@@ -5410,6 +7989,7 @@ static SLang_Intrin_Fun_Type Fit_Intrinsics [] =
    MAKE_INTRINSIC_1("_eval_model", eval_model, I, R),
    MAKE_INTRINSIC_1("_eval_statistic_only", eval_statistic_only, I, R),
    MAKE_INTRINSIC_4("_confidlev", confidence_limits, V, I, D, I, D),
+   MAKE_INTRINSIC_5("_confidlev_list", confidence_limit_list, V, D, I, D, I, I),
    MAKE_INTRINSIC_I("_set_conf_limit_search", _set_conf_limit_search, V),
    MAKE_INTRINSIC("_array_fit", array_fit, V, 0),
    MAKE_INTRINSIC("_get_differential_model", get_differential_model, V, 0),
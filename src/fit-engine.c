@@ -695,6 +695,9 @@ int init_fit_engine (void) /*{{{*/
    if (-1 == isis_fit_add_engine ("simann", "chisqr", Isis_simann_feng))
      return -1;
 
+   if (-1 == isis_fit_add_engine ("diffev", "chisqr", Isis_diffev_feng))
+     return -1;
+
    if (-1 == isis_fit_add_engine ("marquardt", "chisqr", Isis_marquardt_feng))
      return -1;
 
@@ -798,6 +801,8 @@ Isis_Fit_Type *isis_fit_open_fit (char *name, char *sname, Isis_Fit_Fun_Type *fu
      }
 
    f->compute_model = fun;
+   f->compute_models = NULL;
+   f->compute_jacobian = NULL;
    f->engine = e;
    f->stat = s;
    f->statistic = DBL_MAX;
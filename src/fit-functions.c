@@ -848,6 +848,13 @@ Fit_Fun_t *Fit_get_fit_fun (int fun_type) /*{{{*/
 
 /*}}}*/
 
+int Fit_fun_is_compiled (Fit_Fun_t *ff) /*{{{*/
+{
+   return (ff != NULL) && (ff->bin_eval_method == &c_bin_eval);
+}
+
+/*}}}*/
+
 void set_function_category (char *fun_name, unsigned int *category) /*{{{*/
 {
    Fit_Fun_t *ff;
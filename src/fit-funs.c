@@ -73,6 +73,30 @@ static int poly_b (double *val, Isis_Hist_t *g, double *par, unsigned int npar)
 
 /*}}}*/
 
+/* derivatives of the bin-integrated model */
+static int poly_g (double **grad, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
+{
+   int i;
+   double xh, xl, dx;
+
+   (void) par; (void) npar;
+
+   for (i=0; i < g->n_notice; i++)
+     {
+        int n = g->notice_list[i];
+        xh = g->bin_hi[n];
+        xl = g->bin_lo[n];
+        dx =  xh - xl;
+        grad[0][i] = dx;
+        grad[1][i] = dx * (xh + xl) / 2.0;
+        grad[2][i] = dx * (xh*xh + xh*xl + xl*xl) / 3.0;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int poly_c (double *val, Isis_User_Grid_t *g, double *par, unsigned int npar) /*{{{*/
 {
    int i;
@@ -225,6 +249,9 @@ ISIS_USER_SOURCE_MODULE(poly,p,options) /*{{{*/
      return -1;
 
    p->binned = poly_b;
+   p->binned_gradient = poly_g;
+   p->cacheable = 1;
+   p->thread_safe = 1;
    p->function_exit = NULL;
    p->unbinned = poly_c;
    p->init_params_from_screen = poly_p;
@@ -290,6 +317,39 @@ static int lorentz_b (double *val, Isis_Hist_t *g, double *par, unsigned int npa
 }
 /*}}}*/
 
+/* derivatives of the bin-integrated model */
+static int lorentz_g (double **grad, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
+{
+   double area = par[0];
+   double x0   = par[1];
+   double hfw  = par[2] / 2.0;           /* fwhm/2 */
+   int i;
+
+   (void) npar;
+
+   /* not differentiable as a delta function */
+   if (hfw <= 0.0)
+     return -1;
+
+   for (i=0; i < g->n_notice; i++)
+     {
+        double dxh, dxl, ph, pl;
+        int n = g->notice_list[i];
+
+        dxh = (g->bin_hi[n] - x0) / hfw;
+        dxl = (g->bin_lo[n] - x0) / hfw;
+        ph = 1.0 / (1.0 + dxh * dxh);
+        pl = 1.0 / (1.0 + dxl * dxl);
+
+        grad[0][i] = (atan (dxh) - atan (dxl)) / PI;
+        grad[1][i] = -area * (ph - pl) / (PI * hfw);
+        grad[2][i] = -area * (dxh * ph - dxl * pl) / (2.0 * PI * hfw);
+     }
+
+   return 0;
+}
+/*}}}*/
+
 static int lorentz_c (double *val, Isis_User_Grid_t *g, double *par, unsigned int npar) /*{{{*/
 {
    double area = par[0];
@@ -378,6 +438,9 @@ ISIS_USER_SOURCE_MODULE(Lorentz,p,options) /*{{{*/
      return -1;
 
    p->binned = lorentz_b;
+   p->binned_gradient = lorentz_g;
+   p->cacheable = 1;
+   p->thread_safe = 1;
    p->function_exit = NULL;
    p->unbinned = lorentz_c;
    p->init_params_from_screen = lorentz_p;
@@ -431,6 +494,47 @@ static int gauss_b (double *val, Isis_Hist_t *g, double *par, unsigned int npar)
 
 /*}}}*/
 
+static double gauss_pdf (double x) /*{{{*/
+{
+   return exp (-0.5 * x * x) / sqrt (2 * PI);
+}
+
+/*}}}*/
+
+/* derivatives of the bin-integrated model */
+static int gauss_g (double **grad, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
+{
+   double area = par[0];
+   double x0   = par[1];
+   double sigma= par[2];
+   int i;
+
+   (void) npar;
+
+   /* not differentiable as a delta function */
+   if (sigma <= 0.0)
+     return -1;
+
+   for (i=0; i < g->n_notice; i++)
+     {
+        double dxh, dxl, ph, pl;
+        int n = g->notice_list[i];
+
+        dxh = (g->bin_hi[n] - x0) / sigma;
+        dxl = (g->bin_lo[n] - x0) / sigma;
+        ph = gauss_pdf (dxh);
+        pl = gauss_pdf (dxl);
+
+        grad[0][i] = isis_gpf (dxh) - isis_gpf (dxl);
+        grad[1][i] = -area * (ph - pl) / sigma;
+        grad[2][i] = -area * (dxh * ph - dxl * pl) / sigma;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int gauss_c (double *val, Isis_User_Grid_t *g, double *par, unsigned int npar) /*{{{*/
 {
    double area  = par[0];
@@ -520,6 +624,9 @@ ISIS_USER_SOURCE_MODULE(gauss,p,options) /*{{{*/
      return -1;
 
    p->binned = gauss_b;
+   p->binned_gradient = gauss_g;
+   p->cacheable = 1;
+   p->thread_safe = 1;
    p->function_exit = NULL;
    p->unbinned = gauss_c;
    p->init_params_from_screen = gauss_p;
@@ -575,6 +682,43 @@ static int egauss_b (double *val, Isis_Hist_t *g, double *par, unsigned int npar
 
 /*}}}*/
 
+/* derivatives of the bin-integrated model */
+static int egauss_g (double **grad, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
+{
+   double area = par[0];
+   double e0   = par[1];
+   double sigma= par[2];
+   int i;
+
+   (void) npar;
+
+   /* not differentiable as a delta function */
+   if (sigma <= 0.0)
+     return -1;
+
+   for (i=0; i < g->n_notice; i++)
+     {
+        double elo, ehi, dxh, dxl, ph, pl;
+        int n = g->notice_list[i];
+
+        elo = KEV_ANGSTROM / g->bin_hi[n];
+        ehi = KEV_ANGSTROM / g->bin_lo[n];
+
+        dxh = (ehi - e0) / sigma;
+        dxl = (elo - e0) / sigma;
+        ph = gauss_pdf (dxh);
+        pl = gauss_pdf (dxl);
+
+        grad[0][i] = isis_gpf (dxh) - isis_gpf (dxl);
+        grad[1][i] = -area * (ph - pl) / sigma;
+        grad[2][i] = -area * (dxh * ph - dxl * pl) / sigma;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int egauss_c (double *val, Isis_User_Grid_t *g, double *par, unsigned int npar) /*{{{*/
 {
    double area  = par[0];
@@ -619,6 +763,9 @@ ISIS_USER_SOURCE_MODULE(egauss,p,options) /*{{{*/
      return -1;
 
    p->binned = egauss_b;
+   p->binned_gradient = egauss_g;
+   p->cacheable = 1;
+   p->thread_safe = 1;
    p->function_exit = NULL;
    p->unbinned = egauss_c;
    p->init_params_from_screen = NULL;;
@@ -668,6 +815,49 @@ static int powr_b (double *val, Isis_Hist_t *g, double *par, unsigned int npar)
 
 /*}}}*/
 
+/* derivatives of the bin-integrated model */
+static int powr_g (double **grad, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
+{
+   double norm = par[0];
+   double alph = par[1];
+   int i, n;
+
+   (void) npar;
+
+   if (fabs(alph+1.0) > 1.e4 * DBL_EPSILON)
+     {
+        double oma = 1.0 + alph;
+
+        for (i=0; i < g->n_notice; i++)
+          {
+             double a, b, pa, pb;
+             n = g->notice_list[i];
+             a = KEV_ANGSTROM / g->bin_lo[n];
+             b = KEV_ANGSTROM / g->bin_hi[n];
+             pa = pow (a, oma);
+             pb = pow (b, oma);
+             grad[0][i] = (pa - pb) / oma;
+             grad[1][i] = norm * ((pa * log(a) - pb * log(b)) - grad[0][i]) / oma;
+          }
+     }
+   else
+     {
+        for (i=0; i < g->n_notice; i++)
+          {
+             double la, lb;
+             n = g->notice_list[i];
+             la = log (KEV_ANGSTROM / g->bin_lo[n]);
+             lb = log (KEV_ANGSTROM / g->bin_hi[n]);
+             grad[0][i] = la - lb;
+             grad[1][i] = 0.5 * norm * (la * la - lb * lb);
+          }
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int powr_c (double *val, Isis_User_Grid_t *g, double *par, unsigned int npar) /*{{{*/
 {
    double norm = par[0];
@@ -700,6 +890,9 @@ ISIS_USER_SOURCE_MODULE(Powerlaw,p,options) /*{{{*/
      return -1;
 
    p->binned = powr_b;
+   p->binned_gradient = powr_g;
+   p->cacheable = 1;
+   p->thread_safe = 1;
    p->function_exit = NULL;
    p->unbinned = powr_c;
    p->init_params_from_screen = NULL;
@@ -733,6 +926,25 @@ static double planck (double e, double t) /*{{{*/
 
 /*}}}*/
 
+/* d(planck)/dt */
+static double planck_dt (double e, double t) /*{{{*/
+{
+   double min_exp = 1.e-13;
+   double max_exp = 500.0;
+   double x = e / t;
+   double ex;
+
+   if (x < min_exp)
+     return e;
+   else if (x > max_exp)
+     return 0.0;
+
+   ex = exp (x);
+   return e * e * ex * (x / t) / ((ex - 1.0) * (ex - 1.0));
+}
+
+/*}}}*/
+
 static int bbody_b (double *val, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
 {
    double t, norm;
@@ -763,6 +975,37 @@ static int bbody_b (double *val, Isis_Hist_t *g, double *par, unsigned int npar)
 
 /*}}}*/
 
+/* derivatives of the bin-integrated model */
+static int bbody_g (double **grad, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
+{
+   double t, coef;
+   int i;
+
+   (void) npar;
+
+   if (par[1] <= 0.0)
+     return -1;
+
+   t    = par[1];
+   coef = 8.0525 / pow (t, 4.0);
+
+   for (i=0; i < g->n_notice; i++)
+     {
+        double elo, ehi, p, dp;
+        int n = g->notice_list[i];
+        elo = KEV_ANGSTROM / g->bin_hi[n];
+        ehi = KEV_ANGSTROM / g->bin_lo[n];
+        p = 0.5 * (planck (ehi, t) + planck (elo, t));
+        dp = 0.5 * (planck_dt (ehi, t) + planck_dt (elo, t));
+        grad[0][i] = p * coef * (ehi - elo);
+        grad[1][i] = par[0] * coef * (dp - 4.0 * p / t) * (ehi - elo);
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 ISIS_USER_SOURCE_MODULE(blackbody,p,options) /*{{{*/
 {
    static char *names[] = {"norm", "kT", NULL};
@@ -778,6 +1021,9 @@ ISIS_USER_SOURCE_MODULE(blackbody,p,options) /*{{{*/
      return -1;
 
    p->binned = bbody_b;
+   p->binned_gradient = bbody_g;
+   p->cacheable = 1;
+   p->thread_safe = 1;
    p->function_exit = NULL;
    p->unbinned = NULL;
    p->init_params_from_screen = NULL;
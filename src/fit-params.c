@@ -55,9 +55,38 @@ enum
    ALL_PARS = 1
 };
 
+/* The lookup index is kept in the head of the list.  It is
+ * rebuilt on demand after any change to the layout of the table,
+ * i.e. to the set of functions, or to the index, freeze, tie,
+ * or derived status of any parameter.  Changes to parameter values
+ * or limits do not affect it.
+ */
+typedef struct
+{
+   int valid;
+   Param_Info_t **by_idx;         /* [max_idx + 1] */
+   unsigned int max_idx;
+   Param_Info_t **by_vary_idx;    /* [max_vary_idx + 1] */
+   unsigned int max_vary_idx;
+   Param_t **fun_hash;            /* [fun_hash_size] */
+   unsigned int fun_hash_size;
+   Param_Info_t **all;            /* in_use params, in table order */
+   unsigned int num_all;
+   Param_Info_t **variable;       /* not frozen or tied, in table order */
+   unsigned int num_variable;
+   Param_Info_t **derived;        /* defined by a function */
+   unsigned int num_derived;
+   Param_Info_t **tied;           /* tied params, in table order ... */
+   Param_Info_t **tie_target;     /* ... and their targets, or NULL */
+   unsigned int num_tied;
+}
+Param_Index_Type;
+
 struct Param_t
 {
    Param_t *next_fun;
+   Param_t *next_hash;
+   Param_Index_Type *index;     /* head of the list only */
    Param_Info_t *info;
    unsigned int num_params;
    unsigned int fun_id;
@@ -111,11 +140,26 @@ static Param_Info_t *new_param_info (unsigned int num_params) /*{{{*/
 
 /*}}}*/
 
+static void free_param_index (Param_Index_Type *ix) /*{{{*/
+{
+   if (ix == NULL)
+     return;
+
+   ISIS_FREE (ix->by_idx);
+   ISIS_FREE (ix->by_vary_idx);
+   ISIS_FREE (ix->fun_hash);
+   ISIS_FREE (ix->all);
+   ISIS_FREE (ix);
+}
+
+/*}}}*/
+
 void Fit_free_param_table (Param_t *pt) /*{{{*/
 {
    while (pt)
      {
         Param_t *tmp = pt->next_fun;
+        free_param_index (pt->index);
         free_param_info (pt->info, pt->num_params);
         ISIS_FREE (pt);
         pt = tmp;
@@ -159,7 +203,155 @@ Param_t *Fit_new_param_table (unsigned int num_params,  /*{{{*/
 
 /* build and search parameter table */
 
-static Param_t *locate_fun_params (Param_t *pt, unsigned int fun_type, unsigned int fun_id) /*{{{*/
+static void invalidate_param_index (Param_t *pt) /*{{{*/
+{
+   if ((pt != NULL) && (pt->index != NULL))
+     pt->index->valid = 0;
+}
+
+/*}}}*/
+
+static unsigned int hash_fun (unsigned int fun_type, unsigned int fun_id, unsigned int size) /*{{{*/
+{
+   /* size is a power of 2 */
+   return (fun_type * 31u + fun_id * 2654435761u) & (size - 1);
+}
+
+/*}}}*/
+
+static int build_param_index (Param_t *head, Param_Index_Type *ix) /*{{{*/
+{
+   Param_t *pt;
+   Param_Info_t **all;
+   unsigned int num_funs = 0, num_params = 0, size, i, k;
+
+   ISIS_FREE (ix->by_idx);
+   ISIS_FREE (ix->by_vary_idx);
+   ISIS_FREE (ix->fun_hash);
+   ISIS_FREE (ix->all);
+   ix->max_idx = ix->max_vary_idx = 0;
+   ix->num_all = ix->num_variable = ix->num_derived = ix->num_tied = 0;
+
+   for (pt = head; pt != NULL; pt = pt->next_fun)
+     {
+        num_funs++;
+        num_params += pt->num_params;
+        for (i = 0; i < pt->num_params; i++)
+          {
+             Param_Info_t *p = &pt->info[i];
+             if (p->in_use == 0)
+               continue;
+             if (p->idx > ix->max_idx)
+               ix->max_idx = p->idx;
+             if ((p->freeze == 0) && (p->tie_param_name == NULL)
+                 && (p->vary_idx > ix->max_vary_idx))
+               ix->max_vary_idx = p->vary_idx;
+          }
+     }
+
+   for (size = 16; size < 2 * num_funs; size *= 2)
+     ;
+   ix->fun_hash_size = size;
+
+   /* one allocation for the lists, which hold at most num_params each */
+   if ((NULL == (ix->by_idx = (Param_Info_t **) ISIS_MALLOC ((ix->max_idx + 1) * sizeof(Param_Info_t *))))
+       || (NULL == (ix->by_vary_idx = (Param_Info_t **) ISIS_MALLOC ((ix->max_vary_idx + 1) * sizeof(Param_Info_t *))))
+       || (NULL == (ix->fun_hash = (Param_t **) ISIS_MALLOC (size * sizeof(Param_t *))))
+       || (NULL == (all = (Param_Info_t **) ISIS_MALLOC ((5 * num_params + 1) * sizeof(Param_Info_t *)))))
+     return -1;
+
+   memset ((char *)ix->by_idx, 0, (ix->max_idx + 1) * sizeof(Param_Info_t *));
+   memset ((char *)ix->by_vary_idx, 0, (ix->max_vary_idx + 1) * sizeof(Param_Info_t *));
+   memset ((char *)ix->fun_hash, 0, size * sizeof(Param_t *));
+
+   ix->all = all;
+   ix->variable = all + num_params;
+   ix->derived = all + 2 * num_params;
+   ix->tied = all + 3 * num_params;
+   ix->tie_target = all + 4 * num_params;
+
+   for (pt = head; pt != NULL; pt = pt->next_fun)
+     {
+        Param_t **slot;
+
+        /* keep table order within each hash chain */
+        pt->next_hash = NULL;
+        slot = &ix->fun_hash[hash_fun (pt->fun_type, pt->fun_id, size)];
+        while (*slot != NULL)
+          slot = &(*slot)->next_hash;
+        *slot = pt;
+
+        for (i = 0; i < pt->num_params; i++)
+          {
+             Param_Info_t *p = &pt->info[i];
+
+             if (p->in_use == 0)
+               continue;
+
+             ix->all[ix->num_all++] = p;
+
+             if (ix->by_idx[p->idx] == NULL)
+               ix->by_idx[p->idx] = p;
+
+             if ((p->freeze == 0) && (p->tie_param_name == NULL))
+               {
+                  ix->variable[ix->num_variable++] = p;
+                  if (ix->by_vary_idx[p->vary_idx] == NULL)
+                    ix->by_vary_idx[p->vary_idx] = p;
+               }
+
+             if (p->fun_str != NULL)
+               ix->derived[ix->num_derived++] = p;
+
+             if (p->tie_param_name != NULL)
+               ix->tied[ix->num_tied++] = p;
+          }
+     }
+
+   ix->valid = 1;
+
+   /* ties are resolved by name, which needs the index */
+   for (k = 0; k < ix->num_tied; k++)
+     {
+        Param_Info_t *t = Fit_find_param_info_by_full_name (head, ix->tied[k]->tie_param_name);
+        ix->tie_target[k] = ((t != NULL) && t->in_use) ? t : NULL;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static Param_Index_Type *get_param_index (Param_t *pt) /*{{{*/
+{
+   Param_Index_Type *ix;
+
+   if (pt == NULL)
+     return NULL;
+
+   if ((NULL != (ix = pt->index)) && ix->valid)
+     return ix;
+
+   if (ix == NULL)
+     {
+        if (NULL == (ix = (Param_Index_Type *) ISIS_MALLOC (sizeof *ix)))
+          return NULL;
+        memset ((char *)ix, 0, sizeof *ix);
+        pt->index = ix;
+     }
+
+   if (-1 == build_param_index (pt, ix))
+     {
+        ix->valid = 0;
+        return NULL;
+     }
+
+   return ix;
+}
+
+/*}}}*/
+
+static Param_t *scan_fun_params (Param_t *pt, unsigned int fun_type, unsigned int fun_id) /*{{{*/
 {
    while (pt)
      {
@@ -173,6 +365,25 @@ static Param_t *locate_fun_params (Param_t *pt, unsigned int fun_type, unsigned
 
 /*}}}*/
 
+static Param_t *locate_fun_params (Param_t *pt, unsigned int fun_type, unsigned int fun_id) /*{{{*/
+{
+   Param_Index_Type *ix;
+   Param_t *f;
+
+   if (NULL == (ix = get_param_index (pt)))
+     return scan_fun_params (pt, fun_type, fun_id);
+
+   for (f = ix->fun_hash[hash_fun (fun_type, fun_id, ix->fun_hash_size)]; f != NULL; f = f->next_hash)
+     {
+        if ((f->fun_type == fun_type) && (f->fun_id == fun_id))
+          return f;
+     }
+
+   return NULL;
+}
+
+/*}}}*/
+
 static int map_table (Param_t *pt, int which, int (*fun)(Param_Info_t *, void *), void *cl) /*{{{*/
 {
    while (pt)
@@ -198,6 +409,11 @@ static int map_table (Param_t *pt, int which, int (*fun)(Param_Info_t *, void *)
 
 static Param_Info_t *find_param_by_index (Param_t *pt, unsigned int idx) /*{{{*/
 {
+   Param_Index_Type *ix;
+
+   if (NULL != (ix = get_param_index (pt)))
+     return (idx <= ix->max_idx) ? ix->by_idx[idx] : NULL;
+
    while (pt)
      {
         unsigned int i;
@@ -217,6 +433,11 @@ static Param_Info_t *find_param_by_index (Param_t *pt, unsigned int idx) /*{{{*/
 
 static Param_Info_t *find_param_by_vary_index (Param_t *pt, unsigned int vary_idx) /*{{{*/
 {
+   Param_Index_Type *ix;
+
+   if (NULL != (ix = get_param_index (pt)))
+     return (vary_idx <= ix->max_vary_idx) ? ix->by_vary_idx[vary_idx] : NULL;
+
    while (pt)
      {
         unsigned int i;
@@ -239,19 +460,17 @@ static Param_Info_t *find_param_by_vary_index (Param_t *pt, unsigned int vary_id
 
 Param_Info_t *Fit_param_info2 (Param_t *pt, unsigned int fun_type, unsigned int fun_id, unsigned int fun_par) /*{{{*/
 {
-   while (pt)
+   unsigned int i;
+
+   /* functions are registered once, so there is only one match */
+   if (NULL == (pt = locate_fun_params (pt, fun_type, fun_id)))
+     return NULL;
+
+   for (i = 0; i < pt->num_params; i++)
      {
-        if ((pt->fun_type == fun_type) && (pt->fun_id == fun_id))
-          {
-             unsigned int i;
-             for (i = 0; i < pt->num_params; i++)
-               {
-                  Param_Info_t *p = &pt->info[i];
-                  if (p->in_use && (p->fun_par == fun_par))
-                    return p;
-               }
-          }
-        pt = pt->next_fun;
+        Param_Info_t *p = &pt->info[i];
+        if (p->in_use && (p->fun_par == fun_par))
+          return p;
      }
 
    return NULL;
@@ -455,6 +674,7 @@ static int mark_unused (Param_Info_t *p, void *cl) /*{{{*/
 
 int Fit_mark_params_unused (Param_t *pt) /*{{{*/
 {
+   invalidate_param_index (pt);
    return map_table (pt, ALL_PARS, mark_unused, NULL);
 }
 
@@ -481,15 +701,15 @@ static int delete_fun_params (Param_t *pt, unsigned int fun_type, unsigned int f
 
 /*}}}*/
 
-int Fit_register_fun (Param_t *pt, Fit_Fun_t *ff, unsigned int fun_id,  /*{{{*/
-                      unsigned int *idx)
+static int register_fun (Param_t *pt, Fit_Fun_t *ff, unsigned int fun_id,  /*{{{*/
+                         unsigned int *idx)
 {
    Param_t *fun = NULL;
    Param_Info_t *p = NULL;
    unsigned int i = 0;
 
    /* no duplicates */
-   fun = locate_fun_params (pt, ff->fun_type, fun_id);
+   fun = scan_fun_params (pt, ff->fun_type, fun_id);
    if (fun)
      {
         if (fun->fun_version == ff->fun_version)
@@ -544,6 +764,22 @@ int Fit_register_fun (Param_t *pt, Fit_Fun_t *ff, unsigned int fun_id,  /*{{{*/
 }
 /*}}}*/
 
+int Fit_register_fun (Param_t *pt, Fit_Fun_t *ff, unsigned int fun_id,  /*{{{*/
+                      unsigned int *idx)
+{
+   int status;
+
+   /* parameter default hooks may look things up in the
+    * table while it is being changed */
+   invalidate_param_index (pt);
+   status = register_fun (pt, ff, fun_id, idx);
+   invalidate_param_index (pt);
+
+   return status;
+}
+
+/*}}}*/
+
 /* parameter table access */
 
 static int update_tie (Param_Info_t *p, void *cl) /*{{{*/
@@ -574,7 +810,30 @@ static int update_tie (Param_Info_t *p, void *cl) /*{{{*/
 
 static int update_tied_params (Param_t *pt) /*{{{*/
 {
-   return map_table (pt, ALL_PARS, update_tie, pt);
+   Param_Index_Type *ix;
+   unsigned int k;
+
+   if (NULL == (ix = get_param_index (pt)))
+     return map_table (pt, ALL_PARS, update_tie, pt);
+
+   for (k = 0; k < ix->num_tied; k++)
+     {
+        Param_Info_t *p = ix->tied[k];
+        Param_Info_t *tie_info = ix->tie_target[k];
+
+        if (tie_info == NULL)
+          {
+             isis_vmesg (FAIL, I_WARNING, __FILE__, __LINE__, "parameter %d tie is invalid",
+                         p->idx);
+             return -1;
+          }
+
+        p->value = tie_info->value;
+        if (-1 == set_param_minmax (p, tie_info->min, tie_info->max))
+          return -1;
+     }
+
+   return 0;
 }
 
 /*}}}*/
@@ -622,7 +881,36 @@ static int update_derived (Param_Info_t *p, void *cl) /*{{{*/
 
 static int update_derived_params (Param_t *pt, int out_of_range_severity) /*{{{*/
 {
-   return map_table (pt, ALL_PARS, update_derived, (void *)&out_of_range_severity);
+   Param_Index_Type *ix;
+   unsigned int k;
+
+   if (NULL == (ix = get_param_index (pt)))
+     return map_table (pt, ALL_PARS, update_derived, (void *)&out_of_range_severity);
+
+   /* A parameter function could conceivably change the table,
+    * so re-read the list each time. */
+   for (k = 0; k < ix->num_derived; k++)
+     {
+        if (update_derived (ix->derived[k], (void *)&out_of_range_severity))
+          return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+/* Returns 1 if some parameter value is computed by a function,
+ * in which case Fit_get_fun_params may call the interpreter.
+ */
+int Fit_have_derived_params (Param_t *pt) /*{{{*/
+{
+   Param_Index_Type *ix;
+
+   if (NULL == (ix = get_param_index (pt)))
+     return 1;
+
+   return ix->num_derived > 0;
 }
 
 /*}}}*/
@@ -710,6 +998,8 @@ int Fit_set_param_control (Param_t *pt, unsigned int idx, int update_minmax,  /*
    if (p == NULL)
      return -1;
 
+   invalidate_param_index (pt);
+
    if (update_minmax)
      {
         if (-1 == set_param_minmax (p, min, max))
@@ -772,6 +1062,7 @@ int Fit_set_freeze (Param_t *pt, unsigned int idx, unsigned int freeze) /*{{{*/
         return 0;
      }
 
+   invalidate_param_index (pt);
    p->freeze = (freeze == 0) ? 0 : 1;
    return 0;
 }
@@ -785,6 +1076,7 @@ int Fit_tie (Param_t *pt, unsigned int idx_a, unsigned int idx_b) /*{{{*/
      return -1;
    /* tie (0, idx) is the same as untie(idx) */
    x = find_param_by_index (pt, idx_b);
+   invalidate_param_index (pt);
    ISIS_FREE(p->tie_param_name);
    if (x != NULL)
      {
@@ -808,6 +1100,7 @@ int Fit_untie (Param_t *pt, unsigned int idx) /*{{{*/
    Param_Info_t *p;
    if (NULL == (p = find_param_by_index (pt, idx)))
      return -1;
+   invalidate_param_index (pt);
    ISIS_FREE(p->tie_param_name);
    return 0;
 }
@@ -822,6 +1115,8 @@ int Fit_set_param_function (Param_t *pt, unsigned int idx, char *str) /*{{{*/
    if (NULL == (p = find_param_by_index (pt, idx)))
      return -1;
 
+   invalidate_param_index (pt);
+
    if (str == NULL)
      {
         if (p->fun_str != NULL) p->freeze = 0;
@@ -852,6 +1147,7 @@ int Fit_set_param_function (Param_t *pt, unsigned int idx, char *str) /*{{{*/
 
    SLfree (fun_name);
    p->freeze = 1;
+   invalidate_param_index (pt);
 
    return update_derived_params (pt, INFO);
 }
@@ -880,9 +1176,8 @@ int Fit_get_param_value (Param_t *pt, unsigned int idx, double *value) /*{{{*/
 
 /*}}}*/
 
-double *Fit_get_kernel_params (Param_t *pt, int id, Isis_Kernel_Def_t *def) /*{{{*/
+int Fit_copy_kernel_params (Param_t *pt, int id, Isis_Kernel_Def_t *def, double *kp) /*{{{*/
 {
-   double *kp;
    Param_t *fun;
    unsigned int i;
 
@@ -890,17 +1185,38 @@ double *Fit_get_kernel_params (Param_t *pt, int id, Isis_Kernel_Def_t *def) /*{{
    if ((def == NULL)
        || (def->kernel_id == 0)
        || (def->num_kernel_parms == 0))
-     return NULL;
+     return -1;
 
    if (NULL == (fun = locate_fun_params (pt, def->fun_type, id)))
+     return -1;
+
+   for (i = 0; i < def->num_kernel_parms; i++)
+     {
+        kp[i] = fun->info[i].value;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+double *Fit_get_kernel_params (Param_t *pt, int id, Isis_Kernel_Def_t *def) /*{{{*/
+{
+   double *kp;
+
+   /* std kernel has kernel_id = 0 */
+   if ((def == NULL)
+       || (def->kernel_id == 0)
+       || (def->num_kernel_parms == 0))
      return NULL;
 
    if (NULL == (kp = (double *) ISIS_MALLOC (def->num_kernel_parms * sizeof(double))))
      return NULL;
 
-   for (i = 0; i < def->num_kernel_parms; i++)
+   if (-1 == Fit_copy_kernel_params (pt, id, def, kp))
      {
-        kp[i] = fun->info[i].value;
+        ISIS_FREE (kp);
+        return NULL;
      }
 
    return kp;
@@ -934,8 +1250,16 @@ static int count (Param_Info_t *p, void *cl) /*{{{*/
 
 int Fit_count_params (Param_t *pt, int *num_all, int *num_vary) /*{{{*/
 {
+   Param_Index_Type *ix;
    Count_Type num;
 
+   if (NULL != (ix = get_param_index (pt)))
+     {
+        *num_all = ix->num_all;
+        *num_vary = ix->num_variable;
+        return 0;
+     }
+
    num.all = 0;
    num.vary = 0;
 
@@ -983,6 +1307,9 @@ int Fit_pack_variable_params (Param_t *pt, Fit_Param_t *p) /*{{{*/
    if (-1 == update_derived_params (pt, INTR))
      return -1;
 
+   /* this assigns vary_idx */
+   invalidate_param_index (pt);
+
    if (-1 == map_table (pt, VARIABLE_PARS, pack, p))
      {
         isis_vmesg (FAIL, I_WARNING, __FILE__, __LINE__, "no variable parameters");
@@ -1001,6 +1328,8 @@ int Fit_pack_all_params (Param_t *pt, Fit_Param_t *p) /*{{{*/
    if (-1 == update_derived_params (pt, INTR))
      return -1;
 
+   invalidate_param_index (pt);
+
    if (-1 == map_table (pt, ALL_PARS, pack, p))
      {
         isis_vmesg (FAIL, I_WARNING, __FILE__, __LINE__, "no parameters");
@@ -1033,14 +1362,29 @@ static int unpack (Param_Info_t *p, void *cl) /*{{{*/
 }
 /*}}}*/
 
+static int unpack_list (Param_Info_t **list, unsigned int num, double *par) /*{{{*/
+{
+   unsigned int k;
+
+   for (k = 0; k < num; k++)
+     list[k]->value = par[k];
+
+   return 0;
+}
+
+/*}}}*/
+
 int Fit_unpack_variable_params (Param_t *pt, double *par) /*{{{*/
 {
+   Param_Index_Type *ix;
    Pack_Type x;
 
    x.par = par;
    x.n = 0;
 
-   if (-1 == map_table (pt, VARIABLE_PARS, unpack, &x))
+   if (NULL != (ix = get_param_index (pt)))
+     (void) unpack_list (ix->variable, ix->num_variable, par);
+   else if (-1 == map_table (pt, VARIABLE_PARS, unpack, &x))
      return -1;
 
    if (-1 == update_derived_params (pt, INTR))
@@ -1053,12 +1397,15 @@ int Fit_unpack_variable_params (Param_t *pt, double *par) /*{{{*/
 
 int Fit_unpack_all_params (Param_t *pt, double *par) /*{{{*/
 {
+   Param_Index_Type *ix;
    Pack_Type x;
 
    x.par = par;
    x.n = 0;
 
-   if (-1 == map_table (pt, ALL_PARS, unpack, &x))
+   if (NULL != (ix = get_param_index (pt)))
+     (void) unpack_list (ix->all, ix->num_all, par);
+   else if (-1 == map_table (pt, ALL_PARS, unpack, &x))
      return -1;
 
    if (-1 == update_derived_params (pt, INTR))
@@ -1069,6 +1416,147 @@ int Fit_unpack_all_params (Param_t *pt, double *par) /*{{{*/
 
 /*}}}*/
 
+/* Parameter values for one model evaluation, indexed by parameter
+ * index.  Each evaluation context keeps its own vector of values,
+ * so that several parameter vectors may be evaluated at once
+ * while the table, which defines the functions, ties and derived
+ * parameters, is only read.
+ */
+
+unsigned int Fit_num_param_values (Param_t *pt) /*{{{*/
+{
+   Param_Index_Type *ix;
+
+   if ((NULL == (ix = get_param_index (pt)))
+       || (ix->num_all == 0))
+     return 0;
+
+   return ix->max_idx + 1;
+}
+
+/*}}}*/
+
+int Fit_save_param_values (Param_t *pt, double *values) /*{{{*/
+{
+   Param_Index_Type *ix;
+   unsigned int k;
+
+   if ((values == NULL)
+       || (NULL == (ix = get_param_index (pt))))
+     return -1;
+
+   for (k = 0; k < ix->num_all; k++)
+     {
+        Param_Info_t *p = ix->all[k];
+        values[p->idx] = p->value;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+/* Unlike Fit_unpack_variable_params and Fit_unpack_all_params,
+ * this doesn't modify the table, and doesn't call the interpreter.
+ * It fails if some parameter is derived.
+ */
+int Fit_unpack_param_values (Param_t *pt, int all, double *par, double *values) /*{{{*/
+{
+   Param_Index_Type *ix;
+   Param_Info_t **list;
+   unsigned int k, num;
+
+   if ((NULL == (ix = get_param_index (pt)))
+       || (ix->num_derived > 0)
+       || (-1 == Fit_save_param_values (pt, values)))
+     return -1;
+
+   list = all ? ix->all : ix->variable;
+   num = all ? ix->num_all : ix->num_variable;
+
+   for (k = 0; k < num; k++)
+     values[list[k]->idx] = par[k];
+
+   for (k = 0; k < ix->num_tied; k++)
+     {
+        if (ix->tie_target[k] == NULL)
+          return -1;
+        values[ix->tied[k]->idx] = values[ix->tie_target[k]->idx];
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+/* If some parameter is derived, its value is recomputed, as by
+ * Fit_get_fun_params, so the interpreter may be called.
+ */
+static int copy_fun_param_values (Param_t *pt, double *values, /*{{{*/
+                                  unsigned int fun_type, unsigned int fun_id,
+                                  double *par, unsigned int num)
+{
+   Param_Index_Type *ix;
+   Param_t *fun;
+   unsigned int i;
+
+   if ((values == NULL)
+       || (NULL == (ix = get_param_index (pt))))
+     return -1;
+
+   if (ix->num_derived > 0)
+     {
+        unsigned int k;
+        if (-1 == update_derived_params (pt, INTR))
+          return -1;
+        for (k = 0; k < ix->num_derived; k++)
+          values[ix->derived[k]->idx] = ix->derived[k]->value;
+     }
+
+   if ((NULL == (fun = locate_fun_params (pt, fun_type, fun_id)))
+       || (num > fun->num_params))
+     return -1;
+
+   for (i = 0; i < num; i++)
+     {
+        if (fun->info[i].idx > ix->max_idx)
+          return -1;
+        par[i] = values[fun->info[i].idx];
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+int Fit_get_fun_param_values (Param_t *pt, double *values, /*{{{*/
+                              unsigned int fun_type, unsigned int fun_id,
+                              double *par)
+{
+   Param_t *fun;
+
+   if (NULL == (fun = locate_fun_params (pt, fun_type, fun_id)))
+     return -1;
+
+   return copy_fun_param_values (pt, values, fun_type, fun_id, par, fun->num_params);
+}
+
+/*}}}*/
+
+int Fit_copy_kernel_param_values (Param_t *pt, double *values, int id, /*{{{*/
+                                  Isis_Kernel_Def_t *def, double *kp)
+{
+   /* std kernel has kernel_id = 0 */
+   if ((def == NULL)
+       || (def->kernel_id == 0)
+       || (def->num_kernel_parms == 0))
+     return -1;
+
+   return copy_fun_param_values (pt, values, def->fun_type, id, kp, def->num_kernel_parms);
+}
+
+/*}}}*/
+
 int Fit_sync_tied_params (Param_t *pt)
 {
    return update_tied_params (pt);
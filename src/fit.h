@@ -61,6 +61,7 @@ extern int Fit_get_fun_type (char *name);
 extern int Fit_get_fun_par (Fit_Fun_t *ff, char *par_name);
 extern void Fit_get_fun_info (char *name);
 extern int Fit_is_valid_fit_fun (Fit_Fun_t *ff_test);
+extern int Fit_fun_is_compiled (Fit_Fun_t *ff);
 extern int Fit_set_fun_post_hook (char *fun_name);
 extern int Fit_set_fun_trace_hook (char *fun_name);
 
@@ -149,9 +150,15 @@ extern int Fit_pack_all_params (Param_t *pt, Fit_Param_t *p);
 extern int Fit_unpack_all_params (Param_t *pt, double *par);
 extern int Fit_sync_tied_params (Param_t *pt);
 extern int Fit_sync_derived_params (Param_t *pt);
+extern int Fit_have_derived_params (Param_t *pt);
 extern int Fit_count_params (Param_t *pt, int *num_all, int *num_vary);
 extern int Fit_pack_variable_params (Param_t *pt, Fit_Param_t *p);
 extern int Fit_unpack_variable_params (Param_t *pt, double * par);
+extern unsigned int Fit_num_param_values (Param_t *pt);
+extern int Fit_save_param_values (Param_t *pt, double *values);
+extern int Fit_unpack_param_values (Param_t *pt, int all, double *par, double *values);
+extern int Fit_get_fun_param_values (Param_t *pt, double *values,
+                                     unsigned int fun_type, unsigned int fun_id, double *par);
 
 extern int Fit_register_fun (Param_t *pt, Fit_Fun_t *ff, unsigned int fun_id,
                              unsigned int *addr);
@@ -189,6 +196,9 @@ extern int Fit_append_kernel (Isis_Kernel_Def_t *head, Isis_Kernel_Def_t *def);
 extern Isis_Kernel_Def_t * Fit_find_kernel (Isis_Kernel_Def_t *t, unsigned int kernel_id);
 extern Isis_Kernel_Def_t * Fit_find_kernel_by_name (Isis_Kernel_Def_t *t, char *kernel_name);
 extern double *Fit_get_kernel_params (Param_t *pt, int hist_index, Isis_Kernel_Def_t *def);
+extern int Fit_copy_kernel_params (Param_t *pt, int hist_index, Isis_Kernel_Def_t *def, double *kp);
+extern int Fit_copy_kernel_param_values (Param_t *pt, double *values, int hist_index,
+                                         Isis_Kernel_Def_t *def, double *kp);
 extern int Fit_set_kernel_param_default (Isis_Kernel_Def_t *def,
                                          int fun_par, Param_Info_t *p);
 
@@ -291,6 +301,10 @@ extern void verbose_info_hook (void *clientdata, double chisqr,
 
 extern int get_confidence_limits (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *ctrl,
                                   int idx, double *pconf_min, double *pconf_max);
+extern int get_confidence_limit_list (Fit_Object_Type *fo, Param_t *pt, Isis_Fit_CLC_Type *ctrl,
+                                      int *idx, unsigned int num, unsigned int max_restarts,
+                                      unsigned int max_param_retries,
+                                      double *pconf_min, double *pconf_max);
 
 /* engine */
 
@@ -333,6 +347,7 @@ extern Isis_Fit_Engine_Type *Isis_marquardt_feng (char *name, char *sname);
 extern Isis_Fit_Engine_Type *Isis_mpfit_feng (char *name, char *sname);
 extern Isis_Fit_Engine_Type *Isis_subplex_feng (char *name, char *sname);
 extern Isis_Fit_Engine_Type *Isis_simann_feng (char *name, char *sname);
+extern Isis_Fit_Engine_Type *Isis_diffev_feng (char *name, char *sname);
 extern Isis_Fit_Statistic_Type *Isis_chisqr_stat (void);
 extern Isis_Fit_Statistic_Type *Isis_cash_stat (void);
 extern Isis_Fit_Statistic_Type *Isis_ml_stat (void);
@@ -0,0 +1,164 @@
+/* -*- mode: C; mode: fold -*- */
+
+/*  This file is part of ISIS, the Interactive Spectral Interpretation System
+    Copyright (C) 1998-2019  Massachusetts Institute of Technology
+
+    This software was developed by the MIT Center for Space Research under
+    contract SV1-61010 from the Smithsonian Institution.
+
+    Author:  John C. Houck  <houck@space.mit.edu>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#include "isis.h"
+#include "util.h"
+#include "gpfvec.h"
+
+/* Cumulative normal distribution for arrays of arguments, used to
+ * integrate Gaussian line profiles over many bins at once.  The
+ * approximation is the same one used by isis_gpf.
+ */
+
+#define GPF_XMAX 6.0
+
+/*{{{ AVX2 version */
+
+#ifdef ISIS_HAVE_AVX2
+
+#include <immintrin.h>
+
+/* Exponential, following the Cephes library exp().
+ * Valid for -700 < x <= 0, with relative error of a few
+ * times 1.e-16.
+ */
+ISIS_AVX2_FUNCTION
+static __m256d exp4 (__m256d x) /*{{{*/
+{
+   __m256d n, xx, px, qx;
+   __m256i e;
+
+   /* x = n ln(2) + r,  |r| <= ln(2)/2 */
+   n = _mm256_round_pd (_mm256_mul_pd (x, _mm256_set1_pd (1.4426950408889634073599)),
+                        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+   x = _mm256_sub_pd (x, _mm256_mul_pd (n, _mm256_set1_pd (6.93145751953125E-1)));
+   x = _mm256_sub_pd (x, _mm256_mul_pd (n, _mm256_set1_pd (1.42860682030941723212E-6)));
+
+   xx = _mm256_mul_pd (x, x);
+
+   px = _mm256_set1_pd (1.26177193074810590878E-4);
+   px = _mm256_add_pd (_mm256_mul_pd (px, xx), _mm256_set1_pd (3.02994407707441961300E-2));
+   px = _mm256_add_pd (_mm256_mul_pd (px, xx), _mm256_set1_pd (9.99999999999999999910E-1));
+   px = _mm256_mul_pd (px, x);
+
+   qx = _mm256_set1_pd (3.00198505138664455042E-6);
+   qx = _mm256_add_pd (_mm256_mul_pd (qx, xx), _mm256_set1_pd (2.52448340349684104192E-3));
+   qx = _mm256_add_pd (_mm256_mul_pd (qx, xx), _mm256_set1_pd (2.27265548208155028766E-1));
+   qx = _mm256_add_pd (_mm256_mul_pd (qx, xx), _mm256_set1_pd (2.00000000000000000009E0));
+
+   x = _mm256_div_pd (px, _mm256_sub_pd (qx, px));
+   x = _mm256_add_pd (_mm256_set1_pd (1.0), _mm256_add_pd (x, x));
+
+   /* multiply by 2^n */
+   e = _mm256_cvtepi32_epi64 (_mm256_cvtpd_epi32 (n));
+   e = _mm256_slli_epi64 (_mm256_add_epi64 (e, _mm256_set1_epi64x (1023)), 52);
+
+   return _mm256_mul_pd (x, _mm256_castsi256_pd (e));
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static __m256d gpf4 (__m256d x) /*{{{*/
+{
+   const __m256d one = _mm256_set1_pd (1.0);
+   __m256d ax, t, p, g, neg, big;
+
+   ax = _mm256_andnot_pd (_mm256_set1_pd (-0.0), x);
+   big = _mm256_cmp_pd (ax, _mm256_set1_pd (GPF_XMAX), _CMP_GT_OQ);
+   neg = _mm256_cmp_pd (x, _mm256_setzero_pd (), _CMP_LT_OQ);
+
+   t = _mm256_div_pd (one, _mm256_add_pd (one, _mm256_mul_pd (_mm256_set1_pd (0.2316419), ax)));
+
+   p = _mm256_set1_pd (1.330274429);
+   p = _mm256_add_pd (_mm256_mul_pd (p, t), _mm256_set1_pd (-1.821255978));
+   p = _mm256_add_pd (_mm256_mul_pd (p, t), _mm256_set1_pd (1.781477937));
+   p = _mm256_add_pd (_mm256_mul_pd (p, t), _mm256_set1_pd (-0.356563782));
+   p = _mm256_add_pd (_mm256_mul_pd (p, t), _mm256_set1_pd (0.319381530));
+   p = _mm256_mul_pd (p, t);
+
+   /* keep the exponent in range for the lanes that saturate */
+   ax = _mm256_min_pd (ax, _mm256_set1_pd (2.0 * GPF_XMAX));
+   g = exp4 (_mm256_mul_pd (_mm256_set1_pd (-0.5), _mm256_mul_pd (ax, ax)));
+   p = _mm256_mul_pd (p, _mm256_mul_pd (_mm256_set1_pd (0.3989422804), g));
+
+   /* P(x) = p for x < 0, 1 - p otherwise; 0 or 1 beyond GPF_XMAX */
+   p = _mm256_andnot_pd (big, p);
+   return _mm256_blendv_pd (_mm256_sub_pd (one, p), p, neg);
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static void gpf_vector_avx2 (double *x, double *p, unsigned int n) /*{{{*/
+{
+   unsigned int i;
+
+   for (i = 0; i + 4 <= n; i += 4)
+     {
+        _mm256_storeu_pd (p + i, gpf4 (_mm256_loadu_pd (x + i)));
+     }
+
+   for ( ; i < n; i++)
+     {
+        p[i] = isis_gpf (x[i]);
+     }
+}
+
+/*}}}*/
+
+#endif
+
+/*}}}*/
+
+void isis_gpf_vector (double *x, double *p, unsigned int n) /*{{{*/
+{
+   unsigned int i;
+
+#ifdef ISIS_HAVE_AVX2
+   if ((n >= 4) && isis_cpu_has_avx2 ())
+     {
+        gpf_vector_avx2 (x, p, n);
+        return;
+     }
+#endif
+
+   for (i = 0; i < n; i++)
+     {
+        p[i] = isis_gpf (x[i]);
+     }
+}
+
+/*}}}*/
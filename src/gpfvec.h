@@ -0,0 +1,50 @@
+#ifndef ISIS_GPFVEC_H
+#define ISIS_GPFVEC_H
+
+/*  This file is part of ISIS, the Interactive Spectral Interpretation System
+    Copyright (C) 1998-2019  Massachusetts Institute of Technology
+
+    This software was developed by the MIT Center for Space Research under
+    contract SV1-61010 from the Smithsonian Institution.
+
+    Author:  John C. Houck  <houck@space.mit.edu>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+/* Sets p[i] = isis_gpf (x[i]) for i = 0 .. n-1.
+ *
+ * When the CPU supports AVX2, four values are computed at a time
+ * using a vectorized exponential.  The result then differs from
+ * isis_gpf by no more than a few units of rounding error.
+ */
+extern void isis_gpf_vector (double *x, double *p, unsigned int n);
+
+#if 0
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2659,6 +2659,7 @@ static Isis_Arf_t *_factor_rsp (Isis_Rmf_t *rmf) /*{{{*/
         Arf_free_arf (arf);
         return NULL;
      }
+   Rmf_matrix_changed (rmf);
 
    memset ((char *)arf->arf_err, 0, n * sizeof(double));
 
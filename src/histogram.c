@@ -128,6 +128,7 @@ struct _Hist_t
    Isis_Rsp_t f_rsp;             /* fit-response (used in fit) */
    Isis_Rsp_t a_rsp;             /* assigned response */
    Isis_Kernel_t *kernel;        /* fit kernel */
+   Isis_Kernel_Cache_t kernel_cache;     /* kept by the kernel across re-allocations */
 
    SLang_Name_Type *post_model_hook;
    void (*post_model_hook_delete)(SLang_Name_Type *);
@@ -178,6 +179,7 @@ struct _Hist_t
    int orig_nbins;               /* original number of bins */
    int *rebin;                   /* index array for rebinning scheme */
    int *orig_notice;             /* ONLY for recording ignore/notice on unbinned data */
+   int *fold_notice;             /* current notice flags mapped onto unbinned data */
    int *quality;                 /* quality flags, for ignore_bad */
 
    int  n_notice;                /* [R] number of noticed bins */
@@ -354,6 +356,7 @@ static void free_hist (Hist_t *h) /*{{{*/
    ISIS_FREE (h->respfile);
    ISIS_FREE (h->file);
    ISIS_FREE (h->orig_notice);
+   ISIS_FREE (h->fold_notice);
    ISIS_FREE (h->quality);
 
    SLang_free_function (h->pre_combine);
@@ -382,6 +385,8 @@ static void free_hist (Hist_t *h) /*{{{*/
      }
    release_rsp (&h->f_rsp);
    free_kernel (h);
+   if (h->kernel_cache.free_data != NULL)
+     (*h->kernel_cache.free_data)(h->kernel_cache.data);
 
    free_eval_grid_method (&h->eval_grid_method);
 
@@ -5028,6 +5033,11 @@ static int set_model_notice (Hist_t *h) /*{{{*/
           }
      }
 
+   /* keep the channel flags so the kernel can skip ignored channels */
+   ISIS_FREE (h->fold_notice);
+   h->fold_notice = notice;
+   notice = NULL;
+
    ret = 0;
    finish:
 
@@ -5058,8 +5068,11 @@ static int update_model_notice_list (Hist_t *h) /*{{{*/
         int i;
         for (i = 0; i < m->nbins; i++)
           m->notice[i] = 1;
+        ISIS_FREE (h->fold_notice);
      }
 
+   h->kernel->fold_notice = h->fold_notice;
+
    if (-1 == _update_notice_list (m->notice, &m->notice_list, &m->n_notice, m->nbins))
      return -1;
 
@@ -7523,8 +7536,13 @@ Isis_Kernel_t *isis_init_kernel (Isis_Kernel_t *k, unsigned int sizeof_kernel, /
 
    k->exposure_time = o->exposure_time;
    k->apply_rmf = o->apply_rmf;
+   k->apply_rmf_noticed = o->apply_rmf_noticed;
+   k->apply_rmf_multi = o->apply_rmf_multi;
+   k->compute_kernel_multi = NULL;
    k->num_orig_data = o->num_orig_data;
+   k->fold_notice = NULL;
    k->params = NULL;
+   k->cache = o->cache;
 
    k->frame_time = o->frame_time;
    k->tg_part = o->tg_part;
@@ -7573,10 +7591,13 @@ static int set_observation_info (Isis_Obs_t *o, Hist_t *h) /*{{{*/
    o->rsp = h->f_rsp;
 
    o->apply_rmf = &Rmf_apply_rmf;
+   o->apply_rmf_noticed = &Rmf_apply_rmf_noticed;
+   o->apply_rmf_multi = &Rmf_apply_rmf_multi;
    o->num_orig_data = h->orig_nbins;
    o->frame_time = h->frame_time;
    o->tg_part = h->part;
    o->tg_m = h->order;
+   o->cache = &h->kernel_cache;
 
    if (-1 == get_exposure_time (h, &o->exposure_time))
      return -1;
@@ -159,7 +159,7 @@ extern int Hist_set_pre_combine_hook (Hist_t *h, SLang_Name_Type *hook);
 typedef struct
 {
    int (*make_grid)(Hist_t *, void *);
-   int (*eval_model)(Hist_t *, Isis_Hist_t *);
+   int (*eval_model)(Hist_t *, Isis_Hist_t *, void *);   /* client data is the evaluation context */
    void *options;
    void (*destroy_options)(void *);
    int type;
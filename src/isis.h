@@ -36,10 +36,10 @@ extern "C" {
 #include <slang.h>
 
 #define ISIS_VERSION          10602
-#define ISIS_VERSION_STRING  "1.6.2-47"
+#define ISIS_VERSION_STRING  "1.6.2-77"
 #define ISIS_VERSION_PREFIX   1.6.2
 
-#define ISIS_API_VERSION 6
+#define ISIS_API_VERSION 10
 
 enum
 {
@@ -133,6 +133,15 @@ struct Isis_Rmf_t
 
    int (*rebin_rmf) (Isis_Rmf_t *, double *, double *, unsigned int);
    int (*factor_rsp) (Isis_Rmf_t *, double *);
+   /* optional: fold all noticed model bins in one call
+    *   (rmf, flux, notice_list, num_noticed, det_chan, num_det_chan, chan_notice)
+    * If chan_notice != NULL, only the noticed detector channels are computed. */
+   int (*fold)(Isis_Rmf_t *, double *, int *, int, double *, unsigned int, int *);
+   /* optional: fold num models at once, reading the matrix once
+    *   (rmf, flux, num, notice_list, num_noticed, det_chan, num_det_chan, chan_notice)
+    * flux[j*num_noticed + i] is noticed bin i of model j, folded into det_chan[j]. */
+   int (*fold_multi)(Isis_Rmf_t *, double *, unsigned int, int *, int, double **, unsigned int, int *);
+   unsigned int serial;                /* unique, and changes whenever the matrix does */
 
 #define ISIS_RMF_BUFSIZE  72
    int order;
@@ -238,6 +247,16 @@ extern int Isis_Hist_has_grid (Isis_Hist_t *x);
 typedef struct Isis_Kernel_t Isis_Kernel_t;
 typedef struct Isis_Kernel_Def_t Isis_Kernel_Def_t;
 
+/* Data a kernel keeps with its data set, so that it survives
+ * re-allocation of the kernel.  free_data identifies the owner.
+ */
+typedef struct
+{
+   void *data;
+   void (*free_data)(void *);
+}
+Isis_Kernel_Cache_t;
+
 typedef struct
 {
    double exposure_time;
@@ -245,9 +264,12 @@ typedef struct
    double dtcor;
    Isis_Rsp_t rsp;
    int (*apply_rmf)(Isis_Rmf_t *, double *, int, double *, int *, int);
+   int (*apply_rmf_noticed)(Isis_Rmf_t *, double *, int, double *, int *, int, int *);
+   int (*apply_rmf_multi)(Isis_Rmf_t *, double **, unsigned int, int, double *, int *, int, int *);
    int num_orig_data;
    int tg_part;
    int tg_m;
+   Isis_Kernel_Cache_t *cache;
 }
 Isis_Obs_t;
 
@@ -280,8 +302,17 @@ struct Isis_Kernel_Def_t
 
 struct Isis_Kernel_t
 {
+   /* The model is computed by the call fun(g,cl).  The client data
+    * cl carries the evaluation context, so a kernel should keep no
+    * per-evaluation state of its own. */
    int (*compute_kernel)(Isis_Kernel_t *, double *, Isis_Hist_t *, double *, unsigned int,
-                         int (*)(Isis_Hist_t *));
+                         int (*)(Isis_Hist_t *, void *), void *);
+   /* optional: compute num results, result[j] using the model computed
+    * by the call fun(g,j,cl).  This allows folding several models through
+    * the response in one pass. */
+   int (*compute_kernel_multi)(Isis_Kernel_t *, double **, unsigned int, Isis_Hist_t *,
+                               double *, unsigned int,
+                               int (*)(Isis_Hist_t *, unsigned int, void *), void *);
    int (*compute_flux)(Isis_Kernel_t *, double *, unsigned int, Isis_Hist_t *,
                        double *, double *, double *, double **, char *);
    void (*delete_kernel)(Isis_Kernel_t *);
@@ -292,13 +323,20 @@ struct Isis_Kernel_t
    double exposure_time;
    Isis_Rsp_t rsp;
    int (*apply_rmf)(Isis_Rmf_t *, double *, int, double *, int *, int);
+   int (*apply_rmf_noticed)(Isis_Rmf_t *, double *, int, double *, int *, int, int *);
+   /* (rmf, x, num, num_orig_data, arf_src, arf_notice_list, num_arf_noticed, chan_notice)
+    * folds num models; arf_src[j*num_arf_noticed + i] is bin i of model j. */
+   int (*apply_rmf_multi)(Isis_Rmf_t *, double **, unsigned int, int, double *, int *, int, int *);
    unsigned int num_orig_data;
+   int *fold_notice;    /* noticed detector channels (not re-binned), or NULL */
 
    char *params;
 
    int tg_part;
    int tg_m;
 
+   Isis_Kernel_Cache_t *cache;  /* belongs to the data set, or NULL */
+
 #ifdef ISIS_KERNEL_PRIVATE_DATA
    ISIS_KERNEL_PRIVATE_DATA
 #endif
@@ -378,6 +416,9 @@ Isis_User_Grid_t;
 
 typedef int Isis_Binned_Function_t (double *, Isis_Hist_t *, double *, unsigned int);
 typedef int Isis_Unbinned_Function_t (double *, Isis_User_Grid_t *, double *, unsigned int);
+/* grad[k][i] = d val[i] / d par[k] for the noticed bins.
+ * Return -1 if the derivatives aren't defined for these parameters. */
+typedef int Isis_Binned_Gradient_Function_t (double **, Isis_Hist_t *, double *, unsigned int);
 
 enum
 {
@@ -405,6 +446,9 @@ typedef struct
    unsigned int *default_freeze;
    unsigned int num_parameters;
    unsigned int category;          /* addmul, operator, etc. */
+   Isis_Binned_Gradient_Function_t *binned_gradient;  /* optional */
+   unsigned int cacheable;         /* value depends only on the parameters and grid */
+   unsigned int thread_safe;       /* may be evaluated in a worker thread */
 }
 Isis_User_Source_t;
 
@@ -505,9 +549,25 @@ typedef int Isis_Fit_Fun_Type(Isis_Fit_Statistic_Optional_Data_Type *opt_data,
                               double *x, unsigned int nbins,
                               double *par, unsigned int npars,
                               double *fx);
+typedef int Isis_Fit_Multi_Fun_Type(double *x, unsigned int nbins,
+                                    double **par, unsigned int npars,
+                                    unsigned int num, double **fx);
+typedef int Isis_Fit_Jacobian_Fun_Type(Isis_Fit_Statistic_Optional_Data_Type *opt_data,
+                                       double *x, unsigned int nbins,
+                                       double *par, unsigned int npars,
+                                       double *fx, double **dfdp);
 struct Isis_Fit_Type
 {
    Isis_Fit_Fun_Type *compute_model;
+   /* optional: evaluate num parameter vectors at once, e.g. for
+    * finite-difference derivatives.  May be NULL. */
+   Isis_Fit_Multi_Fun_Type *compute_models;
+   /* optional: compute the model and its exact derivatives,
+    * dfdp[k][i] = d fx[i] / d par[k].  Returns 1 if exact
+    * derivatives aren't available, so that finite differences
+    * should be used instead.  If dfdp is NULL, only reports
+    * whether they may be available.  May be NULL. */
+   Isis_Fit_Jacobian_Fun_Type *compute_jacobian;
    Isis_Fit_Engine_Type *engine;
    Isis_Fit_Statistic_Type *stat;
    double statistic;
@@ -112,7 +112,81 @@ static int howmany_iterations (Isis_Fit_Engine_Type *e) /*{{{*/
 
 /*}}}*/
 
+static double perturbed_param (Isis_Fit_Engine_Type *e, int i, double ai, double da) /*{{{*/
+{
+   double a_test = ai + da;
+
+   /* parameter value must stay in bounds */
+   if (a_test < e->par_min[i])
+     a_test = e->par_min[i];
+   else if (e->par_max[i] < a_test)
+     a_test = e->par_max[i];
+
+   return a_test;
+}
+
+/*}}}*/
+
+static double take_difference (double *dyda, double *y_1, double *y_a, /*{{{*/
+                               unsigned int ny, double da)
+{
+   double sumsq_diff = 0.0;
+   unsigned int k;
+
+   /* dyda and y_1 may be the same array */
+   for (k=0; k < ny; k++)
+     {
+        double diff = y_1[k] - y_a[k];
+        dyda[k] = diff / da;
+        sumsq_diff += diff * diff;
+     }
+
+   return sumsq_diff;
+}
+
+/*}}}*/
+
+/* Work space for the derivatives, allocated once per fit */
+typedef struct
+{
+   double **dyda;               /* [nparms][ny] */
+   double **a_list;             /* [nparms][nparms], NULL if unused */
+   double *y_1;                 /* [ny] */
+   unsigned int nparms;
+}
+Marq_Work_Type;
+
+static void free_marquardt_work (Marq_Work_Type *w) /*{{{*/
+{
+   JDMfree_double_matrix (w->dyda, w->nparms);
+   JDMfree_double_matrix (w->a_list, w->nparms);
+   ISIS_FREE (w->y_1);
+}
+
+/*}}}*/
+
+static int init_marquardt_work (Isis_Fit_Type *ft, Marq_Work_Type *w, /*{{{*/
+                                unsigned int ny, unsigned int nparms)
+{
+   memset ((char *)w, 0, sizeof *w);
+   w->nparms = nparms;
+
+   if ((NULL == (w->dyda = JDMdouble_matrix (nparms, ny)))
+       || (NULL == (w->y_1 = JDMdouble_vector (ny)))
+       || ((ft->compute_models != NULL)
+           && (NULL == (w->a_list = JDMdouble_matrix (nparms, nparms)))))
+     {
+        free_marquardt_work (w);
+        return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int _marquardt_compute_alpha_beta (Isis_Fit_Type *ft, void *clientdata, /*{{{*/
+                                          Marq_Work_Type *w,
                                           double **alpha, double *beta,
                                           double *x, double *y_dat,
                                           double *weight, unsigned int ny,
@@ -121,55 +195,86 @@ static int _marquardt_compute_alpha_beta (Isis_Fit_Type *ft, void *clientdata, /
 {
    Isis_Fit_Engine_Type *e = ft->engine;
    Isis_Fit_Statistic_Type *fs = ft->stat;
-   double *y_1 = NULL;
-   double **dyda = NULL;
+   double *y_1 = w->y_1;
+   double **dyda = w->dyda;
+   double **a_list = w->a_list;
    int i, count_max, num_pars = nparms;
+   int num_diff_pars = num_pars;
+   int batched = 0;
    unsigned int k;
    int ret = -1;
    
    if ((count_max = howmany_iterations (e)) < 0)
      return -1;
-   
-   if (NULL == (dyda = JDMdouble_matrix (nparms,ny))
-       || NULL == (y_1 = JDMdouble_vector (ny)))
-     goto finish;
 
-   for (i=0; i < num_pars; i++)
+   /* Use exact derivatives when the model provides them.
+    * Otherwise, num_diff_pars derivatives are computed by
+    * finite differences.
+    */
+   if (ft->compute_jacobian != NULL)
+     {
+        int status = ft->compute_jacobian (fs->opt_data, x, ny, a, nparms, y_1, dyda);
+        if (status == -1)
+          {
+             e->warn_hook (clientdata, "function evaluation failed\n");
+             goto finish;
+          }
+        if (status == 0)
+          num_diff_pars = 0;
+     }
+
+   /* If possible, compute the models for the first step in every
+    * parameter together, so that the response is folded only once.
+    * The results go straight into dyda.
+    */
+   if ((a_list != NULL) && (num_diff_pars > 1))
+     {
+        for (i=0; i < num_pars; i++)
+          {
+             double da = (fabs(a[i]) + sqrt(e->delta)) * sqrt(e->delta);
+             memcpy ((char *)a_list[i], (char *)a, nparms * sizeof(double));
+             a_list[i][i] = perturbed_param (e, i, a[i], da);
+          }
+
+        if (-1 == ft->compute_models (x, ny, a_list, nparms, nparms, dyda))
+          {
+             e->warn_hook (clientdata, "function evaluation failed\n");
+             goto finish;
+          }
+
+        memcpy ((char *)y_1, (char *)dyda[num_pars-1], ny * sizeof(double));
+        batched = 1;
+     }
+
+   for (i=0; i < num_diff_pars; i++)
      {
         double da, sumsq_diff;
         double ai = a[i];
-        double a_min = e->par_min[i];
-        double a_max = e->par_max[i];
         int count = 0;
 
         /* recommended by Nash */
         da = (fabs(ai) + sqrt(e->delta)) * sqrt(e->delta);
 
-        do
+        if (batched)
           {
-             double a_test = ai + da;
-
-             /* parameter value must stay in bounds */
-             if (a_test < a_min)
-               a_test = a_min;
-             else if (a_max < a_test)
-               a_test = a_max;
+             if (0.0 != take_difference (dyda[i], dyda[i], y_a, ny, da))
+               continue;
+             da *= 2;
+             count++;
+          }
 
-             a[i] = a_test;
+        do
+          {
+             a[i] = perturbed_param (e, i, ai, da);
 
              if (-1 == ft->compute_model (fs->opt_data, x, ny, a, nparms, y_1))
                {
                   e->warn_hook (clientdata, "function evaluation failed\n");
+                  a[i] = ai;
                   goto finish;
                }
              
-             sumsq_diff = 0.0;
-             for (k=0; k < ny; k++)
-               {
-                  double diff = y_1[k] - y_a[k];
-                  dyda[i][k] = diff / da;
-                  sumsq_diff += diff * diff;
-               }
+             sumsq_diff = take_difference (dyda[i], y_1, y_a, ny, da);
 
              a[i] = ai;
              da *= 2;
@@ -202,9 +307,6 @@ static int _marquardt_compute_alpha_beta (Isis_Fit_Type *ft, void *clientdata, /
    ret = 0;
 
    finish:
-
-   ISIS_FREE (y_1);
-   JDMfree_double_matrix (dyda,nparms);
       
    return ret;
 }
@@ -217,6 +319,7 @@ static int marquardt (Isis_Fit_Type *ft, void *clientdata, /*{{{*/
 {
    Isis_Fit_Engine_Type *e = ft->engine;
    Isis_Fit_Statistic_Type *fs = ft->stat;
+   Marq_Work_Type w;
    double **alpha = NULL;
    double **cov = NULL;
    double *beta, *a1, *y_1, *alpha_diag, *vec;
@@ -236,6 +339,12 @@ static int marquardt (Isis_Fit_Type *ft, void *clientdata, /*{{{*/
         return -1;
      }
 
+   if (-1 == init_marquardt_work (ft, &w, ny, nparms))
+     {
+        e->warn_hook (clientdata, "marquardt: allocation failed\n");
+        return -1;
+     }
+
    if (NULL == (alpha_diag = JDMdouble_vector (nparms))
        || NULL == (alpha = JDMdouble_matrix (nparms,nparms))
        || NULL == (cov = JDMdouble_matrix (nparms,nparms))
@@ -263,7 +372,7 @@ static int marquardt (Isis_Fit_Type *ft, void *clientdata, /*{{{*/
 
    for (i=0; i < e->max_loops; i++)
      {
-        if (-1 == _marquardt_compute_alpha_beta (ft, clientdata,
+        if (-1 == _marquardt_compute_alpha_beta (ft, clientdata, &w,
                                                  alpha, beta, x, y, weight, ny,
                                                  y_1, a, nparms))
           {
@@ -401,6 +510,7 @@ static int marquardt (Isis_Fit_Type *ft, void *clientdata, /*{{{*/
      }
 #endif
 
+   free_marquardt_work (&w);
    JDMfree_double_matrix (cov, nparms);
    JDMfree_double_matrix (alpha, nparms);
    ISIS_FREE (alpha_diag);
@@ -44,6 +44,7 @@
 #include "util.h"
 #include "_isis.h"
 #include "isismath.h"
+#include "gpfvec.h"
 #include "errors.h"
 /*}}}*/
 
@@ -154,6 +155,41 @@ static void median (void) /*{{{*/
 
 /*}}}*/
 
+/* Cumulative normal distribution, computed either by
+ * isis_gpf_vector or one element at a time by isis_gpf */
+static void gpf (int *use_vector) /*{{{*/
+{
+   SLang_Array_Type *sx = NULL, *sp = NULL;
+   double *x, *p;
+   unsigned int i, n;
+
+   if ((-1 == SLang_pop_array_of_type (&sx, SLANG_DOUBLE_TYPE))
+       || (sx == NULL)
+       || (NULL == (sp = SLang_create_array (SLANG_DOUBLE_TYPE, 0, NULL, sx->dims, sx->num_dims))))
+     {
+        isis_throw_exception (Isis_Error);
+        SLang_free_array (sx);
+        return;
+     }
+
+   x = (double *)sx->data;
+   p = (double *)sp->data;
+   n = sx->num_elements;
+
+   if (*use_vector)
+     isis_gpf_vector (x, p, n);
+   else
+     {
+        for (i = 0; i < n; i++)
+          p[i] = isis_gpf (x[i]);
+     }
+
+   SLang_push_array (sp, 1);
+   SLang_free_array (sx);
+}
+
+/*}}}*/
+
 typedef struct
 {
    int num;
@@ -930,6 +966,7 @@ static SLang_Intrin_Fun_Type Math_Intrinsics [] =
    MAKE_INTRINSIC_2("_fft1d", _fft1d, V, I, D),
    MAKE_INTRINSIC("_moment", moment, V, 0),
    MAKE_INTRINSIC("_median", median, V, 0),
+   MAKE_INTRINSIC_1("_gpf", gpf, V, I),
    MAKE_INTRINSIC("_ks_difference", ks_difference, D, 0),
    MAKE_INTRINSIC_1("_ks_probability", ks_probability, D, D),
    MAKE_INTRINSIC_1("_seed_random", seed_random, V, SLANG_ULONG_TYPE),
@@ -38,6 +38,7 @@
 #include "isis.h"
 #include "util.h"
 #include "errors.h"
+#include "statsum.h"
 
 /* ML statistic */
 
@@ -45,28 +46,12 @@ static int ml_function (Isis_Fit_Statistic_Type *st, /*{{{*/
                           double *y, double *fx, double *w, unsigned int npts,
                           double *vec, double *stat)
 {
-   double sum, s, *val;
-   unsigned int i;
+   double sum;
 
    (void) w;
    (void) st;
 
-   if (NULL == (val = (double *) ISIS_MALLOC (npts * sizeof(double))))
-     return -1;
-
-   for (i = 0; i < npts; i++)
-     {
-        double fxi = fx[i];
-        double log_fxi = (fxi > 0) ? log(fxi) : (double) DBL_MIN_10_EXP;
-
-        s = 2 * (fxi + lgamma (y[i] + 1) - y[i] * log_fxi);
-
-        val[i] = s;
-        vec[i] = s;
-     }
-
-   sum = isis_kahan_sum (val, npts);
-   ISIS_FREE(val);
+   sum = isis_ml_sum (y, fx, npts, vec);
 
    if (0 == isfinite (sum))
      sum = DBL_MAX;
@@ -831,6 +831,14 @@ static SLang_IConstant_Type Model_Intrin_Const [] = /*{{{*/
 };
 /*}}}*/
 
+static SLang_Intrin_Var_Type Model_Intrin_Vars [] = /*{{{*/
+{
+   MAKE_VARIABLE("Model_Num_Threads", &Model_Num_Threads, I, 0),
+   SLANG_END_INTRIN_VAR_TABLE
+};
+
+/*}}}*/
+
 static SLang_Intrin_Fun_Type Model_Intrinsics [] = /*{{{*/
 {
    MAKE_INTRINSIC_1("_load_ascii_model", _load_ascii_model, I, S),
@@ -934,6 +942,9 @@ int init_model_module_ns (char *ns_name) /*{{{*/
    if (-1 == SLns_add_intrin_fun_table (ns, Model_Intrinsics, NULL))
      return isis_trace_return(-1);
 
+   if (-1 == SLns_add_intrin_var_table (pub_ns, Model_Intrin_Vars, NULL))
+     return isis_trace_return(-1);
+
    return 0;
 }
 
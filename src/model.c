@@ -44,6 +44,8 @@
 #include "util.h"
 #include "model.h"
 #include "errors.h"
+#include "gpfvec.h"
+#include "threads.h"
 
 /*}}}*/
 
@@ -52,6 +54,8 @@
 static Isis_Line_Profile_Type *Model_Profile = NULL;
 static Isis_Line_Profile_Type map_thermal_profile;
 
+int Model_Num_Threads = 1;
+
 /*}}}*/
 
 /*{{{ new/free start/end */
@@ -469,46 +473,39 @@ void Model_set_profile_function (int idx) /*{{{*/
 
 /*}}}*/
 
-static int profile_thermal (double *f, double wllo, double wlhi, /*{{{*/
-                            double wl0, double atwt, double *params, int num_params,
-                            void *cl)
+static double thermal_sigma (double wl0, double atwt, double *params) /*{{{*/
 {
    double temperature = params[0];
    double vturb = params[1];
-   double sigma;
-   double dxl, dxh;
-
-   (void) num_params; (void) cl;
 
    /* use wl0 as the line center rather than the value listed
     * in the DB_line_t struct -- might be redshifted.
     */
 
-   sigma = (wl0 / CLIGHT) * sqrt (BOLTZ * temperature / atwt / AMU
-                                  + 0.5 * vturb * vturb);
-
-   dxh = (wlhi - wl0) / sigma;
-   dxl = (wllo - wl0) / sigma;
-
-   *f = isis_gpf (dxh) - isis_gpf (dxl);
-
-   return 0;
+   return (wl0 / CLIGHT) * sqrt (BOLTZ * temperature / atwt / AMU
+                                 + 0.5 * vturb * vturb);
 }
 
 /*}}}*/
 
-#define FAINT_TOL 1.e-4
-/* Line wing faintness limit.  Larger values should make the code run
- * faster but may underestimate the total contribution of faint
- * line wings.   Smaller will take more time, but should be more accurate.
+#define THERMAL_WING_SIGMA 6.0
+/* Line wings are computed out to this many sigma from line center.
+ * Beyond that, isis_gpf saturates, so more distant bins would get
+ * exactly zero anyway.
  */
 
+#define THERMAL_CHUNK 32
+/* Bins per call to isis_gpf_vector */
+
 static int map_thermal_profile (Isis_Hist_t *g, double flux, double wl, double atomic_weight, int mid, /*{{{*/
                                 double *profile_params, int num_profile_params, void *profile_options)
 {
-   double f, av, de, faint;
+   double x[2*THERMAL_CHUNK+2], p[2*THERMAL_CHUNK+2];
+   double sigma, wmin, wmax;
    double *wllo, *wlhi, *val;
-   int i, nbins;
+   int i, j, lo, hi, nbins;
+
+   (void) num_profile_params; (void) profile_options;
 
    if (g == NULL)
      return -1;
@@ -518,32 +515,56 @@ static int map_thermal_profile (Isis_Hist_t *g, double flux, double wl, double a
    val = g->val;
    nbins = g->nbins;
 
-   for (i = mid; i >= 0; i--)
-     {
-        if (-1 == profile_thermal (&f, wllo[i], wlhi[i], wl, atomic_weight,
-                                   profile_params, num_profile_params,
-                                   profile_options))
-          return -1;
-        de = f * flux;
-        av = fabs (val[i]);
-        faint = (av > 0.0) && (fabs(de) < FAINT_TOL * av);
-        val[i] += de;
-        if (faint)
-          break;
-     }
+   sigma = thermal_sigma (wl, atomic_weight, profile_params);
+   wmin = wl - THERMAL_WING_SIGMA * sigma;
+   wmax = wl + THERMAL_WING_SIGMA * sigma;
 
-   for (i = mid+1; i < nbins; i++)
+   lo = mid;
+   while (lo > 0 && wlhi[lo-1] > wmin)
+     lo--;
+   hi = mid;
+   while (hi < nbins-1 && wllo[hi+1] < wmax)
+     hi++;
+
+   for (i = lo; i <= hi; i += THERMAL_CHUNK)
      {
-        if (-1 == profile_thermal (&f, wllo[i], wlhi[i], wl, atomic_weight,
-                                   profile_params, num_profile_params,
-                                   profile_options))
-          return -1;
-        de = f * flux;
-        av = fabs (val[i]);
-        faint = (av > 0.0) && (fabs(de) < FAINT_TOL * av);
-        val[i] += de;
-        if (faint)
-          break;
+        int n = MIN(THERMAL_CHUNK, hi - i + 1);
+        int shared = 1;
+
+        /* adjacent bins usually share an edge */
+        for (j = 0; j < n-1; j++)
+          {
+             if (wlhi[i+j] != wllo[i+j+1])
+               {
+                  shared = 0;
+                  break;
+               }
+          }
+
+        if (shared)
+          {
+             x[0] = (wllo[i] - wl) / sigma;
+             for (j = 0; j < n; j++)
+               x[j+1] = (wlhi[i+j] - wl) / sigma;
+
+             isis_gpf_vector (x, p, n+1);
+
+             for (j = 0; j < n; j++)
+               val[i+j] += (p[j+1] - p[j]) * flux;
+          }
+        else
+          {
+             for (j = 0; j < n; j++)
+               {
+                  x[2*j  ] = (wllo[i+j] - wl) / sigma;
+                  x[2*j+1] = (wlhi[i+j] - wl) / sigma;
+               }
+
+             isis_gpf_vector (x, p, 2*n);
+
+             for (j = 0; j < n; j++)
+               val[i+j] += (p[2*j+1] - p[2*j]) * flux;
+          }
      }
 
    return 0;
@@ -687,8 +708,13 @@ return_status:
 
 /*}}}*/
 
+/* If line_flux is non-NULL, line_flux[k] gets the flux of the kth
+ * line in t, and the line fluxes in the wavelength tables are left
+ * for the caller to update.
+ */
 static int add_spread_lines (double *val, double *wllo, double *wlhi, int nbins, /*{{{*/
-                             EM_line_emis_t *t, Model_t *m, Model_Info_Type *info)
+                             EM_line_emis_t *t, Model_t *m, Model_Info_Type *info,
+                             double *line_flux)
 {
    Isis_Line_Profile_Type *map_profile;
    double thermal_profile_params[2];
@@ -777,12 +803,20 @@ static int add_spread_lines (double *val, double *wllo, double *wlhi, int nbins,
 
         flux *= m->rel_abund[Z];
 
-        /* Side-effect: increment line fluxes stored in wavelength tables: */
-        line->flux += flux;
-
         /* each model component remembers its contribution to the line flux */
         flux_f = (float) flux;
-        SLang_set_array_element (m->line_flux, &line->indx, &flux_f);
+
+        if (line_flux != NULL)
+          {
+             line_flux[k] = flux;
+             ((float *) m->line_flux->data)[line->indx] = flux_f;
+          }
+        else
+          {
+             /* Side-effect: increment line fluxes stored in wavelength tables: */
+             line->flux += flux;
+             SLang_set_array_element (m->line_flux, &line->indx, &flux_f);
+          }
 
         /* profile = NULL imples a delta function. */
         if (NULL == map_profile)
@@ -837,6 +871,363 @@ static int shift_grid_to_emitter_frame (EM_cont_type_t *cont, double *wllo, doub
 
 /*}}}*/
 
+static int add_model_component (Model_t *m, Model_Info_Type *info, EM_line_emis_t *emis_list, /*{{{*/
+                                float *ionpop_new, int include_contin, EM_cont_type_t *cont,
+                                double *wllo, double *wlhi, double *val, double *tmp_val,
+                                double *line_flux)
+{
+   double *val_ptr;
+   int i, cont_nbins = cont->nbins;
+
+   /* 1) Shift the input observer frame grid into the source frame
+    * 2) Compute the emissivity in each rest-frame bin
+    * 3) Shift the emissivity in each bin back to the observer frame,
+    *    (just the time-dilation factor, since I'm assuming that
+    *     the model values are photons/sec/whatever
+    *                      NOT ergs/sec/whatever!).
+    */
+
+   if (m->redshift != 0.0)
+     {
+        memset ((char *)tmp_val, 0, cont_nbins * sizeof(double));
+        val_ptr = tmp_val;
+     }
+   else val_ptr = val;
+
+   if (-1 == shift_grid_to_emitter_frame (cont, wllo, wlhi, m->redshift))
+     return -1;
+
+   if (emis_list != NULL)
+     {
+        if (-1 == add_spread_lines (val_ptr, cont->wllo, cont->wlhi, cont->nbins,
+                                    emis_list, m, info, line_flux))
+          return -1;
+     }
+
+   if (include_contin)
+     {
+        EM_cont_select_t s;
+        double m_norm;
+        double *c_val, *p_val;
+
+        s.Z = 0; s.q = -1;  s.rel_abun = m->rel_abund;
+        if (-1 == EM_get_continuum (cont, m->temperature, m->density, ionpop_new, &s, info->em))
+          return -1;
+
+        m_norm = m->norm;
+
+        switch (info->contrib_flag)
+          {
+           case MODEL_CONTIN_TRUE:
+             c_val = cont->true_contin;
+             for (i = 0; i < cont_nbins; i++)
+               val_ptr[i] += m_norm * c_val[i];
+             break;
+
+           case MODEL_CONTIN_PSEUDO:
+             c_val = cont->pseudo;
+             for (i = 0; i < cont_nbins; i++)
+               val_ptr[i] += m_norm * c_val[i];
+             break;
+
+           default:
+             c_val = cont->true_contin;
+             p_val = cont->pseudo;
+             for (i = 0; i < cont_nbins; i++)
+               val_ptr[i] += m_norm * (c_val[i] + p_val[i]);
+             break;
+          }
+     }
+
+   if (m->redshift != 0.0)
+     {
+        float gm = lorentz_gamma (m->redshift);
+        for (i = 0; i < cont_nbins; i++)
+          val[i] += tmp_val[i] / gm;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int init_line_flux (Model_t *m, SLindex_Type db_nlines) /*{{{*/
+{
+   if (m->line_flux == NULL)
+     {
+        if (NULL == (m->line_flux = SLang_create_array (SLANG_FLOAT_TYPE, 1, NULL, &db_nlines, 1)))
+          return -1;
+     }
+   memset ((char *)m->line_flux->data, 0, db_nlines * sizeof(float));
+   return 0;
+}
+
+/*}}}*/
+
+/*{{{ threaded evaluation */
+
+/* When Model_Num_Threads > 1, the components are divided among
+ * several threads, each of which sums its components into a
+ * private spectrum.  Everything that calls S-Lang or touches shared
+ * state -- the ionpop modifier, the line spectrum cache, the line
+ * fluxes in the wavelength tables -- is handled before or after
+ * the threads run, in component order.
+ */
+
+typedef struct
+{
+   Model_t *m;
+   EM_line_emis_t *emis_list;
+   float *ionpop_new;
+   double *line_flux;          /* [nlines] flux of each line in emis_list */
+   int computed;               /* emis_list not found in the cache */
+}
+Component_Task_Type;
+
+typedef struct
+{
+   Model_Info_Type *info;
+   Component_Task_Type *comp;
+   unsigned int num_comp;
+   char *flag;
+   double *wllo, *wlhi;
+   int include_lines, include_contin;
+   EM_cont_type_t **cont;      /* [num_threads] */
+   double **val;               /* [num_threads] */
+   double **tmp_val;           /* [num_threads] */
+}
+Spectrum_Task_Type;
+
+static int use_threads (Model_t *h, Model_Info_Type *info) /*{{{*/
+{
+   return ((Model_Num_Threads > 1)
+           && (h->next != NULL)
+           && (info->line_emis_modifier == NULL)
+           && (info->profile == NULL)
+           && EM_is_memory_resident ()
+           && isis_have_threads ());
+}
+
+/*}}}*/
+
+static int model_component_task (void *cl, unsigned int thread, unsigned int num_threads) /*{{{*/
+{
+   Spectrum_Task_Type *st = (Spectrum_Task_Type *)cl;
+   unsigned int c;
+
+   for (c = thread; c < st->num_comp; c += num_threads)
+     {
+        Component_Task_Type *ct = &st->comp[c];
+        Model_t *m = ct->m;
+
+        if (st->include_lines && (ct->emis_list == NULL))
+          {
+             ct->emis_list = EM_compute_line_spectrum (st->flag, m->temperature, m->density,
+                                                       ct->ionpop_new, st->info->em);
+             if (ct->emis_list == NULL)
+               return -1;
+             ct->computed = 1;
+          }
+
+        if (ct->emis_list != NULL)
+          {
+             int nlines = EM_get_nlines (ct->emis_list);
+             if (NULL == (ct->line_flux = (double *) ISIS_MALLOC (nlines * sizeof(double))))
+               return -1;
+             memset ((char *)ct->line_flux, 0, nlines * sizeof(double));
+          }
+
+        if (-1 == add_model_component (m, st->info, ct->emis_list, ct->ionpop_new,
+                                       st->include_contin, st->cont[thread],
+                                       st->wllo, st->wlhi, st->val[thread],
+                                       st->tmp_val[thread], ct->line_flux))
+          return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int merge_line_fluxes (Component_Task_Type *ct) /*{{{*/
+{
+   int k, nlines;
+
+   if (ct->emis_list == NULL)
+     return 0;
+
+   nlines = EM_get_nlines (ct->emis_list);
+
+   for (k = 0; k < nlines; k++)
+     {
+        DB_line_t *line;
+        float emis, wl;
+
+        if (-1 == _EM_get_line_emis_wl (&line, &emis, &wl, k, ct->emis_list))
+          return -1;
+
+        line->flux += ct->line_flux[k];
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int threaded_model_spectrum (Model_t *h, Model_Info_Type *info, char *flag, /*{{{*/
+                                    double *wllo, double *wlhi, int nbins, double *val,
+                                    int include_lines, int include_contin,
+                                    SLindex_Type db_nlines)
+{
+   Spectrum_Task_Type st;
+   Model_t *m;
+   unsigned int c, t, num_comp, num_threads = 0;
+   int i, n, ret = -1;
+
+   memset ((char *)&st, 0, sizeof st);
+   st.info = info;
+   st.flag = flag;
+   st.wllo = wllo;
+   st.wlhi = wlhi;
+   st.include_lines = include_lines;
+   st.include_contin = include_contin;
+
+   num_comp = 0;
+   for (m = h; m != NULL; m = m->next)
+     num_comp++;
+
+   if (NULL == (st.comp = (Component_Task_Type *) ISIS_MALLOC (num_comp * sizeof(Component_Task_Type))))
+     return -1;
+   memset ((char *)st.comp, 0, num_comp * sizeof(Component_Task_Type));
+
+   n = ISIS_MAX_PROTON_NUMBER+1;
+
+   for (m = h; m != NULL; m = m->next)
+     {
+        Component_Task_Type *ct;
+
+        if (isis_user_break())
+          {
+             ret = 0;
+             goto finish;
+          }
+
+        if (-1 == init_line_flux (m, db_nlines))
+          goto finish;
+
+        if (m->norm == 0)
+          continue;
+
+        ct = &st.comp[st.num_comp++];
+        ct->m = m;
+
+        if (info->ionpop_modifier != NULL)
+          {
+             if (NULL == (ct->ionpop_new = (float *) ISIS_MALLOC (n*n*sizeof(float))))
+               goto finish;
+             /* start from the previous component's values, as the serial code does */
+             if (st.num_comp > 1)
+               memcpy ((char *)ct->ionpop_new, (char *)st.comp[st.num_comp-2].ionpop_new, n*n*sizeof(float));
+             else
+               memset ((char *)ct->ionpop_new, 0, n*n*sizeof(float));
+             if (-1 == call_ionpop_modifier (m, info, ct->ionpop_new))
+               goto finish;
+          }
+
+        if (include_lines)
+          {
+             ct->emis_list = EM_lookup_line_spectrum (flag, m->temperature, m->density,
+                                                      ct->ionpop_new, info->em);
+          }
+     }
+
+   if (st.num_comp == 0)
+     {
+        ret = 0;
+        goto finish;
+     }
+
+   num_threads = (unsigned int) Model_Num_Threads;
+   if (num_threads > st.num_comp)
+     num_threads = st.num_comp;
+   if (num_threads > ISIS_MAX_THREADS)
+     num_threads = ISIS_MAX_THREADS;
+
+   if ((NULL == (st.cont = (EM_cont_type_t **) ISIS_MALLOC (num_threads * sizeof(EM_cont_type_t *))))
+       || (NULL == (st.val = (double **) ISIS_MALLOC (num_threads * sizeof(double *))))
+       || (NULL == (st.tmp_val = (double **) ISIS_MALLOC (num_threads * sizeof(double *)))))
+     goto finish;
+   memset ((char *)st.cont, 0, num_threads * sizeof(EM_cont_type_t *));
+   memset ((char *)st.val, 0, num_threads * sizeof(double *));
+   memset ((char *)st.tmp_val, 0, num_threads * sizeof(double *));
+
+   for (t = 0; t < num_threads; t++)
+     {
+        if ((NULL == (st.cont[t] = EM_new_continuum (nbins)))
+            || (NULL == (st.val[t] = (double *) ISIS_MALLOC (nbins * sizeof(double))))
+            || (NULL == (st.tmp_val[t] = (double *) ISIS_MALLOC (nbins * sizeof(double)))))
+          goto finish;
+        memset ((char *)st.val[t], 0, nbins * sizeof(double));
+     }
+
+   if (-1 == isis_run_threads (num_threads, &model_component_task, (void *)&st))
+     goto finish;
+
+   for (t = 0; t < num_threads; t++)
+     {
+        double *v = st.val[t];
+        for (i = 0; i < nbins; i++)
+          val[i] += v[i];
+     }
+
+   for (c = 0; c < st.num_comp; c++)
+     {
+        Component_Task_Type *ct = &st.comp[c];
+
+        if (-1 == merge_line_fluxes (ct))
+          goto finish;
+
+        if (ct->computed)
+          {
+             Model_t *cm = ct->m;
+             EM_cache_line_spectrum (ct->emis_list, flag, cm->temperature, cm->density,
+                                     ct->ionpop_new, info->em);
+          }
+     }
+
+   ret = 0;
+
+   finish:
+
+   num_comp = st.num_comp;
+   for (c = 0; c < num_comp; c++)
+     {
+        EM_free_line_emis_list (st.comp[c].emis_list);
+        ISIS_FREE (st.comp[c].ionpop_new);
+        ISIS_FREE (st.comp[c].line_flux);
+     }
+   ISIS_FREE (st.comp);
+
+   for (t = 0; t < num_threads; t++)
+     {
+        if (st.cont != NULL)
+          EM_free_continuum (st.cont[t]);
+        if (st.val != NULL)
+          ISIS_FREE (st.val[t]);
+        if (st.tmp_val != NULL)
+          ISIS_FREE (st.tmp_val[t]);
+     }
+   ISIS_FREE (st.cont);
+   ISIS_FREE (st.val);
+   ISIS_FREE (st.tmp_val);
+
+   return ret;
+}
+
+/*}}}*/
+
+/*}}}*/
+
 int Model_spectrum (Model_t *h, Model_Info_Type *info, /*{{{*/
                     double *wllo, double *wlhi, int nbins, double *val)
 {
@@ -845,7 +1236,7 @@ int Model_spectrum (Model_t *h, Model_Info_Type *info, /*{{{*/
    double *tmp_val = NULL;
    float *ionpop_new = NULL;
    char *flag = NULL;
-   int i, cont_nbins, include_lines, include_contin, ret = -1;
+   int include_lines, include_contin, ret = -1;
    SLindex_Type db_nlines;
 
    if (NULL == h || NULL == info)
@@ -909,6 +1300,13 @@ int Model_spectrum (Model_t *h, Model_Info_Type *info, /*{{{*/
           }
      }
 
+   if (use_threads (h, info))
+     {
+        ret = threaded_model_spectrum (h, info, flag, wllo, wlhi, nbins, val,
+                                       include_lines, include_contin, db_nlines);
+        goto finish;
+     }
+
    if (info->ionpop_modifier != NULL)
      {
         int n = ISIS_MAX_PROTON_NUMBER+1;
@@ -921,20 +1319,10 @@ int Model_spectrum (Model_t *h, Model_Info_Type *info, /*{{{*/
        || (NULL == (tmp_val = (double *) ISIS_MALLOC (nbins * sizeof(double)))))
      goto finish;
 
-   cont_nbins = cont->nbins;
-
-   /* 1) Shift the input observer frame grid into the source frame
-    * 2) Compute the emissivity in each rest-frame bin
-    * 3) Shift the emissivity in each bin back to the observer frame,
-    *    (just the time-dilation factor, since I'm assuming that
-    *     the model values are photons/sec/whatever
-    *                      NOT ergs/sec/whatever!).
-    */
-
    for (m = h; m != NULL; m = m->next)
      {
         EM_line_emis_t *emis_list = NULL;
-        double *val_ptr;
+        int status;
 
         if (isis_user_break())
           {
@@ -942,26 +1330,12 @@ int Model_spectrum (Model_t *h, Model_Info_Type *info, /*{{{*/
              goto finish;
           }
 
-        if (m->line_flux == NULL)
-          {
-             if (NULL == (m->line_flux = SLang_create_array (SLANG_FLOAT_TYPE, 1, NULL, &db_nlines, 1)))
-               goto finish;
-          }
-        memset ((char *)m->line_flux->data, 0, db_nlines * sizeof(float));
+        if (-1 == init_line_flux (m, db_nlines))
+          goto finish;
 
         if (m->norm == 0)
           continue;
 
-        if (m->redshift != 0.0)
-          {
-             memset ((char *)tmp_val, 0, nbins * sizeof(double));
-             val_ptr = tmp_val;
-          }
-        else val_ptr = val;
-
-        if (-1 == shift_grid_to_emitter_frame (cont, wllo, wlhi, m->redshift))
-          goto finish;
-
         if (info->ionpop_modifier != NULL)
           {
              if (-1 == call_ionpop_modifier (m, info, ionpop_new))
@@ -973,56 +1347,13 @@ int Model_spectrum (Model_t *h, Model_Info_Type *info, /*{{{*/
              emis_list = EM_get_line_spectrum (flag, m->temperature, m->density, ionpop_new, info->em);
              if (NULL == emis_list)
                goto finish;
-
-             if (-1 == add_spread_lines (val_ptr, cont->wllo, cont->wlhi, cont->nbins,
-                                         emis_list, m, info))
-               goto finish;
-
-             EM_free_line_emis_list (emis_list);
-             emis_list = NULL;
-          }
-
-        if (include_contin)
-          {
-             EM_cont_select_t s;
-             double m_norm;
-             double *c_val, *p_val;
-
-             s.Z = 0; s.q = -1;  s.rel_abun = m->rel_abund;
-             if (-1 == EM_get_continuum (cont, m->temperature, m->density, ionpop_new, &s, info->em))
-               goto finish;
-
-             m_norm = m->norm;
-
-             switch (info->contrib_flag)
-               {
-                case MODEL_CONTIN_TRUE:
-                  c_val = cont->true_contin;
-                  for (i = 0; i < cont_nbins; i++)
-                    val_ptr[i] += m_norm * c_val[i];
-                  break;
-
-                case MODEL_CONTIN_PSEUDO:
-                  c_val = cont->pseudo;
-                  for (i = 0; i < cont_nbins; i++)
-                    val_ptr[i] += m_norm * c_val[i];
-                  break;
-
-                default:
-                  c_val = cont->true_contin;
-                  p_val = cont->pseudo;
-                  for (i = 0; i < cont_nbins; i++)
-                    val_ptr[i] += m_norm * (c_val[i] + p_val[i]);
-                  break;
-               }
           }
 
-        if (m->redshift != 0.0)
-          {
-             float gm = lorentz_gamma (m->redshift);
-             for (i = 0; i < cont_nbins; i++)
-               val[i] += tmp_val[i] / gm;
-          }
+        status = add_model_component (m, info, emis_list, ionpop_new, include_contin,
+                                      cont, wllo, wlhi, val, tmp_val, NULL);
+        EM_free_line_emis_list (emis_list);
+        if (status == -1)
+          goto finish;
      }
 
    ret = 0;
@@ -98,6 +98,8 @@ extern void Model_set_profile_function (int idx);
 extern Model_t *Model_add_component (Model_t *head, Model_t *x,
        unsigned int *elem, float *elem_abund, unsigned int num_elems);
 
+extern int Model_Num_Threads;
+
 extern int Model_spectrum (Model_t *h, Model_Info_Type *info,
                            double *wllo, double *wlhi, int nbins, double *val);
 
@@ -53,12 +53,121 @@ typedef struct
    double *y;
    double *weights;
    double *fx;
+   double **fx_list;       /* [npars] work space for mpfit_multi_objective */
+   double **dfdp;          /* [npars] exact model derivatives, or NULL */
+   double *work;           /* [2*npts] */
    unsigned int npts;
    unsigned int npars;
 }
 Fun_Info_Type;
 static Fun_Info_Type Fun_Info;
 
+static int numerical_deriv_vec (Isis_Fit_Type *ift, int num_pars, double *pars, /*{{{*/
+                                double *fvec, double **deriv_vec)
+{
+   Isis_Fit_Engine_Type *e = ift->engine;
+   Isis_Fit_Statistic_Type *fs = ift->stat;
+   Fun_Info_Type *fi = &Fun_Info;
+   double *fx = fi->work;
+   double *vec = fi->work + fi->npts;
+   double eps = sqrt (MP_MACHEP0);
+   double stat;
+   unsigned int i;
+   int k;
+
+   for (k = 0; k < num_pars; k++)
+     {
+        double p = pars[k];
+        double h = eps * fabs(p);
+
+        if (deriv_vec[k] == NULL)
+          continue;
+
+        if (h == 0.0) h = eps;
+        if (p + h > e->par_max[k]) h = -h;
+
+        pars[k] = p + h;
+        if (-1 == ift->compute_model (fs->opt_data, fi->x, fi->npts, pars, num_pars, fx))
+          {
+             pars[k] = p;
+             return -1;
+          }
+        pars[k] = p;
+
+        (void)fs->compute_statistic (fs, fi->y, fx, fi->weights, fi->npts, vec, &stat);
+
+        for (i = 0; i < fi->npts; i++)
+          deriv_vec[k][i] = (vec[i] - fvec[i]) / h;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int exact_deriv_vec (Isis_Fit_Type *ift, int num_pars, double *pars, /*{{{*/
+                            double *fvec, double **deriv_vec)
+{
+   Isis_Fit_Statistic_Type *fs = ift->stat;
+   Fun_Info_Type *fi = &Fun_Info;
+   double *fx = fi->work;
+   double *vec = fi->work + fi->npts;
+   double eps = sqrt (DBL_EPSILON);
+   double stat;
+   unsigned int i;
+   int k, status;
+
+   status = ift->compute_jacobian (fs->opt_data, fi->x, fi->npts, pars, num_pars,
+                                   fi->fx, fi->dfdp);
+   if (status == -1)
+     return -1;
+
+   if (status == 0)
+     (void)fs->compute_statistic (fs, fi->y, fi->fx, fi->weights, fi->npts, fvec, &ift->statistic);
+   else
+     {
+        /* not available for these parameter values */
+        if (-1 == ift->compute_model (fs->opt_data, fi->x, fi->npts, pars, num_pars, fi->fx))
+          return -1;
+        (void)fs->compute_statistic (fs, fi->y, fi->fx, fi->weights, fi->npts, fvec, &ift->statistic);
+        return numerical_deriv_vec (ift, num_pars, pars, fvec, deriv_vec);
+     }
+
+   /* Each element of the statistic vector depends only on the
+    * corresponding model value, so the chain rule needs just
+    * one more evaluation of the statistic.  The step is scaled
+    * by the larger of the model and the data, because the
+    * statistic element has the size of the larger of the two.
+    */
+   for (i = 0; i < fi->npts; i++)
+     {
+        double scale = fabs(fi->fx[i]);
+        if (scale < fabs(fi->y[i]))
+          scale = fabs(fi->y[i]);
+        fx[i] = fi->fx[i] + eps * (scale + eps);
+     }
+
+   (void)fs->compute_statistic (fs, fi->y, fx, fi->weights, fi->npts, vec, &stat);
+
+   for (i = 0; i < fi->npts; i++)
+     vec[i] = (vec[i] - fvec[i]) / (fx[i] - fi->fx[i]);
+
+   for (k = 0; k < num_pars; k++)
+     {
+        double *dfdp = fi->dfdp[k];
+
+        if (deriv_vec[k] == NULL)
+          continue;
+
+        for (i = 0; i < fi->npts; i++)
+          deriv_vec[k][i] = vec[i] * dfdp[i];
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int mpfit_objective (int num_fvec_values, int num_pars, double *pars, /*{{{*/
                             double *fvec, double **deriv_vec, void *client_data)
 {
@@ -67,12 +176,20 @@ static int mpfit_objective (int num_fvec_values, int num_pars, double *pars, /*{
    Isis_Fit_Statistic_Type *fs = ift->stat;
    Fun_Info_Type *fi = &Fun_Info;
 
-   (void) num_fvec_values;  (void) deriv_vec;
+   (void) num_fvec_values;
 
-   if (-1 == ift->compute_model (fs->opt_data, fi->x, fi->npts, pars, num_pars, fi->fx))
-     return -1;
+   if ((deriv_vec != NULL) && (fi->dfdp != NULL))
+     {
+        if (-1 == exact_deriv_vec (ift, num_pars, pars, fvec, deriv_vec))
+          return -1;
+     }
+   else
+     {
+        if (-1 == ift->compute_model (fs->opt_data, fi->x, fi->npts, pars, num_pars, fi->fx))
+          return -1;
 
-   (void)fs->compute_statistic (fs, fi->y, fi->fx, fi->weights, fi->npts, fvec, &ift->statistic);
+        (void)fs->compute_statistic (fs, fi->y, fi->fx, fi->weights, fi->npts, fvec, &ift->statistic);
+     }
 
    if (e->verbose > 0)
      e->verbose_hook (Isis_Client_Data, ift->statistic, pars, fi->npars);
@@ -82,6 +199,35 @@ static int mpfit_objective (int num_fvec_values, int num_pars, double *pars, /*{
 
 /*}}}*/
 
+static int mpfit_multi_objective (int num_fvec_values, int num_pars, int num, /*{{{*/
+                                  double **pars, double **fvec, void *client_data)
+{
+   Isis_Fit_Type *ift = (Isis_Fit_Type *)client_data;
+   Isis_Fit_Statistic_Type *fs = ift->stat;
+   Fun_Info_Type *fi = &Fun_Info;
+   double stat;
+   int j;
+
+   (void) num_fvec_values;
+
+   if ((num < 0) || (num > (int) fi->npars))
+     return -1;
+
+   if (-1 == ift->compute_models (fi->x, fi->npts, pars, num_pars, num, fi->fx_list))
+     return -1;
+
+   for (j = 0; j < num; j++)
+     {
+        if (-1 == fs->compute_statistic (fs, fi->y, fi->fx_list[j], fi->weights, fi->npts,
+                                         fvec[j], &stat))
+          return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int mpfit_config_set_defaults (struct mp_config_struct *s) /*{{{*/
 {
    if (s == NULL)
@@ -131,6 +277,10 @@ static int mpfit_config_set_defaults (struct mp_config_struct *s) /*{{{*/
    s->iterproc = 0;
    /* Placeholder pointer - must set to 0 */
 
+   s->multi_funct = 0;
+   /* Set for each fit, if the model can be evaluated
+    * at several parameter vectors at once */
+
    return 0;
 }
 
@@ -172,6 +322,24 @@ static void print_status (struct mp_result_struct *mpfit_result) /*{{{*/
 
 /*}}}*/
 
+static int can_use_exact_derivs (Isis_Fit_Type *ift, double *x, unsigned int npts, /*{{{*/
+                                 double *pars, unsigned int npars)
+{
+   Isis_Fit_Statistic_Type *fs = ift->stat;
+
+   /* The chain rule through the statistic vector assumes
+    * that each element depends on one model value only.
+    */
+   if ((ift->compute_jacobian == NULL)
+       || (fs->sl_fun != NULL)
+       || (fs->constraint_fun != NULL))
+     return 0;
+
+   return (0 == ift->compute_jacobian (fs->opt_data, x, npts, pars, npars, NULL, NULL));
+}
+
+/*}}}*/
+
 static int mpfit_method (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
                           double *x, double *y, double *weights, unsigned int npts,
                           double *pars, unsigned int npars)
@@ -181,6 +349,7 @@ static int mpfit_method (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
    struct mp_par_struct *mpfit_pars;
    Fun_Info_Type *fi = &Fun_Info;
    unsigned int i;
+   int exact_derivs;
    int status = -1;
 
    Isis_Client_Data = clientdata;
@@ -190,6 +359,8 @@ static int mpfit_method (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
 
    e = ift->engine;
 
+   exact_derivs = can_use_exact_derivs (ift, x, npts, pars, npars);
+
    if (NULL == (mpfit_pars = (struct mp_par_struct *) ISIS_MALLOC (npars * sizeof *mpfit_pars)))
      return -1;
 
@@ -204,7 +375,7 @@ static int mpfit_method (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
         ps->parname = 0;
         ps->step = e->par_step[i];
         ps->relstep = e->par_relstep[i];
-        ps->side = 0;        /* FIXME !! */
+        ps->side = exact_derivs ? 3 : 0;        /* FIXME !! */
         /* Note that mpfit's two-sided numerical derivative option
          * does not fully support parameter bounds.  The method used
          * to support parameter bounds with one-sided numerical
@@ -222,6 +393,9 @@ static int mpfit_method (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
    fi->npts = npts;
    fi->npars = npars;
    fi->fx = NULL;
+   fi->fx_list = NULL;
+   fi->dfdp = NULL;
+   fi->work = NULL;
 
    memset ((void *)&mpfit_result, 0, sizeof (struct mp_result_struct));
 
@@ -229,6 +403,27 @@ static int mpfit_method (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
        || (NULL == (ift->covariance_matrix = (double *) ISIS_MALLOC (npars * npars * sizeof(double)))))
      goto finish;
 
+   e->mpfit_config.multi_funct = NULL;
+   if ((ift->compute_models != NULL) && (npars > 1))
+     {
+        if ((NULL == (fi->fx_list = (double **) ISIS_MALLOC (npars * sizeof(double *))))
+            || (NULL == (fi->fx_list[0] = (double *) ISIS_MALLOC (npars * npts * sizeof(double)))))
+          goto finish;
+        for (i = 1; i < npars; i++)
+          fi->fx_list[i] = fi->fx_list[0] + i * npts;
+        e->mpfit_config.multi_funct = mpfit_multi_objective;
+     }
+
+   if (exact_derivs)
+     {
+        if ((NULL == (fi->work = (double *) ISIS_MALLOC (2 * npts * sizeof(double))))
+            || (NULL == (fi->dfdp = (double **) ISIS_MALLOC (npars * sizeof(double *))))
+            || (NULL == (fi->dfdp[0] = (double *) ISIS_MALLOC (npars * npts * sizeof(double)))))
+          goto finish;
+        for (i = 1; i < npars; i++)
+          fi->dfdp[i] = fi->dfdp[0] + i * npts;
+     }
+
    mpfit_result.covar = ift->covariance_matrix;
 
    (void) mpfit (mpfit_objective, npts, npars, pars,
@@ -241,6 +436,18 @@ static int mpfit_method (Isis_Fit_Type *ift, void *clientdata, /*{{{*/
    finish:
 
    free(fi->fx);
+   if (fi->fx_list != NULL)
+     {
+        free(fi->fx_list[0]);
+        free(fi->fx_list);
+     }
+   if (fi->dfdp != NULL)
+     {
+        free(fi->dfdp[0]);
+        free(fi->dfdp);
+        fi->dfdp = NULL;
+     }
+   free(fi->work);
    free(mpfit_pars);
 
    switch (mpfit_result.status)
@@ -23,7 +23,7 @@
 #include "mpfit.h"
 
 /* Forward declarations of functions in this module */
-int mp_fdjac2(mp_func funct,
+int mp_fdjac2(mp_func funct, mp_multi_func multi_funct,
 	      int m, int n, int *ifree, int npar, double *x, double *fvec,
 	      double *fjac, int ldfjac, double epsfcn,
 	      double *wa, void *priv, int *nfev,
@@ -312,6 +312,7 @@ int mpfit(mp_func funct, int m, int npar,
   conf.maxfev = 0;
   conf.covtol = 1e-14;
   conf.nofinitecheck = 0;
+  conf.multi_funct = 0;
 
   if (config) {
     /* Transfer any user-specified configurations */
@@ -326,6 +327,7 @@ int mpfit(mp_func funct, int m, int npar,
     if (config->covtol > 0) conf.covtol = config->covtol;
     if (config->nofinitecheck > 0) conf.nofinitecheck = config->nofinitecheck;
     conf.maxfev = config->maxfev;
+    conf.multi_funct = config->multi_funct;
   }
 
   info = 0;
@@ -479,7 +481,7 @@ int mpfit(mp_func funct, int m, int npar,
   /* XXX call iterproc */
 
   /* Calculate the jacobian matrix */
-  iflag = mp_fdjac2(funct, m, nfree, ifree, npar, xnew, fvec, fjac, ldfjac,
+  iflag = mp_fdjac2(funct, conf.multi_funct, m, nfree, ifree, npar, xnew, fvec, fjac, ldfjac,
 		    conf.epsfcn, wa4, private_data, &nfev,
 		    step, dstep, mpside, qulim, ulim,
 		    ddebug, ddrtol, ddatol);
@@ -967,7 +969,77 @@ int mpfit(mp_func funct, int m, int npar,
 
 /************************fdjac2.c*************************/
 
-int mp_fdjac2(mp_func funct,
+/* Step size for the numerical derivative in free parameter j */
+static double mp_fdjac2_step(int j, double temp, double eps, int *ifree,
+			     double *step, double *dstep, int *dside,
+			     int *qulimited, double *ulimit)
+{
+  int dsidei = (dside)?(dside[ifree[j]]):(0);
+  double h;
+
+  h = eps * fabs(temp);
+  if (step  &&  step[ifree[j]] > 0) h = step[ifree[j]];
+  if (dstep && dstep[ifree[j]] > 0) h = fabs(dstep[ifree[j]]*temp);
+  if (h == 0)                       h = eps;
+
+  /* If negative step requested, or we are against the upper limit */
+  if ((dside && dsidei == -1) ||
+      (dside && dsidei == 0 &&
+       qulimited && ulimit && qulimited[j] &&
+       (temp > (ulimit[j]-h)))) {
+    h = -h;
+  }
+
+  return h;
+}
+
+/* One-sided numerical derivatives for all n free parameters,
+   with the function values for every step computed by one call
+   to multi_funct.  The values are stored directly in fjac. */
+static int mp_fdjac2_multi(mp_multi_func multi_funct,
+			   int m, int n, int *ifree, int npar, double *x,
+			   double *fvec, double *fjac, double eps, void *priv,
+			   double *step, double *dstep, int *dside,
+			   int *qulimited, double *ulimit)
+{
+  double *xs = 0, **xp = 0, **fp = 0, *hs = 0;
+  int i, j, iflag = MP_ERR_MEMORY;
+
+  xs = (double *) malloc(sizeof(double)*n*npar);
+  xp = (double **) malloc(sizeof(double *)*n);
+  fp = (double **) malloc(sizeof(double *)*n);
+  hs = (double *) malloc(sizeof(double)*n);
+  if (xs == 0 || xp == 0 || fp == 0 || hs == 0) goto DONE;
+
+  for (j=0; j<n; j++) {
+    double temp = x[ifree[j]];
+    hs[j] = mp_fdjac2_step(j, temp, eps, ifree, step, dstep, dside,
+			   qulimited, ulimit);
+    xp[j] = xs + j*npar;
+    for (i=0; i<npar; i++) xp[j][i] = x[i];
+    xp[j][ifree[j]] = temp + hs[j];
+    fp[j] = fjac + j*m;
+  }
+
+  iflag = (*multi_funct)(m, npar, n, xp, fp, priv);
+  if (iflag < 0) goto DONE;
+
+  for (j=0; j<n; j++) {
+    double *fj = fjac + j*m;
+    for (i=0; i<m; i++) {
+      fj[i] = (fj[i] - fvec[i])/hs[j]; /* fjac[i+m*j] */
+    }
+  }
+
+ DONE:
+  if (xs) free(xs);
+  if (xp) free(xp);
+  if (fp) free(fp);
+  if (hs) free(hs);
+  return iflag;
+}
+
+int mp_fdjac2(mp_func funct, mp_multi_func multi_funct,
 	      int m, int n, int *ifree, int npar, double *x, double *fvec,
 	      double *fjac, int ldfjac, double epsfcn,
 	      double *wa, void *priv, int *nfev,
@@ -1055,7 +1127,6 @@ int mp_fdjac2(mp_func funct,
   int i,j,ij;
   int iflag = 0;
   double eps,h,temp;
-  static double zero = 0.0;
   double **dvec = 0;
   int has_analytical_deriv = 0, has_numerical_deriv = 0;
   int has_debug_deriv = 0;
@@ -1105,6 +1176,22 @@ int mp_fdjac2(mp_func funct,
 	   "IPNT", "FUNC", "DERIV_U", "DERIV_N", "DIFF_ABS", "DIFF_REL");
   }
 
+  /* If all the derivatives are one-sided differences, evaluate
+     all the perturbed parameter vectors in a single call */
+  if (multi_funct && has_numerical_deriv && !has_analytical_deriv && n > 1) {
+    int use_multi = 1;
+    for (j=0; j<n; j++) {
+      int dsidei = (dside)?(dside[ifree[j]]):(0);
+      if (ddebug[ifree[j]] || dsidei > 1) use_multi = 0;
+    }
+    if (use_multi) {
+      iflag = mp_fdjac2_multi(multi_funct, m, n, ifree, npar, x, fvec, fjac,
+			      eps, priv, step, dstep, dside, qulimited, ulimit);
+      if (nfev) *nfev = *nfev + n;
+      goto DONE;
+    }
+  }
+
   /* Any parameters requiring numerical derivatives */
   if (has_numerical_deriv) for (j=0; j<n; j++) {  /* Loop thru free parms */
     int dsidei = (dside)?(dside[ifree[j]]):(0);
@@ -1120,18 +1207,8 @@ int mp_fdjac2(mp_func funct,
     if (dside && dsidei == 3) continue;
 
     temp = x[ifree[j]];
-    h = eps * fabs(temp);
-    if (step  &&  step[ifree[j]] > 0) h = step[ifree[j]];
-    if (dstep && dstep[ifree[j]] > 0) h = fabs(dstep[ifree[j]]*temp);
-    if (h == zero)                    h = eps;
-
-    /* If negative step requested, or we are against the upper limit */
-    if ((dside && dsidei == -1) ||
-	(dside && dsidei == 0 &&
-	 qulimited && ulimit && qulimited[j] &&
-	 (temp > (ulimit[j]-h)))) {
-      h = -h;
-    }
+    h = mp_fdjac2_step(j, temp, eps, ifree, step, dstep, dside,
+		       qulimited, ulimit);
 
     x[ifree[j]] = temp + h;
     iflag = mp_call(funct, m, npar, x, wa, 0, priv);
@@ -55,6 +55,11 @@ struct mp_par_struct {
 /* Just a placeholder - do not use!! */
 typedef void (*mp_iterproc)(void);
 
+/* Evaluate the fitting function at num parameter vectors x[j],
+   storing the results in fvec[j] */
+typedef int (*mp_multi_func)(int m, int n, int num, double **x, double **fvec,
+			     void *private_data);
+
 /* Definition of MPFIT configuration structure */
 struct mp_config_struct {
   double ftol;    /* Relative chi-square convergence criterium */
@@ -78,6 +83,9 @@ struct mp_config_struct {
 		     */
   mp_iterproc iterproc; /* Placeholder pointer - must set to 0 */
 
+  mp_multi_func multi_funct; /* Optional: evaluates funct at several
+				parameter vectors at once, for numerical
+				derivatives; or 0 */
 };
 
 /* Definition of results structure, for when fit completes */
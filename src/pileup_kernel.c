@@ -361,7 +361,7 @@ static int evaluate_isis_model_on_grid (double *lamlo, double *lamhi,
  *          = S(y) hc/E^2
  * We need the product, A(E)s(E)
  */
-static int convert_spectrum (int (*fun)(Isis_Hist_t *), Isis_Kernel_t *k, Isis_Hist_t *g)
+static int convert_spectrum (int (*fun)(Isis_Hist_t *, void *), Isis_Kernel_t *k, Isis_Hist_t *g)
 {
    double *s_dlam;
    double *arf_s, *energies, *arf;
@@ -478,12 +478,15 @@ static void init_coeffs (double alpha,
 }
 
 static int compute_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, double *pars, unsigned int num_pars,
-			   int (*fun)(Isis_Hist_t *))
+			   int (*fun)(Isis_Hist_t *, void *), void *cl)
 {
    double coeffs[MAX_NUM_TERMS+1];
    double alpha, g0, num_regions;
    double psf_frac;
 
+   /* The model is evaluated on the pileup energy grid */
+   (void) cl;
+
    if (k == NULL || g == NULL || fun == NULL)
      return -1;
 
@@ -47,6 +47,19 @@
 
 /* new/free */
 
+static unsigned int Rmf_Serial;
+
+/* Anything derived from the matrix, e.g. a compiled response,
+ * is identified by the serial number of the RMF.
+ */
+void Rmf_matrix_changed (Isis_Rmf_t *rmf) /*{{{*/
+{
+   if (rmf != NULL)
+     rmf->serial = ++Rmf_Serial;
+}
+
+/*}}}*/
+
 void Isis_free_rmf_grid (Isis_Rmf_Grid_Type *eb) /*{{{*/
 {
    if (NULL == eb)
@@ -162,6 +175,7 @@ static Isis_Rmf_t *new_rmf (void) /*{{{*/
    rmf->next = NULL;
    rmf->index = 0;
    rmf->ref_count = 0;
+   Rmf_matrix_changed (rmf);
 
    rmf->order = 0;
    rmf->grating[0] = 0;
@@ -175,6 +189,8 @@ static Isis_Rmf_t *new_rmf (void) /*{{{*/
    rmf->set_data_grid = NULL;
    rmf->get_data_grid = NULL;
    rmf->redistribute = NULL;
+   rmf->fold = NULL;
+   rmf->fold_multi = NULL;
    rmf->delete_client_data = NULL;
 
    rmf->set_noticed_model_bins = default_set_noticed_model_bins;
@@ -423,9 +439,9 @@ int Rmf_run_post_fit_method (Isis_Rmf_t *rmf)
 
 /*}}}*/
 
-int Rmf_apply_rmf (Isis_Rmf_t *rmf, double *x, int num_orig_data, /*{{{*/
-                   double *arf_src, int *arf_notice_list,
-                   int num_arf_noticed)
+int Rmf_apply_rmf_noticed (Isis_Rmf_t *rmf, double *x, int num_orig_data, /*{{{*/
+                           double *arf_src, int *arf_notice_list,
+                           int num_arf_noticed, int *chan_notice)
 {
    int k;
 
@@ -438,15 +454,25 @@ int Rmf_apply_rmf (Isis_Rmf_t *rmf, double *x, int num_orig_data, /*{{{*/
           return -1;
      }
 
-   for (k = 0; k < num_arf_noticed; k++)
+   if (rmf->fold != NULL)
      {
-        int nk;
-        if (arf_src[k] == 0.0)
-          continue;
-        nk = (arf_notice_list != NULL) ? arf_notice_list[k] : k;
-        if (-1 == rmf->redistribute (rmf, nk, arf_src[k], x, num_orig_data))
+        if (-1 == (*rmf->fold)(rmf, arf_src, arf_notice_list, num_arf_noticed,
+                               x, num_orig_data, chan_notice))
           return -1;
      }
+   else
+     {
+        /* Without a fold method, all channels are computed */
+        for (k = 0; k < num_arf_noticed; k++)
+          {
+             int nk;
+             if (arf_src[k] == 0.0)
+               continue;
+             nk = (arf_notice_list != NULL) ? arf_notice_list[k] : k;
+             if (-1 == rmf->redistribute (rmf, nk, arf_src[k], x, num_orig_data))
+               return -1;
+          }
+     }
 
    if (rmf->post_apply != NULL)
      {
@@ -459,6 +485,56 @@ int Rmf_apply_rmf (Isis_Rmf_t *rmf, double *x, int num_orig_data, /*{{{*/
 
 /*}}}*/
 
+/* Without a fold_multi method, the models are folded one at a time */
+int Rmf_apply_rmf_multi (Isis_Rmf_t *rmf, double **x, unsigned int num, /*{{{*/
+                         int num_orig_data, double *arf_src, int *arf_notice_list,
+                         int num_arf_noticed, int *chan_notice)
+{
+   unsigned int j;
+
+   if ((NULL == rmf) || (NULL == arf_src) || (NULL == x))
+     return -1;
+
+   if (rmf->fold_multi == NULL)
+     {
+        for (j = 0; j < num; j++)
+          {
+             if (-1 == Rmf_apply_rmf_noticed (rmf, x[j], num_orig_data,
+                                              arf_src + j * num_arf_noticed,
+                                              arf_notice_list, num_arf_noticed,
+                                              chan_notice))
+               return -1;
+          }
+        return 0;
+     }
+
+   if ((rmf->pre_apply != NULL)
+       && (-1 == (*rmf->pre_apply)(rmf)))
+     return -1;
+
+   if (-1 == (*rmf->fold_multi)(rmf, arf_src, num, arf_notice_list, num_arf_noticed,
+                                x, num_orig_data, chan_notice))
+     return -1;
+
+   if ((rmf->post_apply != NULL)
+       && (-1 == (*rmf->post_apply)(rmf)))
+     return -1;
+
+   return 0;
+}
+
+/*}}}*/
+
+int Rmf_apply_rmf (Isis_Rmf_t *rmf, double *x, int num_orig_data, /*{{{*/
+                   double *arf_src, int *arf_notice_list,
+                   int num_arf_noticed)
+{
+   return Rmf_apply_rmf_noticed (rmf, x, num_orig_data, arf_src, arf_notice_list,
+                                 num_arf_noticed, NULL);
+}
+
+/*}}}*/
+
 int Rmf_find_peaks (Isis_Rmf_t *rmf, double **h_P, int *num) /*{{{*/
 {
    double *arf_lo, *arf_hi, *ebounds_lo, *ebounds_hi, *profile;
@@ -735,6 +811,8 @@ int Rmf_rebin_rmf (Isis_Rmf_t *rmf, double *lo, double *hi, unsigned int num) /*
         return -1;
      }
 
+   Rmf_matrix_changed (rmf);
+
    return 0;
 }
 
@@ -47,6 +47,7 @@ extern int Rmf_get_arf_grid (Isis_Rmf_t *rmf, double **lo, double **hi, unsigned
 
 extern int Rmf_adjust_data_grid (Isis_Rmf_t *rmf, double *lo, double *hi, unsigned int num);
 extern int Rmf_rebin_rmf (Isis_Rmf_t *rmf, double *lo, double *hi, unsigned int num);
+extern void Rmf_matrix_changed (Isis_Rmf_t *rmf);
 
 extern int Rmf_find_peaks (Isis_Rmf_t *rmf, double **h_P, int *num);
 
@@ -60,6 +61,12 @@ extern Isis_Rmf_t *Rmf_create_delta_rmf (Isis_Rmf_Grid_Type *arf, Isis_Rmf_Grid_
 extern int Rmf_apply_rmf (Isis_Rmf_t *rmf, double *x, int num_orig_data,
                           double *arf_src, int *arf_notice_list,
                           int num_arf_noticed);
+extern int Rmf_apply_rmf_noticed (Isis_Rmf_t *rmf, double *x, int num_orig_data,
+                                  double *arf_src, int *arf_notice_list,
+                                  int num_arf_noticed, int *chan_notice);
+extern int Rmf_apply_rmf_multi (Isis_Rmf_t *rmf, double **x, unsigned int num,
+                                int num_orig_data, double *arf_src, int *arf_notice_list,
+                                int num_arf_noticed, int *chan_notice);
 extern int Rmf_run_post_fit_method (Isis_Rmf_t *rmf);
 
 extern char *Rmf_name (Isis_Rmf_t *rmf);
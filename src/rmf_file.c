@@ -40,10 +40,20 @@
 #  include <stdlib.h>
 #endif
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_SYS_STAT_H) && defined(HAVE_UNISTD_H)
+#  define RMF_CACHE_SUPPORTED
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
 #include "isis.h"
 #include "cfits.h"
 #include "util.h"
 #include "rmf.h"
+#include "threads.h"
 #include "errors.h"
 
 /*}}}*/
@@ -88,6 +98,51 @@ struct Rmf_Vector_t
    Rmf_Element_t *elem;         /* array of detector channel group responses */
 };
 
+/* Once loaded, the matrix is packed into compressed-sparse-row
+ * form.  Rows are model bins and channels are detector channels,
+ * both in order of increasing wavelength, so that folding a model
+ * bin means accumulating contiguous runs of the output array.
+ */
+typedef struct Rmf_Csr_t Rmf_Csr_t;
+struct Rmf_Csr_t
+{
+   unsigned int num_rows;       /* number of model (ARF) bins */
+   unsigned int num_chan;       /* number of detector channels */
+   unsigned int num_grps;
+   unsigned int num_elements;
+   unsigned int *row_start;     /* [num_rows+1] first group of each row */
+   unsigned int *first_chan;    /* [num_grps] first channel of each group */
+   unsigned int *grp_start;     /* [num_grps+1] offset of each group in response[] */
+   float *response;             /* [num_elements] */
+   void *map;                   /* if non-NULL, the arrays point into this */
+   size_t map_size;             /*  memory-mapped cache file */
+
+   /* Identical matrices loaded for different RMFs are shared */
+   unsigned int num_users;      /* 0 if not shared */
+   unsigned long hash;
+   Rmf_Csr_t *next;             /* shared matrix list */
+
+   /* For threaded folding, the detector channels are split into
+    * num_parts contiguous ranges with similar numbers of elements.
+    */
+   unsigned int num_parts;
+   unsigned int *part_chan;     /* [num_parts+1] first channel of each range */
+};
+
+/* Sub-matrices restricted to the noticed detector channels of
+ * the datasets that use this RMF, most recently used first.
+ */
+typedef struct Rmf_Clip_t Rmf_Clip_t;
+struct Rmf_Clip_t
+{
+   Rmf_Clip_t *next;
+   int *chan_notice;            /* [num_chan] notice flags used to build csr */
+   Rmf_Csr_t *csr;
+};
+#define RMF_MAX_CLIPS  8
+
+typedef struct Rmf_Loaded_t Rmf_Loaded_t;
+
 typedef struct
 {
    double threshold;
@@ -108,12 +163,34 @@ typedef struct
    char *ebounds_extname;
    Isis_Rmf_Grid_Type *arf;      /* keV, increasing order */
    Isis_Rmf_Grid_Type *ebounds;  /* keV, increasing order */
-   Rmf_Vector_t *v;              /* keV, increasing order */
+   Rmf_Vector_t *v;              /* keV, increasing order; only used while loading */
+   Rmf_Csr_t *csr;               /* packed matrix, Angstrom, increasing order */
+   Rmf_Clip_t *clip;             /* csr restricted to noticed channels */
+   char *cache_dir;              /* NULL if not caching the packed matrix */
+   unsigned int num_threads;     /* used by fold() */
+   double sparse_tol;            /* drop elements below sparse_tol * row sum */
+   int sparse_renorm;            /*  and rescale the rest of the row */
+   unsigned int sparse_num_elements;  /* elements before sparsifying */
+   double sparse_max_loss;            /* largest row probability dropped */
    unsigned int num_ebins;
    int offset;                   /* F_CHAN TLMIN value */
+   Rmf_Loaded_t *loaded;         /* non-NULL until modified after reading the file */
 }
 Rmf_Client_Data_t;
 
+/* RMF files already in memory, keyed like the RMF cache */
+struct Rmf_Loaded_t
+{
+   Rmf_Loaded_t *next;
+   char *key;
+   Rmf_Client_Data_t *cd;
+   int includes_effective_area;
+   int order;
+   char grating[ISIS_RMF_BUFSIZE];
+   char instrument[ISIS_RMF_BUFSIZE];
+};
+static Rmf_Loaded_t *Loaded_Rmf_List;
+
 struct Rmf_File_t
 {
    cfitsfile *ft;
@@ -129,46 +206,1174 @@ struct Rmf_File_t
    int n_chan_col;
    int matrix_col;
 
-   /* If the column values are constant, they may be moved to keyword values
-    * to save space.  In that case, the _col fields of this structure will be
-    * set to -1 and the actual value is specified below.
-    */
-   long n_grp_val;
-   long f_chan_val;
-   long n_chan_val;
-};
+   /* Array sizes of the columns; for variable-length arrays,
+    * the _vla field is set and the repeat count is not used.
+    */
+   long energ_lo_repeat;
+   long energ_hi_repeat;
+   long n_grp_repeat;
+   long f_chan_repeat;
+   long n_chan_repeat;
+   long matrix_repeat;
+   int f_chan_vla;
+   int n_chan_vla;
+   int matrix_vla;
+   int matrix_heap_size;        /* bytes per variable-length MATRIX element, or 0 */
+   int single_rows;
+
+   /* If the column values are constant, they may be moved to keyword values
+    * to save space.  In that case, the _col fields of this structure will be
+    * set to -1 and the actual value is specified below.
+    */
+   long n_grp_val;
+   long f_chan_val;
+   long n_chan_val;
+};
+
+/*}}}*/
+
+static int print_options_help (Rmf_Client_Data_t *cd);
+static int read_order_keyword (cfitsfile *ft, int *order);
+
+static Rmf_Client_Data_t *get_client_data (Isis_Rmf_t *rmf) /*{{{*/
+{
+   return (Rmf_Client_Data_t *)rmf->client_data;
+}
+
+/*}}}*/
+
+static void free_rmf_vector (Rmf_Vector_t *v) /*{{{*/
+{
+   Rmf_Element_t *elem;
+   Rmf_Element_t *elem_max;
+
+   if ((v == NULL) || ((elem = v->elem) == NULL))
+     return;
+
+   elem_max = elem + v->num_grps;
+
+   while (elem < elem_max)
+     {
+        if (elem->response != NULL) ISIS_FREE (elem->response);
+        elem++;
+     }
+
+   ISIS_FREE (v->elem);
+   v->num_grps = 0;
+}
+
+/*}}}*/
+
+static void free_rmf_vectors (Rmf_Vector_t *v, unsigned int num) /*{{{*/
+{
+   unsigned int i;
+
+   if (v == NULL)
+     return;
+
+   for (i = 0; i < num; i++)
+     free_rmf_vector (&v[i]);
+   ISIS_FREE (v);
+}
+
+/*}}}*/
+
+static void free_csr (Rmf_Csr_t *c) /*{{{*/
+{
+   if (c == NULL)
+     return;
+
+   ISIS_FREE (c->part_chan);
+
+   if (c->map != NULL)
+     {
+#ifdef RMF_CACHE_SUPPORTED
+        (void) munmap (c->map, c->map_size);
+#endif
+        ISIS_FREE (c);
+        return;
+     }
+
+   ISIS_FREE (c->row_start);
+   ISIS_FREE (c->first_chan);
+   ISIS_FREE (c->grp_start);
+   ISIS_FREE (c->response);
+   ISIS_FREE (c);
+}
+
+/*}}}*/
+
+static Rmf_Csr_t *new_csr (unsigned int num_rows, unsigned int num_chan, /*{{{*/
+                           unsigned int num_grps, unsigned int num_elements)
+{
+   Rmf_Csr_t *c;
+
+   if (NULL == (c = (Rmf_Csr_t *) ISIS_MALLOC (sizeof(Rmf_Csr_t))))
+     return NULL;
+   memset ((char *)c, 0, sizeof(*c));
+
+   c->num_rows = num_rows;
+   c->num_chan = num_chan;
+   c->num_grps = num_grps;
+   c->num_elements = num_elements;
+
+   /* +1 so that an empty matrix still gets valid pointers */
+   if ((NULL == (c->row_start = (unsigned int *) ISIS_MALLOC ((num_rows + 1) * sizeof(unsigned int))))
+       || (NULL == (c->first_chan = (unsigned int *) ISIS_MALLOC ((num_grps + 1) * sizeof(unsigned int))))
+       || (NULL == (c->grp_start = (unsigned int *) ISIS_MALLOC ((num_grps + 1) * sizeof(unsigned int))))
+       || (NULL == (c->response = (float *) ISIS_MALLOC ((num_elements + 1) * sizeof(float)))))
+     {
+        free_csr (c);
+        return NULL;
+     }
+
+   return c;
+}
+
+/*}}}*/
+
+/* Many datasets, e.g. several orders or observations using the
+ * same calibration, load identical response matrices.  Packed
+ * matrices are looked up by content so that each distinct matrix
+ * is stored only once.  A shared matrix must not be modified;
+ * use unshare_csr first.
+ */
+
+static Rmf_Csr_t *Shared_Csr_List;
+
+static unsigned long hash_bytes (unsigned long h, void *p, size_t n) /*{{{*/
+{
+   unsigned char *s = (unsigned char *)p;
+   unsigned char *smax = s + n;
+
+   /* FNV-1a */
+   while (s < smax)
+     {
+        h = ((h ^ *s++) * 16777619UL) & 0xffffffffUL;
+     }
+
+   return h;
+}
+
+/*}}}*/
+
+static unsigned long hash_csr (Rmf_Csr_t *c) /*{{{*/
+{
+   unsigned long h = 2166136261UL;
+
+   h = hash_bytes (h, c->row_start, (c->num_rows + 1) * sizeof(unsigned int));
+   h = hash_bytes (h, c->first_chan, c->num_grps * sizeof(unsigned int));
+   h = hash_bytes (h, c->grp_start, (c->num_grps + 1) * sizeof(unsigned int));
+   h = hash_bytes (h, c->response, c->num_elements * sizeof(float));
+
+   return h;
+}
+
+/*}}}*/
+
+static int csr_equal (Rmf_Csr_t *a, Rmf_Csr_t *b) /*{{{*/
+{
+   return ((a->num_rows == b->num_rows)
+           && (a->num_chan == b->num_chan)
+           && (a->num_grps == b->num_grps)
+           && (a->num_elements == b->num_elements)
+           && (a->hash == b->hash)
+           && (0 == memcmp ((char *)a->row_start, (char *)b->row_start,
+                            (a->num_rows + 1) * sizeof(unsigned int)))
+           && (0 == memcmp ((char *)a->first_chan, (char *)b->first_chan,
+                            a->num_grps * sizeof(unsigned int)))
+           && (0 == memcmp ((char *)a->grp_start, (char *)b->grp_start,
+                            (a->num_grps + 1) * sizeof(unsigned int)))
+           && (0 == memcmp ((char *)a->response, (char *)b->response,
+                            a->num_elements * sizeof(float))));
+}
+
+/*}}}*/
+
+/* Returns the shared copy of c; c may be freed */
+static Rmf_Csr_t *share_csr (Rmf_Csr_t *c) /*{{{*/
+{
+   Rmf_Csr_t *s;
+
+   if ((c == NULL) || (c->num_users > 0))
+     return c;
+
+   c->hash = hash_csr (c);
+
+   for (s = Shared_Csr_List; s != NULL; s = s->next)
+     {
+        if (csr_equal (s, c))
+          {
+             free_csr (c);
+             s->num_users++;
+             return s;
+          }
+     }
+
+   c->num_users = 1;
+   c->next = Shared_Csr_List;
+   Shared_Csr_List = c;
+
+   return c;
+}
+
+/*}}}*/
+
+static void unlink_shared_csr (Rmf_Csr_t *c) /*{{{*/
+{
+   Rmf_Csr_t *s, *prev = NULL;
+
+   for (s = Shared_Csr_List; s != NULL; s = s->next)
+     {
+        if (s == c)
+          {
+             if (prev == NULL)
+               Shared_Csr_List = s->next;
+             else prev->next = s->next;
+             break;
+          }
+        prev = s;
+     }
+
+   c->next = NULL;
+   c->num_users = 0;
+}
+
+/*}}}*/
+
+static void release_csr (Rmf_Csr_t *c) /*{{{*/
+{
+   if (c == NULL)
+     return;
+
+   if (c->num_users > 1)
+     {
+        c->num_users--;
+        return;
+     }
+
+   if (c->num_users == 1)
+     unlink_shared_csr (c);
+
+   free_csr (c);
+}
+
+/*}}}*/
+
+/* Returns a private copy of c, which may then be modified */
+static Rmf_Csr_t *unshare_csr (Rmf_Csr_t *c) /*{{{*/
+{
+   Rmf_Csr_t *u;
+
+   if ((c == NULL) || (c->num_users == 0))
+     return c;
+
+   if (c->num_users == 1)
+     {
+        unlink_shared_csr (c);
+        return c;
+     }
+
+   if (NULL == (u = new_csr (c->num_rows, c->num_chan, c->num_grps, c->num_elements)))
+     return NULL;
+
+   memcpy ((char *)u->row_start, (char *)c->row_start, (c->num_rows + 1) * sizeof(unsigned int));
+   memcpy ((char *)u->first_chan, (char *)c->first_chan, c->num_grps * sizeof(unsigned int));
+   memcpy ((char *)u->grp_start, (char *)c->grp_start, (c->num_grps + 1) * sizeof(unsigned int));
+   memcpy ((char *)u->response, (char *)c->response, c->num_elements * sizeof(float));
+
+   c->num_users--;
+
+   return u;
+}
+
+/*}}}*/
+
+static Rmf_Csr_t *pack_rmf_vectors (Rmf_Vector_t *v, unsigned int num_rows, unsigned int num_chan) /*{{{*/
+{
+   Rmf_Csr_t *c;
+   unsigned int e, r, num_grps, num_elements, ng, ne;
+
+   /* v[] is in order of increasing energy, with channel groups in
+    * order of increasing energy.  The packed form reverses both.
+    */
+
+   num_grps = num_elements = 0;
+   for (e = 0; e < num_rows; e++)
+     {
+        unsigned int g;
+        for (g = 0; g < v[e].num_grps; g++)
+          {
+             if (v[e].elem[g].num_channels == 0)
+               continue;
+             num_grps++;
+             num_elements += v[e].elem[g].num_channels;
+          }
+     }
+
+   if (NULL == (c = new_csr (num_rows, num_chan, num_grps, num_elements)))
+     return NULL;
+
+   ng = ne = 0;
+   for (r = 0; r < num_rows; r++)
+     {
+        Rmf_Vector_t *vr = &v[num_rows - r - 1];
+        unsigned int g = vr->num_grps;
+
+        c->row_start[r] = ng;
+
+        while (g-- > 0)
+          {
+             Rmf_Element_t *elem = &vr->elem[g];
+             unsigned int k, n = elem->num_channels;
+             float *resp;
+
+             if (n == 0)
+               continue;
+
+             c->first_chan[ng] = num_chan - (elem->first_channel + n);
+             c->grp_start[ng] = ne;
+
+             resp = c->response + ne;
+             for (k = 0; k < n; k++)
+               resp[k] = elem->response[n - k - 1];
+
+             ne += n;
+             ng++;
+          }
+     }
+   c->row_start[num_rows] = ng;
+   c->grp_start[ng] = ne;
+
+   return c;
+}
+
+/*}}}*/
+
+static void free_clip_list (Rmf_Clip_t *cl) /*{{{*/
+{
+   while (cl != NULL)
+     {
+        Rmf_Clip_t *next = cl->next;
+        ISIS_FREE (cl->chan_notice);
+        free_csr (cl->csr);
+        ISIS_FREE (cl);
+        cl = next;
+     }
+}
+
+/*}}}*/
+
+static Rmf_Csr_t *clip_csr (Rmf_Csr_t *c, int *chan_notice) /*{{{*/
+{
+   Rmf_Csr_t *x;
+   unsigned int r, g, k, num_grps, num_elements, ng, ne;
+
+   /* Keep only the elements that land in noticed channels,
+    * splitting groups wherever they cross an ignored channel.
+    */
+   num_grps = num_elements = 0;
+   for (g = 0; g < c->num_grps; g++)
+     {
+        int *noticed = chan_notice + c->first_chan[g];
+        unsigned int n = c->grp_start[g+1] - c->grp_start[g];
+        int prev = 0;
+
+        for (k = 0; k < n; k++)
+          {
+             if (noticed[k])
+               {
+                  num_elements++;
+                  if (prev == 0) num_grps++;
+               }
+             prev = noticed[k];
+          }
+     }
+
+   if (NULL == (x = new_csr (c->num_rows, c->num_chan, num_grps, num_elements)))
+     return NULL;
+
+   ng = ne = 0;
+   for (r = 0; r < c->num_rows; r++)
+     {
+        unsigned int gmax = c->row_start[r+1];
+
+        x->row_start[r] = ng;
+
+        for (g = c->row_start[r]; g < gmax; g++)
+          {
+             float *response = c->response + c->grp_start[g];
+             unsigned int first = c->first_chan[g];
+             unsigned int n = c->grp_start[g+1] - c->grp_start[g];
+
+             k = 0;
+             while (k < n)
+               {
+                  if (chan_notice[first + k] == 0)
+                    {
+                       k++;
+                       continue;
+                    }
+
+                  x->first_chan[ng] = first + k;
+                  x->grp_start[ng] = ne;
+                  while ((k < n) && chan_notice[first + k])
+                    x->response[ne++] = response[k++];
+                  ng++;
+               }
+          }
+     }
+   x->row_start[c->num_rows] = ng;
+   x->grp_start[ng] = ne;
+
+   return x;
+}
+
+/*}}}*/
+
+static Rmf_Csr_t *find_clipped_csr (Rmf_Client_Data_t *cd, int *chan_notice) /*{{{*/
+{
+   Rmf_Clip_t *cl, *prev;
+   unsigned int n;
+   size_t size;
+
+   size = cd->csr->num_chan * sizeof(int);
+
+   prev = NULL;
+   for (cl = cd->clip; cl != NULL; cl = cl->next)
+     {
+        if (0 == memcmp ((char *)cl->chan_notice, (char *)chan_notice, size))
+          break;
+        prev = cl;
+     }
+
+   if (cl != NULL)
+     {
+        /* move to front */
+        if (prev != NULL)
+          {
+             prev->next = cl->next;
+             cl->next = cd->clip;
+             cd->clip = cl;
+          }
+        return cl->csr;
+     }
+
+   if (NULL == (cl = (Rmf_Clip_t *) ISIS_MALLOC (sizeof(Rmf_Clip_t))))
+     return NULL;
+   memset ((char *)cl, 0, sizeof(*cl));
+
+   if ((NULL == (cl->chan_notice = (int *) ISIS_MALLOC (size)))
+       || (NULL == (cl->csr = clip_csr (cd->csr, chan_notice))))
+     {
+        free_clip_list (cl);
+        return NULL;
+     }
+   memcpy ((char *)cl->chan_notice, (char *)chan_notice, size);
+
+   cl->next = cd->clip;
+   cd->clip = cl;
+
+   /* drop the least recently used entries */
+   n = 1;
+   for (prev = cl; prev->next != NULL; prev = prev->next)
+     {
+        if (++n > RMF_MAX_CLIPS)
+          {
+             free_clip_list (prev->next);
+             prev->next = NULL;
+             break;
+          }
+     }
+
+   return cl->csr;
+}
+
+/*}}}*/
+
+static void invalidate_clips (Rmf_Client_Data_t *cd) /*{{{*/
+{
+   free_clip_list (cd->clip);
+   cd->clip = NULL;
+}
+
+/*}}}*/
+
+/* Drops the elements of each row that are smaller than tol times
+ * the row sum; the channel groups are split where elements were
+ * dropped.  If renorm is set, the remaining elements are rescaled
+ * to preserve the row sum.
+ */
+static Rmf_Csr_t *sparsify_csr (Rmf_Csr_t *c, double tol, int renorm, /*{{{*/
+                                double *max_loss)
+{
+   Rmf_Csr_t *x;
+   unsigned int r, g, k, ng, ne;
+
+   *max_loss = 0.0;
+
+   /* count the surviving groups and elements */
+   ng = ne = 0;
+   for (r = 0; r < c->num_rows; r++)
+     {
+        double sum = 0.0, cut;
+
+        for (k = c->grp_start[c->row_start[r]]; k < c->grp_start[c->row_start[r+1]]; k++)
+          sum += c->response[k];
+        cut = tol * sum;
+
+        for (g = c->row_start[r]; g < c->row_start[r+1]; g++)
+          {
+             int in_group = 0;
+             for (k = c->grp_start[g]; k < c->grp_start[g+1]; k++)
+               {
+                  if ((sum > 0.0) && (c->response[k] < cut))
+                    {
+                       in_group = 0;
+                       continue;
+                    }
+                  if (in_group == 0)
+                    ng++;
+                  in_group = 1;
+                  ne++;
+               }
+          }
+     }
+
+   if (NULL == (x = new_csr (c->num_rows, c->num_chan, ng, ne)))
+     return NULL;
+
+   ng = ne = 0;
+   for (r = 0; r < c->num_rows; r++)
+     {
+        double sum = 0.0, kept = 0.0, cut, loss;
+        unsigned int row_ne = ne;
+
+        x->row_start[r] = ng;
+
+        for (k = c->grp_start[c->row_start[r]]; k < c->grp_start[c->row_start[r+1]]; k++)
+          sum += c->response[k];
+        cut = tol * sum;
+
+        for (g = c->row_start[r]; g < c->row_start[r+1]; g++)
+          {
+             int in_group = 0;
+             for (k = c->grp_start[g]; k < c->grp_start[g+1]; k++)
+               {
+                  if ((sum > 0.0) && (c->response[k] < cut))
+                    {
+                       in_group = 0;
+                       continue;
+                    }
+                  if (in_group == 0)
+                    {
+                       x->first_chan[ng] = c->first_chan[g] + (k - c->grp_start[g]);
+                       x->grp_start[ng] = ne;
+                       ng++;
+                    }
+                  in_group = 1;
+                  kept += c->response[k];
+                  x->response[ne++] = c->response[k];
+               }
+          }
+
+        if (sum <= 0.0)
+          continue;
+
+        loss = (sum - kept) / sum;
+        if (loss > *max_loss)
+          *max_loss = loss;
+
+        if (renorm && (kept > 0.0))
+          {
+             double s = sum / kept;
+             for (k = row_ne; k < ne; k++)
+               x->response[k] = (float) (s * x->response[k]);
+          }
+     }
+
+   x->row_start[c->num_rows] = ng;
+   x->grp_start[ng] = ne;
+
+   return x;
+}
+
+/*}}}*/
+
+static void report_sparse_rmf (Rmf_Client_Data_t *cd) /*{{{*/
+{
+   unsigned int num_kept = cd->csr->num_elements;
+   unsigned int num = cd->sparse_num_elements;
+
+   isis_vmesg (WARN, I_INFO, __FILE__, __LINE__,
+               "RMF sparse=%g kept %u of %u elements (%.3g%%), max row probability loss %.3g%s",
+               cd->sparse_tol, num_kept, num,
+               num ? (100.0 * num_kept) / num : 100.0,
+               cd->sparse_max_loss, cd->sparse_renorm ? " (renormalized)" : "");
+}
+
+/*}}}*/
+
+static int pack_rmf (Rmf_Client_Data_t *cd) /*{{{*/
+{
+   Rmf_Csr_t *c;
+
+   if (NULL == (c = pack_rmf_vectors (cd->v, cd->num_ebins, cd->ebounds->nbins)))
+     return -1;
+
+   if (cd->sparse_tol > 0.0)
+     {
+        Rmf_Csr_t *x;
+        double max_loss;
+
+        if (NULL == (x = sparsify_csr (c, cd->sparse_tol, cd->sparse_renorm, &max_loss)))
+          {
+             free_csr (c);
+             return -1;
+          }
+
+        cd->sparse_num_elements = c->num_elements;
+        cd->sparse_max_loss = max_loss;
+        free_csr (c);
+        c = x;
+     }
+
+   invalidate_clips (cd);
+   release_csr (cd->csr);
+   cd->csr = share_csr (c);
+
+   if (cd->sparse_tol > 0.0)
+     report_sparse_rmf (cd);
+
+   free_rmf_vectors (cd->v, cd->num_ebins);
+   cd->v = NULL;
+
+   return 0;
+}
+
+/*}}}*/
+
+/*{{{ RMF files already loaded */
+
+/* The key of an RMF file identifies its contents by the full path,
+ * size and modification time, together with the load options that
+ * affect how it is read.
+ */
+
+static char *make_file_key (Rmf_Client_Data_t *cd) /*{{{*/
+{
+   char buf[128];
+   char *id, *key;
+
+   if (NULL == (id = isis_file_identity (cd->f.file)))
+     return NULL;
+
+   sprintf (buf, "\n%d\n%.17g\n%d\n", cd->strict, cd->sparse_tol, cd->sparse_renorm);
+
+   key = isis_mkstrcat (id, buf,
+                        cd->matrix_extname ? cd->matrix_extname : "",
+                        "\n",
+                        cd->ebounds_extname ? cd->ebounds_extname : "",
+                        NULL);
+   ISIS_FREE (id);
+
+   return key;
+}
+
+/*}}}*/
+
+/* Loading an RMF file that is already in memory, with the same
+ * options, copies the grids and shares the packed matrix of the
+ * earlier load instead of reading the file again.  An RMF leaves
+ * the list once its matrix or grids are modified.
+ */
+
+static void forget_loaded_rmf (Rmf_Client_Data_t *cd) /*{{{*/
+{
+   Rmf_Loaded_t *l, *prev = NULL;
+
+   if (cd->loaded == NULL)
+     return;
+
+   for (l = Loaded_Rmf_List; l != NULL; l = l->next)
+     {
+        if (l == cd->loaded)
+          {
+             if (prev == NULL)
+               Loaded_Rmf_List = l->next;
+             else prev->next = l->next;
+             break;
+          }
+        prev = l;
+     }
+
+   ISIS_FREE (cd->loaded->key);
+   ISIS_FREE (cd->loaded);
+}
+
+/*}}}*/
+
+/* key is freed if it can't be kept */
+static void remember_loaded_rmf (Isis_Rmf_t *rmf, Rmf_Client_Data_t *cd, char *key) /*{{{*/
+{
+   Rmf_Loaded_t *l;
+
+   if (NULL == (l = (Rmf_Loaded_t *) ISIS_MALLOC (sizeof(Rmf_Loaded_t))))
+     {
+        ISIS_FREE (key);
+        return;
+     }
+   memset ((char *)l, 0, sizeof(*l));
+
+   l->key = key;
+   l->cd = cd;
+   l->includes_effective_area = rmf->includes_effective_area;
+   l->order = rmf->order;
+   isis_strcpy (l->grating, rmf->grating, sizeof(l->grating));
+   isis_strcpy (l->instrument, rmf->instrument, sizeof(l->instrument));
+
+   l->next = Loaded_Rmf_List;
+   Loaded_Rmf_List = l;
+   cd->loaded = l;
+}
+
+/*}}}*/
+
+static int share_loaded_rmf (Isis_Rmf_t *rmf, Rmf_Client_Data_t *cd, char *key) /*{{{*/
+{
+   Rmf_Loaded_t *l;
+   Rmf_Client_Data_t *p;
+
+   for (l = Loaded_Rmf_List; l != NULL; l = l->next)
+     {
+        if (0 == strcmp (l->key, key))
+          break;
+     }
+
+   if (l == NULL)
+     return -1;
+
+   p = l->cd;
+   if ((p->csr == NULL) || (p->csr->num_users == 0))
+     return -1;
+
+   if ((NULL == (cd->arf = Isis_new_rmf_grid (p->arf->nbins, p->arf->bin_lo, p->arf->bin_hi)))
+       || (NULL == (cd->ebounds = Isis_new_rmf_grid (p->ebounds->nbins, p->ebounds->bin_lo,
+                                                     p->ebounds->bin_hi))))
+     {
+        Isis_free_rmf_grid (cd->arf);
+        cd->arf = NULL;
+        return -1;
+     }
+
+   cd->arf->units = p->arf->units;
+   cd->ebounds->units = p->ebounds->units;
+
+   rmf->includes_effective_area = l->includes_effective_area;
+   rmf->order = l->order;
+   isis_strcpy (rmf->grating, l->grating, sizeof(rmf->grating));
+   isis_strcpy (rmf->instrument, l->instrument, sizeof(rmf->instrument));
+
+   cd->threshold = p->threshold;
+   cd->offset = p->offset;
+   cd->swapped_channels = p->swapped_channels;
+   cd->energy_ordered_ebounds = p->energy_ordered_ebounds;
+   cd->num_ebins = p->num_ebins;
+   cd->sparse_num_elements = p->sparse_num_elements;
+   cd->sparse_max_loss = p->sparse_max_loss;
+   p->csr->num_users++;
+   cd->csr = p->csr;
+   cd->is_initialized = 1;
+
+   if (rmf->includes_effective_area)
+     isis_vmesg (WARN, I_INFO, __FILE__, __LINE__, "RMF includes the effective area");
+
+   if (cd->sparse_tol > 0.0)
+     report_sparse_rmf (cd);
+
+   return 0;
+}
+
+/*}}}*/
+
+/*}}}*/
+
+/*{{{ binary cache of parsed RMFs */
+
+/* A parsed and packed RMF may be saved in a cache directory so
+ * that later loads of the same file can map the packed matrix
+ * into memory instead of reading the FITS file again.  Processes
+ * that map the same cache file share one copy in the page cache.
+ * Cache files are only valid on the machine that wrote them.
+ * Entries are keyed by the full path, size and modification time
+ * of the RMF and by the load options that affect how it is read.
+ */
+
+#ifdef RMF_CACHE_SUPPORTED
+
+#define RMF_CACHE_MAGIC      0x434d5249U        /* "IRMC" */
+#define RMF_CACHE_VERSION    2
+#define RMF_CACHE_ALIGN(n)   (((n) + 7) & ~((size_t) 7))
+
+typedef struct
+{
+   unsigned int magic;
+   unsigned int version;
+   unsigned int sizeof_header;
+   unsigned int key_size;                /* including the trailing NUL */
+   double threshold;
+   int offset;
+   int swapped_channels;
+   int energy_ordered_ebounds;
+   int includes_effective_area;
+   int order;
+   int arf_units;
+   int ebounds_units;
+   unsigned int num_ebins;
+   unsigned int num_ebounds;
+   unsigned int num_rows;
+   unsigned int num_chan;
+   unsigned int num_grps;
+   unsigned int num_elements;
+   unsigned int sparse_num_elements;     /* before sparsifying */
+   double sparse_max_loss;
+   char grating[ISIS_RMF_BUFSIZE];
+   char instrument[ISIS_RMF_BUFSIZE];
+}
+Rmf_Cache_Header_t;
+
+/* byte offsets of each section of a cache file */
+typedef struct
+{
+   size_t key;
+   size_t arf_lo, arf_hi;
+   size_t ebounds_lo, ebounds_hi;
+   size_t row_start, first_chan, grp_start;
+   size_t response;
+   size_t total;
+}
+Rmf_Cache_Layout_t;
+
+static void get_cache_layout (Rmf_Cache_Header_t *h, Rmf_Cache_Layout_t *l) /*{{{*/
+{
+   l->key = RMF_CACHE_ALIGN(sizeof(Rmf_Cache_Header_t));
+   l->arf_lo = l->key + RMF_CACHE_ALIGN(h->key_size);
+   l->arf_hi = l->arf_lo + RMF_CACHE_ALIGN(h->num_ebins * sizeof(double));
+   l->ebounds_lo = l->arf_hi + RMF_CACHE_ALIGN(h->num_ebins * sizeof(double));
+   l->ebounds_hi = l->ebounds_lo + RMF_CACHE_ALIGN(h->num_ebounds * sizeof(double));
+   l->row_start = l->ebounds_hi + RMF_CACHE_ALIGN(h->num_ebounds * sizeof(double));
+   l->first_chan = l->row_start + RMF_CACHE_ALIGN((h->num_rows + 1) * sizeof(unsigned int));
+   l->grp_start = l->first_chan + RMF_CACHE_ALIGN((h->num_grps + 1) * sizeof(unsigned int));
+   l->response = l->grp_start + RMF_CACHE_ALIGN((h->num_grps + 1) * sizeof(unsigned int));
+   l->total = l->response + RMF_CACHE_ALIGN((h->num_elements + 1) * sizeof(float));
+}
+
+/*}}}*/
+
+static char *make_cache_file_name (char *dir, char *key) /*{{{*/
+{
+   unsigned long h1 = 2166136261UL, h2 = 5381;
+   unsigned char *s;
+   char name[64];
+
+   /* FNV-1a and djb2; the key itself is checked on load */
+   for (s = (unsigned char *)key; *s != 0; s++)
+     {
+        h1 = ((h1 ^ *s) * 16777619UL) & 0xffffffffUL;
+        h2 = ((h2 * 33) + *s) & 0xffffffffUL;
+     }
+
+   sprintf (name, "rmf-%08lx%08lx.cache", h1, h2);
+
+   return isis_mkstrcat (dir, "/", name, NULL);
+}
+
+/*}}}*/
+
+static int validate_cached_csr (Rmf_Csr_t *c) /*{{{*/
+{
+   unsigned int r, k;
+
+   if ((c->row_start[0] != 0)
+       || (c->row_start[c->num_rows] != c->num_grps)
+       || (c->grp_start[0] != 0)
+       || (c->grp_start[c->num_grps] != c->num_elements))
+     return -1;
+
+   for (r = 0; r < c->num_rows; r++)
+     {
+        if (c->row_start[r] > c->row_start[r+1])
+          return -1;
+     }
+
+   for (k = 0; k < c->num_grps; k++)
+     {
+        unsigned int n;
+        if (c->grp_start[k] > c->grp_start[k+1])
+          return -1;
+        n = c->grp_start[k+1] - c->grp_start[k];
+        if ((c->first_chan[k] > c->num_chan)
+            || (n > c->num_chan - c->first_chan[k]))
+          return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int load_cached_rmf (Isis_Rmf_t *rmf, Rmf_Client_Data_t *cd) /*{{{*/
+{
+   Rmf_Cache_Header_t *h;
+   Rmf_Cache_Layout_t l;
+   Isis_Rmf_Grid_Type *arf = NULL, *ebounds = NULL;
+   Rmf_Csr_t *c = NULL;
+   char *key, *file = NULL;
+   char *map = NULL;
+   struct stat st;
+   size_t size = 0;
+   int fd;
+
+   if (NULL == (key = make_file_key (cd)))
+     return -1;
+
+   if (NULL == (file = make_cache_file_name (cd->cache_dir, key)))
+     goto return_error;
+
+   if (-1 == (fd = open (file, O_RDONLY)))
+     goto return_error;
+
+   if ((-1 == fstat (fd, &st))
+       || (st.st_size < (off_t) sizeof(Rmf_Cache_Header_t)))
+     {
+        close (fd);
+        goto return_error;
+     }
+
+   size = (size_t) st.st_size;
+
+   /* Private and writable, so factor_rsp can scale the matrix in place */
+   map = (char *) mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close (fd);
+   if (map == (char *) MAP_FAILED)
+     {
+        map = NULL;
+        goto return_error;
+     }
+
+   h = (Rmf_Cache_Header_t *) map;
+   if ((h->magic != RMF_CACHE_MAGIC)
+       || (h->version != RMF_CACHE_VERSION)
+       || (h->sizeof_header != sizeof(Rmf_Cache_Header_t))
+       || (h->key_size != strlen (key) + 1)
+       || (h->num_rows != h->num_ebins)
+       || (h->num_chan != h->num_ebounds)
+       || (NULL == memchr (h->grating, 0, sizeof(h->grating)))
+       || (NULL == memchr (h->instrument, 0, sizeof(h->instrument))))
+     goto return_error;
+
+   get_cache_layout (h, &l);
+   if ((l.total != size)
+       || (0 != memcmp (map + l.key, key, h->key_size)))
+     goto return_error;
+
+   if ((NULL == (arf = Isis_new_rmf_grid (h->num_ebins, (double *)(map + l.arf_lo),
+                                          (double *)(map + l.arf_hi))))
+       || (NULL == (ebounds = Isis_new_rmf_grid (h->num_ebounds, (double *)(map + l.ebounds_lo),
+                                                 (double *)(map + l.ebounds_hi))))
+       || (NULL == (c = (Rmf_Csr_t *) ISIS_MALLOC (sizeof(Rmf_Csr_t)))))
+     goto return_error;
+   memset ((char *)c, 0, sizeof(*c));
+
+   arf->units = h->arf_units;
+   ebounds->units = h->ebounds_units;
+
+   c->num_rows = h->num_rows;
+   c->num_chan = h->num_chan;
+   c->num_grps = h->num_grps;
+   c->num_elements = h->num_elements;
+   c->row_start = (unsigned int *)(map + l.row_start);
+   c->first_chan = (unsigned int *)(map + l.first_chan);
+   c->grp_start = (unsigned int *)(map + l.grp_start);
+   c->response = (float *)(map + l.response);
+
+   if (-1 == validate_cached_csr (c))
+     {
+        isis_vmesg (WARN, I_WARNING, __FILE__, __LINE__, "ignoring corrupt RMF cache file %s", file);
+        goto return_error;
+     }
+
+   c->map = map;
+   c->map_size = size;
+
+   rmf->includes_effective_area = h->includes_effective_area;
+   rmf->order = h->order;
+   isis_strcpy (rmf->grating, h->grating, sizeof(rmf->grating));
+   isis_strcpy (rmf->instrument, h->instrument, sizeof(rmf->instrument));
+
+   cd->threshold = h->threshold;
+   cd->offset = h->offset;
+   cd->swapped_channels = h->swapped_channels;
+   cd->energy_ordered_ebounds = h->energy_ordered_ebounds;
+   cd->num_ebins = h->num_ebins;
+   cd->arf = arf;
+   cd->ebounds = ebounds;
+   cd->csr = share_csr (c);
+   cd->sparse_num_elements = h->sparse_num_elements;
+   cd->sparse_max_loss = h->sparse_max_loss;
+   cd->is_initialized = 1;
+
+   if (rmf->includes_effective_area)
+     isis_vmesg (WARN, I_INFO, __FILE__, __LINE__, "RMF includes the effective area");
+
+   /* the cached matrix was sparsified when it was saved */
+   if (cd->sparse_tol > 0.0)
+     report_sparse_rmf (cd);
+
+   ISIS_FREE (key);
+   ISIS_FREE (file);
+   return 0;
+
+   return_error:
+   if (map != NULL)
+     (void) munmap (map, size);
+   ISIS_FREE (c);
+   Isis_free_rmf_grid (arf);
+   Isis_free_rmf_grid (ebounds);
+   ISIS_FREE (key);
+   ISIS_FREE (file);
+   return -1;
+}
+
+/*}}}*/
+
+static int write_cache_section (FILE *fp, void *p, size_t size) /*{{{*/
+{
+   static char zeros[8];
+   size_t pad = RMF_CACHE_ALIGN(size) - size;
+
+   if ((size > 0) && (1 != fwrite (p, size, 1, fp)))
+     return -1;
+   if ((pad > 0) && (1 != fwrite (zeros, pad, 1, fp)))
+     return -1;
+
+   return 0;
+}
+
+/*}}}*/
+
+static int save_cached_rmf (Isis_Rmf_t *rmf, Rmf_Client_Data_t *cd) /*{{{*/
+{
+   Rmf_Cache_Header_t h;
+   Rmf_Csr_t *c = cd->csr;
+   char *key = NULL, *file = NULL, *tmp_file = NULL;
+   char pid[32];
+   FILE *fp = NULL;
+   int status = -1;
+
+   if ((NULL == (key = make_file_key (cd)))
+       || (NULL == (file = make_cache_file_name (cd->cache_dir, key))))
+     goto finish;
+
+   /* Write to a temporary file and rename it, so that processes
+    * loading the same RMF never see a partially written file */
+   sprintf (pid, ".%ld", (long) getpid ());
+   if (NULL == (tmp_file = isis_mkstrcat (file, pid, NULL)))
+     goto finish;
+
+   memset ((char *)&h, 0, sizeof(h));
+   h.magic = RMF_CACHE_MAGIC;
+   h.version = RMF_CACHE_VERSION;
+   h.sizeof_header = sizeof(h);
+   h.key_size = strlen (key) + 1;
+   h.threshold = cd->threshold;
+   h.offset = cd->offset;
+   h.swapped_channels = cd->swapped_channels;
+   h.energy_ordered_ebounds = cd->energy_ordered_ebounds;
+   h.includes_effective_area = rmf->includes_effective_area;
+   h.order = rmf->order;
+   h.arf_units = cd->arf->units;
+   h.ebounds_units = cd->ebounds->units;
+   h.num_ebins = cd->arf->nbins;
+   h.num_ebounds = cd->ebounds->nbins;
+   h.num_rows = c->num_rows;
+   h.num_chan = c->num_chan;
+   h.num_grps = c->num_grps;
+   h.num_elements = c->num_elements;
+   h.sparse_num_elements = cd->sparse_num_elements;
+   h.sparse_max_loss = cd->sparse_max_loss;
+   strncpy (h.grating, rmf->grating, ISIS_RMF_BUFSIZE-1);
+   strncpy (h.instrument, rmf->instrument, ISIS_RMF_BUFSIZE-1);
+
+   if (NULL == (fp = fopen (tmp_file, "wb")))
+     {
+        isis_vmesg (WARN, I_WRITE_OPEN_FAILED, __FILE__, __LINE__, "%s", tmp_file);
+        goto finish;
+     }
+
+   if ((-1 == write_cache_section (fp, &h, sizeof(h)))
+       || (-1 == write_cache_section (fp, key, h.key_size))
+       || (-1 == write_cache_section (fp, cd->arf->bin_lo, h.num_ebins * sizeof(double)))
+       || (-1 == write_cache_section (fp, cd->arf->bin_hi, h.num_ebins * sizeof(double)))
+       || (-1 == write_cache_section (fp, cd->ebounds->bin_lo, h.num_ebounds * sizeof(double)))
+       || (-1 == write_cache_section (fp, cd->ebounds->bin_hi, h.num_ebounds * sizeof(double)))
+       || (-1 == write_cache_section (fp, c->row_start, (h.num_rows + 1) * sizeof(unsigned int)))
+       || (-1 == write_cache_section (fp, c->first_chan, (h.num_grps + 1) * sizeof(unsigned int)))
+       || (-1 == write_cache_section (fp, c->grp_start, (h.num_grps + 1) * sizeof(unsigned int)))
+       || (-1 == write_cache_section (fp, c->response, (h.num_elements + 1) * sizeof(float))))
+     {
+        isis_vmesg (WARN, I_WRITE_FAILED, __FILE__, __LINE__, "%s", tmp_file);
+        goto finish;
+     }
+
+   if (0 != fclose (fp))
+     {
+        fp = NULL;
+        isis_vmesg (WARN, I_WRITE_FAILED, __FILE__, __LINE__, "%s", tmp_file);
+        goto finish;
+     }
+   fp = NULL;
+
+   if (0 != rename (tmp_file, file))
+     {
+        isis_vmesg (WARN, I_WRITE_FAILED, __FILE__, __LINE__, "%s", file);
+        goto finish;
+     }
+
+   status = 0;
+   finish:
+   if (fp != NULL)
+     fclose (fp);
+   if ((status != 0) && (tmp_file != NULL))
+     (void) remove (tmp_file);
+   ISIS_FREE (tmp_file);
+   ISIS_FREE (file);
+   ISIS_FREE (key);
+   return status;
+}
 
 /*}}}*/
 
-static int print_options_help (Rmf_Client_Data_t *cd);
-static int read_order_keyword (cfitsfile *ft, int *order);
+#else
 
-static Rmf_Client_Data_t *get_client_data (Isis_Rmf_t *rmf) /*{{{*/
+static int load_cached_rmf (Isis_Rmf_t *rmf, Rmf_Client_Data_t *cd) /*{{{*/
 {
-   return (Rmf_Client_Data_t *)rmf->client_data;
+   (void) rmf; (void) cd;
+   return -1;
 }
 
 /*}}}*/
 
-static void free_rmf_vector (Rmf_Vector_t *v) /*{{{*/
+static int save_cached_rmf (Isis_Rmf_t *rmf, Rmf_Client_Data_t *cd) /*{{{*/
 {
-   Rmf_Element_t *elem;
-   Rmf_Element_t *elem_max;
-
-   if ((v == NULL) || ((elem = v->elem) == NULL))
-     return;
-
-   elem_max = elem + v->num_grps;
+   (void) rmf; (void) cd;
+   isis_vmesg (WARN, I_NOT_IMPLEMENTED, __FILE__, __LINE__, "RMF cache on this platform");
+   return -1;
+}
 
-   while (elem < elem_max)
-     {
-        if (elem->response != NULL) ISIS_FREE (elem->response);
-        elem++;
-     }
+/*}}}*/
 
-   ISIS_FREE (v->elem);
-   v->num_grps = 0;
-}
+#endif
 
 /*}}}*/
 
@@ -199,6 +1404,52 @@ static int check_rmf_extension (cfitsfile *ft) /*{{{*/
 
 /*}}}*/
 
+static int get_column_size (Rmf_File_t *rft, int col, long *repeat, int *is_vla) /*{{{*/
+{
+   *repeat = 1;
+   *is_vla = 0;
+
+   if (col == -1)
+     return 0;
+
+   if (-1 == cfits_get_column_repeat (rft->ft, col, repeat, is_vla))
+     return -1;
+
+   /* Variable-length scalars are unusual, but they can only
+    * be read one row at a time. */
+   if (*is_vla || (*repeat < 1))
+     *repeat = 1;
+
+   return 0;
+}
+
+/*}}}*/
+
+static int get_column_sizes (Rmf_File_t *rft) /*{{{*/
+{
+   int is_vla[3];
+
+   if ((-1 == get_column_size (rft, rft->energ_lo_col, &rft->energ_lo_repeat, &is_vla[0]))
+       || (-1 == get_column_size (rft, rft->energ_hi_col, &rft->energ_hi_repeat, &is_vla[1]))
+       || (-1 == get_column_size (rft, rft->n_grp_col, &rft->n_grp_repeat, &is_vla[2]))
+       || (-1 == get_column_size (rft, rft->f_chan_col, &rft->f_chan_repeat, &rft->f_chan_vla))
+       || (-1 == get_column_size (rft, rft->n_chan_col, &rft->n_chan_repeat, &rft->n_chan_vla))
+       || (-1 == get_column_size (rft, rft->matrix_col, &rft->matrix_repeat, &rft->matrix_vla)))
+     {
+        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF column formats");
+        return -1;
+     }
+
+   rft->single_rows = (is_vla[0] || is_vla[1] || is_vla[2]);
+
+   rft->matrix_heap_size = rft->matrix_vla
+     ? cfits_get_vla_float_size (rft->ft, rft->matrix_col) : 0;
+
+   return 0;
+}
+
+/*}}}*/
+
 static Rmf_File_t *open_rmf_file (char *file, Isis_Rmf_t *rmf) /*{{{*/
 {
    /* This routine is complicated by the fact that CAL/GEN/92-002 allows
@@ -312,6 +1563,9 @@ static Rmf_File_t *open_rmf_file (char *file, Isis_Rmf_t *rmf) /*{{{*/
    if (-1 == (rft->n_chan_col = columns[4]))
      rft->n_chan_val = allow_as_keyword[4];
 
+   if (-1 == get_column_sizes (rft))
+     goto return_error;
+
    return rft;
 
    return_error:
@@ -333,142 +1587,453 @@ static void close_rmf_file (Rmf_File_t **rft) /*{{{*/
 
 /*}}}*/
 
-static int read_rmf_vector (Rmf_File_t *rft, int row, Rmf_Vector_t *v, /*{{{*/
-                            double *elo, double *ehi,
-                            int chan_range[2])
+/* Rows are read in blocks of cfits_optimal_numrows rows.  Scalar
+ * and fixed-length columns are read for the whole block in a single
+ * call.  For a variable-length MATRIX column, the array descriptors
+ * of the block are read, then the span of the heap they cover is
+ * read at once and converted row by row.  Other variable-length
+ * arrays, or a MATRIX which is scaled or spread thinly over the
+ * heap, are read one row at a time.
+ */
+typedef struct
 {
-   cfitsfile *ft;
-   unsigned int *nchan=NULL, *fchan=NULL;
-   Rmf_Element_t *elem;
-   Rmf_Element_t *elem_max;
-   float f_elo, f_ehi;
-   unsigned int i;
-   unsigned int ngrps;
-   long offset;
-   int matrix_col;
+   long first_row;
+   int num_rows;
+   unsigned int *ngrps;         /* [num_rows * n_grp_repeat] */
+   float *elo, *ehi;            /* [num_rows * energ_repeat] */
+   unsigned int *fchan, *nchan; /* fixed-length columns only */
+   float *matrix;               /* fixed-length column only */
+
+   /* variable-length MATRIX column read from the heap */
+   long *matrix_num, *matrix_ofs;       /* [num_rows] descriptors */
+   unsigned char *heap;
+   long heap_start;                     /* heap offset of heap[0] */
+   long max_heap_bytes;
+   int have_heap;                       /* boolean: heap holds this block */
+
+   /* per-row scratch space */
+   unsigned int *row_fchan, *row_nchan;
+   float *row_matrix;
+   unsigned int max_row_grps;
+   unsigned int max_row_elements;
+}
+Rmf_Block_t;
+
+static void free_rmf_block (Rmf_Block_t *b) /*{{{*/
+{
+   ISIS_FREE (b->ngrps);
+   ISIS_FREE (b->elo);
+   ISIS_FREE (b->ehi);
+   ISIS_FREE (b->fchan);
+   ISIS_FREE (b->nchan);
+   ISIS_FREE (b->matrix);
+   ISIS_FREE (b->matrix_num);
+   ISIS_FREE (b->matrix_ofs);
+   ISIS_FREE (b->heap);
+   ISIS_FREE (b->row_fchan);
+   ISIS_FREE (b->row_nchan);
+   ISIS_FREE (b->row_matrix);
+}
+
+/*}}}*/
+
+static int init_rmf_block (Rmf_File_t *rft, Rmf_Block_t *b, int block_size) /*{{{*/
+{
+   memset ((char *)b, 0, sizeof(*b));
+
+   if ((NULL == (b->ngrps = (unsigned int *) ISIS_MALLOC (block_size * rft->n_grp_repeat * sizeof(unsigned int))))
+       || (NULL == (b->elo = (float *) ISIS_MALLOC (block_size * rft->energ_lo_repeat * sizeof(float))))
+       || (NULL == (b->ehi = (float *) ISIS_MALLOC (block_size * rft->energ_hi_repeat * sizeof(float)))))
+     goto return_error;
+
+   if ((rft->f_chan_col != -1) && (rft->f_chan_vla == 0)
+       && (NULL == (b->fchan = (unsigned int *) ISIS_MALLOC (block_size * rft->f_chan_repeat * sizeof(unsigned int)))))
+     goto return_error;
+
+   if ((rft->n_chan_col != -1) && (rft->n_chan_vla == 0)
+       && (NULL == (b->nchan = (unsigned int *) ISIS_MALLOC (block_size * rft->n_chan_repeat * sizeof(unsigned int)))))
+     goto return_error;
+
+   if ((rft->matrix_vla == 0)
+       && (NULL == (b->matrix = (float *) ISIS_MALLOC (block_size * rft->matrix_repeat * sizeof(float)))))
+     goto return_error;
+
+   if ((rft->matrix_heap_size > 0)
+       && ((NULL == (b->matrix_num = (long *) ISIS_MALLOC (block_size * sizeof(long))))
+           || (NULL == (b->matrix_ofs = (long *) ISIS_MALLOC (block_size * sizeof(long))))))
+     goto return_error;
+
+   return 0;
+
+   return_error:
+   free_rmf_block (b);
+   return -1;
+}
+
+/*}}}*/
+
+static int read_rmf_block_heap (Rmf_File_t *rft, Rmf_Block_t *b) /*{{{*/
+{
+   long lo, hi, num_bytes, span;
+   int i, size = rft->matrix_heap_size;
+
+   b->have_heap = 0;
 
-   if (rft == NULL || v == NULL)
+   if (-1 == cfits_read_descripts (rft->ft, rft->matrix_col, b->first_row, b->num_rows,
+                                   b->matrix_num, b->matrix_ofs))
      return -1;
 
-   v->num_grps = 0;
-   v->elem = NULL;
+   lo = hi = 0;
+   num_bytes = 0;
+   for (i = 0; i < b->num_rows; i++)
+     {
+        long n = b->matrix_num[i] * size;
+        if (n == 0)
+          continue;
+        if ((num_bytes == 0) || (b->matrix_ofs[i] < lo))
+          lo = b->matrix_ofs[i];
+        if ((num_bytes == 0) || (b->matrix_ofs[i] + n > hi))
+          hi = b->matrix_ofs[i] + n;
+        num_bytes += n;
+     }
+
+   if (num_bytes == 0)
+     return 0;
 
-   ft = rft->ft;
+   /* Rows normally follow one another in the heap.  If they
+    * don't, reading the whole span could cost more than reading
+    * each row, so leave them to get_row_matrix. */
+   span = hi - lo;
+   if (span > 2 * num_bytes + 65536)
+     return 0;
 
-   if (rft->n_grp_col == -1)
-     ngrps = rft->n_grp_val;
-   else if (-1 == cfits_read_column_uints (ft, rft->n_grp_col, row, 1, &ngrps, 1))
+   if (span > b->max_heap_bytes)
+     {
+        unsigned char *tmp;
+        if (NULL == (tmp = (unsigned char *) ISIS_REALLOC (b->heap, span)))
+          return -1;
+        b->heap = tmp;
+        b->max_heap_bytes = span;
+     }
+
+   if (-1 == cfits_read_heap (rft->ft, lo, span, b->heap))
+     return -1;
+
+   b->heap_start = lo;
+   b->have_heap = 1;
+
+   return 0;
+}
+
+/*}}}*/
+
+static int read_rmf_block (Rmf_File_t *rft, Rmf_Block_t *b, long first_row, int num_rows) /*{{{*/
+{
+   cfitsfile *ft = rft->ft;
+
+   b->first_row = first_row;
+   b->num_rows = num_rows;
+
+   if ((rft->n_grp_col != -1)
+       && (-1 == cfits_read_column_uints (ft, rft->n_grp_col, first_row, 1, b->ngrps,
+                                          num_rows * rft->n_grp_repeat)))
      {
         isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading number of RMF groups");
         return -1;
      }
 
-   if (-1 == cfits_read_column_floats (ft, rft->energ_lo_col, row, 1, &f_elo, 1)
-       || -1 == cfits_read_column_floats (ft, rft->energ_hi_col, row, 1, &f_ehi, 1))
+   if ((-1 == cfits_read_column_floats (ft, rft->energ_lo_col, first_row, 1, b->elo,
+                                        num_rows * rft->energ_lo_repeat))
+       || (-1 == cfits_read_column_floats (ft, rft->energ_hi_col, first_row, 1, b->ehi,
+                                           num_rows * rft->energ_hi_repeat)))
      {
         isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF vector energy grid");
         return -1;
      }
 
-   *elo = (double) f_elo;
-   *ehi = (double) f_ehi;
-
-   if ((*elo == FLT_MIN) || (*ehi == FLT_MIN))
+   if ((b->fchan != NULL)
+       && (-1 == cfits_read_column_uints (ft, rft->f_chan_col, first_row, 1, b->fchan,
+                                          num_rows * rft->f_chan_repeat)))
      {
-        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "Corrupted energy grid in RMF");
+        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF fchan column");
         return -1;
      }
 
-   if (ngrps == 0)
-     return 0;
+   if ((b->nchan != NULL)
+       && (-1 == cfits_read_column_uints (ft, rft->n_chan_col, first_row, 1, b->nchan,
+                                          num_rows * rft->n_chan_repeat)))
+     {
+        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF nchan column");
+        return -1;
+     }
 
-   if (NULL == (elem = (Rmf_Element_t *) ISIS_MALLOC (ngrps * sizeof(Rmf_Element_t))))
-     return -1;
-   memset ((char *) elem, 0, ngrps * sizeof(*elem));
+   if ((b->matrix != NULL)
+       && (-1 == cfits_read_column_floats (ft, rft->matrix_col, first_row, 1, b->matrix,
+                                           num_rows * rft->matrix_repeat)))
+     {
+        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF response column");
+        return -1;
+     }
 
-   if (NULL == (nchan = (unsigned int *) ISIS_MALLOC (2*ngrps * sizeof(unsigned int))))
+   if ((b->matrix_num != NULL)
+       && (-1 == read_rmf_block_heap (rft, b)))
      {
-        ISIS_FREE(elem);
+        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF response column");
         return -1;
      }
-   fchan = nchan + ngrps;
 
-   v->num_grps = ngrps;
-   v->elem = elem;
+   return 0;
+}
 
-   /* Hopefully the cfitsio library will cache things. In general things will
-    * be in the heap and whether it has a cache or not may be irrelevant.
-    */
+/*}}}*/
+
+static int get_row_channels (Rmf_File_t *rft, Rmf_Block_t *b, int i, unsigned int ngrps, /*{{{*/
+                             unsigned int **fchan, unsigned int **nchan)
+{
+   long row = b->first_row + i;
+   unsigned int k;
 
-   if (-1 == rft->f_chan_col)
+   if (ngrps > b->max_row_grps)
      {
-        unsigned int imax = ngrps;
-        unsigned int f_chan_val = rft->f_chan_val;
+        unsigned int *tmp;
+        if (NULL == (tmp = (unsigned int *) ISIS_REALLOC (b->row_fchan, ngrps * sizeof(unsigned int))))
+          return -1;
+        b->row_fchan = tmp;
+        if (NULL == (tmp = (unsigned int *) ISIS_REALLOC (b->row_nchan, ngrps * sizeof(unsigned int))))
+          return -1;
+        b->row_nchan = tmp;
+        b->max_row_grps = ngrps;
+     }
 
-        for (i = 0; i < imax; i++) fchan [i] = f_chan_val;
+   if (rft->f_chan_col == -1)
+     {
+        for (k = 0; k < ngrps; k++)
+          b->row_fchan[k] = rft->f_chan_val;
+        *fchan = b->row_fchan;
      }
-   else if (-1 == cfits_read_column_uints (ft, rft->f_chan_col, row, 1, fchan, ngrps))
+   else if (rft->f_chan_vla)
      {
-        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF fchan column");
-        goto return_error;
+        if (-1 == cfits_read_column_uints (rft->ft, rft->f_chan_col, row, 1, b->row_fchan, ngrps))
+          {
+             isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF fchan column");
+             return -1;
+          }
+        *fchan = b->row_fchan;
+     }
+   else if (ngrps <= rft->f_chan_repeat)
+     *fchan = b->fchan + i * rft->f_chan_repeat;
+   else
+     {
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "N_GRP=%u exceeds F_CHAN array size", ngrps);
+        return -1;
      }
 
-   if (-1 == rft->n_chan_col)
+   if (rft->n_chan_col == -1)
+     {
+        for (k = 0; k < ngrps; k++)
+          b->row_nchan[k] = rft->n_chan_val;
+        *nchan = b->row_nchan;
+     }
+   else if (rft->n_chan_vla)
+     {
+        if (-1 == cfits_read_column_uints (rft->ft, rft->n_chan_col, row, 1, b->row_nchan, ngrps))
+          {
+             isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF nchan column");
+             return -1;
+          }
+        *nchan = b->row_nchan;
+     }
+   else if (ngrps <= rft->n_chan_repeat)
+     *nchan = b->nchan + i * rft->n_chan_repeat;
+   else
      {
-        unsigned int imax = ngrps;
-        unsigned int n_chan_val = rft->n_chan_val;
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "N_GRP=%u exceeds N_CHAN array size", ngrps);
+        return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
 
-        for (i = 0; i < imax; i++) nchan [i] = n_chan_val;
+static int get_row_matrix (Rmf_File_t *rft, Rmf_Block_t *b, int i, unsigned int num_elements, /*{{{*/
+                           float **matrix)
+{
+   if (rft->matrix_vla == 0)
+     {
+        if (num_elements > rft->matrix_repeat)
+          {
+             isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "N_CHAN total %u exceeds MATRIX array size",
+                         num_elements);
+             return -1;
+          }
+        *matrix = b->matrix + i * rft->matrix_repeat;
+        return 0;
      }
-   else if (-1 == cfits_read_column_uints (ft, rft->n_chan_col, row, 1, nchan, ngrps))
+
+   if (num_elements > b->max_row_elements)
      {
-        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF nchan column");
-        goto return_error;
+        float *tmp;
+        if (NULL == (tmp = (float *) ISIS_REALLOC (b->row_matrix, num_elements * sizeof(float))))
+          return -1;
+        b->row_matrix = tmp;
+        b->max_row_elements = num_elements;
      }
 
-   elem = v->elem;
-   elem_max = elem + ngrps;
-   i = 0;
+   if (b->have_heap)
+     {
+        if (num_elements > (unsigned long) b->matrix_num[i])
+          {
+             isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "N_CHAN total %u exceeds MATRIX array size",
+                         num_elements);
+             return -1;
+          }
+        if (num_elements > 0)
+          cfits_decode_floats (b->heap + (b->matrix_ofs[i] - b->heap_start),
+                               rft->matrix_heap_size, num_elements, b->row_matrix);
+        *matrix = b->row_matrix;
+        return 0;
+     }
 
-   matrix_col = rft->matrix_col;
-   offset = 1;
+   if (-1 == cfits_read_column_floats (rft->ft, rft->matrix_col, b->first_row + i, 1,
+                                       b->row_matrix, num_elements))
+     {
+        isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF response column");
+        return -1;
+     }
 
-   while (elem < elem_max)
+   *matrix = b->row_matrix;
+   return 0;
+}
+
+/*}}}*/
+
+static int unpack_rmf_vector (Rmf_File_t *rft, Rmf_Block_t *b, int i, Rmf_Vector_t *v, /*{{{*/
+                              double *elo, double *ehi,
+                              int chan_range[2])
+{
+   unsigned int *nchan, *fchan;
+   float *matrix;
+   Rmf_Element_t *elem;
+   unsigned int k, ngrps, num_elements;
+   long offset;
+
+   v->num_grps = 0;
+   v->elem = NULL;
+
+   if (rft->n_grp_col == -1)
+     ngrps = rft->n_grp_val;
+   else ngrps = b->ngrps[i * rft->n_grp_repeat];
+
+   *elo = (double) b->elo[i * rft->energ_lo_repeat];
+   *ehi = (double) b->ehi[i * rft->energ_hi_repeat];
+
+   if ((*elo == FLT_MIN) || (*ehi == FLT_MIN))
+     {
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "Corrupted energy grid in RMF");
+        return -1;
+     }
+
+   if (ngrps == 0)
+     return 0;
+
+   if (-1 == get_row_channels (rft, b, i, ngrps, &fchan, &nchan))
+     return -1;
+
+   num_elements = 0;
+   for (k = 0; k < ngrps; k++)
+     num_elements += nchan[k];
+
+   if (-1 == get_row_matrix (rft, b, i, num_elements, &matrix))
+     return -1;
+
+   if (NULL == (elem = (Rmf_Element_t *) ISIS_MALLOC (ngrps * sizeof(Rmf_Element_t))))
+     return -1;
+   memset ((char *) elem, 0, ngrps * sizeof(*elem));
+
+   v->num_grps = ngrps;
+   v->elem = elem;
+
+   offset = 0;
+
+   for (k = 0; k < ngrps; k++)
      {
-        elem->first_channel = fchan[i];
-        elem->num_channels = nchan[i];
+        elem[k].first_channel = fchan[k];
+        elem[k].num_channels = nchan[k];
 
         /* derive min/max channels included in this mapping */
-        if ((int) fchan[i] < chan_range[0])
+        if ((int) fchan[k] < chan_range[0])
+          {
+             chan_range[0] = (int)fchan[k];
+          }
+        if (chan_range[1] < (int)fchan[k] + (int)nchan[k] - 1)
           {
-             chan_range[0] = (int)fchan[i];
+             chan_range[1] = (int)fchan[k] + (int)nchan[k] - 1;
           }
-        if (chan_range[1] < (int)fchan[i] + (int)nchan[i] - 1)
+
+        if (NULL == (elem[k].response = (float *) ISIS_MALLOC (nchan[k] * sizeof(float))))
+          {
+             free_rmf_vector (v);
+             return -1;
+          }
+        memcpy ((char *)elem[k].response, (char *)(matrix + offset), nchan[k] * sizeof(float));
+
+        offset += nchan[k];
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int read_rmf_vectors (Rmf_File_t *rft, Rmf_Vector_t *v, Isis_Rmf_Grid_Type *g, /*{{{*/
+                             int chan_range[2])
+{
+   Rmf_Block_t b;
+   long block_size, row;
+   int ret = -1;
+
+   if (rft->single_rows)
+     block_size = 1;
+   else block_size = cfits_optimal_numrows (rft->ft);
+   if (block_size < 1)
+     block_size = 1;
+   if (block_size > rft->num_rows)
+     block_size = rft->num_rows;
+
+   if (-1 == init_rmf_block (rft, &b, block_size))
+     return -1;
+
+   for (row = 0; row < rft->num_rows; row += block_size)
+     {
+        int i, num_rows;
+
+        num_rows = block_size;
+        if (row + num_rows > rft->num_rows)
+          num_rows = rft->num_rows - row;
+
+        if (-1 == read_rmf_block (rft, &b, row+1, num_rows))
           {
-             chan_range[1] = (int)fchan[i] + (int)nchan[i] - 1;
+             isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF rows %ld-%ld",
+                         row, row + num_rows - 1);
+             goto finish;
           }
 
-        elem->response = (float *) ISIS_MALLOC (elem->num_channels * sizeof(float));
-        if ((elem->response == NULL)
-            || (-1 == cfits_read_column_floats (ft, matrix_col, row, offset,
-                                                elem->response, elem->num_channels)))
+        for (i = 0; i < num_rows; i++)
           {
-             isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF response column");
-             goto return_error;
+             if (-1 == unpack_rmf_vector (rft, &b, i, &v[row+i],
+                                          &g->bin_lo[row+i], &g->bin_hi[row+i], chan_range))
+               {
+                  isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF vector in row %ld", row+i);
+                  goto finish;
+               }
           }
-
-        offset += elem->num_channels;
-        i++;
-        elem++;
      }
 
-   ISIS_FREE(nchan);
-   return 0;
-
-   return_error:
-   ISIS_FREE(nchan);
-   free_rmf_vector (v);
-   return -1;
+   ret = 0;
+   finish:
+   free_rmf_block (&b);
+   return ret;
 }
 
 /*}}}*/
@@ -689,7 +2254,8 @@ static int read_rmf (Isis_Rmf_t *rmf, char *file) /*{{{*/
    Rmf_Client_Data_t *cd;
    Rmf_File_t *rft = NULL;
    Isis_Rmf_Grid_Type *g = NULL;
-   int row, ret = -1;
+   char *key;
+   int ret = -1;
    int reversed, min_chan, rmf_order;
    int chan_range[2];
 
@@ -701,9 +2267,20 @@ static int read_rmf (Isis_Rmf_t *rmf, char *file) /*{{{*/
 
    cd = (Rmf_Client_Data_t *) rmf->client_data;
 
+   key = make_file_key (cd);
+
+   if ((key != NULL)
+       && ((0 == share_loaded_rmf (rmf, cd, key))
+           || ((cd->cache_dir != NULL) && (0 == load_cached_rmf (rmf, cd)))))
+     {
+        remember_loaded_rmf (rmf, cd, key);
+        return 0;
+     }
+
    if (NULL == (rft = open_rmf_file (file, rmf)))
      {
         isis_vmesg (FAIL, I_READ_OPEN_FAILED, __FILE__, __LINE__, "%s", file);
+        ISIS_FREE (key);
         return -1;
      }
    rmf->includes_effective_area = rft->includes_effective_area;
@@ -736,15 +2313,8 @@ static int read_rmf (Isis_Rmf_t *rmf, char *file) /*{{{*/
    chan_range[1] = -INT_MAX;
 
    g = cd->arf;
-   for (row = 0; row < rft->num_rows; row++)
-     {
-        if (-1 == read_rmf_vector (rft, row+1, &cd->v[row],
-                                   &g->bin_lo[row], &g->bin_hi[row], chan_range))
-          {
-             isis_vmesg (FAIL, I_FAILED, __FILE__, __LINE__, "reading RMF vector in row %d", row);
-             goto finish;
-          }
-     }
+   if (-1 == read_rmf_vectors (rft, cd->v, g, chan_range))
+     goto finish;
 
    /* Try to fix common sloppiness */
    if (g->bin_lo[0] < 0)
@@ -783,6 +2353,12 @@ static int read_rmf (Isis_Rmf_t *rmf, char *file) /*{{{*/
    if (-1 == validate_rmf (rmf))
      goto finish;
 
+   if (-1 == pack_rmf (cd))
+     goto finish;
+
+   if (cd->cache_dir != NULL)
+     (void) save_cached_rmf (rmf, cd);
+
    cd->is_initialized = 1;
    ret = 0;
 
@@ -790,6 +2366,10 @@ static int read_rmf (Isis_Rmf_t *rmf, char *file) /*{{{*/
 
    close_rmf_file (&rft);
 
+   if ((ret == 0) && (key != NULL))
+     remember_loaded_rmf (rmf, cd, key);
+   else ISIS_FREE (key);
+
    return ret;
 }
 
@@ -803,13 +2383,10 @@ static void delete_client_data (Isis_Rmf_t *rmf) /*{{{*/
 
    if (NULL != cd)
      {
-        if (cd->v != NULL)
-          {
-             unsigned int i;
-             for (i = 0; i < cd->num_ebins; i++)
-               free_rmf_vector (&cd->v[i]);
-             ISIS_FREE (cd->v);
-          }
+        forget_loaded_rmf (cd);
+        free_rmf_vectors (cd->v, cd->num_ebins);
+        free_clip_list (cd->clip);
+        release_csr (cd->csr);
         Isis_free_rmf_grid (cd->arf);
         Isis_free_rmf_grid (cd->ebounds);
         if (cd->type == RMF_TYPE_FILE)
@@ -819,6 +2396,7 @@ static void delete_client_data (Isis_Rmf_t *rmf) /*{{{*/
 
         ISIS_FREE (cd->matrix_extname);
         ISIS_FREE (cd->ebounds_extname);
+        ISIS_FREE (cd->cache_dir);
      }
 
    ISIS_FREE (rmf->client_data);
@@ -829,35 +2407,328 @@ static int redistribute (Isis_Rmf_t *rmf, unsigned int in_lam, double flux, /*{{
                          double *det_chan, unsigned int num_ebounds)
 {
    Rmf_Client_Data_t *cd = get_client_data (rmf);
-   Rmf_Vector_t *v;
-   unsigned int g, in_egy;
+   Rmf_Csr_t *c = cd->csr;
+   unsigned int g, gmax;
 
-   in_egy = cd->num_ebins - in_lam - 1;
-   v = &cd->v[in_egy];
+   (void) num_ebounds;
 
-   for (g = 0; g < v->num_grps; g++)
+   gmax = c->row_start[in_lam + 1];
+
+   for (g = c->row_start[in_lam]; g < gmax; g++)
      {
-        Rmf_Element_t *elem = &v->elem[g];
-        float *response = elem->response;
-        int k, num_channels = elem->num_channels;
-        double *d = det_chan + num_ebounds - elem->first_channel - 1;
+        float *response = c->response + c->grp_start[g];
+        unsigned int k, num_channels = c->grp_start[g+1] - c->grp_start[g];
+        double *d = det_chan + c->first_chan[g];
 
         for (k = 0; k < num_channels; k++)
-          d[-k] += flux * response[k];
+          d[k] += flux * response[k];
+     }
+
+   return 0;
+}
+/*}}}*/
+
+static void accumulate_response (double *d, float *r, unsigned int n, double flux) /*{{{*/
+{
+   unsigned int k, n4;
+
+   /* Unrolled so that the compiler can vectorize the
+    * float->double multiply-add; d and r never overlap.
+    */
+   n4 = n & ~3U;
+   for (k = 0; k < n4; k += 4)
+     {
+        double d0 = d[k]   + flux * r[k];
+        double d1 = d[k+1] + flux * r[k+1];
+        double d2 = d[k+2] + flux * r[k+2];
+        double d3 = d[k+3] + flux * r[k+3];
+        d[k]   = d0;
+        d[k+1] = d1;
+        d[k+2] = d2;
+        d[k+3] = d3;
+     }
+
+   for (; k < n; k++)
+     d[k] += flux * r[k];
+}
+
+/*}}}*/
+
+/* Fewer threads are used if each would get less than this
+ * many matrix elements to accumulate.
+ */
+#define RMF_MIN_ELEMENTS_PER_THREAD  32768
+
+static unsigned int *partition_channels (Rmf_Csr_t *c, unsigned int num_parts) /*{{{*/
+{
+   unsigned int *count = NULL;
+   unsigned int *part_chan;
+   unsigned int g, k, p;
+   double total, sum;
+
+   if ((NULL == (part_chan = (unsigned int *) ISIS_MALLOC ((num_parts + 1) * sizeof(unsigned int))))
+       || (NULL == (count = (unsigned int *) ISIS_MALLOC ((c->num_chan + 1) * sizeof(unsigned int)))))
+     {
+        ISIS_FREE (part_chan);
+        return NULL;
+     }
+   memset ((char *)count, 0, (c->num_chan + 1) * sizeof(unsigned int));
+
+   /* count[k] = number of elements in channel k, via differences */
+   for (g = 0; g < c->num_grps; g++)
+     {
+        count[c->first_chan[g]]++;
+        count[c->first_chan[g] + (c->grp_start[g+1] - c->grp_start[g])]--;
+     }
+   for (k = 1; k < c->num_chan; k++)
+     count[k] += count[k-1];
+
+   total = (double) c->num_elements;
+
+   part_chan[0] = 0;
+   sum = 0.0;
+   k = 0;
+   for (p = 1; p < num_parts; p++)
+     {
+        double target = (total * p) / num_parts;
+        while ((k < c->num_chan) && (sum + count[k] <= target))
+          sum += count[k++];
+        part_chan[p] = k;
+     }
+   part_chan[num_parts] = c->num_chan;
+
+   ISIS_FREE (count);
+
+   return part_chan;
+}
+
+/*}}}*/
+
+/* A matrix shared by several RMFs may be folded by several
+ * datasets at once (see Fit_Num_Threads), so only a private
+ * matrix keeps its partition.  The caller frees the result
+ * if it differs from c->part_chan.
+ */
+static unsigned int *get_channel_partition (Rmf_Csr_t *c, unsigned int num_parts) /*{{{*/
+{
+   unsigned int *part_chan;
+
+   if ((c->part_chan != NULL) && (c->num_parts == num_parts))
+     return c->part_chan;
+
+   if (NULL == (part_chan = partition_channels (c, num_parts)))
+     return NULL;
+
+   if (c->num_users > 1)
+     return part_chan;
+
+   ISIS_FREE (c->part_chan);
+   c->part_chan = part_chan;
+   c->num_parts = num_parts;
+
+   return part_chan;
+}
+
+/*}}}*/
+
+/* Several models may be folded at once, so that the matrix is
+ * read only once.  flux[j*num_noticed + i] is noticed bin i of
+ * model j, which is folded into det_chan[j].
+ */
+typedef struct
+{
+   Rmf_Csr_t *c;
+   unsigned int *part_chan;
+   double *flux;
+   unsigned int num;
+   int *notice_list;
+   int num_noticed;
+   double **det_chan;
+}
+Fold_Task_Type;
+
+static int flux_is_zero (Fold_Task_Type *t, int i) /*{{{*/
+{
+   unsigned int j;
+
+   for (j = 0; j < t->num; j++)
+     {
+        if (t->flux[j * t->num_noticed + i] != 0.0)
+          return 0;
+     }
+
+   return 1;
+}
+
+/*}}}*/
+
+static int fold_channel_range (void *cl, unsigned int part, unsigned int num_parts) /*{{{*/
+{
+   Fold_Task_Type *t = (Fold_Task_Type *)cl;
+   Rmf_Csr_t *c = t->c;
+   unsigned int *row_start = c->row_start;
+   unsigned int *first_chan = c->first_chan;
+   unsigned int *grp_start = c->grp_start;
+   float *response = c->response;
+   unsigned int cmin, cmax;
+   int i;
+
+   (void) num_parts;
+
+   cmin = t->part_chan[part];
+   cmax = t->part_chan[part + 1];
+   if (cmin >= cmax)
+     return 0;
+
+   /* Each thread owns the channels [cmin, cmax) and visits the
+    * model bins in the same order as the serial loop, so every
+    * channel is summed in the same order and the result doesn't
+    * depend on the number of threads.
+    */
+   for (i = 0; i < t->num_noticed; i++)
+     {
+        unsigned int g, gmax, r;
+
+        if (flux_is_zero (t, i))
+          continue;
+
+        r = (t->notice_list != NULL) ? (unsigned int) t->notice_list[i] : (unsigned int) i;
+
+        gmax = row_start[r + 1];
+        for (g = row_start[r]; g < gmax; g++)
+          {
+             unsigned int lo = first_chan[g];
+             unsigned int hi = lo + (grp_start[g+1] - grp_start[g]);
+             unsigned int offset = 0;
+             unsigned int j;
+
+             if ((hi <= cmin) || (lo >= cmax))
+               continue;
+             if (lo < cmin)
+               {
+                  offset = cmin - lo;
+                  lo = cmin;
+               }
+             if (hi > cmax)
+               hi = cmax;
+
+             for (j = 0; j < t->num; j++)
+               {
+                  double f = t->flux[j * t->num_noticed + i];
+                  if (f != 0.0)
+                    accumulate_response (t->det_chan[j] + lo, response + grp_start[g] + offset,
+                                         hi - lo, f);
+               }
+          }
      }
 
    return 0;
 }
+
+/*}}}*/
+
+static int fold_csr (Rmf_Csr_t *c, unsigned int num_threads, Fold_Task_Type *t) /*{{{*/
+{
+   unsigned int max_threads;
+   int i, status;
+
+   for (i = 0; i < t->num_noticed; i++)
+     {
+        unsigned int r = (t->notice_list != NULL) ? (unsigned int) t->notice_list[i] : (unsigned int) i;
+        if (r >= c->num_rows)
+          return -1;
+     }
+
+   t->c = c;
+
+   max_threads = c->num_elements / RMF_MIN_ELEMENTS_PER_THREAD;
+   if (num_threads > max_threads)
+     num_threads = max_threads;
+   if (num_threads > c->num_chan)
+     num_threads = c->num_chan;
+   if ((num_threads <= 1) || (0 == isis_have_threads ()))
+     {
+        unsigned int part_chan[2];
+        part_chan[0] = 0;
+        part_chan[1] = c->num_chan;
+        t->part_chan = part_chan;
+        return fold_channel_range ((void *)t, 0, 1);
+     }
+
+   if (NULL == (t->part_chan = get_channel_partition (c, num_threads)))
+     return -1;
+
+   status = isis_run_threads (num_threads, fold_channel_range, (void *)t);
+
+   if (t->part_chan != c->part_chan)
+     ISIS_FREE (t->part_chan);
+
+   return status;
+}
+
+/*}}}*/
+
+static int fold_multi (Isis_Rmf_t *rmf, double *flux, unsigned int num, /*{{{*/
+                       int *notice_list, int num_noticed,
+                       double **det_chan, unsigned int num_ebounds, int *chan_notice)
+{
+   Rmf_Client_Data_t *cd = get_client_data (rmf);
+   Fold_Task_Type t;
+   Rmf_Csr_t *c;
+
+   if ((cd == NULL) || (NULL == (c = cd->csr)))
+     return -1;
+
+   if (num_ebounds != c->num_chan)
+     {
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "RMF EBOUNDS/data grid mismatch");
+        return -1;
+     }
+
+   /* Only accumulate into the noticed channels (fold=noticed).
+    * The clipped copy is built on first use.  The list is locked
+    * because folds may run in threads; an entry can't be dropped
+    * while in use, because datasets sharing an RMF are folded by
+    * the same thread.
+    */
+   if (chan_notice != NULL)
+     {
+        isis_lock_shared_state ();
+        c = find_clipped_csr (cd, chan_notice);
+        isis_unlock_shared_state ();
+        if (c == NULL)
+          return -1;
+     }
+
+   t.flux = flux;
+   t.num = num;
+   t.notice_list = notice_list;
+   t.num_noticed = num_noticed;
+   t.det_chan = det_chan;
+
+   return fold_csr (c, cd->num_threads, &t);
+}
+
+/*}}}*/
+
+static int fold (Isis_Rmf_t *rmf, double *flux, int *notice_list, int num_noticed, /*{{{*/
+                 double *det_chan, unsigned int num_ebounds, int *chan_notice)
+{
+   return fold_multi (rmf, flux, 1, notice_list, num_noticed, &det_chan,
+                      num_ebounds, chan_notice);
+}
+
 /*}}}*/
 
 static int set_noticed_model_bins (Isis_Rmf_t *rmf, int num_chan, int *chan_notice, /*{{{*/
                                    int num_model, int *model_notice)
 {
    Rmf_Client_Data_t *cd = get_client_data (rmf);
+   Rmf_Csr_t *c;
    unsigned int *undetected_model_bin;
    unsigned int e_model;
 
-   if ((NULL == rmf) || (NULL == cd))
+   if ((NULL == rmf) || (NULL == cd) || (NULL == (c = cd->csr)))
      return -1;
 
    if (num_chan != (int) cd->ebounds->nbins)
@@ -880,26 +2751,24 @@ static int set_noticed_model_bins (Isis_Rmf_t *rmf, int num_chan, int *chan_noti
    for (e_model = 0; e_model < (unsigned int) num_model; e_model++)
      undetected_model_bin[e_model] = 1;
 
-   for (e_model = 0; e_model < cd->num_ebins; e_model++)
+   for (e_model = 0; e_model < (unsigned int) num_model; e_model++)
      {
-        Rmf_Vector_t *v = &cd->v[e_model];
-        unsigned int g;
+        unsigned int g, gmax = c->row_start[e_model + 1];
 
-        for (g = 0; g < v->num_grps; g++)
+        for (g = c->row_start[e_model]; g < gmax; g++)
           {
-             Rmf_Element_t *elem = &v->elem[g];
-             int num_channels = elem->num_channels;
-             int *noticed = (chan_notice + num_chan - 1) - elem->first_channel;
-             int e_ch;
+             float *response = c->response + c->grp_start[g];
+             unsigned int num_channels = c->grp_start[g+1] - c->grp_start[g];
+             int *noticed = chan_notice + c->first_chan[g];
+             unsigned int e_ch;
 
              for (e_ch = 0; e_ch < num_channels; e_ch++)
                {
-                  if (elem->response[e_ch] > 0.0)
+                  if (response[e_ch] > 0.0)
                     {
-                       unsigned int k = num_model - e_model - 1;
-                       undetected_model_bin[k] = 0;
-                       if (noticed[-e_ch])
-                         model_notice[k] = 1;
+                       undetected_model_bin[e_model] = 0;
+                       if (noticed[e_ch])
+                         model_notice[e_model] = 1;
                     }
                }
           }
@@ -999,46 +2868,41 @@ static int dummy_init (Isis_Rmf_t *rmf) /*{{{*/
 static int factor_rsp (Isis_Rmf_t *rmf, double *arf) /*{{{*/
 {
    Rmf_Client_Data_t *cd = get_client_data (rmf);
-   Rmf_Element_t *elem;
+   Rmf_Csr_t *c;
    float *response;
-   int k, num_channels;
    unsigned int in_lam, negative_sum, num_ebins;
 
-   if (rmf == NULL || arf == NULL || cd == NULL)
+   if (rmf == NULL || arf == NULL || cd == NULL || NULL == cd->csr)
      return -1;
 
+   if (NULL == (c = unshare_csr (cd->csr)))
+     return -1;
+   cd->csr = c;
+   forget_loaded_rmf (cd);
+
    /* factor ARF out of RSP matrix
     *   RSP => RMF * ARF
     * where RMF is normalized.
     */
 
-   num_ebins = cd->num_ebins;
+   num_ebins = c->num_rows;
    negative_sum = 0;
 
    for (in_lam = 0; in_lam < num_ebins; in_lam++)
      {
-        Rmf_Vector_t *v;
-        unsigned int g, in_egy, num_grps;
+        unsigned int k, kmin, kmax;
         double sum;
 
-        in_egy = cd->num_ebins - in_lam - 1;
-
-        v = &cd->v[in_egy];
-        num_grps = v->num_grps;
+        /* the groups of a row are contiguous in response[] */
+        kmin = c->grp_start[c->row_start[in_lam]];
+        kmax = c->grp_start[c->row_start[in_lam+1]];
+        response = c->response;
 
         sum = 0.0;
         arf[in_lam] = 0.0;
 
-        /* sum over RMF groups */
-        for (g = 0; g < num_grps; g++)
-          {
-             elem = &v->elem[g];
-             response = elem->response;
-             num_channels = elem->num_channels;
-
-             for (k = 0; k < num_channels; k++)
-               sum += response[k];
-          }
+        for (k = kmin; k < kmax; k++)
+          sum += response[k];
 
         if (sum == 0.0)
           continue;
@@ -1049,20 +2913,14 @@ static int factor_rsp (Isis_Rmf_t *rmf, double *arf) /*{{{*/
           }
 
         /* normalize */
-        for (g = 0; g < num_grps; g++)
-          {
-             elem = &v->elem[g];
-             response = elem->response;
-             num_channels = elem->num_channels;
-
-             for (k = 0; k < num_channels; k++)
-               response[k] /= sum;
-          }
+        for (k = kmin; k < kmax; k++)
+          response[k] /= sum;
 
         arf[in_lam] = sum;
      }
 
    rmf->includes_effective_area = 0;
+   invalidate_clips (cd);
 
    if (negative_sum)
      isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "corrupted RSP?  %d RSP groups had norm < 0", negative_sum);
@@ -1204,20 +3062,6 @@ static int store_rmf_histogram (double *h, unsigned int num, unsigned int offset
 
 /*}}}*/
 
-static void free_rmf_vectors (Rmf_Vector_t *v, unsigned int num) /*{{{*/
-{
-   unsigned int i;
-
-   if (v == NULL)
-     return;
-
-   for (i = 0; i < num; i++)
-     free_rmf_vector (&v[i]);
-   ISIS_FREE (v);
-}
-
-/*}}}*/
-
 static int rebin_rmf (Isis_Rmf_t *rmf, double *wv_lo, double *wv_hi, unsigned int new_num) /*{{{*/
 {
    double *new_lo, *new_hi, *new_h;
@@ -1225,13 +3069,14 @@ static int rebin_rmf (Isis_Rmf_t *rmf, double *wv_lo, double *wv_hi, unsigned in
    unsigned int old_num;
    Isis_Rmf_Grid_Type *ebounds;
    Rmf_Client_Data_t *cd;
+   Rmf_Csr_t *c, *new_c;
    Rmf_Vector_t *new_v;
    unsigned int i;
    int *f_chan, *n_chan;
    unsigned int num_rows;
 
    cd = get_client_data(rmf);
-   if (cd == NULL)
+   if ((cd == NULL) || (NULL == (c = cd->csr)))
      return -1;
 
    f_chan = n_chan = NULL;
@@ -1275,26 +3120,28 @@ static int rebin_rmf (Isis_Rmf_t *rmf, double *wv_lo, double *wv_hi, unsigned in
 
    for (i = 0; i < num_rows; i++)
      {
-        Rmf_Vector_t *v;
-        unsigned int g;
+        unsigned int g, gmin, gmax, r;
         double *old_h_start, *old_h_end;
         unsigned int old_h_num, old_h_offset, new_h_num;
         int i_new_start, i_new_end;
 
-        v = cd->v + i;
+        /* energy row i is packed as wavelength row r */
+        r = num_rows - i - 1;
+        gmin = c->row_start[r];
+        gmax = c->row_start[r+1];
 
-        if (v->num_grps == 0)
+        if (gmin == gmax)
           continue;
 
         old_h_start = NULL;
         old_h_end = NULL;
 
-        for (g = 0; g < v->num_grps; g++)
+        for (g = gmin; g < gmax; g++)
           {
-             Rmf_Element_t *elem = &v->elem[g];
-             unsigned int num_channels = elem->num_channels;
-             float *response = elem->response;
-             double *h = old_h + elem->first_channel;
+             unsigned int num_channels = c->grp_start[g+1] - c->grp_start[g];
+             float *response = c->response + c->grp_start[g];
+             /* energy-ordered channel of the last packed element */
+             double *h = old_h + (old_num - (c->first_chan[g] + num_channels));
              unsigned int k;
 
              if ((old_h_end == NULL) || ((h + num_channels - 1) > old_h_end))
@@ -1303,7 +3150,7 @@ static int rebin_rmf (Isis_Rmf_t *rmf, double *wv_lo, double *wv_hi, unsigned in
                old_h_start = h;
 
              for (k = 0; k < num_channels; k++)
-               h[k] = response[k];
+               h[k] = response[num_channels - k - 1];
           }
 
         old_h_offset = old_h_start - old_h;
@@ -1340,15 +3187,21 @@ static int rebin_rmf (Isis_Rmf_t *rmf, double *wv_lo, double *wv_hi, unsigned in
         memset ((char *)old_h+old_h_offset, 0, old_h_num * sizeof (double));
      }
 
+   if (NULL == (new_c = pack_rmf_vectors (new_v, num_rows, new_num)))
+     goto return_error;
+   free_rmf_vectors (new_v, num_rows);
+
    /* If we made it this far, then it has been a success. So make the
     * appropriate replacements
     */
-   free_rmf_vectors (cd->v, num_rows);
+   invalidate_clips (cd);
+   forget_loaded_rmf (cd);
+   release_csr (cd->csr);
 
    ISIS_FREE (ebounds->bin_lo);
    ISIS_FREE (ebounds->bin_hi);
 
-   cd->v = new_v;
+   cd->csr = share_csr (new_c);
    ebounds->bin_lo = new_lo;
    ebounds->bin_hi = new_hi;
    ebounds->nbins = new_num;
@@ -1364,10 +3217,10 @@ static int rebin_rmf (Isis_Rmf_t *rmf, double *wv_lo, double *wv_hi, unsigned in
 
    ISIS_FREE (f_chan);
    ISIS_FREE (n_chan);
-   ISIS_FREE (new_h);
+   ISIS_FREE (old_h);
 
    free_hist (new_lo, new_hi, new_h);
-   free_rmf_vectors (new_v, new_num);
+   free_rmf_vectors (new_v, num_rows);
 
    return -1;
 }
@@ -1424,18 +3277,110 @@ static int handle_ebounds_option (char *subsystem, char *optname, char *value, v
 
 /*}}}*/
 
+static int handle_cache_option (char *subsystem, char *optname, char *value, void *clientdata) /*{{{*/
+{
+   Rmf_Client_Data_t *cd = (Rmf_Client_Data_t *)clientdata;
+
+   (void) subsystem; (void) optname;
+
+   ISIS_FREE(cd->cache_dir);
+   if (NULL == (cd->cache_dir = isis_make_string (value)))
+     return -1;
+
+   return 0;
+}
+
+/*}}}*/
+
+static int handle_nthreads_option (char *subsystem, char *optname, char *value, void *clientdata) /*{{{*/
+{
+   Rmf_Client_Data_t *cd = (Rmf_Client_Data_t *)clientdata;
+   int n;
+
+   if ((1 != sscanf (value, "%d", &n)) || (n < 1))
+     {
+        fprintf (stderr, "Unknown '%s;%s' option value '%s'\n", subsystem, optname, value);
+        return -1;
+     }
+
+   if (n > ISIS_MAX_THREADS)
+     n = ISIS_MAX_THREADS;
+
+   cd->num_threads = (unsigned int) n;
+
+   return 0;
+}
+
+/*}}}*/
+
+static int handle_sparse_option (char *subsystem, char *optname, char *value, void *clientdata) /*{{{*/
+{
+   Rmf_Client_Data_t *cd = (Rmf_Client_Data_t *)clientdata;
+   double tol;
+
+   if ((1 != sscanf (value, "%lf", &tol)) || (tol < 0.0) || (tol >= 1.0))
+     {
+        fprintf (stderr, "Unknown '%s;%s' option value '%s'\n", subsystem, optname, value);
+        return -1;
+     }
+
+   cd->sparse_tol = tol;
+
+   return 0;
+}
+
+/*}}}*/
+
+static int handle_renorm_option (char *subsystem, char *optname, char *value, void *clientdata) /*{{{*/
+{
+   Rmf_Client_Data_t *cd = (Rmf_Client_Data_t *)clientdata;
+
+   if (0 == isis_strcasecmp (value, "yes"))
+     cd->sparse_renorm = 1;
+   else if (0 == isis_strcasecmp (value, "no"))
+     cd->sparse_renorm = 0;
+   else
+     {
+        fprintf (stderr, "Unknown '%s;%s' option value '%s'\n", subsystem, optname, value);
+        return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static Isis_Option_Table_Type Option_Table [] =
 {
      {"strict", handle_strict_option, ISIS_OPT_REQUIRES_VALUE, "2", "OGIP strictness"},
      {"ebounds", handle_ebounds_option, ISIS_OPT_REQUIRES_VALUE, "EBOUNDS", "EXTNAME of FITS extension containing EBOUNDS grid"},
      {"matrix", handle_matrix_option, ISIS_OPT_REQUIRES_VALUE, "SPECRESP MATRIX", "EXTNAME of FITS extension containing RMF matrix"},
+     {"cache", handle_cache_option, ISIS_OPT_REQUIRES_VALUE, "$ISIS_RMF_CACHE_DIR", "directory for cached binary copies of RMFs, or none"},
+     {"nthreads", handle_nthreads_option, ISIS_OPT_REQUIRES_VALUE, "1", "number of threads used to fold the RMF"},
+     {"sparse", handle_sparse_option, ISIS_OPT_REQUIRES_VALUE, "0", "drop matrix elements below this fraction of the row sum"},
+     {"renorm", handle_renorm_option, ISIS_OPT_REQUIRES_VALUE, "no", "rescale rows after dropping elements (yes|no)"},
      ISIS_OPTION_TABLE_TYPE_NULL
 };
 
 static int set_options (Rmf_Client_Data_t *cd, Isis_Option_Type *opts) /*{{{*/
 {
+   char *dir;
+
    cd->strict = Isis_Rmf_OGIP_Compliance;
-   return isis_process_options (opts, Option_Table, (void *)cd, 1);
+   cd->num_threads = 1;
+   if (-1 == isis_process_options (opts, Option_Table, (void *)cd, 1))
+     return -1;
+
+   if ((cd->cache_dir == NULL)
+       && (NULL != (dir = getenv ("ISIS_RMF_CACHE_DIR")))
+       && (NULL == (cd->cache_dir = isis_make_string (dir))))
+     return -1;
+
+   if ((cd->cache_dir != NULL)
+       && ((*cd->cache_dir == 0) || (0 == isis_strcasecmp (cd->cache_dir, "none"))))
+     ISIS_FREE (cd->cache_dir);
+
+   return 0;
 }
 
 /*}}}*/
@@ -1501,6 +3446,8 @@ static int init_rmf_t (Isis_Rmf_t *rmf) /*{{{*/
    rmf->set_noticed_model_bins = set_noticed_model_bins;
    rmf->rebin_rmf = rebin_rmf;
    rmf->factor_rsp = factor_rsp;
+   rmf->fold = fold;
+   rmf->fold_multi = fold_multi;
    rmf->delete_client_data = delete_client_data;
 
    rmf->client_data = (Rmf_Client_Data_t *) ISIS_MALLOC (sizeof(Rmf_Client_Data_t));
@@ -1618,6 +3565,9 @@ int Rmf_load_slang (Isis_Rmf_t *rmf, void *options) /*{{{*/
         SLang_free_array (at_rmf);
      }
 
+   if (-1 == pack_rmf (cd))
+     goto return_error;
+
    ISIS_FREE (n_chan);
    ISIS_FREE (f_chan);
    return 0;
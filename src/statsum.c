@@ -0,0 +1,537 @@
+/* -*- mode: C; mode: fold -*- */
+
+/*  This file is part of ISIS, the Interactive Spectral Interpretation System
+    Copyright (C) 1998-2019  Massachusetts Institute of Technology
+
+    This software was developed by the MIT Center for Space Research under
+    contract SV1-61010 from the Smithsonian Institution.
+
+    Author:  John C. Houck  <houck@space.mit.edu>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#include "isis.h"
+#include "util.h"
+#include "statsum.h"
+
+/* Fused kernels for the chisqr, cash and ml fit-statistics.
+ * With many data bins, e.g. for combined CCD spectra, the
+ * statistic is evaluated often enough for its cost to matter,
+ * so the per-bin terms and their compensated sum are computed
+ * in one pass, using AVX2 when the CPU supports it.
+ */
+
+int Isis_Vector_Statistics = 1;
+
+#define SIGN(x)  ((x) < 0.0 ? -1 : 1)
+
+/*{{{ scalar versions */
+
+/* Kahan summation.  Beware of optimizers that break this. */
+typedef struct
+{
+   double s, c;
+}
+Kahan_Type;
+
+static void kahan_add (Kahan_Type *k, double x) /*{{{*/
+{
+   double y, t;
+
+   y = x - k->c;
+   t = k->s + y;
+   k->c = (t - k->s) - y;
+   k->s = t;
+}
+
+/*}}}*/
+
+static double chisqr_term (unsigned int sigma, double yi, double fxi, double wi, /*{{{*/
+                           unsigned int *num_bad)
+{
+   double dy = yi - fxi;
+   double wt;
+
+   switch (sigma)
+     {
+      case STATSUM_DATA_VARIANCE:
+        return dy * sqrt(wi);
+
+      case STATSUM_GEHRELS_VARIANCE:
+        if (yi >= 0.0) dy /= 1.0 + sqrt(yi + 0.75);
+        else *num_bad += 1;
+        return dy;
+
+      case STATSUM_MODEL_VARIANCE:
+        wt = 1.0;
+        if (fxi != 0.0) wt = 1.0 / fabs(fxi);
+        else *num_bad += 1;
+        return dy * sqrt(wt);
+
+      default:
+        break;
+     }
+
+   return dy;
+}
+
+/*}}}*/
+
+static double cash_term (double yi, double fxi, double *veci) /*{{{*/
+{
+   double s, log_fxi;
+
+   /* The form of the statistic is modified according to the
+    * suggestion of Castor described in the XSPEC manual.
+    *
+    * Want sum += (yi - fxi) +  yi * log (fxi/yi);
+    * but must avoid log(0) and f/0
+    */
+
+   if (yi <= 0) yi = 1.e-5;
+   log_fxi = (fxi > 0) ? log(fxi) : (double) DBL_MIN_10_EXP;
+
+   s = (yi - fxi);
+   s += yi * (log_fxi - log (yi));
+   s *= -2;
+
+   *veci = isfinite(s) ? (s * SIGN(yi-fxi)) : DBL_MAX;
+
+   return s;
+}
+
+/*}}}*/
+
+static double ml_term (double yi, double fxi) /*{{{*/
+{
+   double log_fxi = (fxi > 0) ? log(fxi) : (double) DBL_MIN_10_EXP;
+   return 2 * (fxi + lgamma (yi + 1) - yi * log_fxi);
+}
+
+/*}}}*/
+
+static double chisqr_sum_scalar (unsigned int sigma, double *y, double *fx, double *w, /*{{{*/
+                                 unsigned int n, double *vec, unsigned int *num_bad)
+{
+   Kahan_Type k = {0.0, 0.0};
+   unsigned int i;
+
+   for (i = 0; i < n; i++)
+     {
+        double wi = (sigma == STATSUM_DATA_VARIANCE) ? w[i] : 1.0;
+        double v = chisqr_term (sigma, y[i], fx[i], wi, num_bad);
+        vec[i] = v;
+        kahan_add (&k, v * v);
+     }
+
+   return k.s;
+}
+
+/*}}}*/
+
+static double cash_sum_scalar (double *y, double *fx, unsigned int n, double *vec) /*{{{*/
+{
+   Kahan_Type k = {0.0, 0.0};
+   unsigned int i;
+
+   for (i = 0; i < n; i++)
+     {
+        kahan_add (&k, cash_term (y[i], fx[i], &vec[i]));
+     }
+
+   return k.s;
+}
+
+/*}}}*/
+
+static double ml_sum_scalar (double *y, double *fx, unsigned int n, double *vec) /*{{{*/
+{
+   Kahan_Type k = {0.0, 0.0};
+   unsigned int i;
+
+   for (i = 0; i < n; i++)
+     {
+        double s = ml_term (y[i], fx[i]);
+        vec[i] = s;
+        kahan_add (&k, s);
+     }
+
+   return k.s;
+}
+
+/*}}}*/
+
+/*}}}*/
+
+/*{{{ AVX2 versions */
+
+#ifdef ISIS_HAVE_AVX2
+
+#include <immintrin.h>
+
+/* Four Kahan sums, one per lane */
+typedef struct
+{
+   __m256d s, c;
+}
+Kahan4_Type;
+
+ISIS_AVX2_FUNCTION
+static void kahan4_add (Kahan4_Type *k, __m256d x) /*{{{*/
+{
+   __m256d y, t;
+
+   y = _mm256_sub_pd (x, k->c);
+   t = _mm256_add_pd (k->s, y);
+   k->c = _mm256_sub_pd (_mm256_sub_pd (t, k->s), y);
+   k->s = t;
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static double kahan4_total (Kahan4_Type *k4, Kahan_Type *k) /*{{{*/
+{
+   double s[4], c[4];
+   int i;
+
+   _mm256_storeu_pd (s, k4->s);
+   _mm256_storeu_pd (c, k4->c);
+
+   for (i = 0; i < 4; i++)
+     {
+        kahan_add (k, s[i]);
+        kahan_add (k, -c[i]);
+     }
+
+   return k->s;
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static int num_lanes_set (__m256d mask) /*{{{*/
+{
+   int m = _mm256_movemask_pd (mask);
+   return (m & 1) + ((m >> 1) & 1) + ((m >> 2) & 1) + ((m >> 3) & 1);
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static __m256d abs4 (__m256d x) /*{{{*/
+{
+   return _mm256_andnot_pd (_mm256_set1_pd (-0.0), x);
+}
+
+/*}}}*/
+
+/* Returns a mask of the lanes holding normal, positive, finite
+ * values, for which log4() is valid.
+ */
+ISIS_AVX2_FUNCTION
+static __m256d log4_domain (__m256d x) /*{{{*/
+{
+   return _mm256_and_pd (_mm256_cmp_pd (x, _mm256_set1_pd (DBL_MIN), _CMP_GE_OQ),
+                         _mm256_cmp_pd (x, _mm256_set1_pd (DBL_MAX), _CMP_LE_OQ));
+}
+
+/*}}}*/
+
+/* Natural logarithm, following the Cephes library log().
+ * x must be normal, positive and finite.  The relative error
+ * is a few times 1.e-16.
+ */
+ISIS_AVX2_FUNCTION
+static __m256d log4 (__m256d x) /*{{{*/
+{
+   const __m256d one = _mm256_set1_pd (1.0);
+   __m256i bits, ebits;
+   __m256d e, m, z, p, q, y, small;
+
+   /* x = m * 2^e, 0.5 <= m < 1 */
+   bits = _mm256_castpd_si256 (x);
+   ebits = _mm256_or_si256 (_mm256_srli_epi64 (bits, 52),
+                            _mm256_set1_epi64x (0x4330000000000000LL));
+   e = _mm256_sub_pd (_mm256_castsi256_pd (ebits), _mm256_set1_pd (4503599627370496.0 + 1022.0));
+   m = _mm256_castsi256_pd (_mm256_or_si256 (_mm256_and_si256 (bits, _mm256_set1_epi64x (0x000FFFFFFFFFFFFFLL)),
+                                             _mm256_set1_epi64x (0x3FE0000000000000LL)));
+
+   /* if m < sqrt(1/2), e -= 1, m = 2m - 1, else m = m - 1 */
+   small = _mm256_cmp_pd (m, _mm256_set1_pd (0.70710678118654752440), _CMP_LT_OQ);
+   e = _mm256_sub_pd (e, _mm256_and_pd (small, one));
+   m = _mm256_sub_pd (_mm256_add_pd (m, _mm256_and_pd (small, m)), one);
+
+   z = _mm256_mul_pd (m, m);
+
+   p = _mm256_set1_pd (1.01875663804580931796E-4);
+   p = _mm256_add_pd (_mm256_mul_pd (p, m), _mm256_set1_pd (4.97494994976747001425E-1));
+   p = _mm256_add_pd (_mm256_mul_pd (p, m), _mm256_set1_pd (4.70579119878881725854E0));
+   p = _mm256_add_pd (_mm256_mul_pd (p, m), _mm256_set1_pd (1.44989225341610930846E1));
+   p = _mm256_add_pd (_mm256_mul_pd (p, m), _mm256_set1_pd (1.79368678507819816313E1));
+   p = _mm256_add_pd (_mm256_mul_pd (p, m), _mm256_set1_pd (7.70838733755885391666E0));
+
+   q = _mm256_add_pd (m, _mm256_set1_pd (1.12873587189167450590E1));
+   q = _mm256_add_pd (_mm256_mul_pd (q, m), _mm256_set1_pd (4.52279145837532221105E1));
+   q = _mm256_add_pd (_mm256_mul_pd (q, m), _mm256_set1_pd (8.29875266912776603211E1));
+   q = _mm256_add_pd (_mm256_mul_pd (q, m), _mm256_set1_pd (7.11544750618563894466E1));
+   q = _mm256_add_pd (_mm256_mul_pd (q, m), _mm256_set1_pd (2.31251620126765340583E1));
+
+   y = _mm256_mul_pd (m, _mm256_div_pd (_mm256_mul_pd (z, p), q));
+   y = _mm256_sub_pd (y, _mm256_mul_pd (e, _mm256_set1_pd (2.121944400546905827679e-4)));
+   y = _mm256_sub_pd (y, _mm256_mul_pd (z, _mm256_set1_pd (0.5)));
+   z = _mm256_add_pd (m, y);
+   z = _mm256_add_pd (z, _mm256_mul_pd (e, _mm256_set1_pd (0.693359375)));
+
+   return z;
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static double chisqr_sum_avx2 (unsigned int sigma, double *y, double *fx, double *w, /*{{{*/
+                               unsigned int n, double *vec, unsigned int *num_bad)
+{
+   const __m256d one = _mm256_set1_pd (1.0);
+   const __m256d zero = _mm256_setzero_pd ();
+   Kahan4_Type k4;
+   Kahan_Type k = {0.0, 0.0};
+   unsigned int i, bad = 0;
+
+   k4.s = k4.c = zero;
+
+   for (i = 0; i + 4 <= n; i += 4)
+     {
+        __m256d yi = _mm256_loadu_pd (y + i);
+        __m256d fxi = _mm256_loadu_pd (fx + i);
+        __m256d v = _mm256_sub_pd (yi, fxi);
+        __m256d ok;
+
+        switch (sigma)
+          {
+           case STATSUM_DATA_VARIANCE:
+             v = _mm256_mul_pd (v, _mm256_sqrt_pd (_mm256_loadu_pd (w + i)));
+             break;
+
+           case STATSUM_GEHRELS_VARIANCE:
+             ok = _mm256_cmp_pd (yi, zero, _CMP_GE_OQ);
+             v = _mm256_blendv_pd (v,
+                                   _mm256_div_pd (v, _mm256_add_pd (one, _mm256_sqrt_pd (_mm256_add_pd (yi, _mm256_set1_pd (0.75))))),
+                                   ok);
+             bad += 4 - num_lanes_set (ok);
+             break;
+
+           case STATSUM_MODEL_VARIANCE:
+             ok = _mm256_cmp_pd (fxi, zero, _CMP_NEQ_UQ);
+             v = _mm256_mul_pd (v, _mm256_sqrt_pd (_mm256_blendv_pd (one, _mm256_div_pd (one, abs4 (fxi)), ok)));
+             bad += 4 - num_lanes_set (ok);
+             break;
+
+           default:
+             break;
+          }
+
+        _mm256_storeu_pd (vec + i, v);
+        kahan4_add (&k4, _mm256_mul_pd (v, v));
+     }
+
+   for ( ; i < n; i++)
+     {
+        double wi = (sigma == STATSUM_DATA_VARIANCE) ? w[i] : 1.0;
+        double v = chisqr_term (sigma, y[i], fx[i], wi, &bad);
+        vec[i] = v;
+        kahan_add (&k, v * v);
+     }
+
+   *num_bad += bad;
+
+   return kahan4_total (&k4, &k);
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static double cash_sum_avx2 (double *y, double *fx, unsigned int n, double *vec) /*{{{*/
+{
+   const __m256d zero = _mm256_setzero_pd ();
+   const __m256d one = _mm256_set1_pd (1.0);
+   const __m256d max = _mm256_set1_pd (DBL_MAX);
+   Kahan4_Type k4;
+   Kahan_Type k = {0.0, 0.0};
+   unsigned int i;
+
+   k4.s = k4.c = zero;
+
+   for (i = 0; i + 4 <= n; i += 4)
+     {
+        __m256d yi = _mm256_loadu_pd (y + i);
+        __m256d fxi = _mm256_loadu_pd (fx + i);
+        __m256d fx_pos, fx_ok, log_fxi, d, s, sign;
+
+        yi = _mm256_blendv_pd (yi, _mm256_set1_pd (1.e-5), _mm256_cmp_pd (yi, zero, _CMP_LE_OQ));
+        fx_pos = _mm256_cmp_pd (fxi, zero, _CMP_GT_OQ);
+        fx_ok = log4_domain (fxi);
+
+        /* Denormals, infinities and NaNs are left to the scalar code */
+        if ((_mm256_movemask_pd (_mm256_andnot_pd (fx_ok, fx_pos)) != 0)
+            || (_mm256_movemask_pd (log4_domain (yi)) != 0xf))
+          {
+             unsigned int j;
+             for (j = i; j < i + 4; j++)
+               kahan_add (&k, cash_term (y[j], fx[j], &vec[j]));
+             continue;
+          }
+
+        log_fxi = _mm256_blendv_pd (_mm256_set1_pd ((double) DBL_MIN_10_EXP),
+                                    log4 (_mm256_blendv_pd (one, fxi, fx_pos)),
+                                    fx_pos);
+
+        d = _mm256_sub_pd (yi, fxi);
+        s = _mm256_add_pd (d, _mm256_mul_pd (yi, _mm256_sub_pd (log_fxi, log4 (yi))));
+        s = _mm256_mul_pd (s, _mm256_set1_pd (-2.0));
+
+        sign = _mm256_blendv_pd (one, _mm256_set1_pd (-1.0), _mm256_cmp_pd (d, zero, _CMP_LT_OQ));
+        _mm256_storeu_pd (vec + i, _mm256_blendv_pd (max, _mm256_mul_pd (s, sign),
+                                                     _mm256_cmp_pd (abs4 (s), max, _CMP_LE_OQ)));
+        kahan4_add (&k4, s);
+     }
+
+   for ( ; i < n; i++)
+     {
+        kahan_add (&k, cash_term (y[i], fx[i], &vec[i]));
+     }
+
+   return kahan4_total (&k4, &k);
+}
+
+/*}}}*/
+
+ISIS_AVX2_FUNCTION
+static double ml_sum_avx2 (double *y, double *fx, unsigned int n, double *vec) /*{{{*/
+{
+   const __m256d zero = _mm256_setzero_pd ();
+   const __m256d one = _mm256_set1_pd (1.0);
+   Kahan4_Type k4;
+   Kahan_Type k = {0.0, 0.0};
+   unsigned int i;
+
+   k4.s = k4.c = zero;
+
+   for (i = 0; i + 4 <= n; i += 4)
+     {
+        __m256d yi = _mm256_loadu_pd (y + i);
+        __m256d fxi = _mm256_loadu_pd (fx + i);
+        __m256d fx_pos, log_fxi, s;
+        double lg[4];
+        unsigned int j;
+
+        fx_pos = _mm256_cmp_pd (fxi, zero, _CMP_GT_OQ);
+
+        if (_mm256_movemask_pd (_mm256_andnot_pd (log4_domain (fxi), fx_pos)) != 0)
+          {
+             for (j = i; j < i + 4; j++)
+               {
+                  vec[j] = ml_term (y[j], fx[j]);
+                  kahan_add (&k, vec[j]);
+               }
+             continue;
+          }
+
+        for (j = 0; j < 4; j++)
+          lg[j] = lgamma (y[i+j] + 1);
+
+        log_fxi = _mm256_blendv_pd (_mm256_set1_pd ((double) DBL_MIN_10_EXP),
+                                    log4 (_mm256_blendv_pd (one, fxi, fx_pos)),
+                                    fx_pos);
+
+        s = _mm256_sub_pd (_mm256_add_pd (fxi, _mm256_loadu_pd (lg)),
+                           _mm256_mul_pd (yi, log_fxi));
+        s = _mm256_mul_pd (s, _mm256_set1_pd (2.0));
+
+        _mm256_storeu_pd (vec + i, s);
+        kahan4_add (&k4, s);
+     }
+
+   for ( ; i < n; i++)
+     {
+        vec[i] = ml_term (y[i], fx[i]);
+        kahan_add (&k, vec[i]);
+     }
+
+   return kahan4_total (&k4, &k);
+}
+
+/*}}}*/
+
+#endif
+
+/*}}}*/
+
+static int use_vector_code (unsigned int n) /*{{{*/
+{
+#ifdef ISIS_HAVE_AVX2
+   return Isis_Vector_Statistics && (n >= 4) && isis_cpu_has_avx2 ();
+#else
+   (void) n;
+   return 0;
+#endif
+}
+
+/*}}}*/
+
+double isis_chisqr_sum (unsigned int sigma, double *y, double *fx, double *w, /*{{{*/
+                        unsigned int n, double *vec, unsigned int *num_bad)
+{
+#ifdef ISIS_HAVE_AVX2
+   if (use_vector_code (n))
+     return chisqr_sum_avx2 (sigma, y, fx, w, n, vec, num_bad);
+#endif
+   return chisqr_sum_scalar (sigma, y, fx, w, n, vec, num_bad);
+}
+
+/*}}}*/
+
+double isis_cash_sum (double *y, double *fx, unsigned int n, double *vec) /*{{{*/
+{
+#ifdef ISIS_HAVE_AVX2
+   if (use_vector_code (n))
+     return cash_sum_avx2 (y, fx, n, vec);
+#endif
+   return cash_sum_scalar (y, fx, n, vec);
+}
+
+/*}}}*/
+
+double isis_ml_sum (double *y, double *fx, unsigned int n, double *vec) /*{{{*/
+{
+#ifdef ISIS_HAVE_AVX2
+   if (use_vector_code (n))
+     return ml_sum_avx2 (y, fx, n, vec);
+#endif
+   return ml_sum_scalar (y, fx, n, vec);
+}
+
+/*}}}*/
@@ -0,0 +1,69 @@
+#ifndef ISIS_STATSUM_H
+#define ISIS_STATSUM_H
+
+/*  This file is part of ISIS, the Interactive Spectral Interpretation System
+    Copyright (C) 1998-2019  Massachusetts Institute of Technology
+
+    This software was developed by the MIT Center for Space Research under
+    contract SV1-61010 from the Smithsonian Institution.
+
+    Author:  John C. Houck  <houck@space.mit.edu>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+/* Each function computes the per-bin contributions to a fit
+ * statistic, stores them in vec[], and returns their
+ * compensated sum, all in a single pass over the data.
+ *
+ * When Fit_Vector_Statistics is non-zero and the CPU supports
+ * it, a vectorized version is used.  The vectorized sum is
+ * accumulated in several parts, and the Cash and ML statistics
+ * use a vectorized logarithm, so the result may differ from
+ * that of the scalar version by a relative amount of up to
+ * about 1.e-12.  The scalar version reproduces the original
+ * element-by-element calculation exactly.
+ */
+
+enum
+{
+   STATSUM_DATA_VARIANCE,
+   STATSUM_GEHRELS_VARIANCE,
+   STATSUM_MODEL_VARIANCE,
+   STATSUM_LEAST_SQUARES
+};
+
+extern int Isis_Vector_Statistics;
+
+extern double isis_chisqr_sum (unsigned int sigma, double *y, double *fx, double *w,
+                               unsigned int n, double *vec, unsigned int *num_bad);
+extern double isis_cash_sum (double *y, double *fx, unsigned int n, double *vec);
+extern double isis_ml_sum (double *y, double *fx, unsigned int n, double *vec);
+
+#if 0
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,14 +34,99 @@
 #include <math.h>
 
 #define ISIS_KERNEL_PRIVATE_DATA \
-   int allows_ignoring_model_intervals;
+   int allows_ignoring_model_intervals; \
+   int fold_noticed_channels; \
+   int compile_response; \
+   Isis_Kernel_Cache_t own_cache; \
+   char *scratch; \
+   size_t scratch_size;
 
 #include "isis.h"
 #include "util.h"
 #include "errors.h"
 
+/* The compiled response is the product RMF * ARF * exposure,
+ * restricted to the noticed model bins (and, optionally, to the
+ * noticed detector channels).  Row i of the matrix corresponds
+ * to notice_list[i].  Each row is stored as a list of groups of
+ * contiguous detector channels, as in the packed FITS RMF.
+ *
+ * It is kept with the data set, so that it survives the
+ * re-allocation of the kernel at the start of each fit, and is
+ * rebuilt only when the RMF, the ARF or exposure time, or the
+ * noticed model bins or channels change.
+ */
+typedef struct Compiled_Rsp_Type
+{
+   unsigned int rmf_serial;
+   int num_noticed;
+   int *notice_list;            /* [num_noticed] model bins */
+   double *scale;               /* [num_noticed] ARF * exposure */
+   int *chan_notice;            /* [num_chan] channel flags, or NULL */
+   unsigned int num_chan;
+   unsigned int num_grps;
+   unsigned int *row_start;     /* [num_noticed+1] index into grp arrays */
+   unsigned int *first_chan;    /* [num_grps] */
+   unsigned int *grp_start;     /* [num_grps+1] index into response */
+   double *response;            /* NULL until the matrix is built */
+}
+Compiled_Rsp_Type;
+
+static void free_compiled_rsp (Compiled_Rsp_Type *c) /*{{{*/
+{
+   if (c == NULL)
+     return;
+   ISIS_FREE (c->notice_list);
+   ISIS_FREE (c->scale);
+   ISIS_FREE (c->chan_notice);
+   ISIS_FREE (c->row_start);
+   ISIS_FREE (c->first_chan);
+   ISIS_FREE (c->grp_start);
+   ISIS_FREE (c->response);
+   ISIS_FREE (c);
+}
+
+/*}}}*/
+
+static void free_compiled_rsp_data (void *data) /*{{{*/
+{
+   free_compiled_rsp ((Compiled_Rsp_Type *)data);
+}
+
+/*}}}*/
+
+static Compiled_Rsp_Type *get_compiled_rsp (Isis_Kernel_t *k) /*{{{*/
+{
+   /* the data set may hold data from another kernel */
+   if ((k->cache == NULL)
+       || (k->cache->free_data != &free_compiled_rsp_data))
+     return NULL;
+
+   return (Compiled_Rsp_Type *) k->cache->data;
+}
+
+/*}}}*/
+
+static void set_compiled_rsp (Isis_Kernel_t *k, Compiled_Rsp_Type *c) /*{{{*/
+{
+   Isis_Kernel_Cache_t *cache = k->cache;
+
+   if (cache->free_data != NULL)
+     (*cache->free_data)(cache->data);
+
+   cache->data = c;
+   cache->free_data = (c != NULL) ? &free_compiled_rsp_data : NULL;
+}
+
+/*}}}*/
+
 static void delete_kernel (Isis_Kernel_t *k) /*{{{*/
 {
+   if (k == NULL)
+     return;
+   if (k->cache == &k->own_cache)
+     set_compiled_rsp (k, NULL);
+   ISIS_FREE (k->scratch);
    ISIS_FREE (k);
 }
 
@@ -56,13 +141,31 @@ static int print_kernel (Isis_Kernel_t *k) /*{{{*/
 
 /*}}}*/
 
+static char *reserve_scratch (Isis_Kernel_t *k, size_t size) /*{{{*/
+{
+   char *s;
+
+   if (size <= k->scratch_size)
+     return k->scratch;
+
+   if (NULL == (s = (char *) ISIS_MALLOC (size)))
+     return NULL;
+
+   ISIS_FREE (k->scratch);
+   k->scratch = s;
+   k->scratch_size = size;
+
+   return s;
+}
+
+/*}}}*/
+
 static int match_arf_grid (Isis_Kernel_t *k, Isis_Rsp_t *rsp, Isis_Hist_t *g, Isis_Hist_t *m) /*{{{*/
 {
    Isis_Arf_t *a;
    double *g_val, *m_val;
-   int i;
-
-   g_val = m_val = NULL;
+   char *s;
+   int i, n;
 
    /* When there's only one ARF, the model is computed on that grid.
     * If we've got multiple responses, we interpolate the model
@@ -83,72 +186,60 @@ static int match_arf_grid (Isis_Kernel_t *k, Isis_Rsp_t *rsp, Isis_Hist_t *g, Is
    m->bin_lo = a->bin_lo;
    m->bin_hi = a->bin_hi;
    m->n_notice = 0;
-   m->val = NULL;
-   m->notice = NULL;
-   m->notice_list = NULL;
-   if ((NULL == (m_val = (double *) ISIS_MALLOC (m->nbins * sizeof(double))))
-       || (NULL == (m->notice = (int *) ISIS_MALLOC (m->nbins * sizeof(int))))
-       || (NULL == (g_val = (double *) ISIS_MALLOC (g->nbins * sizeof(double)))))
-     {
-        goto fail;
-     }
+
+   /* The work space is kept with the kernel, because the
+    * model is folded through each response on every evaluation.
+    * The mapped model is only needed until the next response
+    * is folded.
+    */
+   if (NULL == (s = reserve_scratch (k, (2 * m->nbins + g->nbins) * sizeof(double)
+                                     + 2 * m->nbins * sizeof(int))))
+     return -1;
+
+   m_val = (double *) s;
+   m->val = m_val + m->nbins;
+   g_val = m->val + m->nbins;
+   m->notice = (int *) (g_val + g->nbins);
+   m->notice_list = m->notice + m->nbins;
+
    memset ((char *)m->notice, 0, m->nbins * sizeof(int));
    memset ((char *)g_val, 0, g->nbins * sizeof(double));
 
    if (-1 == unpack_noticed (g->val, g->notice_list, g->n_notice, g->nbins, g_val))
-     goto fail;
+     return -1;
 
    if ((-1 == rebin_histogram (g_val, g->bin_lo, g->bin_hi, g->nbins,
                                 m_val, m->bin_lo, m->bin_hi, m->nbins))
        || (-1 == transfer_notice (g->bin_lo, g->bin_hi, g->notice_list, g->n_notice,
-                                  m->bin_lo, m->bin_hi, m->nbins, m->notice))
-       || (-1 == _update_notice_list (m->notice, &m->notice_list, &m->n_notice, m->nbins)))
+                                  m->bin_lo, m->bin_hi, m->nbins, m->notice)))
      {
-        goto fail;
+        return -1;
      }
 
    /* Finish by packing according to the notice list */
-   if (NULL == (m->val = (double *) ISIS_MALLOC (m->n_notice * sizeof(double))))
-     goto fail;
+   for (i = 0; i < m->nbins; i++)
+     {
+        if (m->notice[i])
+          m->notice_list[m->n_notice++] = i;
+     }
 
    for (i = 0; i < m->n_notice; i++)
      {
-        int n = m->notice_list[i];
+        n = m->notice_list[i];
         m->val[i] = m_val[n];
      }
 
-   ISIS_FREE (g_val);
-   ISIS_FREE (m_val);
-   ISIS_FREE (m->notice);
-   return 1;
-
-   fail:
-   ISIS_FREE (g_val);
-   ISIS_FREE (m_val);
-   ISIS_FREE (m->notice);
-   ISIS_FREE (m->val);
-   ISIS_FREE (m->notice_list);
-   m->n_notice = 0;
-   return -1;
+   m->notice = NULL;
+   return 0;
 }
 
 /*}}}*/
 
-static int compute_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, double *par, unsigned int num, /*{{{*/
-                           int (*fun)(Isis_Hist_t *))
+static int fold_responses (Isis_Kernel_t *k, double *result, Isis_Hist_t *g) /*{{{*/
 {
    Isis_Rsp_t *rsp;
    int ret = -1;
 
-   (void) par; (void) num;
-
-   if ((k == NULL) || (g == NULL) || (NULL == fun))
-     return -1;
-
-   /* Evaluate the model once */
-   if (-1 == (*fun)(g))
-     return -1;
-
    /* Fold the model through each of the responses,
     * incrementing 'result' for each such contribution
     */
@@ -156,9 +247,9 @@ static int compute_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, dou
      {
         double *arf = rsp->arf->arf;
         Isis_Hist_t m;
-        int i, malloced;
+        int i;
 
-        if ((malloced = match_arf_grid (k, rsp, g, &m)) < 0)
+        if (-1 == match_arf_grid (k, rsp, g, &m))
           return -1;
 
         for (i = 0; i < m.n_notice; i++)
@@ -167,13 +258,13 @@ static int compute_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, dou
              m.val[i] *= (arf[n] * k->exposure_time);
           }
 
-        ret = k->apply_rmf (rsp->rmf, result, k->num_orig_data,
-                            m.val, m.notice_list, m.n_notice);
-        if (malloced)
-          {
-             ISIS_FREE (m.notice_list);
-             ISIS_FREE (m.val);
-          }
+        if (k->fold_noticed_channels && (k->fold_notice != NULL))
+          ret = k->apply_rmf_noticed (rsp->rmf, result, k->num_orig_data,
+                                      m.val, m.notice_list, m.n_notice,
+                                      k->fold_notice);
+        else
+          ret = k->apply_rmf (rsp->rmf, result, k->num_orig_data,
+                              m.val, m.notice_list, m.n_notice);
 
         if (ret == -1)
           return ret;
@@ -184,6 +275,421 @@ static int compute_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, dou
 
 /*}}}*/
 
+static int *fold_channel_notice (Isis_Kernel_t *k) /*{{{*/
+{
+   if (k->fold_noticed_channels)
+     return k->fold_notice;
+   return NULL;
+}
+
+/*}}}*/
+
+static Compiled_Rsp_Type *new_compiled_rsp (Isis_Kernel_t *k, Isis_Hist_t *g) /*{{{*/
+{
+   Compiled_Rsp_Type *c;
+   double *arf = k->rsp.arf->arf;
+   int *chan_notice = fold_channel_notice (k);
+   int i;
+
+   if (NULL == (c = (Compiled_Rsp_Type *) ISIS_MALLOC (sizeof *c)))
+     return NULL;
+   memset ((char *)c, 0, sizeof *c);
+
+   c->rmf_serial = k->rsp.rmf->serial;
+   c->num_noticed = g->n_notice;
+   c->num_chan = k->num_orig_data;
+
+   if ((NULL == (c->notice_list = (int *) ISIS_MALLOC ((g->n_notice + 1) * sizeof(int))))
+       || (NULL == (c->scale = (double *) ISIS_MALLOC ((g->n_notice + 1) * sizeof(double)))))
+     {
+        free_compiled_rsp (c);
+        return NULL;
+     }
+   memcpy ((char *)c->notice_list, (char *)g->notice_list, g->n_notice * sizeof(int));
+
+   for (i = 0; i < g->n_notice; i++)
+     c->scale[i] = arf[g->notice_list[i]] * k->exposure_time;
+
+   if (chan_notice != NULL)
+     {
+        if (NULL == (c->chan_notice = (int *) ISIS_MALLOC (c->num_chan * sizeof(int))))
+          {
+             free_compiled_rsp (c);
+             return NULL;
+          }
+        memcpy ((char *)c->chan_notice, (char *)chan_notice, c->num_chan * sizeof(int));
+     }
+
+   return c;
+}
+
+/*}}}*/
+
+static int compiled_rsp_is_current (Isis_Kernel_t *k, Compiled_Rsp_Type *c, Isis_Hist_t *g) /*{{{*/
+{
+   double *arf = k->rsp.arf->arf;
+   int *chan_notice = fold_channel_notice (k);
+   int i;
+
+   if ((c->rmf_serial != k->rsp.rmf->serial)
+       || (c->num_noticed != g->n_notice)
+       || (c->num_chan != k->num_orig_data)
+       || ((c->chan_notice == NULL) != (chan_notice == NULL)))
+     return 0;
+
+   if (0 != memcmp ((char *)c->notice_list, (char *)g->notice_list,
+                    g->n_notice * sizeof(int)))
+     return 0;
+
+   if ((chan_notice != NULL)
+       && (0 != memcmp ((char *)c->chan_notice, (char *)chan_notice,
+                        c->num_chan * sizeof(int))))
+     return 0;
+
+   /* the ARF may have been replaced or changed in place */
+   for (i = 0; i < g->n_notice; i++)
+     {
+        if (c->scale[i] != arf[g->notice_list[i]] * k->exposure_time)
+          return 0;
+     }
+
+   return 1;
+}
+
+/*}}}*/
+
+static int grow_compiled_rsp (Compiled_Rsp_Type *c, unsigned int *max_grps, unsigned int *max_elements, /*{{{*/
+                              unsigned int num_elements)
+{
+   if (c->num_grps + 1 >= *max_grps)
+     {
+        unsigned int *tmp, n = 2 * (*max_grps);
+        if (NULL == (tmp = (unsigned int *) ISIS_REALLOC (c->first_chan, n * sizeof(unsigned int))))
+          return -1;
+        c->first_chan = tmp;
+        if (NULL == (tmp = (unsigned int *) ISIS_REALLOC (c->grp_start, (n + 1) * sizeof(unsigned int))))
+          return -1;
+        c->grp_start = tmp;
+        *max_grps = n;
+     }
+
+   if (num_elements > *max_elements)
+     {
+        double *tmp;
+        unsigned int n = 2 * (*max_elements);
+        if (n < num_elements)
+          n = num_elements;
+        if (NULL == (tmp = (double *) ISIS_REALLOC (c->response, n * sizeof(double))))
+          return -1;
+        c->response = tmp;
+        *max_elements = n;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int build_compiled_rsp (Isis_Kernel_t *k, Compiled_Rsp_Type *c) /*{{{*/
+{
+   Isis_Rsp_t *rsp = &k->rsp;
+   double *det = NULL;
+   unsigned int max_grps, max_elements, num_elements;
+   int i, ret;
+
+   max_grps = 64;
+   max_elements = 1024;
+
+   if ((NULL == (det = (double *) ISIS_MALLOC (c->num_chan * sizeof(double))))
+       || (NULL == (c->row_start = (unsigned int *) ISIS_MALLOC ((c->num_noticed + 1) * sizeof(unsigned int))))
+       || (NULL == (c->first_chan = (unsigned int *) ISIS_MALLOC (max_grps * sizeof(unsigned int))))
+       || (NULL == (c->grp_start = (unsigned int *) ISIS_MALLOC ((max_grps + 1) * sizeof(unsigned int))))
+       || (NULL == (c->response = (double *) ISIS_MALLOC (max_elements * sizeof(double)))))
+     goto return_error;
+
+   memset ((char *)det, 0, c->num_chan * sizeof(double));
+   c->num_grps = 0;
+   num_elements = 0;
+
+   /* Each row is computed by folding a single model bin
+    * through the RMF, so any RMF method will do.
+    */
+   for (i = 0; i < c->num_noticed; i++)
+     {
+        int n = c->notice_list[i];
+        double flux = c->scale[i];
+        unsigned int j;
+
+        c->row_start[i] = c->num_grps;
+
+        if (flux == 0.0)
+          continue;
+
+        if (c->chan_notice != NULL)
+          ret = k->apply_rmf_noticed (rsp->rmf, det, c->num_chan, &flux, &n, 1, c->chan_notice);
+        else
+          ret = k->apply_rmf (rsp->rmf, det, c->num_chan, &flux, &n, 1);
+        if (ret == -1)
+          goto return_error;
+
+        j = 0;
+        while (j < c->num_chan)
+          {
+             unsigned int first;
+
+             if (det[j] == 0.0)
+               {
+                  j++;
+                  continue;
+               }
+
+             first = j;
+             while ((j < c->num_chan) && (det[j] != 0.0))
+               j++;
+
+             if (-1 == grow_compiled_rsp (c, &max_grps, &max_elements, num_elements + (j - first)))
+               goto return_error;
+
+             c->first_chan[c->num_grps] = first;
+             c->grp_start[c->num_grps] = num_elements;
+             c->num_grps++;
+
+             memcpy ((char *)(c->response + num_elements), (char *)(det + first),
+                     (j - first) * sizeof(double));
+             memset ((char *)(det + first), 0, (j - first) * sizeof(double));
+             num_elements += j - first;
+          }
+     }
+
+   c->row_start[c->num_noticed] = c->num_grps;
+   c->grp_start[c->num_grps] = num_elements;
+
+   ISIS_FREE (det);
+   return 0;
+
+   return_error:
+   ISIS_FREE (det);
+   ISIS_FREE (c->row_start);
+   ISIS_FREE (c->first_chan);
+   ISIS_FREE (c->grp_start);
+   ISIS_FREE (c->response);
+   c->num_grps = 0;
+   return -1;
+}
+
+/*}}}*/
+
+static void apply_compiled_rsp (Compiled_Rsp_Type *c, double *val, double *result) /*{{{*/
+{
+   int i;
+
+   for (i = 0; i < c->num_noticed; i++)
+     {
+        double v = val[i];
+        unsigned int j;
+
+        if (v == 0.0)
+          continue;
+
+        for (j = c->row_start[i]; j < c->row_start[i+1]; j++)
+          {
+             double *d = result + c->first_chan[j];
+             double *r = c->response + c->grp_start[j];
+             unsigned int m, len = c->grp_start[j+1] - c->grp_start[j];
+
+             for (m = 0; m < len; m++)
+               d[m] += v * r[m];
+          }
+     }
+}
+
+/*}}}*/
+
+static void apply_compiled_rsp_multi (Compiled_Rsp_Type *c, double *vals, unsigned int num, /*{{{*/
+                                      double **result)
+{
+   int i;
+
+   /* Each block of the matrix is applied to all num models
+    * before moving on, so the matrix is read only once.
+    * vals[j*num_noticed + i] is bin i of model j.
+    */
+   for (i = 0; i < c->num_noticed; i++)
+     {
+        unsigned int j;
+
+        for (j = c->row_start[i]; j < c->row_start[i+1]; j++)
+          {
+             double *r = c->response + c->grp_start[j];
+             unsigned int first = c->first_chan[j];
+             unsigned int m, len = c->grp_start[j+1] - c->grp_start[j];
+             unsigned int s;
+
+             for (s = 0; s < num; s++)
+               {
+                  double v = vals[s * c->num_noticed + i];
+                  double *d = result[s] + first;
+
+                  if (v == 0.0)
+                    continue;
+
+                  for (m = 0; m < len; m++)
+                    d[m] += v * r[m];
+               }
+          }
+     }
+}
+
+/*}}}*/
+
+static int fold_compiled_rsp (Isis_Kernel_t *k, double *result, Isis_Hist_t *g) /*{{{*/
+{
+   Compiled_Rsp_Type *c = get_compiled_rsp (k);
+
+   /* The matrix is built the second time a given set of noticed
+    * bins is folded, so one-shot evaluations don't pay for it.
+    */
+   if ((c != NULL) && (0 == compiled_rsp_is_current (k, c, g)))
+     c = NULL;
+
+   if (c == NULL)
+     {
+        if (NULL == (c = new_compiled_rsp (k, g)))
+          return -1;
+        set_compiled_rsp (k, c);
+        return fold_responses (k, result, g);
+     }
+
+   if ((c->response == NULL)
+       && (-1 == build_compiled_rsp (k, c)))
+     return -1;
+
+   apply_compiled_rsp (c, g->val, result);
+
+   return 0;
+}
+
+/*}}}*/
+
+static int compute_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, double *par, unsigned int num, /*{{{*/
+                           int (*fun)(Isis_Hist_t *, void *), void *cl)
+{
+   (void) par; (void) num;
+
+   if ((k == NULL) || (g == NULL) || (NULL == fun))
+     return -1;
+
+   /* Evaluate the model once */
+   if (-1 == (*fun)(g, cl))
+     return -1;
+
+   /* The ARF and exposure time can be folded into the RMF
+    * once only when there is a single response */
+   if (k->compile_response && (k->rsp.next == NULL))
+     return fold_compiled_rsp (k, result, g);
+
+   return fold_responses (k, result, g);
+}
+
+/*}}}*/
+
+static int fold_compiled_rsp_multi (Isis_Kernel_t *k, double **result, unsigned int num, /*{{{*/
+                                    Isis_Hist_t *g,
+                                    int (*fun)(Isis_Hist_t *, unsigned int, void *), void *cl)
+{
+   Compiled_Rsp_Type *c;
+   double *vals;
+   unsigned int j;
+
+   /* The models are folded together, so build the compiled
+    * response right away.
+    */
+   c = get_compiled_rsp (k);
+   if ((c != NULL) && (0 == compiled_rsp_is_current (k, c, g)))
+     c = NULL;
+   if (c == NULL)
+     {
+        if (NULL == (c = new_compiled_rsp (k, g)))
+          return -1;
+        set_compiled_rsp (k, c);
+     }
+   if ((c->response == NULL)
+       && (-1 == build_compiled_rsp (k, c)))
+     return -1;
+
+   /* The models are kept in the kernel's work space, which
+    * is reused from one evaluation to the next.
+    */
+   if (NULL == (vals = (double *) reserve_scratch (k, (num * g->n_notice + 1) * sizeof(double))))
+     return -1;
+
+   for (j = 0; j < num; j++)
+     {
+        if (-1 == (*fun)(g, j, cl))
+          return -1;
+        memcpy ((char *)(vals + j * g->n_notice), (char *)g->val, g->n_notice * sizeof(double));
+     }
+
+   apply_compiled_rsp_multi (c, vals, num, result);
+
+   return 0;
+}
+
+/*}}}*/
+
+static int compute_kernel_multi (Isis_Kernel_t *k, double **result, unsigned int num, /*{{{*/
+                                 Isis_Hist_t *g, double *par, unsigned int npar,
+                                 int (*fun)(Isis_Hist_t *, unsigned int, void *), void *cl)
+{
+   double *vals, *arf;
+   unsigned int j;
+   int i;
+
+   (void) par; (void) npar;
+
+   if ((k == NULL) || (g == NULL) || (result == NULL) || (NULL == fun))
+     return -1;
+
+   if ((k->rsp.next != NULL) || (k->apply_rmf_multi == NULL))
+     {
+        for (j = 0; j < num; j++)
+          {
+             if ((-1 == (*fun)(g, j, cl))
+                 || (-1 == fold_responses (k, result[j], g)))
+               return -1;
+          }
+        return 0;
+     }
+
+   if (k->compile_response)
+     return fold_compiled_rsp_multi (k, result, num, g, fun, cl);
+
+   /* With a single response, the models are on the ARF grid.
+    * They're scaled by the ARF and exposure time, then folded
+    * through the RMF together.
+    */
+   if (NULL == (vals = (double *) reserve_scratch (k, (num * g->n_notice + 1) * sizeof(double))))
+     return -1;
+
+   arf = k->rsp.arf->arf;
+
+   for (j = 0; j < num; j++)
+     {
+        double *v = vals + j * g->n_notice;
+
+        if (-1 == (*fun)(g, j, cl))
+          return -1;
+
+        for (i = 0; i < g->n_notice; i++)
+          v[i] = g->val[i] * (arf[g->notice_list[i]] * k->exposure_time);
+     }
+
+   return k->apply_rmf_multi (k->rsp.rmf, result, num, k->num_orig_data, vals,
+                              g->notice_list, g->n_notice, fold_channel_notice (k));
+}
+
+/*}}}*/
+
 static int compute_flux (Isis_Kernel_t *k, double *kernel_params, unsigned int num_kernel_params, /*{{{*/
                          Isis_Hist_t *counts, double *bgd,
                          double *f, double *df, double **weights, char *options)
@@ -282,9 +788,63 @@ static int eval_option (char *subsystem, char *optname, char *value, void *clien
 
 /*}}}*/
 
+static int fold_option (char *subsystem, char *optname, char *value, void *clientdata) /*{{{*/
+{
+   Isis_Kernel_t *k = (Isis_Kernel_t *)clientdata;
+
+   (void) subsystem;
+   (void) optname;
+
+   if (k == NULL)
+     return -1;
+
+   if (0 == isis_strcasecmp (value, "all"))
+     k->fold_noticed_channels = 0;
+   else if (0 == isis_strcasecmp (value, "noticed"))
+     k->fold_noticed_channels = 1;
+   else
+     {
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "unrecognized kernel option '%s'",
+                    value ? value : "<null>");
+        return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
+static int compile_option (char *subsystem, char *optname, char *value, void *clientdata) /*{{{*/
+{
+   Isis_Kernel_t *k = (Isis_Kernel_t *)clientdata;
+
+   (void) subsystem;
+   (void) optname;
+
+   if (k == NULL)
+     return -1;
+
+   if (0 == isis_strcasecmp (value, "yes"))
+     k->compile_response = 1;
+   else if (0 == isis_strcasecmp (value, "no"))
+     k->compile_response = 0;
+   else
+     {
+        isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__, "unrecognized kernel option '%s'",
+                    value ? value : "<null>");
+        return -1;
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static Isis_Option_Table_Type Std_Option_Table [] = /*{{{*/
 {
      {"eval", eval_option, ISIS_OPT_REQUIRES_VALUE, "noticed", "specify energies to evaluate model: (all | noticed)"},
+     {"fold", fold_option, ISIS_OPT_REQUIRES_VALUE, "all", "specify detector channels to compute: (all | noticed)"},
+     {"compile", compile_option, ISIS_OPT_REQUIRES_VALUE, "yes", "fold ARF and exposure into the RMF: (yes | no)"},
      ISIS_OPTION_TABLE_TYPE_NULL
 };
 
@@ -319,6 +879,9 @@ static Isis_Kernel_t *allocate_std_kernel (Isis_Obs_t *o, char *options) /*{{{*/
      return NULL;
 
    k->allows_ignoring_model_intervals = 1;
+   k->compile_response = 1;
+   if (k->cache == NULL)
+     k->cache = &k->own_cache;
 
    if (-1 == process_options (k, options))
      {
@@ -328,6 +891,7 @@ static Isis_Kernel_t *allocate_std_kernel (Isis_Obs_t *o, char *options) /*{{{*/
 
    k->delete_kernel = delete_kernel;
    k->compute_kernel = compute_kernel;
+   k->compute_kernel_multi = compute_kernel_multi;
    k->compute_flux = compute_flux;
    k->print_kernel = print_kernel;
 
@@ -354,7 +918,7 @@ ISIS_USER_KERNEL_MODULE(std,def,options)
 }
 
 static int compute_yshift_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, double *par, unsigned int num, /*{{{*/
-                                 int (*fun)(Isis_Hist_t *))
+                                  int (*fun)(Isis_Hist_t *, void *), void *cl)
 {
    Isis_Rmf_t *rmf = k->rsp.rmf;
    double *ylo=NULL, *yhi=NULL;
@@ -362,7 +926,7 @@ static int compute_yshift_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t
    unsigned int n;
    int status = -1;
 
-   if (-1 == compute_kernel (k, result, g, par, num, fun))
+   if (-1 == compute_kernel (k, result, g, par, num, fun, cl))
      return -1;
 
    if (dy == 0.0)
@@ -466,7 +1030,7 @@ ISIS_USER_KERNEL_MODULE(yshift,def,options)
 }
 
 static int compute_gainshift_kernel (Isis_Kernel_t *k, double *result, Isis_Hist_t *g, double *par, unsigned int num, /*{{{*/
-                                     int (*fun)(Isis_Hist_t *))
+                                     int (*fun)(Isis_Hist_t *, void *), void *cl)
 {
    Isis_Rmf_t *rmf = k->rsp.rmf;
    double *ylo=NULL, *yhi=NULL;
@@ -475,7 +1039,7 @@ static int compute_gainshift_kernel (Isis_Kernel_t *k, double *result, Isis_Hist
    unsigned int i, len, n;
    int status = -1;
 
-   if (-1 == compute_kernel (k, result, g, par, num, fun))
+   if (-1 == compute_kernel (k, result, g, par, num, fun, cl))
      return -1;
 
    if (par[1] == 0.0)
@@ -0,0 +1,289 @@
+/* -*- mode: C; mode: fold -*- */
+
+/*  This file is part of ISIS, the Interactive Spectral Interpretation System
+    Copyright (C) 1998-2019  Massachusetts Institute of Technology
+
+    This software was developed by the MIT Center for Space Research under
+    contract SV1-61010 from the Smithsonian Institution.
+
+    Author:  John C. Houck  <houck@space.mit.edu>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif
+
+#include "isis.h"
+#include "threads.h"
+#include "errors.h"
+
+#ifdef HAVE_PTHREAD_H
+
+/* Worker threads are created the first time they're needed and then
+ * wait on a condition variable for more work, so that callers which
+ * run many small jobs (e.g. one fold per model evaluation) don't pay
+ * for thread startup every time.  Tasks are handed out one index at
+ * a time; the calling thread takes tasks too, so every job completes
+ * even if some of the workers couldn't be created.
+ */
+
+typedef struct
+{
+   Isis_Thread_Task_Type *task;
+   void *client_data;
+   unsigned int num_tasks;
+   unsigned int next_task;
+   unsigned int num_done;
+   int status;
+}
+Thread_Job_Type;
+
+static pthread_mutex_t Pool_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Pool_Work_Cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t Pool_Done_Cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t Shared_State_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static Thread_Job_Type *Pool_Job;
+static unsigned long Pool_Generation;
+static unsigned int Pool_Num_Workers;
+static int Pool_Busy;
+static int Pool_Atfork_Registered;
+
+/* call with Pool_Mutex locked */
+static void run_job_tasks (Thread_Job_Type *job) /*{{{*/
+{
+   while (job->next_task < job->num_tasks)
+     {
+        unsigned int i = job->next_task++;
+        int status;
+
+        (void) pthread_mutex_unlock (&Pool_Mutex);
+        status = (*job->task)(job->client_data, i, job->num_tasks);
+        (void) pthread_mutex_lock (&Pool_Mutex);
+
+        if (status == -1)
+          job->status = -1;
+        if (++job->num_done == job->num_tasks)
+          (void) pthread_cond_signal (&Pool_Done_Cond);
+     }
+}
+
+/*}}}*/
+
+static void *worker_thread (void *p) /*{{{*/
+{
+   unsigned long seen;
+
+   (void) p;
+
+   (void) pthread_mutex_lock (&Pool_Mutex);
+   seen = Pool_Generation;
+
+   for (;;)
+     {
+        while (seen == Pool_Generation)
+          (void) pthread_cond_wait (&Pool_Work_Cond, &Pool_Mutex);
+        seen = Pool_Generation;
+        if (Pool_Job != NULL)
+          run_job_tasks (Pool_Job);
+     }
+
+   return NULL;
+}
+
+/*}}}*/
+
+static void reset_pool_in_child (void) /*{{{*/
+{
+   /* Only the forking thread survives in the child process */
+   (void) pthread_mutex_init (&Pool_Mutex, NULL);
+   (void) pthread_cond_init (&Pool_Work_Cond, NULL);
+   (void) pthread_cond_init (&Pool_Done_Cond, NULL);
+   (void) pthread_mutex_init (&Shared_State_Mutex, NULL);
+   Pool_Job = NULL;
+   Pool_Num_Workers = 0;
+   Pool_Busy = 0;
+}
+
+/*}}}*/
+
+/* call with Pool_Mutex locked */
+static void add_workers (unsigned int num_workers) /*{{{*/
+{
+   pthread_attr_t attr;
+
+   if (Pool_Num_Workers >= num_workers)
+     return;
+
+   if (Pool_Atfork_Registered == 0)
+     {
+        if (0 != pthread_atfork (NULL, NULL, &reset_pool_in_child))
+          return;
+        Pool_Atfork_Registered = 1;
+     }
+
+   if (0 != pthread_attr_init (&attr))
+     return;
+   (void) pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+
+   while (Pool_Num_Workers < num_workers)
+     {
+        pthread_t thread;
+        if (0 != pthread_create (&thread, &attr, &worker_thread, NULL))
+          break;
+        Pool_Num_Workers++;
+     }
+
+   (void) pthread_attr_destroy (&attr);
+}
+
+/*}}}*/
+
+int isis_run_threads (unsigned int num_tasks, Isis_Thread_Task_Type *task, void *client_data) /*{{{*/
+{
+   Thread_Job_Type job;
+   unsigned int i;
+   int status = 0;
+
+   if (task == NULL)
+     return -1;
+
+   if (num_tasks <= 1)
+     return (*task)(client_data, 0, 1);
+
+   if (num_tasks > ISIS_MAX_THREADS)
+     num_tasks = ISIS_MAX_THREADS;
+
+   (void) pthread_mutex_lock (&Pool_Mutex);
+
+   /* A task which itself asks for threads, or a second caller
+    * while the pool is in use, runs its tasks serially.
+    */
+   if (Pool_Busy)
+     {
+        (void) pthread_mutex_unlock (&Pool_Mutex);
+        for (i = 0; i < num_tasks; i++)
+          {
+             if (-1 == (*task)(client_data, i, num_tasks))
+               status = -1;
+          }
+        return status;
+     }
+
+   Pool_Busy = 1;
+   add_workers (num_tasks - 1);
+
+   job.task = task;
+   job.client_data = client_data;
+   job.num_tasks = num_tasks;
+   job.next_task = 0;
+   job.num_done = 0;
+   job.status = 0;
+
+   Pool_Job = &job;
+   Pool_Generation++;
+   (void) pthread_cond_broadcast (&Pool_Work_Cond);
+
+   run_job_tasks (&job);
+
+   while (job.num_done < job.num_tasks)
+     (void) pthread_cond_wait (&Pool_Done_Cond, &Pool_Mutex);
+
+   Pool_Job = NULL;
+   Pool_Busy = 0;
+   (void) pthread_mutex_unlock (&Pool_Mutex);
+
+   return job.status;
+}
+
+/*}}}*/
+
+int isis_have_threads (void) /*{{{*/
+{
+   return 1;
+}
+
+/*}}}*/
+
+void isis_lock_shared_state (void) /*{{{*/
+{
+   (void) pthread_mutex_lock (&Shared_State_Mutex);
+}
+
+/*}}}*/
+
+void isis_unlock_shared_state (void) /*{{{*/
+{
+   (void) pthread_mutex_unlock (&Shared_State_Mutex);
+}
+
+/*}}}*/
+
+#else
+
+int isis_run_threads (unsigned int num_tasks, Isis_Thread_Task_Type *task, void *client_data) /*{{{*/
+{
+   unsigned int i;
+   int status = 0;
+
+   if (task == NULL)
+     return -1;
+
+   if (num_tasks == 0)
+     num_tasks = 1;
+
+   if (num_tasks > ISIS_MAX_THREADS)
+     num_tasks = ISIS_MAX_THREADS;
+
+   for (i = 0; i < num_tasks; i++)
+     {
+        if (-1 == (*task)(client_data, i, num_tasks))
+          status = -1;
+     }
+
+   return status;
+}
+
+/*}}}*/
+
+int isis_have_threads (void) /*{{{*/
+{
+   return 0;
+}
+
+/*}}}*/
+
+void isis_lock_shared_state (void) /*{{{*/
+{
+}
+
+/*}}}*/
+
+void isis_unlock_shared_state (void) /*{{{*/
+{
+}
+
+/*}}}*/
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef ISIS_THREADS_H
+#define ISIS_THREADS_H
+
+/*  This file is part of ISIS, the Interactive Spectral Interpretation System
+    Copyright (C) 1998-2019  Massachusetts Institute of Technology
+
+    This software was developed by the MIT Center for Space Research under
+    contract SV1-61010 from the Smithsonian Institution.
+
+    Author:  John C. Houck  <houck@space.mit.edu>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#define ISIS_MAX_THREADS  256
+
+typedef int Isis_Thread_Task_Type (void *, unsigned int, unsigned int);
+
+/* Calls task (client_data, i, num_tasks) for i = 0,...,num_tasks-1,
+ * spread over the calling thread and a pool of worker threads which
+ * persists between calls, and waits for all of them to finish.
+ * The tasks must not call back into S-Lang.  Without thread support,
+ * or when called while the pool is already in use (e.g. from within
+ * a task), the tasks are run one after another.  Returns -1 if any
+ * task returned -1.
+ */
+extern int isis_run_threads (unsigned int num_tasks, Isis_Thread_Task_Type *task, void *client_data);
+extern int isis_have_threads (void);
+
+/* Serializes brief updates of state shared between tasks, e.g.
+ * caches.  The lock must not be held while calling isis_run_threads.
+ */
+extern void isis_lock_shared_state (void);
+extern void isis_unlock_shared_state (void);
+
+#if 0
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif
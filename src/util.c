@@ -214,6 +214,26 @@ double isis_kahan_sum (double *x, unsigned int n) /*{{{*/
 
 /*}}}*/
 
+int isis_cpu_has_avx2 (void) /*{{{*/
+{
+#ifdef ISIS_HAVE_AVX2
+   static int checked = 0, ok = 0;
+
+   if (checked == 0)
+     {
+        __builtin_cpu_init ();
+        ok = __builtin_cpu_supports ("avx2");
+        checked = 1;
+     }
+
+   return ok;
+#else
+   return 0;
+#endif
+}
+
+/*}}}*/
+
 double isis_kahan_sum_squares (double *x, unsigned int n) /*{{{*/
 {
    double s, c, y, t;
@@ -528,6 +548,37 @@ int is_regular_file (char *file) /*{{{*/
 
 /*}}}*/
 
+/* Identifies the current contents of a file by its absolute path,
+ * size and modification time.  Returns NULL if the file can't be
+ * identified.
+ */
+char *isis_file_identity (char *file) /*{{{*/
+{
+#if defined(HAVE_STAT) && defined(HAVE_UNISTD_H)
+   struct stat st;
+   char cwd[4096];
+   char buf[64];
+
+   if ((file == NULL) || (-1 == stat (file, &st)))
+     return NULL;
+
+   sprintf (buf, "\n%lu\n%ld", (unsigned long) st.st_size, (long) st.st_mtime);
+
+   if (file[0] == '/')
+     return isis_mkstrcat (file, buf, NULL);
+
+   if (NULL == getcwd (cwd, sizeof(cwd)))
+     return NULL;
+
+   return isis_mkstrcat (cwd, "/", file, buf, NULL);
+#else
+   (void) file;
+   return NULL;
+#endif
+}
+
+/*}}}*/
+
 /*{{{ make temporary file name */
 
 static unsigned int _Fast_Random;
@@ -2232,3 +2283,130 @@ int isis_coerce_array_to_type (SLang_Array_Type **at, int type) /*{{{*/
 }
 
 /*}}}*/
+
+/*{{{ scratch arena */
+
+/* An arena hands out scratch space in stack order: a caller
+ * takes a mark, allocates, and releases back to the mark when
+ * done.  Requests that don't fit in the current block are
+ * satisfied from the heap; the block is then enlarged to the
+ * largest size needed the next time the arena becomes empty.
+ * So, once a calculation has been done once, repeating it
+ * does not touch the heap.
+ */
+
+#define ARENA_ALIGN  16
+
+typedef struct Arena_Overflow_Type Arena_Overflow_Type;
+struct Arena_Overflow_Type
+{
+   Arena_Overflow_Type *next;
+   size_t offset;               /* arena offset at allocation */
+   double data[1];
+};
+
+struct Isis_Arena_Type
+{
+   char *block;
+   size_t size;                 /* size of block */
+   size_t used;                 /* bytes handed out */
+   size_t high_water;           /* max bytes handed out */
+   Arena_Overflow_Type *overflow;
+};
+
+Isis_Arena_Type *isis_new_arena (void) /*{{{*/
+{
+   Isis_Arena_Type *a;
+
+   if (NULL == (a = (Isis_Arena_Type *) ISIS_MALLOC (sizeof *a)))
+     return NULL;
+   memset ((char *)a, 0, sizeof *a);
+
+   return a;
+}
+
+/*}}}*/
+
+void isis_free_arena (Isis_Arena_Type *a) /*{{{*/
+{
+   if (a == NULL)
+     return;
+
+   isis_arena_release (a, 0);
+   ISIS_FREE (a->block);
+   ISIS_FREE (a);
+}
+
+/*}}}*/
+
+size_t isis_arena_mark (Isis_Arena_Type *a) /*{{{*/
+{
+   return a->used;
+}
+
+/*}}}*/
+
+void *isis_arena_alloc (Isis_Arena_Type *a, size_t size) /*{{{*/
+{
+   Arena_Overflow_Type *o;
+   size_t offset = a->used;
+
+   size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+   if (size == 0)
+     size = ARENA_ALIGN;
+
+   if (offset + size <= a->size)
+     {
+        a->used += size;
+        if (a->high_water < a->used)
+          a->high_water = a->used;
+        return a->block + offset;
+     }
+
+   if (NULL == (o = (Arena_Overflow_Type *) ISIS_MALLOC (sizeof(*o) + size)))
+     return NULL;
+
+   o->offset = offset;
+   o->next = a->overflow;
+   a->overflow = o;
+
+   a->used += size;
+   if (a->high_water < a->used)
+     a->high_water = a->used;
+
+   return (void *) o->data;
+}
+
+/*}}}*/
+
+void isis_arena_release (Isis_Arena_Type *a, size_t mark) /*{{{*/
+{
+   char *b;
+
+   if (a == NULL)
+     return;
+
+   while ((a->overflow != NULL) && (a->overflow->offset >= mark))
+     {
+        Arena_Overflow_Type *next = a->overflow->next;
+        ISIS_FREE (a->overflow);
+        a->overflow = next;
+     }
+
+   a->used = mark;
+
+   if ((mark != 0) || (a->high_water <= a->size))
+     return;
+
+   /* The arena is empty, so the block may be resized */
+   if (NULL == (b = (char *) ISIS_MALLOC (a->high_water)))
+     return;
+
+   ISIS_FREE (a->block);
+   a->block = b;
+   a->size = a->high_water;
+}
+
+/*}}}*/
+
+/*}}}*/
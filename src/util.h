@@ -66,6 +66,15 @@ enum
 
 #define INTERVALS_OVERLAP(alo,ahi,blo,bhi) (((alo) < (bhi)) && ((blo) < (ahi)))
 
+/* Compilers able to build AVX2 functions; isis_cpu_has_avx2()
+ * tells whether the CPU can run them. */
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))))
+# define ISIS_HAVE_AVX2 1
+# define ISIS_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
 #define bit_set(uint,mask)   ((uint) |= (mask))
 #define bit_clear(uint,mask)   ((uint) &= ~(mask))
 
@@ -86,10 +95,12 @@ extern FILE *isis_open_pager (void);
 extern void isis_close_pager (FILE *fp);
 
 extern int is_regular_file (char *file);
+extern char *isis_file_identity (char *file);
 extern void isis_set_errno (int err);
 extern int (*Isis_User_Break_Hook) (void);
 
 extern double isis_nan (void);
+extern int isis_cpu_has_avx2 (void);
 
 #ifdef SLANG_VERSION
 extern int isis_coerce_array_to_type (SLang_Array_Type **at, int type);
@@ -166,6 +177,13 @@ extern Isis_Arg_Type *isis_pop_args (int n);
 extern int isis_push_args (Isis_Arg_Type *at);
 extern void isis_free_args (Isis_Arg_Type *at);
 
+typedef struct Isis_Arena_Type Isis_Arena_Type;
+extern Isis_Arena_Type *isis_new_arena (void);
+extern void isis_free_arena (Isis_Arena_Type *a);
+extern size_t isis_arena_mark (Isis_Arena_Type *a);
+extern void *isis_arena_alloc (Isis_Arena_Type *a, size_t size);
+extern void isis_arena_release (Isis_Arena_Type *a, size_t mark);
+
 #if 0
 {
 #endif
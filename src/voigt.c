@@ -396,6 +396,55 @@ static int gauss_quad4 (double lo, double hi, double y, double *q) /*{{{*/
 
 /*}}}*/
 
+/* Derivatives of the quadrature with respect to its limits and y.
+ * Because w(z) is analytic,
+ *    dH/dx = Re[w'(z)],  dH/dy = -Im[w'(z)],  w'(z) = -2z w(z) + 2i/sqrt(pi)
+ */
+static int gauss_quad4_grad (double lo, double hi, double y, double *q, /*{{{*/
+                             double *dq_dlo, double *dq_dhi, double *dq_dy)
+{
+   static double xi[] = {-0.8611363116, -0.3399810436, 0.3399810436, 0.8611363116};
+   static double wt[] = {0.3478548451, 0.6521451549, 0.6521451549, 0.3478548451};
+   double a, b, sum, sum_x, sum_sx, sum_y;
+   int k;
+
+   a = 0.5 * (hi + lo);
+   b = 0.5 * (hi - lo);
+
+   sum = sum_x = sum_sx = sum_y = 0.0;
+
+   for (k = 0; k < 4; k++)
+     {
+        double x = a + b*xi[k];
+        double u, v, hx;
+
+        if (-1 == wofz (x, y, &u, &v))
+          {
+             isis_vmesg (FAIL, I_ERROR, __FILE__, __LINE__,
+                         "evaluating voigt function for x=%g, y=%g",
+                         x, y);
+             return -1;
+          }
+
+        hx = 2.0 * (y*v - x*u);
+        sum += wt[k] * u;
+        sum_x += wt[k] * hx;
+        sum_sx += wt[k] * xi[k] * hx;
+        sum_y += wt[k] * (2.0 * (x*v + y*u) - 2.0 / SQRT_PI);
+     }
+
+   *q = b * sum;
+
+   /* dq/da = b*sum_x,  dq/db = sum + b*sum_sx */
+   *dq_dlo = 0.5 * (b * sum_x - (sum + b * sum_sx));
+   *dq_dhi = 0.5 * (b * sum_x + (sum + b * sum_sx));
+   *dq_dy = b * sum_y;
+
+   return 0;
+}
+
+/*}}}*/
+
 static int binned_voigt (double *val, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
 {
    double norm = par[0];
@@ -445,6 +494,62 @@ static int binned_voigt (double *val, Isis_Hist_t *g, double *par, unsigned int
 
 /*}}}*/
 
+/* derivatives of the bin-integrated model */
+static int binned_voigt_grad (double **grad, Isis_Hist_t *g, double *par, unsigned int npar) /*{{{*/
+{
+   double norm = par[0];
+   double e0 = par[1];      /* center [keV] */
+   double vtherm = par[3];  /* thermal speed [km/s] */
+   double *lo = g->bin_lo;
+   double *hi = g->bin_hi;
+   int *notice_list = g->notice_list;
+   int num = g->n_notice;
+   double y, width, scale;
+   int i, n;
+
+   (void) npar;
+
+   if ((e0 <= 0) || (vtherm <= 0) || (par[2] < 0))
+     return -1;
+
+   width = (e0 * vtherm / C_KMS);
+   y = (par[2] / FOURPI) / width;
+
+   /* val = norm * scale * q */
+   scale = Isis_Voigt_Is_Normalized ? (1.0 / SQRT_PI) : width;
+
+   for (i=0; i < num; i++)
+     {
+        double xlo, xhi, q, dq_dlo, dq_dhi, dq_dy, dq;
+
+        n = notice_list[i];
+
+        xlo = (KEV_ANGSTROM /hi[n] - e0) / width;
+        xhi = (KEV_ANGSTROM /lo[n] - e0) / width;
+
+        if (-1 == gauss_quad4_grad (xlo, xhi, y, &q, &dq_dlo, &dq_dhi, &dq_dy))
+          return -1;
+
+        grad[0][i] = scale * q;
+
+        /* width is proportional to e0 and to vtherm */
+        dq = dq_dlo * xlo + dq_dhi * xhi + dq_dy * y;
+        grad[1][i] = -norm * scale * ((dq_dlo + dq_dhi) / width + dq / e0);
+        grad[2][i] = norm * scale * dq_dy / (FOURPI * width);
+        grad[3][i] = -norm * scale * dq / vtherm;
+
+        if (Isis_Voigt_Is_Normalized == 0)
+          {
+             grad[1][i] += norm * q * width / e0;
+             grad[3][i] += norm * q * width / vtherm;
+          }
+     }
+
+   return 0;
+}
+
+/*}}}*/
+
 static int contin_voigt (double *val, Isis_User_Grid_t *g, double *par, unsigned int npar) /*{{{*/
 {
    double norm = par[0];
@@ -502,6 +607,9 @@ ISIS_USER_SOURCE_MODULE(voigt,p,options)
     * as it stands, fwhm=Gamma but the FWHM is Gamma/(2pi) */
 
    p->binned = binned_voigt;
+   p->binned_gradient = binned_voigt_grad;
+   p->cacheable = 1;
+   p->thread_safe = 1;
    p->unbinned = contin_voigt;
 
    p->parameter_names = parameter_names;